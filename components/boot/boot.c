@@ -5,6 +5,7 @@
 #include <esp_event.h>
 #include <esp_event_loop.h>
 #include <esp_log.h>
+#include <esp_timer.h>
 #include <nvs_flash.h>
 #include <freertos/event_groups.h>
 #include <string.h>
@@ -16,7 +17,11 @@
 #include "ec_reading.h"
 #include "ph_reading.h"
 #include "water_temp_reading.h"
+#include "water_level_reading.h"
 #include "sync_sensors.h"
+#include "sensor_registry.h"
+#include "calibration.h"
+#include "sensor_history.h"
 #include "reservoir_control.h"
 #include "control_task.h"
 #include "ec_control.h"
@@ -29,11 +34,38 @@
 #include "nvs_manager.h"
 #include "deep_sleep_manager.c"
 #include "grow_manager.h"
+#include "recipe.h"
 #include "hard_reset_manager.h"
 #include "hard_reset_manager.c"
 #include "led_manager.h"
 
+// Set once sensing and control run, MQTT waits for it so it publishes initialized statuses and alarms
+#define BOOT_CONTROL_READY_BIT (1<<0)
+
+static EventGroupHandle_t boot_event_group;
+static int64_t boot_milestones[NUM_BOOT_MILESTONES];
+
+// Bring up SNTP, Wi-Fi and MQTT in background so a missing network never holds back control
+static void network_task(void *parameter) {
+	// SNTP polls until network is up, then sets system time and RTC
+	init_sntp();
+
+	// Connect wifi, starts access point if network settings are missing
+	init_network_connections();
+
+	xEventGroupWaitBits(boot_event_group, BOOT_CONTROL_READY_BIT, pdFALSE, pdTRUE, portMAX_DELAY);
+
+	// Initialize and connect to MQTT
+	init_mqtt();
+	mqtt_connect();
+
+	ESP_LOGI(BOOT_TAG, "Network started");
+	vTaskDelete(NULL);
+}
+
 void boot_sequence() {
+	boot_event_group = xEventGroupCreate();
+
 	//Start Wifi led task
 	xTaskCreatePinnedToCore(wifi_led, "led_task", 2500, NULL, LED_TASK_PRIORITY, &led_task_handle, 0);
 
@@ -46,6 +78,9 @@ void boot_sequence() {
 	// Init nvs
 	init_nvs();
 
+	// Load grow recipe before network connects, recipe can arrive as soon as topics are subscribed
+	recipe_init();
+
 	// Initialize deep sleep
 	init_power_button();
 
@@ -58,9 +93,6 @@ void boot_sequence() {
 	tcpip_adapter_init();
 	ESP_ERROR_CHECK(esp_event_loop_create_default());
 
-	// Init network properties
-	init_network_connections();
-
 	sensor_event_group = xEventGroupCreate();
 
 	// Init i2cdev
@@ -68,19 +100,21 @@ void boot_sequence() {
 
 	init_ports();
 
-	// Set all sync bits var
-	set_sensor_sync_bits();
-
-	// Init time rtc
-	init_sntp();
+	// Init time from rtc, SNTP corrects it once network is up
 	init_rtc();
 
+	// Network comes up in parallel with sensing and control
+	xTaskCreatePinnedToCore(network_task, "network_task", 4096, NULL, NETWORK_TASK_PRIORITY, &network_task_handle, 0);
+
 	// Start Irrigation control
 	init_irrigation();
 	
 	// Start Grow Light Control
 	init_lights();
 
+	// Control reports into equipment statuses, which exist before MQTT does
+	init_equipment_status();
+
 	// Init sensor control
 	init_control();
 
@@ -93,17 +127,37 @@ void boot_sequence() {
 	xTaskCreatePinnedToCore(sensor_control, "sensor_control_task", 3000, NULL, SENSOR_CONTROL_TASK_PRIORITY, &sensor_control_task_handle, 0);
 
 	// Create core 1 tasks
-	xTaskCreatePinnedToCore(measure_water_temperature, "temperature_task", 2500, NULL, WATER_TEMPERATURE_TASK_PRIORITY, sensor_get_task_handle(get_water_temp_sensor()), 1);
-	xTaskCreatePinnedToCore(measure_ec, "ec_task", 2500, NULL, EC_TASK_PRIORITY, sensor_get_task_handle(get_ec_sensor()), 1);
-	xTaskCreatePinnedToCore(measure_ph, "ph_task", 2500, NULL, PH_TASK_PRIORITY, sensor_get_task_handle(get_ph_sensor()), 1);
+	register_water_temp_sensor();
+	register_ec_sensors();
+	register_ph_sensors();
+	register_water_level_sensors();
+	sensor_history_init();
+	sensor_registry_start_tasks();
 	xTaskCreatePinnedToCore(sync_task, "sync_task", 2500, NULL, SYNC_TASK_PRIORITY, &sync_task_handle, 1);
+	xTaskCreatePinnedToCore(calibration_task, "calibration_task", 3000, NULL, CALIBRATION_TASK_PRIORITY, &calibration_task_handle, 1);
 	
 	// Init grow manager
 	init_grow_manager();
+
+	xEventGroupSetBits(boot_event_group, BOOT_CONTROL_READY_BIT);
+	ESP_LOGI(BOOT_TAG, "Boot sequence done after %lld ms", esp_timer_get_time() / 1000);
+}
+
+void boot_mark_milestone(enum boot_milestone milestone) {
+	static const char *names[NUM_BOOT_MILESTONES] = { "First control decision", "Time synced", "Online" };
+	if(boot_milestones[milestone] != 0) return;
+
+	boot_milestones[milestone] = esp_timer_get_time();
+	ESP_LOGI(BOOT_TAG, "%s after %lld ms", names[milestone], boot_milestones[milestone] / 1000);
+}
+
+int64_t boot_get_milestone_ms(enum boot_milestone milestone) {
+	return boot_milestones[milestone] != 0 ? boot_milestones[milestone] / 1000 : -1;
 }
 
 void restart_esp32() { // Restart ESP32
 	ESP_LOGE("", "RESTARTING ESP32");
+	nvs_flush();
 	fflush(stdout);
 	esp_restart();
 }
@@ -1,3 +1,25 @@
+#include <stdint.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#ifndef COMPONENTS_BOOT_BOOT_H_
+#define COMPONENTS_BOOT_BOOT_H_
+
+#define BOOT_TAG "BOOT"
+
+// Points of boot that are timed from reset
+enum boot_milestone {
+	BOOT_MILESTONE_CONTROL,		// Control task made first control decision
+	BOOT_MILESTONE_TIME_SYNCED,	// SNTP set system time and RTC
+	BOOT_MILESTONE_ONLINE,		// MQTT connected and subscribed
+	NUM_BOOT_MILESTONES
+};
+
+#endif /* COMPONENTS_BOOT_BOOT_H_ */
+
+// Network task handle
+TaskHandle_t network_task_handle;
+
 // Contains all the boot code for esp32
 void boot_sequence();
 
@@ -7,3 +29,9 @@ void restart_esp32();
 // Suspend and resume tasks
 void suspend_tasks();
 void resume_tasks();
+
+// Record time since reset milestone was first reached
+void boot_mark_milestone(enum boot_milestone milestone);
+
+// Get ms from reset to milestone, -1 if it wasn't reached yet
+int64_t boot_get_milestone_ms(enum boot_milestone milestone);
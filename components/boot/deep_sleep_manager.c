@@ -13,17 +13,30 @@
 #include <soc/rtc.h>
 #include <driver/timer.h>
 #include <driver/periph_ctrl.h>
+#include <freertos/timers.h>
 #include "nvs_manager.h"
 
 #include "ports.h"
 
-void IRAM_ATTR timer_group0_isr(void *param) {
+// Runs in timer task, NVS can't be written from interrupt
+static void enter_deep_sleep(void *param, uint32_t arg) {
+   // write cached settings, deep sleep wakes through reset
+   nvs_flush();
    // configure GPIO for wakeup device from sleep mode
    esp_sleep_enable_ext0_wakeup(POWER_BUTTON_GPIO, 0);
    // start sleep mode
    esp_deep_sleep_start();
 }
 
+void IRAM_ATTR timer_group0_isr(void *param) {
+   // ISR returns now, so level interrupt has to be cleared, alarm was disabled by hardware when it fired
+   timer_group_clr_intr_status_in_isr(TIMER_GROUP_0, TIMER_0);
+
+   BaseType_t xHigherPriorityTaskWoken = false;
+   xTimerPendFunctionCallFromISR(enter_deep_sleep, NULL, 0, &xHigherPriorityTaskWoken);
+   if(xHigherPriorityTaskWoken) portYIELD_FROM_ISR();
+}
+
 
 static void IRAM_ATTR power_button_isr_handler (void* arg) {
    // reset last time;
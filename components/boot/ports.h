@@ -13,6 +13,8 @@
 #define FLOAT_SWITCH_TOP_GPIO 		32
 #define BLUE_LED                    25 // wifi
 #define GREEN_LED                   26
+#define ULTRASONIC_TRIGGER_GPIO     27
+#define ULTRASONIC_ECHO_GPIO        34
 
 
 
@@ -26,6 +28,16 @@
 #define PH_UP_PUMP_GPIO 			6
 #define PH_DOWN_PUMP_GPIO 			7
 
+// Reservoirs run by one controller, each has its own pH and ec sensors and dosing pumps
+#define NUM_RESERVOIRS 1
+
+// Pumps of second reservoir are on port B of MCP23017
+#define RESERVOIR_PUMP_GPIO_OFFSET	8
+
+#if NUM_RESERVOIRS < 1 || NUM_RESERVOIRS > 2
+#error "MCP23017 has pump outputs for up to 2 reservoirs"
+#endif
+
 mcp23x17_t ports_dev;
 
 // Initialize ports
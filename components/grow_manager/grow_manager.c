@@ -12,11 +12,15 @@
 #include "ec_reading.h"
 #include "ph_reading.h"
 #include "water_temp_reading.h"
+#include "water_level_reading.h"
+#include "sensor_registry.h"
+#include "sensor_alarms.h"
 #include "sync_sensors.h"
 #include "mqtt_manager.h"
 #include "ph_control.h"
 #include "ec_control.h"
 #include "water_temp_control.h"
+#include "control_channels.h"
 #include "control_task.h"
 #include "rf_transmitter.h"
 #include "rtc.h"
@@ -33,9 +37,7 @@ void init_grow_manager() {
 		return;
 	} else {
 		ESP_LOGI(GROW_MANAGER_TAG, "Settings stored in NVS");
-		ph_get_nvs_settings();
-		ec_get_nvs_settings();
-		water_temp_get_nvs_settings();
+		for(uint8_t i = 0; i < NUM_CONTROL_CHANNELS; ++i) control_channel_get_nvs_settings(get_control_channel(i));
 		settings_received();
 	}
 
@@ -71,9 +73,7 @@ void suspend_tasks() {
 	vTaskSuspend(sensor_control_task_handle);
 
 	// Core 1
-	vTaskSuspend(*sensor_get_task_handle(get_water_temp_sensor()));
-	vTaskSuspend(*sensor_get_task_handle(get_ec_sensor()));
-	vTaskSuspend(*sensor_get_task_handle(get_ph_sensor()));
+	sensor_registry_suspend_tasks();
 	vTaskSuspend(sync_task_handle);
 }
 
@@ -83,10 +83,9 @@ void resume_tasks() {
 	vTaskResume(publish_task_handle);
 	vTaskResume(sensor_control_task_handle);
 
-	// Core 1
-	vTaskResume(*sensor_get_task_handle(get_water_temp_sensor()));
-	vTaskResume(*sensor_get_task_handle(get_ec_sensor()));
-	vTaskResume(*sensor_get_task_handle(get_ph_sensor()));
+	// Core 1, sensors didn't sample while suspended so don't report them as stale
+	sensor_alarms_restart();
+	sensor_registry_resume_tasks();
 	vTaskResume(sync_task_handle);
 }
 
@@ -115,13 +114,16 @@ void stop_grow_cycle() {
 	suspend_tasks();
 	//Put ph and ec sensor to hibernate mode if active before to consume less power //
 	vTaskDelay(pdMS_TO_TICKS(4000));
-	if (get_is_ph_activated()) {
-		hibernate_ph(get_ph_dev());
-		set_is_ph_activated(false);
-	}
-	if (get_is_ec_activated()) {
-		hibernate_ec(get_ec_dev());
-		set_is_ec_activated(false);
+	for(uint8_t reservoir = 0; reservoir < NUM_RESERVOIRS; ++reservoir) {
+		// Calibrating sensors are hibernated by calibration once it is done
+		if (get_is_ph_activated(reservoir) && !sensor_calib_status(get_ph_sensor(reservoir))) {
+			hibernate_ph(get_ph_dev(reservoir));
+			set_is_ph_activated(reservoir, false);
+		}
+		if (get_is_ec_activated(reservoir) && !sensor_calib_status(get_ec_sensor(reservoir))) {
+			hibernate_ec(get_ec_dev(reservoir));
+			set_is_ec_activated(reservoir, false);
+		}
 	}
 }
 
@@ -0,0 +1,251 @@
+#include "recipe.h"
+
+#include <esp_log.h>
+#include <math.h>
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+#include "nvs_manager.h"
+#include "nvs_namespace_keys.h"
+#include "control_settings_keys.h"
+#include "mqtt_manager.h"
+#include "rtc.h"
+
+static struct recipe recipe;
+
+// Recipe is replaced by MQTT task and applied by control task
+static SemaphoreHandle_t recipe_mutex;
+
+// Stage and stage day lights/irrigation were last applied for and status was last published for, -1 if none
+static int8_t applied_stage = -1;
+static int32_t applied_day = -1;
+
+// --------------------------------------------------- Helper functions ----------------------------------------------
+
+static int8_t recipe_find_channel(const char *settings_key) {
+	for(uint8_t i = 0; i < NUM_CONTROL_CHANNELS; ++i) {
+		if(strcmp(get_control_channel(i)->settings_key, settings_key) == 0) return i;
+	}
+	return -1;
+}
+
+static bool recipe_parse_stage(cJSON *obj, struct recipe_stage *stage) {
+	memset(stage, 0, sizeof(struct recipe_stage));
+	for(uint8_t i = 0; i < NUM_CONTROL_CHANNELS; ++i) {
+		stage->targets[i] = NAN;
+		stage->night_targets[i] = NAN;
+	}
+	stage->lights_on = -1;
+	stage->lights_off = -1;
+
+	struct tm time;
+	cJSON *element = obj->child;
+	while(element != NULL) {
+		char *key = element->string;
+		int8_t channel = recipe_find_channel(key);
+		if(strcmp(key, RECIPE_NAME_KEY) == 0 && cJSON_IsString(element)) {
+			strncpy(stage->name, element->valuestring, RECIPE_NAME_LENGTH - 1);
+		} else if(strcmp(key, RECIPE_STAGE_DAYS_KEY) == 0) {
+			stage->duration = element->valuedouble * SECONDS_PER_DAY;
+		} else if(strcmp(key, RECIPE_STAGE_RAMP_KEY) == 0) {
+			stage->ramp = element->valuedouble * 3600;
+		} else if(strcmp(key, LIGHTS_ON_KEY) == 0 && cJSON_IsString(element)) {
+			parse_iso_timestamp(element->valuestring, &time);
+			stage->lights_on = time.tm_hour * 60 + time.tm_min;
+		} else if(strcmp(key, LIGHTS_OFF_KEY) == 0 && cJSON_IsString(element)) {
+			parse_iso_timestamp(element->valuestring, &time);
+			stage->lights_off = time.tm_hour * 60 + time.tm_min;
+		} else if(strcmp(key, IRRIGATION_ON_KEY) == 0) {
+			stage->irrigation_on = element->valueint * 60;
+		} else if(strcmp(key, IRRIGATION_OFF_KEY) == 0) {
+			stage->irrigation_off = element->valueint * 60;
+		} else if(channel >= 0) {
+			// Targets use same keys as channel control settings
+			cJSON *target = element->child;
+			while(target != NULL) {
+				if(strcmp(target->string, TARGET_VALUE) == 0 || strcmp(target->string, DAY_TARGET_VALUE) == 0) stage->targets[channel] = target->valuedouble;
+				else if(strcmp(target->string, NIGHT_TARGET_VALUE) == 0) stage->night_targets[channel] = target->valuedouble;
+				target = target->next;
+			}
+		} else {
+			ESP_LOGE(RECIPE_TAG, "Error: Invalid stage key: %s", key);
+		}
+		element = element->next;
+	}
+
+	// Ramp can't be longer than stage
+	if(stage->ramp > stage->duration) stage->ramp = stage->duration;
+	return stage->duration > 0;
+}
+
+static void recipe_store() {
+	nvs_handle_t *handle = nvs_get_handle(RECIPE_NVS_NAMESPACE);
+	nvs_add_blob(handle, RECIPE_KEY, &recipe, sizeof(struct recipe));
+	nvs_commit_data(handle);
+}
+
+// Get stage running at time and its start, last stage is held once recipe is finished
+static uint8_t recipe_find_stage(uint32_t time, uint32_t *stage_start, bool *is_finished) {
+	*stage_start = recipe.start_time;
+	*is_finished = false;
+	for(uint8_t i = 0; i < recipe.num_stages; ++i) {
+		if(time < *stage_start + recipe.stages[i].duration) return i;
+		*stage_start += recipe.stages[i].duration;
+	}
+
+	*is_finished = true;
+	*stage_start -= recipe.stages[recipe.num_stages - 1].duration;
+	return recipe.num_stages - 1;
+}
+
+// Move from previous stage target, stages without target keep channel settings
+static float recipe_ramp(float from, float to, float fraction) {
+	if(isnan(from) || isnan(to)) return to;
+	return from + (to - from) * fraction;
+}
+
+static void recipe_apply_targets(uint8_t stage_index, uint32_t time_in_stage) {
+	struct recipe_stage *stage = &recipe.stages[stage_index];
+	struct recipe_stage *previous = stage_index > 0 ? &recipe.stages[stage_index - 1] : stage;
+	float fraction = stage->ramp > 0 && time_in_stage < stage->ramp ? (float) time_in_stage / stage->ramp : 1;
+
+	for(uint8_t i = 0; i < NUM_CONTROL_CHANNELS; ++i) {
+		struct sensor_control *control = get_control_channel(i)->control;
+		float target = recipe_ramp(previous->targets[i], stage->targets[i], fraction);
+		float night_target = recipe_ramp(previous->night_targets[i], stage->night_targets[i], fraction);
+		if(!isnan(target)) control->target_value = target;
+		if(!isnan(night_target)) control->night_target_value = night_target;
+	}
+}
+
+static void recipe_apply_schedules(struct recipe_stage *stage) {
+	if(stage->lights_on >= 0 && stage->lights_off >= 0) {
+		update_grow_light_alarms(stage->lights_on / 60, stage->lights_on % 60, stage->lights_off / 60, stage->lights_off % 60);
+	}
+	if(stage->irrigation_on > 0 && stage->irrigation_off > 0) {
+		irrigation_on_time = stage->irrigation_on;
+		irrigation_off_time = stage->irrigation_off;
+		enable_timer(&dev, &irrigation_timer, is_irrigation_on ? irrigation_on_time : irrigation_off_time);
+	}
+	ESP_LOGI(RECIPE_TAG, "Started stage %s of recipe %s", stage->name, recipe.name);
+}
+
+// Go back to settings received through device settings
+static void recipe_restore_settings() {
+	for(uint8_t i = 0; i < NUM_CONTROL_CHANNELS; ++i) control_channel_get_nvs_settings(get_control_channel(i));
+
+	uint32_t on_time, off_time;
+	if(nvs_get_uint32(IRRIGATION_NVS_NAMESPACE, IRRIGATION_ON_KEY, &on_time) && nvs_get_uint32(IRRIGATION_NVS_NAMESPACE, IRRIGATION_OFF_KEY, &off_time)) {
+		irrigation_on_time = on_time;
+		irrigation_off_time = off_time;
+		enable_timer(&dev, &irrigation_timer, is_irrigation_on ? irrigation_on_time : irrigation_off_time);
+	}
+	init_lights();
+}
+
+// --------------------------------------------------------------------------------------------------------------------
+
+void recipe_init() {
+	recipe_mutex = xSemaphoreCreateMutex();
+
+	size_t length = sizeof(struct recipe);
+	if(!nvs_get_blob_data(RECIPE_NVS_NAMESPACE, RECIPE_KEY, &recipe, &length) || length != sizeof(struct recipe) || recipe.num_stages > MAX_RECIPE_STAGES) {
+		memset(&recipe, 0, sizeof(struct recipe));
+	}
+	ESP_LOGI(RECIPE_TAG, "Recipe: %s, stages: %d", recipe.num_stages > 0 ? recipe.name : "none", recipe.num_stages);
+}
+
+void recipe_set(cJSON *obj) {
+	time_t now;
+	if(get_unix_time(&dev, &now) != ESP_OK) {
+		ESP_LOGE(RECIPE_TAG, "Unable to get time, recipe not updated");
+		return;
+	}
+
+	xSemaphoreTake(recipe_mutex, portMAX_DELAY);
+	bool was_running = recipe.num_stages > 0;
+	memset(&recipe, 0, sizeof(struct recipe));
+
+	cJSON *name = cJSON_GetObjectItem(obj, RECIPE_NAME_KEY);
+	cJSON *day = cJSON_GetObjectItem(obj, RECIPE_DAY_KEY);
+	cJSON *stages = cJSON_GetObjectItem(obj, RECIPE_STAGES_KEY);
+	if(cJSON_IsString(name)) strncpy(recipe.name, name->valuestring, RECIPE_NAME_LENGTH - 1);
+
+	// Day lets recipe be started part way through
+	recipe.start_time = now - (cJSON_IsNumber(day) ? day->valueint * SECONDS_PER_DAY : 0);
+
+	cJSON *stage;
+	cJSON_ArrayForEach(stage, stages) {
+		if(recipe.num_stages >= MAX_RECIPE_STAGES) {
+			ESP_LOGE(RECIPE_TAG, "Recipe has more than %d stages, rest are ignored", MAX_RECIPE_STAGES);
+			break;
+		}
+		if(!recipe_parse_stage(stage, &recipe.stages[recipe.num_stages])) {
+			ESP_LOGE(RECIPE_TAG, "Stage %d has no duration, recipe stopped", recipe.num_stages);
+			recipe.num_stages = 0;
+			break;
+		}
+		recipe.num_stages++;
+	}
+
+	recipe_store();
+	applied_stage = -1;
+	applied_day = -1;
+	ESP_LOGI(RECIPE_TAG, "Recipe: %s, stages: %d", recipe.num_stages > 0 ? recipe.name : "none", recipe.num_stages);
+
+	if(was_running && recipe.num_stages == 0) recipe_restore_settings();
+	xSemaphoreGive(recipe_mutex);
+
+	recipe_update();
+	if(recipe.num_stages == 0 && is_mqtt_connected) publish_recipe_status();
+}
+
+void recipe_update() {
+	time_t now;
+	if(recipe.num_stages == 0 || get_unix_time(&dev, &now) != ESP_OK) return;
+
+	xSemaphoreTake(recipe_mutex, portMAX_DELAY);
+	bool is_changed = false;
+	if(recipe.num_stages > 0) {
+		uint32_t stage_start;
+		bool is_finished;
+		uint8_t stage = recipe_find_stage(now, &stage_start, &is_finished);
+		int32_t day = (now - recipe.start_time) / SECONDS_PER_DAY;
+
+		recipe_apply_targets(stage, now - stage_start);
+		if(stage != applied_stage) recipe_apply_schedules(&recipe.stages[stage]);
+
+		is_changed = stage != applied_stage || day != applied_day;
+		applied_stage = stage;
+		applied_day = day;
+	}
+	xSemaphoreGive(recipe_mutex);
+
+	if(is_changed && is_mqtt_connected) publish_recipe_status();
+}
+
+void recipe_get_status_json(cJSON **obj) {
+	*obj = cJSON_CreateObject();
+
+	time_t now;
+	xSemaphoreTake(recipe_mutex, portMAX_DELAY);
+	if(recipe.num_stages == 0 || get_unix_time(&dev, &now) != ESP_OK) {
+		cJSON_AddNullToObject(*obj, "recipe");
+	} else {
+		uint32_t stage_start;
+		bool is_finished;
+		uint8_t stage = recipe_find_stage(now, &stage_start, &is_finished);
+
+		// Days are counted from 1
+		cJSON_AddStringToObject(*obj, "recipe", recipe.name);
+		cJSON_AddNumberToObject(*obj, "day", (now - recipe.start_time) / SECONDS_PER_DAY + 1);
+		cJSON_AddNumberToObject(*obj, "stage", stage + 1);
+		cJSON_AddNumberToObject(*obj, "num_stages", recipe.num_stages);
+		cJSON_AddStringToObject(*obj, "stage_name", recipe.stages[stage].name);
+		cJSON_AddNumberToObject(*obj, "stage_day", (now - stage_start) / SECONDS_PER_DAY + 1);
+		cJSON_AddNumberToObject(*obj, "stage_days", recipe.stages[stage].duration / SECONDS_PER_DAY);
+		cJSON_AddBoolToObject(*obj, "finished", is_finished);
+	}
+	xSemaphoreGive(recipe_mutex);
+}
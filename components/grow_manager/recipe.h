@@ -0,0 +1,60 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <cJSON.h>
+
+#include "control_channels.h"
+
+#ifndef COMPONENTS_GROW_MANAGER_RECIPE_H_
+#define COMPONENTS_GROW_MANAGER_RECIPE_H_
+
+#define RECIPE_TAG "RECIPE"
+
+#define MAX_RECIPE_STAGES 12
+#define RECIPE_NAME_LENGTH 16
+
+// NVS key of stored recipe
+#define RECIPE_KEY "recipe"
+
+// Recipe JSON keys, targets use channel settings keys and lights/irrigation use rtc keys
+#define RECIPE_NAME_KEY "name"
+#define RECIPE_DAY_KEY "day"
+#define RECIPE_STAGES_KEY "stages"
+#define RECIPE_STAGE_DAYS_KEY "days"
+#define RECIPE_STAGE_RAMP_KEY "ramp_hours"
+
+#define SECONDS_PER_DAY 86400
+
+// Stage of recipe, unset targets are NAN, unset light times -1 and unset irrigation times 0
+struct recipe_stage {
+	char name[RECIPE_NAME_LENGTH];
+	uint32_t duration;							// Seconds
+	uint32_t ramp;								// Seconds targets move linearly from previous stage at start of stage
+	float targets[NUM_CONTROL_CHANNELS];
+	float night_targets[NUM_CONTROL_CHANNELS];
+	int16_t lights_on;							// Minute of day
+	int16_t lights_off;
+	uint32_t irrigation_on;						// Seconds
+	uint32_t irrigation_off;
+};
+
+// Recipe as stored in NVS, stages are timed from start time
+struct recipe {
+	char name[RECIPE_NAME_LENGTH];
+	uint32_t start_time;						// Unix time
+	uint8_t num_stages;
+	struct recipe_stage stages[MAX_RECIPE_STAGES];
+};
+
+#endif /* COMPONENTS_GROW_MANAGER_RECIPE_H_ */
+
+// Load stored recipe, stage is applied by first recipe update
+void recipe_init();
+
+// Replace recipe with JSON recipe, empty or invalid recipe stops running recipe and restores stored settings
+void recipe_set(cJSON *obj);
+
+// Apply targets of current stage and lights/irrigation when stage changes, called every measurement period
+void recipe_update();
+
+// Get JSON of current stage
+void recipe_get_status_json(cJSON **obj);
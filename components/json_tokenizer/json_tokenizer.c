@@ -0,0 +1,271 @@
+#include "json_tokenizer.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// What has to come next while tokenizing
+enum json_parse_state {
+	JSON_STATE_VALUE,				// Root value, value after colon and value after comma in array
+	JSON_STATE_VALUE_OR_CLOSE,		// After [
+	JSON_STATE_KEY,					// After comma in object
+	JSON_STATE_KEY_OR_CLOSE,		// After {
+	JSON_STATE_COLON,
+	JSON_STATE_COMMA_OR_CLOSE,		// After value in object or array
+	JSON_STATE_DONE					// Only whitespace may follow root value
+};
+
+// --------------------------------------------------- Helper functions ----------------------------------------------
+
+static bool json_is_whitespace(char c) { return c == ' ' || c == '\t' || c == '\n' || c == '\r'; }
+static bool json_is_digit(char c) { return c >= '0' && c <= '9'; }
+static bool json_is_hex(char c) { return json_is_digit(c) || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F'); }
+
+static size_t json_skip_whitespace(const char *json, size_t length, size_t pos) {
+	while(pos < length && json_is_whitespace(json[pos])) pos++;
+	return pos;
+}
+
+// Get offset of closing quote of string starting at pos, 0 if string is invalid
+static size_t json_scan_string(const char *json, size_t length, size_t pos) {
+	for(pos++; pos < length; pos++) {
+		char c = json[pos];
+		if(c == '"') return pos;
+		if((unsigned char) c < 0x20) return 0;
+		if(c != '\\') continue;
+
+		if(++pos >= length) return 0;
+		switch(json[pos]) {
+		case '"': case '\\': case '/': case 'b': case 'f': case 'n': case 'r': case 't':
+			break;
+		case 'u':
+			if(pos + 4 >= length) return 0;
+			for(uint8_t i = 1; i <= 4; ++i) {
+				if(!json_is_hex(json[pos + i])) return 0;
+			}
+			pos += 4;
+			break;
+		default:
+			return 0;
+		}
+	}
+	return 0;
+}
+
+// Get offset after number starting at pos, 0 if number is invalid
+static size_t json_scan_number(const char *json, size_t length, size_t pos) {
+	if(json[pos] == '-') pos++;
+	if(pos >= length || !json_is_digit(json[pos])) return 0;
+
+	// No leading zeros
+	if(json[pos] == '0') pos++;
+	else while(pos < length && json_is_digit(json[pos])) pos++;
+
+	if(pos < length && json[pos] == '.') {
+		if(++pos >= length || !json_is_digit(json[pos])) return 0;
+		while(pos < length && json_is_digit(json[pos])) pos++;
+	}
+	if(pos < length && (json[pos] == 'e' || json[pos] == 'E')) {
+		pos++;
+		if(pos < length && (json[pos] == '+' || json[pos] == '-')) pos++;
+		if(pos >= length || !json_is_digit(json[pos])) return 0;
+		while(pos < length && json_is_digit(json[pos])) pos++;
+	}
+	return pos;
+}
+
+// Get type of true, false or null literal starting at pos, JSON_INVALID if there is none
+static enum json_type json_scan_literal(const char *json, size_t length, size_t pos, size_t *end) {
+	static const char *literals[] = { "true", "false", "null" };
+	static const enum json_type types[] = { JSON_TRUE, JSON_FALSE, JSON_NULL };
+	for(uint8_t i = 0; i < 3; ++i) {
+		size_t literal_length = strlen(literals[i]);
+		if(length - pos >= literal_length && memcmp(&json[pos], literals[i], literal_length) == 0) {
+			*end = pos + literal_length;
+			return types[i];
+		}
+	}
+	return JSON_INVALID;
+}
+
+static bool json_add_token(struct json_document *doc, enum json_type type, size_t start, size_t end) {
+	if(doc->num_tokens >= doc->max_tokens) return false;
+
+	struct json_token *token = &doc->tokens[doc->num_tokens];
+	token->type = type;
+	token->start = start;
+	token->end = end;
+	token->size = 0;
+	token->skip = ++doc->num_tokens;
+	return true;
+}
+
+static uint8_t json_hex_value(char c) {
+	if(json_is_digit(c)) return c - '0';
+	return (c | 0x20) - 'a' + 10;
+}
+
+// Walk JSON once, containers on stack get their end and skip once they close
+static bool json_tokenize(struct json_document *doc, const char *json, size_t length) {
+	struct json_token *tokens = doc->tokens;
+	enum json_parse_state state = JSON_STATE_VALUE;
+	uint16_t stack[JSON_MAX_DEPTH];
+	uint8_t depth = 0;
+
+	size_t pos = json_skip_whitespace(json, length, 0);
+	while(pos < length) {
+		char c = json[pos];
+		struct json_token *parent = depth > 0 ? &tokens[stack[depth - 1]] : NULL;
+		bool is_close_allowed = state == JSON_STATE_COMMA_OR_CLOSE || state == JSON_STATE_KEY_OR_CLOSE || state == JSON_STATE_VALUE_OR_CLOSE;
+
+		if(state == JSON_STATE_DONE) return false;
+
+		if((c == '}' || c == ']') && is_close_allowed) {
+			if(parent->type != (c == '}' ? JSON_OBJECT : JSON_ARRAY)) return false;
+			parent->end = pos + 1;
+			parent->skip = doc->num_tokens;
+			depth--;
+			pos++;
+			state = depth > 0 ? JSON_STATE_COMMA_OR_CLOSE : JSON_STATE_DONE;
+		} else if(state == JSON_STATE_COMMA_OR_CLOSE) {
+			if(c != ',') return false;
+			pos++;
+			state = parent->type == JSON_OBJECT ? JSON_STATE_KEY : JSON_STATE_VALUE;
+		} else if(state == JSON_STATE_COLON) {
+			if(c != ':') return false;
+			pos++;
+			state = JSON_STATE_VALUE;
+		} else if(state == JSON_STATE_KEY || state == JSON_STATE_KEY_OR_CLOSE) {
+			size_t end = c == '"' ? json_scan_string(json, length, pos) : 0;
+			if(end == 0 || !json_add_token(doc, JSON_STRING, pos + 1, end)) return false;
+			parent->size++;
+			pos = end + 1;
+			state = JSON_STATE_COLON;
+		} else {
+			// Arrays count values, objects count keys
+			if(parent != NULL && parent->type == JSON_ARRAY) parent->size++;
+
+			if(c == '{' || c == '[') {
+				if(depth >= JSON_MAX_DEPTH || !json_add_token(doc, c == '{' ? JSON_OBJECT : JSON_ARRAY, pos, pos + 1)) return false;
+				stack[depth++] = doc->num_tokens - 1;
+				pos++;
+				state = c == '{' ? JSON_STATE_KEY_OR_CLOSE : JSON_STATE_VALUE_OR_CLOSE;
+			} else {
+				size_t end;
+				bool is_added;
+				if(c == '"') {
+					end = json_scan_string(json, length, pos);
+					is_added = end != 0 && json_add_token(doc, JSON_STRING, pos + 1, end);
+					end++;
+				} else if(c == '-' || json_is_digit(c)) {
+					end = json_scan_number(json, length, pos);
+					is_added = end != 0 && json_add_token(doc, JSON_NUMBER, pos, end);
+				} else {
+					enum json_type type = json_scan_literal(json, length, pos, &end);
+					is_added = type != JSON_INVALID && json_add_token(doc, type, pos, end);
+				}
+				if(!is_added) return false;
+				pos = end;
+				state = depth > 0 ? JSON_STATE_COMMA_OR_CLOSE : JSON_STATE_DONE;
+			}
+		}
+		pos = json_skip_whitespace(json, length, pos);
+	}
+	return state == JSON_STATE_DONE;
+}
+
+// --------------------------------------------------------------------------------------------------------------------
+
+bool json_parse(struct json_document *doc, const char *json, size_t length, struct json_token *tokens, uint16_t max_tokens) {
+	doc->json = json;
+	doc->tokens = tokens;
+	doc->num_tokens = 0;
+	doc->max_tokens = max_tokens;
+
+	// Offsets are stored in 16 bits
+	if(json == NULL || length > UINT16_MAX) return false;
+
+	// Tokens of valid start of invalid JSON are dropped so handlers never act on them
+	if(!json_tokenize(doc, json, length)) {
+		doc->num_tokens = 0;
+		return false;
+	}
+	return true;
+}
+
+enum json_type json_get_type(const struct json_document *doc, int index) {
+	if(index < 0 || index >= doc->num_tokens) return JSON_INVALID;
+	return doc->tokens[index].type;
+}
+
+int json_get_object_item(const struct json_document *doc, int object, const char *key) {
+	if(json_get_type(doc, object) != JSON_OBJECT) return -1;
+
+	int index;
+	JSON_FOR_EACH(doc, object, index) {
+		if(json_string_equals(doc, index, key)) return index + 1;
+	}
+	return -1;
+}
+
+bool json_string_equals(const struct json_document *doc, int index, const char *string) {
+	if(json_get_type(doc, index) != JSON_STRING) return false;
+
+	const struct json_token *token = &doc->tokens[index];
+	size_t length = token->end - token->start;
+	return strlen(string) == length && memcmp(&doc->json[token->start], string, length) == 0;
+}
+
+bool json_get_number(const struct json_document *doc, int index, double *value) {
+	if(json_get_type(doc, index) != JSON_NUMBER) return false;
+
+	// Number isn't terminated in JSON text
+	const struct json_token *token = &doc->tokens[index];
+	char number[JSON_NUMBER_LENGTH];
+	size_t length = token->end - token->start;
+	if(length >= JSON_NUMBER_LENGTH) return false;
+	memcpy(number, &doc->json[token->start], length);
+	number[length] = '\0';
+
+	*value = strtod(number, NULL);
+	return true;
+}
+
+bool json_get_bool(const struct json_document *doc, int index, bool *value) {
+	enum json_type type = json_get_type(doc, index);
+	if(type != JSON_TRUE && type != JSON_FALSE) return false;
+	*value = type == JSON_TRUE;
+	return true;
+}
+
+bool json_get_string(const struct json_document *doc, int index, char *string, size_t size) {
+	if(json_get_type(doc, index) != JSON_STRING || size == 0) return false;
+
+	// Escapes were validated by tokenizer, characters beyond ASCII in \u escapes become ?
+	const struct json_token *token = &doc->tokens[index];
+	size_t length = 0;
+	for(size_t pos = token->start; pos < token->end; ++pos) {
+		char c = doc->json[pos];
+		if(c == '\\') {
+			c = doc->json[++pos];
+			switch(c) {
+			case 'b': c = '\b'; break;
+			case 'f': c = '\f'; break;
+			case 'n': c = '\n'; break;
+			case 'r': c = '\r'; break;
+			case 't': c = '\t'; break;
+			case 'u': {
+				uint16_t code = 0;
+				for(uint8_t i = 1; i <= 4; ++i) code = (code << 4) | json_hex_value(doc->json[pos + i]);
+				c = code < 0x80 ? code : '?';
+				pos += 4;
+				break;
+			}
+			default: break;
+			}
+		}
+		if(length + 1 >= size) return false;
+		string[length++] = c;
+	}
+	string[length] = '\0';
+	return true;
+}
@@ -0,0 +1,65 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef COMPONENTS_JSON_TOKENIZER_JSON_TOKENIZER_H_
+#define COMPONENTS_JSON_TOKENIZER_JSON_TOKENIZER_H_
+
+// Deepest nesting of objects and arrays
+#define JSON_MAX_DEPTH 16
+
+// Longest number text converted by json_get_number
+#define JSON_NUMBER_LENGTH 32
+
+enum json_type {
+	JSON_INVALID,
+	JSON_OBJECT,
+	JSON_ARRAY,
+	JSON_STRING,
+	JSON_NUMBER,
+	JSON_TRUE,
+	JSON_FALSE,
+	JSON_NULL
+};
+
+// Token of JSON value, every key of an object is a string token directly followed by its value
+struct json_token {
+	uint8_t type;				// enum json_type
+	uint16_t start;				// Offset of first character in JSON, strings without quotes
+	uint16_t end;				// Offset after last character
+	uint16_t size;				// Values of array or keys of object
+	uint16_t skip;				// Index of first token after value and everything nested in it
+};
+
+// Tokenized JSON, tokens point into JSON text which has to outlive document
+struct json_document {
+	const char *json;
+	struct json_token *tokens;
+	uint16_t num_tokens;
+	uint16_t max_tokens;
+};
+
+// Iterate over values of array or keys of object, value of key is at index + 1
+#define JSON_FOR_EACH(doc, container, index) \
+	for(index = (container) + 1; index < (doc)->tokens[container].skip; \
+		index = (doc)->tokens[(doc)->tokens[container].type == JSON_OBJECT ? index + 1 : index].skip)
+
+#endif /* COMPONENTS_JSON_TOKENIZER_JSON_TOKENIZER_H_ */
+
+// Validate JSON and split it into tokens without allocating, root value is token 0
+// Fails on syntax errors, nesting deeper than JSON_MAX_DEPTH and JSON with more values than tokens
+bool json_parse(struct json_document *doc, const char *json, size_t length, struct json_token *tokens, uint16_t max_tokens);
+
+// Get type of token, JSON_INVALID if index is out of range
+enum json_type json_get_type(const struct json_document *doc, int index);
+
+// Get index of value of key in object, -1 if object has no such key
+int json_get_object_item(const struct json_document *doc, int object, const char *key);
+
+// Compare string token with string, escapes aren't decoded
+bool json_string_equals(const struct json_document *doc, int index, const char *string);
+
+// Get number, bool or decoded string of token, false if token has other type or string doesn't fit
+bool json_get_number(const struct json_document *doc, int index, double *value);
+bool json_get_bool(const struct json_document *doc, int index, bool *value);
+bool json_get_string(const struct json_document *doc, int index, char *string, size_t size);
@@ -0,0 +1,173 @@
+#include "mqtt_groups.h"
+
+#include <esp_log.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "mqtt_manager.h"
+#include "nvs_manager.h"
+#include "nvs_namespace_keys.h"
+
+static struct mqtt_groups groups;
+static struct settings_scope settings_scopes[MAX_SCOPED_SETTINGS];
+
+// Empty topic for scopes device isn't member of
+static char group_topics[NUM_MQTT_GROUP_TOPICS][NUM_MQTT_GROUP_SCOPES][MQTT_GROUP_TOPIC_LENGTH];
+
+static const char *scope_names[NUM_MQTT_SCOPES] = { "device", "zone", "room", "site" };
+static const char *group_topic_headings[NUM_MQTT_GROUP_TOPICS] = { SENSOR_SETTINGS_HEADING, GROW_CYCLE_HEADING, RF_CONTROL_HEADING };
+
+// --------------------------------------------------- Helper functions ----------------------------------------------
+
+// Group topics have scope name where device topics have device ID
+static void make_group_topics() {
+	for(uint8_t topic = 0; topic < NUM_MQTT_GROUP_TOPICS; ++topic) {
+		for(uint8_t i = 0; i < NUM_MQTT_GROUP_SCOPES; ++i) {
+			group_topics[topic][i][0] = '\0';
+			if(groups.ids[i][0] == '\0') continue;
+			snprintf(group_topics[topic][i], MQTT_GROUP_TOPIC_LENGTH, "%s/%s/%s", group_topic_headings[topic], scope_names[MQTT_SCOPE_ZONE + i], groups.ids[i]);
+			ESP_LOGI(MQTT_GROUPS_TAG, "Group topic: %s", group_topics[topic][i]);
+		}
+	}
+}
+
+static void set_group_subscriptions(bool is_subscribed) {
+	if(mqtt_client == NULL) return;
+
+	for(uint8_t topic = 0; topic < NUM_MQTT_GROUP_TOPICS; ++topic) {
+		for(uint8_t i = 0; i < NUM_MQTT_GROUP_SCOPES; ++i) {
+			if(group_topics[topic][i][0] == '\0') continue;
+			if(is_subscribed) esp_mqtt_client_subscribe(mqtt_client, group_topics[topic][i], SUBSCRIBE_DATA_QOS);
+			else esp_mqtt_client_unsubscribe(mqtt_client, group_topics[topic][i]);
+		}
+	}
+}
+
+// IDs become topic levels, so they can't hold level separators or wildcards
+static bool is_group_id_valid(const char *id) {
+	for(; *id != '\0'; ++id) {
+		if(*id == '/' || *id == '+' || *id == '#' || (unsigned char) *id < 0x20) return false;
+	}
+	return true;
+}
+
+// Empty key finds free entry
+static struct settings_scope* find_settings_scope(const char *settings_key) {
+	for(uint8_t i = 0; i < MAX_SCOPED_SETTINGS; ++i) {
+		if(strcmp(settings_scopes[i].key, settings_key) == 0) return &settings_scopes[i];
+	}
+	return NULL;
+}
+
+static void store_settings_scopes() {
+	nvs_handle_t *handle = nvs_get_handle(NETWORK_SETTINGS_NVS_NAMESPACE);
+	nvs_add_settings(handle, SETTINGS_SCOPES_KEY, SETTINGS_SCOPES_VERSION, settings_scopes, sizeof(settings_scopes));
+	nvs_commit_data(handle);
+}
+
+// Settings of group device left no longer take precedence, any scope may replace them again
+static void clear_group_settings_scopes(const struct mqtt_groups *updated) {
+	bool is_cleared = false;
+	for(uint8_t i = 0; i < NUM_MQTT_GROUP_SCOPES; ++i) {
+		if(strcmp(groups.ids[i], updated->ids[i]) == 0) continue;
+		for(uint8_t j = 0; j < MAX_SCOPED_SETTINGS; ++j) {
+			if(settings_scopes[j].key[0] == '\0' || settings_scopes[j].scope != MQTT_SCOPE_ZONE + i) continue;
+			ESP_LOGI(MQTT_GROUPS_TAG, "Left %s group, %s settings no longer held", scope_names[MQTT_SCOPE_ZONE + i], settings_scopes[j].key);
+			memset(&settings_scopes[j], 0, sizeof(struct settings_scope));
+			is_cleared = true;
+		}
+	}
+	if(is_cleared) store_settings_scopes();
+}
+
+// --------------------------------------------------------------------------------------------------------------------
+
+void init_mqtt_groups() {
+	if(nvs_get_settings(NETWORK_SETTINGS_NVS_NAMESPACE, MQTT_GROUPS_KEY, &groups, sizeof(groups)) == 0) memset(&groups, 0, sizeof(groups));
+	if(nvs_get_settings(NETWORK_SETTINGS_NVS_NAMESPACE, SETTINGS_SCOPES_KEY, settings_scopes, sizeof(settings_scopes)) == 0) memset(settings_scopes, 0, sizeof(settings_scopes));
+	make_group_topics();
+}
+
+void mqtt_groups_subscribe() { set_group_subscriptions(true); }
+
+bool mqtt_groups_match(const char *topic, uint32_t topic_len, enum mqtt_group_topic *group_topic, enum mqtt_scope *scope) {
+	for(uint8_t i = 0; i < NUM_MQTT_GROUP_TOPICS; ++i) {
+		for(uint8_t j = 0; j < NUM_MQTT_GROUP_SCOPES; ++j) {
+			const char *group = group_topics[i][j];
+			if(group[0] == '\0' || strlen(group) != topic_len || memcmp(topic, group, topic_len) != 0) continue;
+			*group_topic = i;
+			*scope = MQTT_SCOPE_ZONE + j;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool mqtt_groups_update(const struct json_document *doc, int object, char *error) {
+	if(json_get_type(doc, object) != JSON_OBJECT) {
+		strcpy(error, "groups are not an object");
+		return false;
+	}
+
+	struct mqtt_groups updated;
+	memset(&updated, 0, sizeof(updated));
+	for(uint8_t i = 0; i < NUM_MQTT_GROUP_SCOPES; ++i) {
+		const char *name = scope_names[MQTT_SCOPE_ZONE + i];
+		int index = json_get_object_item(doc, object, name);
+		if(index < 0 || json_get_type(doc, index) == JSON_NULL) continue;
+		if(!json_get_string(doc, index, updated.ids[i], MQTT_GROUP_ID_LENGTH) || !is_group_id_valid(updated.ids[i])) {
+			snprintf(error, SETTINGS_ERROR_LENGTH, "invalid %s id", name);
+			return false;
+		}
+	}
+
+	clear_group_settings_scopes(&updated);
+
+	// Broker keeps subscriptions of persistent session, so old groups are left explicitly
+	set_group_subscriptions(false);
+	memcpy(&groups, &updated, sizeof(groups));
+	make_group_topics();
+	set_group_subscriptions(true);
+
+	nvs_handle_t *handle = nvs_get_handle(NETWORK_SETTINGS_NVS_NAMESPACE);
+	nvs_add_settings(handle, MQTT_GROUPS_KEY, MQTT_GROUPS_VERSION, &groups, sizeof(groups));
+	nvs_commit_data(handle);
+	return true;
+}
+
+bool mqtt_groups_is_settings_allowed(const char *settings_key, enum mqtt_scope scope, enum mqtt_scope *applied_scope) {
+	struct settings_scope *settings_scope = settings_key[0] != '\0' ? find_settings_scope(settings_key) : NULL;
+	*applied_scope = settings_scope != NULL ? settings_scope->scope : NUM_MQTT_SCOPES;
+	return scope <= *applied_scope;
+}
+
+void mqtt_groups_set_settings_scope(const char *settings_key, enum mqtt_scope scope) {
+	if(settings_key[0] == '\0') return;
+
+	struct settings_scope *settings_scope = find_settings_scope(settings_key);
+	if(settings_scope == NULL) {
+		// Keys that don't fit aren't tracked, their settings are replaced by any scope
+		if(strlen(settings_key) >= SCOPED_SETTINGS_KEY_LENGTH || (settings_scope = find_settings_scope("")) == NULL) {
+			ESP_LOGW(MQTT_GROUPS_TAG, "Scope of %s settings not tracked", settings_key);
+			return;
+		}
+		strcpy(settings_scope->key, settings_key);
+	} else if(settings_scope->scope == scope) {
+		return;
+	}
+
+	settings_scope->scope = scope;
+	store_settings_scopes();
+}
+
+void mqtt_groups_clear_settings_scope(const char *settings_key) {
+	struct settings_scope *settings_scope = find_settings_scope(settings_key);
+	if(settings_key[0] == '\0' || settings_scope == NULL) return;
+
+	memset(settings_scope, 0, sizeof(struct settings_scope));
+	store_settings_scopes();
+}
+
+const char* mqtt_groups_get_id(enum mqtt_scope scope) { return scope >= MQTT_SCOPE_ZONE && scope < NUM_MQTT_SCOPES ? groups.ids[scope - MQTT_SCOPE_ZONE] : ""; }
+
+const char* mqtt_groups_get_scope_name(enum mqtt_scope scope) { return scope < NUM_MQTT_SCOPES ? scope_names[scope] : "none"; }
@@ -0,0 +1,90 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "json_tokenizer.h"
+
+#ifndef COMPONENTS_NETWORK_MANAGER_MQTT_MQTT_GROUPS_H_
+#define COMPONENTS_NETWORK_MANAGER_MQTT_MQTT_GROUPS_H_
+
+#define MQTT_GROUPS_TAG "MQTT_GROUPS"
+
+// NVS keys of group membership and of scopes settings were applied from
+#define MQTT_GROUPS_KEY "MQTT_GROUPS"
+#define MQTT_GROUPS_VERSION 1
+#define SETTINGS_SCOPES_KEY "SET_SCOPES"
+#define SETTINGS_SCOPES_VERSION 1
+
+// Settings key of group membership, only accepted on device settings topic
+#define GROUPS_SETTINGS_KEY "groups"
+
+// Group ID including terminator, IDs are unique within fleet
+#define MQTT_GROUP_ID_LENGTH 16
+
+// Longest group topic including terminator, <heading>/<scope>/<group id>
+#define MQTT_GROUP_TOPIC_LENGTH 48
+
+// Settings keys tracked for precedence, keys of control channels, irrigation, grow lights and reservoir
+#define MAX_SCOPED_SETTINGS 12
+#define SCOPED_SETTINGS_KEY_LENGTH 12
+
+// Where command came from, settings applied from lower value aren't replaced by settings of higher value
+enum mqtt_scope {
+	MQTT_SCOPE_DEVICE,
+	MQTT_SCOPE_ZONE,
+	MQTT_SCOPE_ROOM,
+	MQTT_SCOPE_SITE,
+	NUM_MQTT_SCOPES
+};
+
+// Scopes device can be member of
+#define NUM_MQTT_GROUP_SCOPES (NUM_MQTT_SCOPES - MQTT_SCOPE_ZONE)
+
+// Commands that can be sent to group instead of every device
+enum mqtt_group_topic {
+	MQTT_GROUP_SETTINGS,		// device_settings/<scope>/<group id>
+	MQTT_GROUP_STATUS,			// device_status/<scope>/<group id>
+	MQTT_GROUP_RF_CONTROL,		// manual_rf_control/<scope>/<group id>
+	NUM_MQTT_GROUP_TOPICS
+};
+
+// Empty ID means device isn't member of group of that scope
+struct mqtt_groups {
+	char ids[NUM_MQTT_GROUP_SCOPES][MQTT_GROUP_ID_LENGTH];
+};
+
+// Scope settings key was last applied from
+struct settings_scope {
+	char key[SCOPED_SETTINGS_KEY_LENGTH];
+	uint8_t scope;
+};
+
+#endif /* COMPONENTS_NETWORK_MANAGER_MQTT_MQTT_GROUPS_H_ */
+
+// Get membership and settings scopes from NVS and build group topics
+void init_mqtt_groups();
+
+// Subscribe to group topics of membership, called with other subscriptions
+void mqtt_groups_subscribe();
+
+// Check if topic is group topic of membership, command and scope are set if it is
+bool mqtt_groups_match(const char *topic, uint32_t topic_len, enum mqtt_group_topic *group_topic, enum mqtt_scope *scope);
+
+// Replace membership with {"site": <id>, "room": <id>, "zone": <id>} object, missing or empty ID leaves group
+// Subscriptions are moved to new groups, nothing is changed and error is set if any ID is invalid
+// Settings applied from group that is left or changed may be replaced by any scope again
+bool mqtt_groups_update(const struct json_document *doc, int object, char *error);
+
+// Check if settings from scope may replace settings applied before, scope of applied settings is set
+bool mqtt_groups_is_settings_allowed(const char *settings_key, enum mqtt_scope scope, enum mqtt_scope *applied_scope);
+
+// Store scope settings were applied from
+void mqtt_groups_set_settings_scope(const char *settings_key, enum mqtt_scope scope);
+
+// Forget scope of settings, groups may replace device settings again
+void mqtt_groups_clear_settings_scope(const char *settings_key);
+
+// Get group ID of scope, empty if device isn't member
+const char* mqtt_groups_get_id(enum mqtt_scope scope);
+
+// Get name of scope used in topics and reports
+const char* mqtt_groups_get_scope_name(enum mqtt_scope scope);
@@ -4,20 +4,26 @@
 #include <esp_log.h>
 #include <esp_err.h>
 #include <esp_system.h>
+#include <esp_timer.h>
 #include <freertos/semphr.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
+#include <math.h>
 #include <cJSON.h>
 
 #include "boot.h"
 #include "ec_reading.h"
 #include "ph_reading.h"
 #include "water_temp_reading.h"
+#include "sensor_registry.h"
+#include "sensor_alarms.h"
+#include "recipe.h"
 #include "ec_control.h"
 #include "ph_control.h"
 #include "water_temp_control.h"
+#include "control_channels.h"
 #include "sync_sensors.h"
 #include "rf_transmitter.h"
 #include "rtc.h"
@@ -27,9 +33,15 @@
 #include "reservoir_control.h"
 #include "ports.h"
 #include "test_hardware.h"
-
-static void initiate_ota(const char *mqtt_data);
-static esp_err_t parse_ota_parameters(const char *buffer, char *version, char *endpoint);
+#include "pump_calibration.h"
+#include "calibration.h"
+#include "sensor_history.h"
+#include "nvs_manager.h"
+#include "mqtt_scheduler.h"
+#include "mqtt_groups.h"
+
+static void initiate_ota(const struct json_document *doc);
+static esp_err_t parse_ota_parameters(const struct json_document *doc, char *version, char *endpoint);
 static esp_err_t validate_ota_parameters(char *version, char *endpoint);
 static void publish_firmware_version();
     
@@ -37,16 +49,24 @@ static void publish_firmware_version();
 extern char *url_buf;
 extern bool is_ota_success_on_bootup;
 
+static char mqtt_client_id[MQTT_CLIENT_ID_LENGTH];
+static struct mqtt_stats stats = { .connect_latency = -1 };
+static int64_t connect_start;		// Start of first connect or of outage, us since boot
+
+static void mqtt_connected(bool is_session_present);
+static void mqtt_disconnected();
+
 esp_err_t mqtt_event_handler(esp_mqtt_event_handle_t event) {
    const char *TAG = "MQTT_Event_Handler";
 
    switch (event->event_id) {
       case MQTT_EVENT_CONNECTED:
-         ESP_LOGI(TAG, "MQTT_EVENT_CONNECTED");
-         xSemaphoreGive(mqtt_connect_semaphore);
+         ESP_LOGI(TAG, "MQTT_EVENT_CONNECTED, session_present=%d", event->session_present);
+         mqtt_connected(event->session_present);
          break;
       case MQTT_EVENT_DISCONNECTED:
          ESP_LOGI(TAG, "MQTT_EVENT_DISCONNECTED");
+         mqtt_disconnected();
          break;
 
       case MQTT_EVENT_SUBSCRIBED:
@@ -57,6 +77,7 @@ esp_err_t mqtt_event_handler(esp_mqtt_event_handle_t event) {
          break;
       case MQTT_EVENT_PUBLISHED:
          ESP_LOGI(TAG, "MQTT_EVENT_PUBLISHED, msg_id=%d", event->msg_id);
+         mqtt_scheduler_acked(event->msg_id);
          break;
       case MQTT_EVENT_DATA:
          ESP_LOGI(TAG, "MQTT_EVENT_DATA");
@@ -148,9 +169,12 @@ void make_topics() {
 	add_id(wifi_connect_topic);
 	ESP_LOGI(MQTT_TAG, "Wifi Topic: %s", wifi_connect_topic);
 
-	init_topic(&sensor_data_topic, device_id_len + 1 + strlen(SENSOR_DATA_HEADING) + 1, SENSOR_DATA_HEADING);
-	add_id(sensor_data_topic);
-	ESP_LOGI(MQTT_TAG, "Sensor data topic: %s", sensor_data_topic);
+	for(uint8_t reservoir = 0; reservoir < NUM_RESERVOIRS; ++reservoir) {
+		init_topic(&sensor_data_topics[reservoir], device_id_len + 1 + strlen(SENSOR_DATA_HEADING) + 3 + 1, SENSOR_DATA_HEADING);
+		add_id(sensor_data_topics[reservoir]);
+		if(reservoir > 0) sprintf(sensor_data_topics[reservoir] + strlen(sensor_data_topics[reservoir]), "/%d", reservoir + 1);
+		ESP_LOGI(MQTT_TAG, "Sensor data topic: %s", sensor_data_topics[reservoir]);
+	}
 
 	init_topic(&sensor_settings_topic, device_id_len + 1 + strlen(SENSOR_SETTINGS_HEADING) + 1, SENSOR_SETTINGS_HEADING);
 	add_id(sensor_settings_topic);
@@ -164,6 +188,17 @@ void make_topics() {
 	add_id(grow_cycle_topic);
 	ESP_LOGI(MQTT_TAG, "Grow cycle topic: %s", grow_cycle_topic);
 
+	// Recipe status is published below device status, device status itself is only subscribed to
+	init_topic(&recipe_status_topic, device_id_len + 1 + strlen(GROW_CYCLE_HEADING) + 1 + strlen(RECIPE_STATUS_SUBTOPIC) + 1, GROW_CYCLE_HEADING);
+	add_id(recipe_status_topic);
+	strcat(recipe_status_topic, "/");
+	strcat(recipe_status_topic, RECIPE_STATUS_SUBTOPIC);
+	ESP_LOGI(MQTT_TAG, "Recipe status topic: %s", recipe_status_topic);
+
+	init_topic(&recipe_topic, device_id_len + 1 + strlen(RECIPE_HEADING) + 1, RECIPE_HEADING);
+	add_id(recipe_topic);
+	ESP_LOGI(MQTT_TAG, "Recipe topic: %s", recipe_topic);
+
 	init_topic(&rf_control_topic, device_id_len + 1 + strlen(RF_CONTROL_HEADING) + 1, RF_CONTROL_HEADING);
 	add_id(rf_control_topic);
 	ESP_LOGI(MQTT_TAG, "RF control settings topic: %s", rf_control_topic);
@@ -173,6 +208,26 @@ void make_topics() {
    add_id(calibration_topic);
    ESP_LOGI(MQTT_TAG, "Calibration sensors topic: %s", calibration_topic);
 
+   init_topic(&calibration_progress_topic, device_id_len + 1 + strlen(CALIBRATION_PROGRESS_HEADING) + 1, CALIBRATION_PROGRESS_HEADING);
+   add_id(calibration_progress_topic);
+   ESP_LOGI(MQTT_TAG, "Calibration progress topic: %s", calibration_progress_topic);
+
+   init_topic(&history_request_topic, device_id_len + 1 + strlen(HISTORY_REQUEST_HEADING) + 1, HISTORY_REQUEST_HEADING);
+   add_id(history_request_topic);
+   ESP_LOGI(MQTT_TAG, "History request topic: %s", history_request_topic);
+
+   init_topic(&history_response_topic, device_id_len + 1 + strlen(HISTORY_RESPONSE_HEADING) + 1, HISTORY_RESPONSE_HEADING);
+   add_id(history_response_topic);
+   ESP_LOGI(MQTT_TAG, "History response topic: %s", history_response_topic);
+
+   init_topic(&settings_result_topic, device_id_len + 1 + strlen(SETTINGS_RESULT_HEADING) + 1, SETTINGS_RESULT_HEADING);
+   add_id(settings_result_topic);
+   ESP_LOGI(MQTT_TAG, "Settings result topic: %s", settings_result_topic);
+
+   init_topic(&alarms_topic, device_id_len + 1 + strlen(ALARMS_HEADING) + 1, ALARMS_HEADING);
+   add_id(alarms_topic);
+   ESP_LOGI(MQTT_TAG, "Alarms topic: %s", alarms_topic);
+
    init_topic(&test_motor_topic, device_id_len + 1 + strlen(TEST_MOTOR_HEADING) + 1, TEST_MOTOR_HEADING);
    add_id(test_motor_topic);
    ESP_LOGI(MQTT_TAG, "Test motor topic: %s", test_motor_topic);
@@ -218,8 +273,10 @@ void subscribe_topics() {
 	// Subscribe to topics
 	esp_mqtt_client_subscribe(mqtt_client, sensor_settings_topic, SUBSCRIBE_DATA_QOS);
 	esp_mqtt_client_subscribe(mqtt_client, grow_cycle_topic, SUBSCRIBE_DATA_QOS);
+	esp_mqtt_client_subscribe(mqtt_client, recipe_topic, SUBSCRIBE_DATA_QOS);
 	esp_mqtt_client_subscribe(mqtt_client, rf_control_topic, SUBSCRIBE_DATA_QOS);
 	esp_mqtt_client_subscribe(mqtt_client, calibration_topic, SUBSCRIBE_DATA_QOS);
+	esp_mqtt_client_subscribe(mqtt_client, history_request_topic, SUBSCRIBE_DATA_QOS);
    esp_mqtt_client_subscribe(mqtt_client, ota_update_topic, SUBSCRIBE_DATA_QOS);
    esp_mqtt_client_subscribe(mqtt_client, version_request_topic, SUBSCRIBE_DATA_QOS);
    esp_mqtt_client_subscribe(mqtt_client, test_motor_topic, SUBSCRIBE_DATA_QOS);
@@ -228,13 +285,21 @@ void subscribe_topics() {
    esp_mqtt_client_subscribe(mqtt_client, test_temperature_topic, SUBSCRIBE_DATA_QOS);
    esp_mqtt_client_subscribe(mqtt_client, test_ec_topic, SUBSCRIBE_DATA_QOS);
    esp_mqtt_client_subscribe(mqtt_client, test_rf_topic, SUBSCRIBE_DATA_QOS);
+
+	// Settings, grow cycle and rf control can also be sent to zone, room or site of device
+	mqtt_groups_subscribe();
 }
 
 void init_mqtt() {
 	// Set broker configuration
+	// Stable client ID and persistent session, broker queues commands for device while it is disconnected
+	snprintf(mqtt_client_id, sizeof(mqtt_client_id), "%s_%s", DEVICE_TYPE, get_network_settings()->device_id);
 	esp_mqtt_client_config_t mqtt_cfg = {
 			.host = get_network_settings()->broker_ip,
 			.port = 1883,
+			.client_id = mqtt_client_id,
+			.disable_clean_session = true,
+			.reconnect_timeout_ms = MQTT_RECONNECT_TIMEOUT,
 			.event_handle = mqtt_event_handler
 	};
 
@@ -243,40 +308,65 @@ void init_mqtt() {
 
 	// Dynamically create topics
 	make_topics();
+	init_mqtt_groups();
 
-	// Create equipment status JSON
-	init_equipment_status();
+	// Outbound messages are queued by priority and sent by scheduler task
+	// Publishing tasks already run, so queue only opens once every topic is built
+	init_mqtt_scheduler();
 }
 
 void mqtt_connect() {
-	// First check if wifi is connected
-	if(!is_wifi_connected) {
-		is_mqtt_connected = false;
-		return;
-	}
-
-	// Connect mqtt
-	mqtt_connect_semaphore = xSemaphoreCreateBinary();
+	// Client connects and reconnects by itself, connection state is tracked from its events
+	connect_start = esp_timer_get_time();
 	esp_mqtt_client_start(mqtt_client);
-	xSemaphoreTake(mqtt_connect_semaphore, portMAX_DELAY); //  add approximate time to connect to mqtt
+}
 
-	// Subscribe to topics
+// Runs in MQTT task on every connect
+static void mqtt_connected(bool is_session_present) {
+	// Persistent session may lack topics added by update or subscriptions lost before their ack, subscribing again is harmless
 	subscribe_topics();
 
 	// Send connect success message (must be retain message)
-	esp_mqtt_client_publish(mqtt_client, wifi_connect_topic, "1", 0, PUBLISH_DATA_QOS, 1);
+	mqtt_scheduler_publish(wifi_connect_topic, "1", 0, PUBLISH_DATA_QOS, 1, MQTT_PRIORITY_STATE);
 
 	// Send equipment statuses
 	publish_equipment_status();
 
+	// Send alarms, including ones raised while disconnected
+	publish_alarms();
+
+	// Send recipe stage
+	publish_recipe_status();
+
+	stats.connects++;
+	stats.connect_latency = (esp_timer_get_time() - connect_start) / 1000;
+	stats.is_session_present = is_session_present;
+	ESP_LOGI(MQTT_TAG, "Connected after %d ms, connect %d", stats.connect_latency, stats.connects);
+
 	is_mqtt_connected = true;
+	boot_mark_milestone(BOOT_MILESTONE_ONLINE);
+
+	// Send messages queued while disconnected
+	mqtt_scheduler_wake();
 
    if (is_ota_success_on_bootup == true) {
       printf("Publishing OTA Success result on boot up ...");
       publish_ota_result(mqtt_client, OTA_SUCCESS, NO_FALIURE);
+      is_ota_success_on_bootup = false;
    }
 }
 
+static void mqtt_disconnected() {
+	// Failed reconnects also report disconnect, outage starts at first one
+	if(!is_mqtt_connected) return;
+
+	is_mqtt_connected = false;
+	connect_start = esp_timer_get_time();
+	stats.disconnects++;
+}
+
+void get_mqtt_stats(struct mqtt_stats *stats_out) { memcpy(stats_out, &stats, sizeof(stats)); }
+
 void create_time_json(cJSON **time_json) {
 	char time_str[TIME_STRING_LENGTH];
 
@@ -300,68 +390,65 @@ void create_time_json(cJSON **time_json) {
 }
 
 void publish_sensor_data(void *parameter) {			// MQTT Setup and Data Publishing Task
-	ESP_LOGI(MQTT_TAG, "Sensor data topic: %s", sensor_data_topic);
-
+	TickType_t next_publish = xTaskGetTickCount();
 	for (;;) {
-		if(!is_mqtt_connected) {
-			ESP_LOGE(MQTT_TAG, "Wifi not connected, cannot send MQTT data");
-
-			// Wait for delay period and try again
-			vTaskDelay(pdMS_TO_TICKS(SENSOR_MEASUREMENT_PERIOD));
-			continue;
-		}
+		// Sleep till next publish or till alarm engine wakes task
+		TickType_t now = xTaskGetTickCount();
+		if((int32_t) (next_publish - now) > 0) ulTaskNotifyTake(pdTRUE, next_publish - now);
 
-		cJSON *root, *time, *sensor_arr, *sensor;
+		// Alarms go out as soon as they change, ahead of telemetry
+		if(is_mqtt_connected && sensor_alarms_take_pending()) publish_alarms();
 
-		// Initializing json object and sensor array
-		root = cJSON_CreateObject();
-		sensor_arr = cJSON_CreateArray();
+		if((int32_t) (next_publish - xTaskGetTickCount()) > 0) continue;
+		next_publish = xTaskGetTickCount() + pdMS_TO_TICKS(SENSOR_MEASUREMENT_PERIOD);
 
-		// Adding time
-		create_time_json(&time);
-		cJSON_AddItemToObject(root, "time", time);
+		// Readings are queued while disconnected too, newest reading of reservoir replaces queued one
+		if(!is_mqtt_connected) ESP_LOGW(MQTT_TAG, "MQTT not connected, sensor data queued");
 
-		// Adding water temperature
-		sensor_get_json(get_water_temp_sensor(), &sensor);
-		cJSON_AddItemToArray(sensor_arr, sensor);
+		// Shared sensors are published for every reservoir, so windows are closed once per publish cycle
+		sensor_registry_close_windows();
 
-		// Adding ec
-		sensor_get_json(get_ec_sensor(), &sensor);
-		cJSON_AddItemToArray(sensor_arr, sensor);
+		// Every reservoir publishes its own sensors on its own topic
+		for(uint8_t reservoir = 0; reservoir < NUM_RESERVOIRS; ++reservoir) {
+			cJSON *root, *time, *sensor_arr;
 
-		// Adding pH
-		sensor_get_json(get_ph_sensor(), &sensor);
-		cJSON_AddItemToArray(sensor_arr, sensor);
+			// Initializing json object and sensor array
+			root = cJSON_CreateObject();
+			sensor_arr = cJSON_CreateArray();
 
-		// Adding array to object
-		cJSON_AddItemToObject(root, "sensors", sensor_arr);
+			// Adding time
+			create_time_json(&time);
+			cJSON_AddItemToObject(root, "time", time);
 
-		// Creating string from JSON
-		char *data = cJSON_PrintUnformatted(root);
+			// Adding registered sensors of reservoir
+			sensor_registry_get_json(reservoir, sensor_arr);
 
-		// Free memory
-		cJSON_Delete(root);
+			// Adding array to object
+			cJSON_AddItemToObject(root, "sensors", sensor_arr);
 
-		// Publish data to MQTT broker using topic and data
-		esp_mqtt_client_publish(mqtt_client, sensor_data_topic, data, 0, PUBLISH_DATA_QOS, 0);
+			// Creating string from JSON
+			char *data = cJSON_PrintUnformatted(root);
 
-      
+			// Free memory
+			cJSON_Delete(root);
 
+			// Publish data to MQTT broker using topic and data
+			mqtt_scheduler_publish(sensor_data_topics[reservoir], data, 0, PUBLISH_DATA_QOS, 0, MQTT_PRIORITY_TELEMETRY);
 
-		ESP_LOGI(MQTT_TAG, "Sensor data: %s", data);
-
-		// Publish data every sensor reading
-		vTaskDelay(pdMS_TO_TICKS(SENSOR_MEASUREMENT_PERIOD));
+			ESP_LOGI(MQTT_TAG, "Sensor data: %s", data);
+			free(data);
+		}
 	}
 
 	free(wifi_connect_topic);
-	free(sensor_data_topic);
+	for(uint8_t reservoir = 0; reservoir < NUM_RESERVOIRS; ++reservoir) free(sensor_data_topics[reservoir]);
 	free(sensor_settings_topic);
 }
 
-cJSON* get_ph_control_status() { return ph_control_status; }
-cJSON* get_ec_control_status() { return ec_control_status; }
-cJSON* get_water_temp_control_status() { return water_temp_control_status; }
+cJSON* get_control_status(uint8_t channel) { return channel < NUM_CONTROL_CHANNELS ? control_statuses[channel] : NULL; }
+cJSON* get_reservoir_state_status() { return reservoir_state_status; }
+cJSON* get_reservoir_fault_status() { return reservoir_fault_status; }
+cJSON* get_reservoir_leak_status() { return reservoir_leak_status; }
 cJSON **get_rf_statuses() { return rf_statuses; }
 
 void init_equipment_status() {
@@ -370,12 +457,19 @@ void init_equipment_status() {
 	rf_status_root = cJSON_CreateObject();
 
 	// Create sensor statuses
-	ph_control_status = cJSON_CreateNumber(0);
-	ec_control_status = cJSON_CreateNumber(0);
-	water_temp_control_status = cJSON_CreateNumber(0);
-	cJSON_AddItemToObject(control_status_root, "ph_control", ph_control_status);
-	cJSON_AddItemToObject(control_status_root, "ec_control", ec_control_status);
-	cJSON_AddItemToObject(control_status_root, "water_temp_control", water_temp_control_status);
+	for(uint8_t i = 0; i < NUM_CONTROL_CHANNELS; ++i) {
+		control_statuses[i] = cJSON_CreateNumber(0);
+		cJSON_AddItemToObject(control_status_root, get_control_channel(i)->status_key, control_statuses[i]);
+	}
+
+	// Create reservoir change status
+	reservoir_status_root = cJSON_CreateObject();
+	reservoir_state_status = cJSON_CreateNumber(0);
+	reservoir_fault_status = cJSON_CreateNumber(0);
+	reservoir_leak_status = cJSON_CreateNumber(0);
+	cJSON_AddItemToObject(reservoir_status_root, "state", reservoir_state_status);
+	cJSON_AddItemToObject(reservoir_status_root, "fault", reservoir_fault_status);
+	cJSON_AddItemToObject(reservoir_status_root, "leak", reservoir_leak_status);
 
 	// Create rf statuses
 	char key[3];
@@ -388,55 +482,141 @@ void init_equipment_status() {
 
 	cJSON_AddItemToObject(equipment_status_root, "rf", rf_status_root);
 	cJSON_AddItemToObject(equipment_status_root, "control", control_status_root);
+	cJSON_AddItemToObject(equipment_status_root, "reservoir", reservoir_status_root);
 }
 
 void publish_equipment_status() {
+	// Control runs before MQTT is up, statuses are published on connect
+	if(mqtt_client == NULL) return;
+
 	char *data = cJSON_Print(equipment_status_root); // Create data string
-	esp_mqtt_client_publish(mqtt_client, equipment_status_topic, data, 0, PUBLISH_DATA_QOS, 1); // Publish data
+	mqtt_scheduler_publish(equipment_status_topic, data, 0, PUBLISH_DATA_QOS, 1, MQTT_PRIORITY_STATE); // Publish data
 	ESP_LOGI(MQTT_TAG, "Equipment Data: %s", data);
+	free(data);
+}
+
+void publish_alarms() {
+	cJSON *root, *time;
+	sensor_alarms_get_json(&root);
+	create_time_json(&time);
+	cJSON_AddItemToObject(root, "time", time);
+
+	// Retained so dashboards connecting later see alarms that are still active
+	char *data = cJSON_PrintUnformatted(root);
+	cJSON_Delete(root);
+	mqtt_scheduler_publish(alarms_topic, data, 0, PUBLISH_DATA_QOS, 1, MQTT_PRIORITY_ALARM);
+	ESP_LOGI(MQTT_TAG, "Alarms: %s", data);
+	free(data);
+}
+
+void publish_recipe_status() {
+	cJSON *root;
+	recipe_get_status_json(&root);
+
+	char *data = cJSON_PrintUnformatted(root);
+	cJSON_Delete(root);
+	mqtt_scheduler_publish(recipe_status_topic, data, 0, PUBLISH_DATA_QOS, 1, MQTT_PRIORITY_STATE);
+	ESP_LOGI(MQTT_TAG, "Recipe status: %s", data);
+	free(data);
+}
+
+void publish_calibration_progress(cJSON *progress) {
+	if(mqtt_client == NULL) return;
+
+	char *data = cJSON_PrintUnformatted(progress);
+	mqtt_scheduler_publish(calibration_progress_topic, data, 0, PUBLISH_DATA_QOS, 0, MQTT_PRIORITY_RESULT);
+	ESP_LOGI(MQTT_TAG, "Calibration progress: %s", data);
+	free(data);
+}
+
+// Tell cloud whether settings were applied, which scope they came from and why they were rejected
+static void publish_settings_result(const char *settings_key, bool is_applied, const char *error, enum mqtt_scope scope) {
+	cJSON *root = cJSON_CreateObject();
+	if(settings_key != NULL) cJSON_AddStringToObject(root, "settings", settings_key);
+	cJSON_AddBoolToObject(root, "ok", is_applied);
+	cJSON_AddStringToObject(root, "scope", mqtt_groups_get_scope_name(scope));
+	if(scope != MQTT_SCOPE_DEVICE) cJSON_AddStringToObject(root, "group", mqtt_groups_get_id(scope));
+	if(!is_applied) cJSON_AddStringToObject(root, "error", error);
+
+	char *data = cJSON_PrintUnformatted(root);
+	cJSON_Delete(root);
+	mqtt_scheduler_publish(settings_result_topic, data, 0, PUBLISH_DATA_QOS, 0, MQTT_PRIORITY_RESULT);
+	ESP_LOGI(MQTT_TAG, "Settings result: %s", data);
+	free(data);
 }
 
-void update_settings(char *settings) {
-	cJSON *root = cJSON_Parse(settings);
-	char* string = cJSON_Print(root);
-	ESP_LOGI(MQTT_TAG, "datavalue:\n %s\n", string);
-	cJSON *object_settings = root->child;
-	
-	char *data_topic = object_settings->string;
-	ESP_LOGI(MQTT_TAG, "datatopic: %s\n", data_topic);
-
-	if(strcmp("ph", data_topic) == 0) {
-		ESP_LOGI(MQTT_TAG, "pH data received");
-		ph_update_settings(object_settings);
-	} else if(strcmp("ec", data_topic) == 0) {
-		ESP_LOGI(MQTT_TAG, "EC data received");
-		ec_update_settings(object_settings);
-	} else if(strcmp("water_temp", data_topic) == 0) {
-		ESP_LOGI(MQTT_TAG, "Water Temperature data received");
-		water_temp_update_settings(object_settings);
+void update_settings(const struct json_document *doc, enum mqtt_scope scope) {
+	char error[SETTINGS_ERROR_LENGTH];
+	char data_topic[SETTINGS_KEY_LENGTH];
+
+	// Settings are first key of message, its value is next token
+	if(json_get_type(doc, 0) != JSON_OBJECT || doc->tokens[0].size == 0 || !json_get_string(doc, 1, data_topic, sizeof(data_topic))) {
+		ESP_LOGE(MQTT_TAG, "Settings are not a JSON object");
+		publish_settings_result(NULL, false, "invalid JSON", scope);
+		return;
+	}
+	int object_settings = 2;
+	ESP_LOGI(MQTT_TAG, "datatopic: %s, scope: %s\n", data_topic, mqtt_groups_get_scope_name(scope));
+
+	// Membership is set per device, groups can't move their members
+	if(strcmp(GROUPS_SETTINGS_KEY, data_topic) == 0) {
+		bool is_applied = false;
+		if(scope != MQTT_SCOPE_DEVICE) strcpy(error, "groups are set per device");
+		else is_applied = mqtt_groups_update(doc, object_settings, error);
+		publish_settings_result(data_topic, is_applied, error, scope);
+		return;
+	}
+
+	// Device settings override group settings and zone settings override room and site settings
+	enum mqtt_scope applied_scope;
+	if(!mqtt_groups_is_settings_allowed(data_topic, scope, &applied_scope)) {
+		ESP_LOGW(MQTT_TAG, "%s settings of %s ignored, %s settings apply", data_topic, mqtt_groups_get_scope_name(scope), mqtt_groups_get_scope_name(applied_scope));
+		snprintf(error, sizeof(error), "overridden by %s settings", mqtt_groups_get_scope_name(applied_scope));
+		publish_settings_result(data_topic, false, error, scope);
+		return;
+	}
+
+	// Null settings on device topic drop override, settings stay until group sends new ones
+	if(scope == MQTT_SCOPE_DEVICE && json_get_type(doc, object_settings) == JSON_NULL) {
+		mqtt_groups_clear_settings_scope(data_topic);
+		publish_settings_result(data_topic, true, NULL, scope);
+		return;
+	}
+
+	bool is_applied = false;
+	strcpy(error, "unknown settings");
+	struct control_channel *channel = find_control_channel(data_topic);
+	if(channel != NULL) {
+		ESP_LOGI(MQTT_TAG, "%s data received", channel->name);
+		is_applied = control_channel_update_settings(channel, doc, object_settings, error);
+
+		// Running recipe puts its targets back over received targets
+		if(is_applied) recipe_update();
 	} else if(strcmp("irrigation", data_topic) == 0) {
 		ESP_LOGI(MQTT_TAG, "Irrigation data received");
-		update_irrigation_timings(object_settings);
+		is_applied = update_irrigation_timings(doc, object_settings, error);
 	} else if(strcmp("grow_lights", data_topic) == 0) {
 		ESP_LOGI(MQTT_TAG, "Grow Lights data received");
-		update_grow_light_timings(object_settings);
+		is_applied = update_grow_light_timings(doc, object_settings, error);
 	} else if(strcmp("reservoir", data_topic) == 0) {
 		ESP_LOGI(MQTT_TAG, "Reservoir data received");
-		update_reservoir_settings(object_settings);
+		is_applied = update_reservoir_settings(doc, object_settings, error);
 	} else {
 		ESP_LOGE(MQTT_TAG, "Data %s not recognized", data_topic);
 	}
-	cJSON_Delete(root);
+	publish_settings_result(data_topic, is_applied, error, scope);
 
+	if(!is_applied) return;
 	ESP_LOGI(MQTT_TAG, "Settings updated");
+	mqtt_groups_set_settings_scope(data_topic, scope);
 	if(!get_is_settings_received()) settings_received();
 }
 
-static void initiate_ota(const char *mqtt_data) {
+static void initiate_ota(const struct json_document *doc) {
    const char *TAG = "INITIATE_OTA";
 
    char version[FIRMWARE_VERSION_LEN], endpoint[OTA_URL_SIZE];
-   if (ESP_OK == parse_ota_parameters(mqtt_data, version, endpoint)) {
+   if (ESP_OK == parse_ota_parameters(doc, version, endpoint)) {
       if (ESP_OK == validate_ota_parameters(version, endpoint)) {
          ESP_LOGI(TAG, "FW upgrade command received over MQTT - checking for valid URL\n");
          if (strlen(endpoint) > OTA_URL_SIZE) {
@@ -485,35 +665,28 @@ static esp_err_t validate_ota_parameters(char *version, char *endpoint)
    return ESP_OK;
 }
 
-static esp_err_t parse_ota_parameters(const char *buffer, char *version_buf, char *endpoint_buf)
+static esp_err_t parse_ota_parameters(const struct json_document *doc, char *version_buf, char *endpoint_buf)
 {
    const char *TAG = "PARSE_OTA_PARAMETERS";
 
-   cJSON *version;
-   cJSON *endpoint;
-
-   if (buffer == NULL) {
-      ESP_LOGI(TAG, "Invalid parameter received");
-      return ESP_FAIL;
-   }
-
-   cJSON *root = cJSON_Parse(buffer);
-   if (root == NULL) {
+   if (json_get_type(doc, 0) != JSON_OBJECT) {
       ESP_LOGI(TAG, "Fail to deserialize Json");
       return ESP_FAIL;
    }
 
-   version = cJSON_GetObjectItemCaseSensitive(root, "version");
-   if (cJSON_IsString(version) && (version->valuestring != NULL)) {
-      strcpy(version_buf, version->valuestring);
-      ESP_LOGI(TAG, "version: \"%s\"\n", version_buf);
+   // Values that don't fit their buffer are rejected instead of copied past it
+   if (!json_get_string(doc, json_get_object_item(doc, 0, "version"), version_buf, FIRMWARE_VERSION_LEN)) {
+      ESP_LOGI(TAG, "Invalid version received");
+      return ESP_FAIL;
    }
+   ESP_LOGI(TAG, "version: \"%s\"\n", version_buf);
 
-   endpoint = cJSON_GetObjectItemCaseSensitive(root, "endpoint");
-   if (cJSON_IsString(endpoint) && (endpoint->valuestring != NULL)) {
-      strcpy(endpoint_buf, endpoint->valuestring);
-      ESP_LOGI(TAG, "endpoint: \"%s\"\n", endpoint_buf);
+   if (!json_get_string(doc, json_get_object_item(doc, 0, "endpoint"), endpoint_buf, OTA_URL_SIZE)) {
+      ESP_LOGI(TAG, "Invalid endpoint received");
+      publish_ota_result(mqtt_client, OTA_FAIL, INVALID_OTA_URL_RECEIVED);
+      return ESP_FAIL;
    }
+   ESP_LOGI(TAG, "endpoint: \"%s\"\n", endpoint_buf);
    return ESP_OK;
 }
 
@@ -587,107 +760,145 @@ static void create_and_publish_ota_result(esp_mqtt_client_handle_t client, ota_r
 
    ESP_LOGI(TAG, "Message: %s", data);
 
-   esp_mqtt_client_publish(client, ota_done_topic, data, 0, 1, 0);
+   mqtt_scheduler_publish(ota_done_topic, data, 0, 1, 0, MQTT_PRIORITY_RESULT);
 
    ESP_LOGI(TAG, "ota_failed message publish successful, Message: %s", data);
+   free(data);
 }
 
 void publish_ota_result(esp_mqtt_client_handle_t client, ota_result_t ota_result, ota_failure_reason_t ota_failure_reason) {
    create_and_publish_ota_result(client, ota_result, ota_failure_reason);
 }
 
-void data_handler(char *topic_in, uint32_t topic_len, char *data_in, uint32_t data_len) {
-   const char *TAG = "DATA_HANDLER";
+// Inbound messages are tokenized in place, tokens are shared since only MQTT task handles messages
+static struct json_token message_tokens[MQTT_MAX_MESSAGE_TOKENS];
 
-   // Create dynamically allocated vars for topic and data
-   char *topic = malloc(sizeof(char) * (topic_len+1));
-   char *data = malloc(sizeof(char) * (data_len+1));
+// Topic and data of inbound message aren't terminated
+static bool is_topic(const char *topic_in, uint32_t topic_len, const char *topic) {
+   return strlen(topic) == topic_len && memcmp(topic_in, topic, topic_len) == 0;
+}
 
-   // Copy over topic
-   for(int i = 0; i < topic_len; i++) {
-      topic[i] = topic_in[i];
-   }
-   topic[topic_len] = 0;
+// Integer value of key of root object, bools are 0 and 1
+static bool get_message_int(const struct json_document *doc, int index, int *value) {
+   double number;
+   bool is_true;
+   if(json_get_number(doc, index, &number)) *value = number;
+   else if(json_get_bool(doc, index, &is_true)) *value = is_true;
+   else return false;
+   return true;
+}
+
+// Message is 0 to stop grow cycle, anything else starts it
+static void set_grow_cycle(const char *data_in, uint32_t data_len) {
+   ESP_LOGI(MQTT_TAG, "Grow cycle status received");
+   if(data_len > 0 && data_in[0] == '0') stop_grow_cycle();
+   else start_grow_cycle();
+}
 
-   // Copy over data
-   for(int i = 0; i < data_len; i++) {
-      data[i] = data_in[i];
+// Message is outlet number and state, {"<outlet>": <state>}
+static void set_rf_outlet(const struct json_document *doc) {
+   char outlet[RF_OUTLET_KEY_LENGTH];
+   int state;
+   if(json_get_type(doc, 0) == JSON_OBJECT && doc->tokens[0].size > 0 && json_get_string(doc, 1, outlet, sizeof(outlet)) && get_message_int(doc, 2, &state)) {
+      ESP_LOGI(MQTT_TAG, "RF id number %d: RF state: %d", atoi(outlet), state);
+      control_power_outlet(atoi(outlet), state);
+   } else {
+      ESP_LOGE(MQTT_TAG, "Invalid RF control message");
    }
+}
+
+// Recipe and history requests are still parsed into cJSON trees, which need terminated text
+static cJSON* parse_message_tree(const char *data_in, uint32_t data_len) {
+   char *data = malloc(data_len + 1);
+   if(data == NULL) return NULL;
+   memcpy(data, data_in, data_len);
    data[data_len] = 0;
+   cJSON *obj = cJSON_Parse(data);
+   free(data);
+   return obj;
+}
+
+void data_handler(char *topic_in, uint32_t topic_len, char *data_in, uint32_t data_len) {
+   const char *TAG = "DATA_HANDLER";
+
+   // Document of message that isn't JSON has no tokens, handlers check types of tokens they use
+   struct json_document doc;
+   if(!json_parse(&doc, data_in, data_len, message_tokens, MQTT_MAX_MESSAGE_TOKENS)) ESP_LOGD(TAG, "Message isn't JSON");
 
-   ESP_LOGI(TAG, "Incoming Topic: %s", topic);
+   ESP_LOGI(TAG, "Incoming Topic: %.*s", topic_len, topic_in);
+
+   enum mqtt_group_topic group_topic;
+   enum mqtt_scope scope;
 
    // Check topic against each subscribed topic possible
-   if(strcmp(topic, sensor_settings_topic) == 0) {
+   if(is_topic(topic_in, topic_len, sensor_settings_topic)) {
       // Update sensor settings
       ESP_LOGI(TAG, "Sensor settings received");
-      update_settings(data);
-   } else if(strcmp(topic, grow_cycle_topic) == 0) {
+      update_settings(&doc, MQTT_SCOPE_DEVICE);
+   } else if(is_topic(topic_in, topic_len, grow_cycle_topic)) {
       // Start/stop grow cycle according to message
-      ESP_LOGI(TAG, "Grow cycle status received");
-      if(data[0] == '0') stop_grow_cycle();
-      else start_grow_cycle();
-   } else if(strcmp(topic, rf_control_topic) == 0) {
-      cJSON *obj = cJSON_Parse(data);
-      obj = obj->child;
-      ESP_LOGI(TAG, "RF id number %d: RF state: %d", atoi(obj->string), obj->valueint);
-      control_power_outlet(atoi(obj->string), obj->valueint);
-   } else if(strcmp(topic, calibration_topic) == 0) {
-      cJSON *obj = cJSON_Parse(data);
-      update_calibration(obj); 
-   } 	else if(strcmp(topic, ota_update_topic) == 0) {
+      set_grow_cycle(data_in, data_len);
+   } else if(is_topic(topic_in, topic_len, recipe_topic)) {
+      // Empty or invalid recipe stops running recipe
+      ESP_LOGI(TAG, "Recipe received");
+      cJSON *obj = parse_message_tree(data_in, data_len);
+      recipe_set(obj);
+      cJSON_Delete(obj);
+   } else if(is_topic(topic_in, topic_len, rf_control_topic)) {
+      set_rf_outlet(&doc);
+   } else if(is_topic(topic_in, topic_len, calibration_topic)) {
+      update_calibration(&doc);
+   } else if(is_topic(topic_in, topic_len, history_request_topic)) {
+      ESP_LOGI(TAG, "History request received");
+      cJSON *obj = parse_message_tree(data_in, data_len);
+      if(obj != NULL) history_request(obj);
+   } 	else if(is_topic(topic_in, topic_len, ota_update_topic)) {
       // Initiate ota
       ESP_LOGI(TAG, "OTA update message received");
-      initiate_ota(data);
-   } else if(strcmp(topic, version_request_topic) == 0) {
+      initiate_ota(&doc);
+   } else if(is_topic(topic_in, topic_len, version_request_topic)) {
       // Send back firmware version
       ESP_LOGI(TAG, "Firmware version requested");
       publish_firmware_version();
-   } else if(strcmp(topic, test_motor_topic) == 0) {
-      int pump_status = 0;
-      cJSON *choice;
-      cJSON *switch_status;
-      cJSON *root  = cJSON_Parse(data);  
-      choice = cJSON_GetObjectItemCaseSensitive(root, "choice");
-      switch_status = cJSON_GetObjectItemCaseSensitive(root, "switch_status");
-      if (switch_status->valueint == 0 || switch_status->valueint == 1 || switch_status->valueint == -1) {
-         pump_status = switch_status->valueint;   
-         ESP_LOGI(TAG, "%d\n",pump_status);
-      }
-      ESP_LOGI(TAG, "Received the test motor message");
-      test_motor(choice->valueint,pump_status);
-   } else if(strcmp(topic, test_lights_topic) == 0){
-      int light_status = 0;
-      cJSON *choice;
-      cJSON *switch_status;
-      cJSON *object = cJSON_Parse(data);
-      choice = cJSON_GetObjectItemCaseSensitive(object, "choice");
-      switch_status = cJSON_GetObjectItemCaseSensitive(object, "switch_status");
-      if(switch_status->valueint == 0 || switch_status->valueint == 1 || switch_status->valueint == -1){
-         light_status = switch_status->valueint;
-         ESP_LOGI(TAG, "%d\n",light_status);
+   } else if(is_topic(topic_in, topic_len, test_motor_topic) || is_topic(topic_in, topic_len, test_lights_topic)) {
+      // Switch status is -1, 0 or 1, anything else is 0
+      bool is_motor = is_topic(topic_in, topic_len, test_motor_topic);
+      int choice, switch_status = 0;
+      if(!get_message_int(&doc, json_get_object_item(&doc, 0, "choice"), &choice)) {
+         ESP_LOGE(TAG, "Test message requires choice");
+      } else {
+         if(!get_message_int(&doc, json_get_object_item(&doc, 0, "switch_status"), &switch_status) || switch_status < -1 || switch_status > 1) switch_status = 0;
+         ESP_LOGI(TAG, "%d\n", switch_status);
+         if(is_motor) {
+            ESP_LOGI(TAG, "Received the test motor message");
+            test_motor(choice, switch_status);
+         } else {
+            ESP_LOGI(TAG,"Received the test lights message");
+            test_lights(choice, switch_status);
+         }
       }
-      ESP_LOGI(TAG,"Received the test lights message");
-      test_lights(choice->valueint,light_status);
-   } else if(strcmp(topic, test_ph_topic) == 0){
+   } else if(is_topic(topic_in, topic_len, test_ph_topic)){
       ESP_LOGI(TAG, "Received the test PH message");
       test_ph();
-   } else if(strcmp(topic, test_temperature_topic) == 0){
+   } else if(is_topic(topic_in, topic_len, test_temperature_topic)){
       ESP_LOGI(TAG, "Received the test Water TEmperature message");
       test_water_temperature();
-   } else if(strcmp(topic, test_ec_topic) == 0){
+   } else if(is_topic(topic_in, topic_len, test_ec_topic)){
       ESP_LOGI(TAG, "Received the test EC message");
       test_ec();
-   } else if(strcmp(topic, test_rf_topic) == 0){
+   } else if(is_topic(topic_in, topic_len, test_rf_topic)){
       ESP_LOGI(TAG,"Received the test RF message");
       test_rf();
+   } else if(mqtt_groups_match(topic_in, topic_len, &group_topic, &scope)) {
+      // One publish to group reaches every member
+      ESP_LOGI(TAG, "%s %s command received", mqtt_groups_get_scope_name(scope), mqtt_groups_get_id(scope));
+      if(group_topic == MQTT_GROUP_SETTINGS) update_settings(&doc, scope);
+      else if(group_topic == MQTT_GROUP_STATUS) set_grow_cycle(data_in, data_len);
+      else set_rf_outlet(&doc);
    } else {
       // Topic doesn't match any known topics
       ESP_LOGE(TAG, "Topic unknown");
    }
-
-   free(topic);
-   free(data);
 }
 
 static void publish_firmware_version() {
@@ -707,44 +918,247 @@ static void publish_firmware_version() {
    }
    cJSON_AddItemToObject(root, "version", version);
 
-   esp_mqtt_client_publish(mqtt_client, version_result_topic, cJSON_PrintUnformatted(root), 0, 1, 0);
+   // Adding flash write counts of settings store
+   struct nvs_write_stats stats;
+   nvs_get_write_stats(&stats);
+   cJSON *nvs = cJSON_CreateObject();
+   cJSON_AddNumberToObject(nvs, "writes", stats.writes);
+   cJSON_AddNumberToObject(nvs, "skipped", stats.skipped);
+   cJSON_AddNumberToObject(nvs, "commits", stats.commits);
+   cJSON_AddItemToObject(root, "nvs", nvs);
+
+   // Adding boot timings, -1 for milestones not reached yet
+   cJSON *boot = cJSON_CreateObject();
+   cJSON_AddNumberToObject(boot, "control_ms", boot_get_milestone_ms(BOOT_MILESTONE_CONTROL));
+   cJSON_AddNumberToObject(boot, "time_synced_ms", boot_get_milestone_ms(BOOT_MILESTONE_TIME_SYNCED));
+   cJSON_AddNumberToObject(boot, "online_ms", boot_get_milestone_ms(BOOT_MILESTONE_ONLINE));
+   cJSON_AddItemToObject(root, "boot", boot);
+
+   // Adding wifi connection timings
+   struct wifi_stats wifi_stats;
+   get_wifi_stats(&wifi_stats);
+   cJSON *wifi = cJSON_CreateObject();
+   cJSON_AddNumberToObject(wifi, "time_to_ip_ms", wifi_stats.time_to_ip);
+   cJSON_AddBoolToObject(wifi, "fast_connect", wifi_stats.is_fast_connect);
+   cJSON_AddNumberToObject(wifi, "reconnects", wifi_stats.reconnects);
+   cJSON_AddItemToObject(root, "wifi", wifi);
+
+   // Adding broker connection counts
+   struct mqtt_stats mqtt_stats;
+   get_mqtt_stats(&mqtt_stats);
+   cJSON *mqtt = cJSON_CreateObject();
+   cJSON_AddNumberToObject(mqtt, "connects", mqtt_stats.connects);
+   cJSON_AddNumberToObject(mqtt, "disconnects", mqtt_stats.disconnects);
+   cJSON_AddNumberToObject(mqtt, "connect_latency_ms", mqtt_stats.connect_latency);
+   cJSON_AddBoolToObject(mqtt, "session_present", mqtt_stats.is_session_present);
+   cJSON_AddStringToObject(mqtt, "topics", TOPIC_SCHEME);
+   cJSON_AddItemToObject(root, "mqtt", mqtt);
+
+   // Adding group membership, empty for scopes device isn't member of
+   cJSON *groups = cJSON_CreateObject();
+   for(uint8_t scope = MQTT_SCOPE_ZONE; scope < NUM_MQTT_SCOPES; ++scope) cJSON_AddStringToObject(groups, mqtt_groups_get_scope_name(scope), mqtt_groups_get_id(scope));
+   cJSON_AddItemToObject(root, "groups", groups);
+
+   // Adding outbound queue depths, drops and latencies per priority
+   struct mqtt_scheduler_stats outbox_stats;
+   mqtt_scheduler_get_stats(&outbox_stats);
+   cJSON *outbox = cJSON_CreateObject();
+   cJSON_AddNumberToObject(outbox, "bytes", outbox_stats.bytes);
+   cJSON_AddNumberToObject(outbox, "peak_bytes", outbox_stats.peak_bytes);
+   cJSON_AddNumberToObject(outbox, "inflight", outbox_stats.inflight);
+   for(uint8_t priority = 0; priority < NUM_MQTT_PRIORITIES; ++priority) {
+      struct mqtt_priority_stats *priority_stats = &outbox_stats.priorities[priority];
+      cJSON *queue = cJSON_CreateObject();
+      cJSON_AddNumberToObject(queue, "depth", priority_stats->depth);
+      cJSON_AddNumberToObject(queue, "max_depth", priority_stats->max_depth);
+      cJSON_AddNumberToObject(queue, "sent", priority_stats->sent);
+      cJSON_AddNumberToObject(queue, "merged", priority_stats->merged);
+      cJSON_AddNumberToObject(queue, "dropped", priority_stats->dropped);
+      cJSON_AddNumberToObject(queue, "latency_ms", priority_stats->sent > 0 ? priority_stats->latency_sum / priority_stats->sent : 0);
+      cJSON_AddNumberToObject(queue, "max_latency_ms", priority_stats->max_latency);
+      cJSON_AddItemToObject(outbox, mqtt_scheduler_get_priority_name(priority), queue);
+   }
+   cJSON_AddItemToObject(root, "outbox", outbox);
+
+   char *data = cJSON_PrintUnformatted(root);
+   mqtt_scheduler_publish(version_result_topic, data, 0, 1, 0, MQTT_PRIORITY_RESULT);
+   free(data);
    cJSON_Delete(root);
 }
 
-void update_calibration(cJSON *data) {
-    cJSON *obj = data->child;  
-    char *data_string = cJSON_Print(data);
-    ESP_LOGI(MQTT_TAG, "%s", data_string);
-    if (strcmp(obj->string, "type") == 0) {
-        if (strcmp(obj->valuestring, "ph") == 0) {
-            sensor_set_calib_status(get_ph_sensor(), true);
-            ESP_LOGI(MQTT_TAG, "pH calibration received");
-            if (!get_is_grow_active()) {
-                vTaskResume(*sensor_get_task_handle(get_water_temp_sensor()));
-                vTaskResume(*sensor_get_task_handle(get_ph_sensor()));
-                ESP_LOGI(MQTT_TAG, "pH and water_temp task resumed");
-            }
-        } else if (strcmp(obj->valuestring, "ec_wet") == 0) {
-            sensor_set_calib_status(get_ec_sensor(), true);
-            ESP_LOGI(MQTT_TAG, "ec wet calibration received");
-            if (!get_is_grow_active()) {
-                vTaskResume(*sensor_get_task_handle(get_ec_sensor()));
-                ESP_LOGI(MQTT_TAG, "ec task resumed");
-            }
-        } else if (strcmp(obj->valuestring, "ec_dry") == 0) {
-            dry_calib = true; 
-            ESP_LOGI(MQTT_TAG, "ec dry calibration received");
-            if (!get_is_grow_active()) {
-                vTaskResume(*sensor_get_task_handle(get_ec_sensor()));
-                ESP_LOGI(MQTT_TAG, "ec task resumed");
+// Read optional point sequence and stability settings of calibration message and start calibration
+// Calibration runs in calibration task, progress is published on calibration progress topic
+static void start_sensor_calibration(const struct json_document *doc, esp_err_t (*start)(uint8_t, const char**, uint8_t, const struct calibration_settings*),
+        uint8_t reservoir, const char *default_key) {
+    struct calibration_settings settings;
+    calibration_default_settings(&settings);
+    double window, accuracy, timeout;
+    if (json_get_number(doc, json_get_object_item(doc, 0, "window"), &window) && window >= 1 && window <= UINT8_MAX) settings.window = window;
+    if (json_get_number(doc, json_get_object_item(doc, 0, "accuracy"), &accuracy) && accuracy > 0) settings.accuracy = accuracy;
+    if (json_get_number(doc, json_get_object_item(doc, 0, "timeout"), &timeout) && timeout > 0) settings.timeout = timeout;
+
+    // Keys are copied out of message, message text isn't terminated
+    char point_keys[CALIBRATION_MAX_POINTS][CALIBRATION_KEY_LENGTH];
+    const char *keys[CALIBRATION_MAX_POINTS];
+    uint8_t num_keys = 0;
+    int points = json_get_object_item(doc, 0, "points");
+    int point;
+    if (json_get_type(doc, points) == JSON_ARRAY) {
+        JSON_FOR_EACH(doc, points, point) {
+            if (num_keys >= CALIBRATION_MAX_POINTS || !json_get_string(doc, point, point_keys[num_keys], CALIBRATION_KEY_LENGTH)) {
+                ESP_LOGE(MQTT_TAG, "Calibration points have to be at most %d keys", CALIBRATION_MAX_POINTS);
+                return;
             }
+            keys[num_keys] = point_keys[num_keys];
+            num_keys++;
+        }
+    }
+    if (num_keys == 0 && default_key != NULL) keys[num_keys++] = default_key;
+
+    esp_err_t error = start(reservoir, keys, num_keys, &settings);
+    if (error != ESP_OK) ESP_LOGE(MQTT_TAG, "Calibration not started: %s", esp_err_to_name(error));
+}
+
+void update_calibration(const struct json_document *doc) {
+    // Reservoir is optional and numbered from 1, first reservoir is calibrated if it isn't given
+    uint8_t reservoir = 0;
+    double reservoir_number;
+    if (json_get_number(doc, json_get_object_item(doc, 0, "reservoir"), &reservoir_number) && reservoir_number >= 1 && reservoir_number <= NUM_RESERVOIRS) reservoir = reservoir_number - 1;
+
+    char type[CALIBRATION_KEY_LENGTH];
+    if (json_get_type(doc, 0) != JSON_OBJECT || !json_string_equals(doc, 1, "type")) {
+        ESP_LOGE(MQTT_TAG, "Invalid Key Recieved, Expected Key: type");
+        return;
+    }
+    if (!json_get_string(doc, 2, type, sizeof(type))) {
+        ESP_LOGE(MQTT_TAG, "Invalid Value Recieved");
+        return;
+    }
+
+    double pump, value;
+    bool has_pump = json_get_number(doc, json_get_object_item(doc, 0, PUMP_CALIBRATION_PUMP_KEY), &pump) && pump >= 1 && pump <= NUM_DOSING_PUMPS;
+    if (strcmp(type, "ph") == 0) {
+        ESP_LOGI(MQTT_TAG, "pH calibration received");
+        start_sensor_calibration(doc, &ph_start_calibration, reservoir, NULL);
+    } else if (strcmp(type, "ec") == 0) {
+        ESP_LOGI(MQTT_TAG, "ec calibration received");
+        start_sensor_calibration(doc, &ec_start_calibration, reservoir, NULL);
+    } else if (strcmp(type, "ec_wet") == 0) {
+        ESP_LOGI(MQTT_TAG, "ec wet calibration received");
+        start_sensor_calibration(doc, &ec_start_calibration, reservoir, "single");
+    } else if (strcmp(type, "ec_dry") == 0) {
+        ESP_LOGI(MQTT_TAG, "ec dry calibration received");
+        start_sensor_calibration(doc, &ec_start_calibration, reservoir, "dry");
+    } else if (strcmp(type, "pump_run") == 0) {
+        // Run pump for known time so dispensed volume can be measured
+        if (has_pump && json_get_number(doc, json_get_object_item(doc, 0, PUMP_CALIBRATION_TIME_KEY), &value)) {
+            ESP_LOGI(MQTT_TAG, "pump calibration run received");
+            pump_calibration_start(pump_get_index(reservoir, (uint8_t) pump - 1), value);
+        } else {
+            ESP_LOGE(MQTT_TAG, "Pump calibration run requires pump and time");
+        }
+    } else if (strcmp(type, "pump_volume") == 0) {
+        // Measured volume of last calibration run
+        if (has_pump && json_get_number(doc, json_get_object_item(doc, 0, PUMP_CALIBRATION_VOLUME_KEY), &value)) {
+            ESP_LOGI(MQTT_TAG, "pump calibration volume received");
+            pump_calibration_finish(pump_get_index(reservoir, (uint8_t) pump - 1), value);
         } else {
-            ESP_LOGE(MQTT_TAG, "Invalid Value Recieved");
+            ESP_LOGE(MQTT_TAG, "Pump calibration volume requires pump and volume");
         }
     } else {
-        ESP_LOGE(MQTT_TAG, "Invalid Key Recieved, Expected Key: type");
+        ESP_LOGE(MQTT_TAG, "Invalid Value Recieved");
     }
-    cJSON_Delete(data);
+}
+
+// Values are stored as floats, round them so responses don't carry float noise digits
+static cJSON* create_history_value(float value) {
+   return cJSON_CreateNumber(round((double) value * 1000) / 1000);
+}
+
+static void publish_history_error(cJSON *id, const char *error) {
+   cJSON *root = cJSON_CreateObject();
+   if(id != NULL) cJSON_AddItemToObject(root, "id", cJSON_Duplicate(id, true));
+   cJSON_AddStringToObject(root, "error", error);
+   char *data = cJSON_PrintUnformatted(root);
+   mqtt_scheduler_publish(history_response_topic, data, 0, PUBLISH_DATA_QOS, 0, MQTT_PRIORITY_RESULT);
+   free(data);
+   cJSON_Delete(root);
+}
+
+void history_request(cJSON *data) {
+   // Points are copied out chunk by chunk so history isn't locked while publishing
+   static struct history_point points[HISTORY_CHUNK_POINTS];
+
+   cJSON *id = cJSON_GetObjectItemCaseSensitive(data, "id");
+   cJSON *sensor = cJSON_GetObjectItemCaseSensitive(data, "sensor");
+   cJSON *reservoir_item = cJSON_GetObjectItemCaseSensitive(data, "reservoir");
+   cJSON *from_item = cJSON_GetObjectItemCaseSensitive(data, "from");
+   cJSON *to_item = cJSON_GetObjectItemCaseSensitive(data, "to");
+   cJSON *tier_item = cJSON_GetObjectItemCaseSensitive(data, "tier");
+
+   // Reservoir is numbered from 1 like in calibration messages
+   uint8_t reservoir = 0;
+   if (cJSON_IsNumber(reservoir_item) && reservoir_item->valueint >= 1 && reservoir_item->valueint <= NUM_RESERVOIRS) reservoir = reservoir_item->valueint - 1;
+   uint32_t from = cJSON_IsNumber(from_item) && from_item->valuedouble > 0 ? from_item->valuedouble : 0;
+   uint32_t to = cJSON_IsNumber(to_item) && to_item->valuedouble > 0 ? to_item->valuedouble : UINT32_MAX;
+
+   struct history_channel *channel = cJSON_IsString(sensor) ? sensor_history_find(sensor->valuestring, reservoir) : NULL;
+   if (channel == NULL) {
+      ESP_LOGE(MQTT_TAG, "History request for unknown sensor");
+      publish_history_error(id, "unknown sensor");
+      cJSON_Delete(data);
+      return;
+   }
+
+   // Tier is picked from start of range unless it is requested
+   enum history_tier tier;
+   if (!cJSON_IsString(tier_item) || !sensor_history_parse_tier(tier_item->valuestring, &tier)) tier = sensor_history_select_tier(channel, from);
+
+   uint16_t chunk = 0;
+   uint16_t num_points;
+   do {
+      num_points = sensor_history_query(channel, tier, from, to, points, HISTORY_CHUNK_POINTS);
+
+      cJSON *root = cJSON_CreateObject();
+      if (id != NULL) cJSON_AddItemToObject(root, "id", cJSON_Duplicate(id, true));
+      cJSON_AddStringToObject(root, "sensor", sensor->valuestring);
+      cJSON_AddNumberToObject(root, "reservoir", reservoir + 1);
+      cJSON_AddStringToObject(root, "tier", sensor_history_get_tier_name(tier));
+      cJSON_AddNumberToObject(root, "chunk", chunk++);
+      cJSON_AddBoolToObject(root, "last", num_points < HISTORY_CHUNK_POINTS);
+
+      // Raw points are [time, value], aggregated points [time, min, max, mean]
+      cJSON *point_arr = cJSON_CreateArray();
+      for (uint16_t i = 0; i < num_points; ++i) {
+         cJSON *point = cJSON_CreateArray();
+         cJSON_AddItemToArray(point, cJSON_CreateNumber(points[i].time));
+         if (tier != HISTORY_RAW) {
+            cJSON_AddItemToArray(point, create_history_value(points[i].min));
+            cJSON_AddItemToArray(point, create_history_value(points[i].max));
+         }
+         cJSON_AddItemToArray(point, create_history_value(points[i].mean));
+         cJSON_AddItemToArray(point_arr, point);
+      }
+      cJSON_AddItemToObject(root, "points", point_arr);
+
+      char *response = cJSON_PrintUnformatted(root);
+      bool is_queued = mqtt_scheduler_publish(history_response_topic, response, 0, PUBLISH_DATA_QOS, 0, MQTT_PRIORITY_BULK);
+      free(response);
+      cJSON_Delete(root);
+
+      // Chunks don't push out other messages, cloud asks again for remaining range
+      if (!is_queued) {
+         ESP_LOGW(MQTT_TAG, "Outbox full, history of %s truncated after %d chunks", sensor->valuestring, chunk - 1);
+         publish_history_error(id, "outbox full");
+         cJSON_Delete(data);
+         return;
+      }
+
+      if (num_points > 0) from = points[num_points - 1].time + 1;
+   } while (num_points == HISTORY_CHUNK_POINTS);
+
+   ESP_LOGI(MQTT_TAG, "History of %s sent in %d chunks", sensor->valuestring, chunk);
+   cJSON_Delete(data);
 }
 
 void publish_pump_status(int publish_motor_choice , int publish_status){
@@ -763,10 +1177,11 @@ void publish_pump_status(int publish_motor_choice , int publish_status){
 
    ESP_LOGI(TAG, "Message: %s", data);
 
-   esp_mqtt_client_publish(mqtt_client,test_motor_topic, data, 0, 1, 0);
+   mqtt_scheduler_publish(test_motor_topic, data, 0, 1, 0, MQTT_PRIORITY_RESULT);
    cJSON_Delete(temp_obj);
 
    ESP_LOGI(TAG, "Message publish successful, Message: %s", data);
+   free(data);
 }
 
 void publish_light_status(int publish_light_choice, int publish_status)
@@ -785,8 +1200,9 @@ void publish_light_status(int publish_light_choice, int publish_status)
 
    ESP_LOGI(TAG, "Message: %s", data);
 
-   esp_mqtt_client_publish(mqtt_client,test_lights_topic, data, 0, 1, 0);
+   mqtt_scheduler_publish(test_lights_topic, data, 0, 1, 0, MQTT_PRIORITY_RESULT);
    cJSON_Delete(info);
 
    ESP_LOGI(TAG, "Message publish successful, Message: %s", data);
+   free(data);
 }
@@ -7,8 +7,12 @@
 #include <cjson.h>
 #include <string.h>
 #include <driver/gpio.h> 
+#include <sdkconfig.h>
 
 #include "rf_transmitter.h"
+#include "control_channels.h"
+#include "json_tokenizer.h"
+#include "mqtt_groups.h"
 
 #include "ota.h"
 
@@ -18,13 +22,30 @@
 
 #define DEVICE_TYPE "fertigation"
 
-#define WIFI_CONNECT_HEADING "wifi_connect_status"
+// Recurring outbound messages, topic is sent with every message so short headings save broker bandwidth
+#ifdef CONFIG_MQTT_COMPACT_TOPICS
+#define TOPIC_SCHEME "compact"
+#define SENSOR_DATA_HEADING "ld"
+#define EQUIPMENT_STATUS_HEADING "es"
+#define ALARMS_HEADING "al"
+#else
+#define TOPIC_SCHEME "full"
 #define SENSOR_DATA_HEADING "live_data"
-#define SENSOR_SETTINGS_HEADING "device_settings"
 #define EQUIPMENT_STATUS_HEADING "equipment_status"
+#define ALARMS_HEADING "alarms"
+#endif
+
+#define WIFI_CONNECT_HEADING "wifi_connect_status"
+#define SENSOR_SETTINGS_HEADING "device_settings"
+#define SETTINGS_RESULT_HEADING "settings_result"
 #define GROW_CYCLE_HEADING "device_status"
+#define RECIPE_HEADING "recipe"
+#define RECIPE_STATUS_SUBTOPIC "recipe"
 #define RF_CONTROL_HEADING "manual_rf_control"
 #define CALIBRATION_HEADING "calibration"
+#define CALIBRATION_PROGRESS_HEADING "calibration_progress"
+#define HISTORY_REQUEST_HEADING "history_request"
+#define HISTORY_RESPONSE_HEADING "history_response"
 #define OTA_UPDATE_HEADING "ota_update"
 #define OTA_DONE_HEADING "ota_done"
 #define VERSION_REQUEST_HEADING "version_request"
@@ -61,8 +82,32 @@ typedef enum {
 
 #define TIME_STRING_LENGTH 21
 
+// Wait between broker reconnect attempts, ms
+#define MQTT_RECONNECT_TIMEOUT 5000
+
+// Client ID has to stay the same across connects for broker to keep session
+#define MQTT_CLIENT_ID_LENGTH 32
+
+// Connections to broker reported in version result
+struct mqtt_stats {
+	uint16_t connects;
+	uint16_t disconnects;
+	int32_t connect_latency;		// ms from client start or disconnect to last connect, -1 before first connect
+	bool is_session_present;		// Broker kept session on last connect
+};
+
 #define MQTT_TAG "MQTT_MANAGER"
 
+// Most JSON values in inbound message, messages with more values are rejected
+#define MQTT_MAX_MESSAGE_TOKENS 128
+
+// Longest settings key and RF outlet key of inbound messages
+#define SETTINGS_KEY_LENGTH 32
+#define RF_OUTLET_KEY_LENGTH 8
+
+// Longest calibration point key
+#define CALIBRATION_KEY_LENGTH 16
+
 // Task handle
 TaskHandle_t publish_task_handle;
 
@@ -74,16 +119,23 @@ bool is_mqtt_connected;
 
 // Topics
 char *wifi_connect_topic;
-char *sensor_data_topic;
+char *sensor_data_topics[NUM_RESERVOIRS];	// First reservoir publishes to live_data/<id>, others to live_data/<id>/<reservoir>
 char *sensor_settings_topic;
+char *settings_result_topic;
 char *ota_update_topic;
 char *ota_done_topic;
 char *version_request_topic;
 char *version_result_topic;
 char *equipment_status_topic;
 char *grow_cycle_topic;
+char *recipe_topic;
+char *recipe_status_topic;		// device_status/<id>/recipe
 char *rf_control_topic;
 char *calibration_topic; 
+char *calibration_progress_topic;
+char *history_request_topic;
+char *history_response_topic;
+char *alarms_topic;
 char *test_motor_topic;
 char *test_lights_topic;
 char *test_ph_topic;
@@ -91,27 +143,31 @@ char *test_temperature_topic;
 char *test_ec_topic;
 char *test_rf_topic;
 
-SemaphoreHandle_t mqtt_connect_semaphore;
-
 // JSON objects for equipment status
 cJSON *equipment_status_root;
 cJSON *control_status_root;
-cJSON *ph_control_status;
-cJSON *ec_control_status;
-cJSON *water_temp_control_status;
+cJSON *control_statuses[NUM_CONTROL_CHANNELS];
+cJSON *reservoir_status_root;
+cJSON *reservoir_state_status;
+cJSON *reservoir_fault_status;
+cJSON *reservoir_leak_status;
 cJSON *rf_status_root;
 cJSON *rf_statuses[NUM_OUTLETS];
 
 
 // Get JSON objects
-cJSON *get_ph_control_status();
-cJSON *get_ec_control_status();
-cJSON *get_water_temp_control_status();
+cJSON *get_control_status(uint8_t channel);
+cJSON *get_reservoir_state_status();
+cJSON *get_reservoir_fault_status();
+cJSON *get_reservoir_leak_status();
 cJSON **get_rf_statuses();
 
-// Set broker IP config in MQTT
+// Start MQTT client, returns at once and client keeps reconnecting while broker is unreachable
 void mqtt_connect();
 
+// Get broker connection counts
+void get_mqtt_stats(struct mqtt_stats *stats);
+
 // Initialize MQTT connection
 void init_mqtt();
 
@@ -127,8 +183,8 @@ void init_equipment_status();
 // Send equipment data over MQTT
 void publish_equipment_status();
 
-// Update system settings
-void update_settings();
+// Update system settings received on device topic or group topic of scope
+void update_settings(const struct json_document *doc, enum mqtt_scope scope);
 
 // Create publishing topic
 void create_sensor_data_topic();
@@ -140,7 +196,19 @@ void create_settings_data_topic();
 void publish_ota_result(esp_mqtt_client_handle_t client, ota_result_t ota_result, ota_failure_reason_t ota_failure_reason);
 
 //Update calibration settings
-void update_calibration(cJSON *obj);
+void update_calibration(const struct json_document *doc);
+
+// Publish progress of running sensor calibration
+void publish_calibration_progress(cJSON *progress);
+
+// Publish active sensor alarms as retained message
+void publish_alarms();
+
+// Publish current stage of grow recipe as retained message
+void publish_recipe_status();
+
+// Answer sensor history range query with chunked responses
+void history_request(cJSON *data);
 
 //Publish status for motors
 void publish_pump_status(int publish_motor_choice, int publish_status);
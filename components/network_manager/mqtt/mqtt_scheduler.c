@@ -0,0 +1,274 @@
+#include "mqtt_scheduler.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <freertos/semphr.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mqtt_manager.h"
+#include "task_priorities.h"
+
+// Queued message, data follows struct in same allocation
+struct mqtt_message {
+	struct mqtt_message *next;
+	const char *topic;			// Topics live as long as MQTT manager
+	size_t length;
+	int64_t queued_time;		// us since boot
+	uint8_t qos;
+	bool retain;
+	char data[];
+};
+
+// Message handed to client and waiting for broker ack, its memory is held by client outbox meanwhile
+struct mqtt_inflight {
+	int msg_id;
+	uint8_t priority;
+	uint32_t bytes;
+	int64_t queued_time;
+};
+
+static SemaphoreHandle_t scheduler_mutex;
+static struct mqtt_message *queue_heads[NUM_MQTT_PRIORITIES];
+static struct mqtt_inflight inflight[MQTT_SCHEDULER_MAX_INFLIGHT];
+static struct mqtt_scheduler_stats stats;
+
+// Acks that came in before publish returned and slot was filled, oldest is overwritten
+static int early_acks[MQTT_SCHEDULER_MAX_INFLIGHT];
+static uint8_t next_early_ack;
+
+static const char *priority_names[NUM_MQTT_PRIORITIES] = { "alarm", "result", "state", "telemetry", "bulk" };
+
+// Newer message replaces queued one of same topic, messages of these classes carry whole state
+static const bool is_mergeable[NUM_MQTT_PRIORITIES] = { true, false, true, true, false };
+
+// --------------------------------------------------- Helper functions ----------------------------------------------
+
+static uint32_t get_message_bytes(const struct mqtt_message *message) { return sizeof(struct mqtt_message) + message->length; }
+
+static void record_latency(uint8_t priority, int64_t queued_time) {
+	uint32_t latency = (esp_timer_get_time() - queued_time) / 1000;
+	struct mqtt_priority_stats *priority_stats = &stats.priorities[priority];
+	priority_stats->sent++;
+	priority_stats->latency_sum += latency;
+	if(latency > priority_stats->max_latency) priority_stats->max_latency = latency;
+}
+
+static void free_message(uint8_t priority, struct mqtt_message *message) {
+	stats.bytes -= get_message_bytes(message);
+	stats.priorities[priority].depth--;
+	free(message);
+}
+
+// Drop oldest message of lowest class that may make room for message of priority
+static bool drop_for_room(enum mqtt_priority priority) {
+	for(int8_t i = NUM_MQTT_PRIORITIES - 1; i >= 0; --i) {
+		// Only telemetry pushes out its own class, older readings are superseded anyway
+		if(i < priority || (i == priority && i != MQTT_PRIORITY_TELEMETRY)) break;
+		if(queue_heads[i] == NULL) continue;
+
+		struct mqtt_message *message = queue_heads[i];
+		queue_heads[i] = message->next;
+		ESP_LOGW(MQTT_SCHEDULER_TAG, "Dropped %s message on %s for room", priority_names[i], message->topic);
+		stats.priorities[i].dropped++;
+		free_message(i, message);
+		return true;
+	}
+	return false;
+}
+
+// Put message into its class, replacing queued message of same topic if class allows it
+static void queue_message(enum mqtt_priority priority, struct mqtt_message *message) {
+	struct mqtt_message **link = &queue_heads[priority];
+	while(*link != NULL) {
+		if(is_mergeable[priority] && strcmp((*link)->topic, message->topic) == 0) {
+			// Replacement keeps place of queued message
+			struct mqtt_message *old = *link;
+			message->next = old->next;
+			*link = message;
+			stats.priorities[priority].merged++;
+			free_message(priority, old);
+			return;
+		}
+		link = &(*link)->next;
+	}
+	message->next = NULL;
+	*link = message;
+}
+
+static int8_t find_free_inflight() {
+	for(uint8_t i = 0; i < MQTT_SCHEDULER_MAX_INFLIGHT; ++i) {
+		if(inflight[i].msg_id == 0) return i;
+	}
+	return -1;
+}
+
+// Check if broker acked message before its slot was filled
+static bool take_early_ack(int msg_id) {
+	for(uint8_t i = 0; i < MQTT_SCHEDULER_MAX_INFLIGHT; ++i) {
+		if(early_acks[i] != msg_id) continue;
+		early_acks[i] = 0;
+		return true;
+	}
+	return false;
+}
+
+// Free slots of messages broker never acked, client gives up on them too
+static void expire_inflight() {
+	int64_t now = esp_timer_get_time();
+	for(uint8_t i = 0; i < MQTT_SCHEDULER_MAX_INFLIGHT; ++i) {
+		if(inflight[i].msg_id == 0 || now - inflight[i].queued_time < (int64_t) MQTT_SCHEDULER_ACK_TIMEOUT * 1000) continue;
+		ESP_LOGW(MQTT_SCHEDULER_TAG, "Message %d not acked", inflight[i].msg_id);
+		stats.priorities[inflight[i].priority].dropped++;
+		stats.bytes -= inflight[i].bytes;
+		inflight[i].msg_id = 0;
+		stats.inflight--;
+	}
+}
+
+// Hand highest priority message to client, returns false if nothing could be sent
+static bool send_next() {
+	xSemaphoreTake(scheduler_mutex, portMAX_DELAY);
+	int8_t slot = find_free_inflight();
+	uint8_t priority;
+	struct mqtt_message *message = NULL;
+	for(priority = 0; priority < NUM_MQTT_PRIORITIES && message == NULL; ++priority) message = queue_heads[priority];
+	priority--;
+
+	// QoS 0 messages don't wait for ack so they don't need slot
+	if(message == NULL || (message->qos > 0 && slot < 0)) {
+		xSemaphoreGive(scheduler_mutex);
+		return false;
+	}
+	queue_heads[priority] = message->next;
+	xSemaphoreGive(scheduler_mutex);
+
+	// Client may block on socket, queue stays open to other tasks meanwhile
+	int msg_id = esp_mqtt_client_publish(mqtt_client, message->topic, message->data, message->length, message->qos, message->retain);
+
+	xSemaphoreTake(scheduler_mutex, portMAX_DELAY);
+	if(msg_id < 0) {
+		// Connection dropped, message goes back to front of its class
+		message->next = queue_heads[priority];
+		queue_heads[priority] = message;
+		xSemaphoreGive(scheduler_mutex);
+		return false;
+	}
+
+	// Ack may have been handled while client was still returning from publish
+	if(message->qos > 0 && !take_early_ack(msg_id)) {
+		// Bytes stay counted while client outbox holds message
+		inflight[slot].msg_id = msg_id;
+		inflight[slot].priority = priority;
+		inflight[slot].bytes = get_message_bytes(message);
+		inflight[slot].queued_time = message->queued_time;
+		stats.inflight++;
+		stats.priorities[priority].depth--;
+		free(message);
+	} else {
+		record_latency(priority, message->queued_time);
+		free_message(priority, message);
+	}
+	xSemaphoreGive(scheduler_mutex);
+	return true;
+}
+
+static void mqtt_scheduler(void *parameter) {
+	for(;;) {
+		// Wake on new message, ack and connect
+		ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(MQTT_SCHEDULER_PERIOD));
+
+		xSemaphoreTake(scheduler_mutex, portMAX_DELAY);
+		expire_inflight();
+		xSemaphoreGive(scheduler_mutex);
+
+		// Queue holds while broker is unreachable, mergeable classes keep it from growing
+		while(is_mqtt_connected && send_next());
+	}
+}
+
+// --------------------------------------------------------------------------------------------------------------------
+
+void init_mqtt_scheduler() {
+	scheduler_mutex = xSemaphoreCreateMutex();
+	xTaskCreatePinnedToCore(mqtt_scheduler, "mqtt_scheduler_task", 3000, NULL, MQTT_SCHEDULER_TASK_PRIORITY, &mqtt_scheduler_task_handle, 0);
+}
+
+bool mqtt_scheduler_publish(const char *topic, const char *data, size_t length, int qos, bool retain, enum mqtt_priority priority) {
+	if(scheduler_mutex == NULL || topic == NULL || data == NULL) return false;
+	if(length == 0) length = strlen(data);
+
+	struct mqtt_message *message = malloc(sizeof(struct mqtt_message) + length);
+	if(message == NULL) return false;
+	message->topic = topic;
+	message->length = length;
+	message->queued_time = esp_timer_get_time();
+	message->qos = qos;
+	message->retain = retain;
+	memcpy(message->data, data, length);
+
+	xSemaphoreTake(scheduler_mutex, portMAX_DELAY);
+	bool is_queued = true;
+	while(stats.bytes + get_message_bytes(message) > MQTT_SCHEDULER_BUDGET) {
+		if(drop_for_room(priority)) continue;
+
+		ESP_LOGW(MQTT_SCHEDULER_TAG, "Outbox full, refused %s message on %s", priority_names[priority], topic);
+		stats.priorities[priority].dropped++;
+		is_queued = false;
+		break;
+	}
+
+	if(is_queued) {
+		stats.bytes += get_message_bytes(message);
+		if(stats.bytes > stats.peak_bytes) stats.peak_bytes = stats.bytes;
+		struct mqtt_priority_stats *priority_stats = &stats.priorities[priority];
+		if(++priority_stats->depth > priority_stats->max_depth) priority_stats->max_depth = priority_stats->depth;
+		queue_message(priority, message);
+	}
+	xSemaphoreGive(scheduler_mutex);
+
+	if(!is_queued) {
+		free(message);
+		return false;
+	}
+	xTaskNotifyGive(mqtt_scheduler_task_handle);
+	return true;
+}
+
+void mqtt_scheduler_acked(int msg_id) {
+	if(scheduler_mutex == NULL || msg_id <= 0) return;
+
+	xSemaphoreTake(scheduler_mutex, portMAX_DELAY);
+	bool is_found = false;
+	for(uint8_t i = 0; i < MQTT_SCHEDULER_MAX_INFLIGHT; ++i) {
+		if(inflight[i].msg_id != msg_id) continue;
+		record_latency(inflight[i].priority, inflight[i].queued_time);
+		stats.bytes -= inflight[i].bytes;
+		inflight[i].msg_id = 0;
+		stats.inflight--;
+		is_found = true;
+		break;
+	}
+	if(!is_found) {
+		early_acks[next_early_ack] = msg_id;
+		next_early_ack = (next_early_ack + 1) % MQTT_SCHEDULER_MAX_INFLIGHT;
+	}
+	xSemaphoreGive(scheduler_mutex);
+	xTaskNotifyGive(mqtt_scheduler_task_handle);
+}
+
+void mqtt_scheduler_wake() {
+	if(mqtt_scheduler_task_handle != NULL) xTaskNotifyGive(mqtt_scheduler_task_handle);
+}
+
+void mqtt_scheduler_get_stats(struct mqtt_scheduler_stats *stats_out) {
+	if(scheduler_mutex == NULL) {
+		memset(stats_out, 0, sizeof(struct mqtt_scheduler_stats));
+		return;
+	}
+	xSemaphoreTake(scheduler_mutex, portMAX_DELAY);
+	memcpy(stats_out, &stats, sizeof(stats));
+	xSemaphoreGive(scheduler_mutex);
+}
+
+const char* mqtt_scheduler_get_priority_name(enum mqtt_priority priority) { return priority_names[priority]; }
@@ -0,0 +1,73 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#ifndef COMPONENTS_NETWORK_MANAGER_MQTT_MQTT_SCHEDULER_H_
+#define COMPONENTS_NETWORK_MANAGER_MQTT_MQTT_SCHEDULER_H_
+
+#define MQTT_SCHEDULER_TAG "MQTT_SCHEDULER"
+
+// Memory of queued messages and messages waiting for broker ack, bytes
+#define MQTT_SCHEDULER_BUDGET (24 * 1024)
+
+// QoS 1 and 2 messages sent but not acked yet, more wait in queue
+#define MQTT_SCHEDULER_MAX_INFLIGHT 4
+
+// Messages not acked in time are counted as lost and free their inflight slot, ms
+#define MQTT_SCHEDULER_ACK_TIMEOUT 60000
+
+// Longest wait of scheduler task between checks, ms
+#define MQTT_SCHEDULER_PERIOD 1000
+
+// Message classes, lower value is sent first and may push out queued messages of higher value when budget is used up
+enum mqtt_priority {
+	MQTT_PRIORITY_ALARM,		// Alarm snapshots, newer replaces queued one
+	MQTT_PRIORITY_RESULT,		// Command results, never replaced
+	MQTT_PRIORITY_STATE,		// Equipment and recipe state, newer replaces queued one
+	MQTT_PRIORITY_TELEMETRY,	// Sensor data, newer replaces queued one and oldest is dropped for room
+	MQTT_PRIORITY_BULK,			// History chunks, never replaced and pushed out first so they can't push out state
+	NUM_MQTT_PRIORITIES
+};
+
+struct mqtt_priority_stats {
+	uint16_t depth;				// Messages queued now
+	uint16_t max_depth;
+	uint32_t sent;
+	uint32_t merged;			// Queued messages replaced by newer one of same topic
+	uint32_t dropped;			// Messages pushed out or refused for budget, or not acked in time
+	uint32_t latency_sum;		// ms from queueing to broker ack, or to send for QoS 0
+	uint32_t max_latency;
+};
+
+struct mqtt_scheduler_stats {
+	uint32_t bytes;				// Budget used now
+	uint32_t peak_bytes;
+	uint8_t inflight;
+	struct mqtt_priority_stats priorities[NUM_MQTT_PRIORITIES];
+};
+
+#endif /* COMPONENTS_NETWORK_MANAGER_MQTT_MQTT_SCHEDULER_H_ */
+
+// Scheduler task handle
+TaskHandle_t mqtt_scheduler_task_handle;
+
+// Create queue and start scheduler task
+void init_mqtt_scheduler();
+
+// Queue message, data is copied and length 0 takes length of string
+// Never blocks, returns false if message didn't fit in budget or scheduler or topic isn't set up yet
+bool mqtt_scheduler_publish(const char *topic, const char *data, size_t length, int qos, bool retain, enum mqtt_priority priority);
+
+// Report broker ack of message, called from MQTT event handler
+void mqtt_scheduler_acked(int msg_id);
+
+// Wake scheduler, called once broker connects
+void mqtt_scheduler_wake();
+
+// Get queue depths, drops and latencies
+void mqtt_scheduler_get_stats(struct mqtt_scheduler_stats *stats);
+
+// Get name of priority used in reports
+const char* mqtt_scheduler_get_priority_name(enum mqtt_priority priority);
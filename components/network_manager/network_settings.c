@@ -9,7 +9,6 @@
 #include "nvs_namespace_keys.h"
 #include "access_point.h"
 #include "wifi_connect.h"
-#include "mqtt_manager.h"
 
 struct Network_Settings* get_network_settings() { return &network_settings; }
 
@@ -21,22 +20,25 @@ void init_network_connections() {
 	if(!nvs_get_uint8(NETWORK_SETTINGS_NVS_NAMESPACE, INIT_PROPERTIES_KEY, &init_properties_status) || init_properties_status == 0) {
 		ESP_LOGI(TAG, "Properties not initialized. Starting access point");
 
+		bool is_connected;
 		do {
 			// Creates access point for mobile connection to receive wifi SSID and pw, broker IP address, and station name
 			init_access_point_mode();
-		} while(!connect_wifi());
+			is_connected = connect_wifi();
+
+			// Credentials are wrong, stop reconnecting before asking again
+			if(!is_connected) stop_wifi();
+		} while(!is_connected);
 
 		push_network_settings();
 
 	} else {
 		pull_network_settings();
+
+		// Wifi keeps reconnecting in background if router is down
 		connect_wifi();
 	}
 
-	// Initialize and connect to MQTT
-	init_mqtt();
-	mqtt_connect();
-
 	ESP_LOGI(TAG, "Init properties done");
 }
 
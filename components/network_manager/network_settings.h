@@ -30,7 +30,7 @@ struct Network_Settings network_settings;
 // Get struct
 struct Network_Settings* get_network_settings();
 
-// Initialize wifi and mqtt connections
+// Initialize wifi connection, runs access point until network settings are received
 void init_network_connections();
 
 // Push/pull network settings to/from NVS
@@ -1,4 +1,5 @@
 #include "ota.h"
+#include "nvs_manager.h"
 
 char *url_buf = {0};
 bool  is_ota_success_on_bootup = false;
@@ -204,7 +205,8 @@ void ota_task(void *pvParameter)
    /* Publish OTA successful message over MQTT */
    vTaskDelay(2000 / portTICK_PERIOD_MS);
 
-   /* Restart ESP with latest firmware */
+   /* Write pending settings and restart ESP with latest firmware */
+   nvs_flush();
    esp_restart();
    return ;
 }
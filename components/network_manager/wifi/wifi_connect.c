@@ -3,83 +3,200 @@
 #include <esp_err.h>
 #include <esp_log.h>
 #include <esp_event.h>
+#include <esp_system.h>
+#include <esp_timer.h>
 #include <esp_wifi.h>
+#include <tcpip_adapter.h>
+#include <sdkconfig.h>
 #include <string.h>
 #include <driver/gpio.h>
 #include "ports.h"
 
 #include "network_settings.h"
+#include "nvs_manager.h"
+#include "nvs_namespace_keys.h"
+#include "task_priorities.h"
+
+static struct wifi_cache cache;
+static bool is_cache_valid;
+static bool is_wifi_started;
+static bool is_fast_connect;
+static uint8_t num_failures;		// Failed attempts since last connect
+static int64_t connect_start;		// Start of connect or outage, us since boot
+static struct wifi_stats stats = { .time_to_ip = -1 };
+
+// Cached access point is tried first, full scan finds best access point of network if it moved or went down
+static void set_sta_config(bool is_fast) {
+	wifi_config_t wifi_config;
+	memset(&wifi_config, 0, sizeof(wifi_config));
+	strcpy((char*)(wifi_config.sta.ssid), get_network_settings()->wifi_ssid);
+	strcpy((char*)(wifi_config.sta.password), get_network_settings()->wifi_pw);
+
+	if(is_fast) {
+		wifi_config.sta.scan_method = WIFI_FAST_SCAN;
+		wifi_config.sta.bssid_set = true;
+		memcpy(wifi_config.sta.bssid, cache.bssid, sizeof(cache.bssid));
+		wifi_config.sta.channel = cache.channel;
+	} else {
+		wifi_config.sta.scan_method = WIFI_ALL_CHANNEL_SCAN;
+		wifi_config.sta.sort_method = WIFI_CONNECT_AP_BY_SIGNAL;
+	}
+	esp_wifi_set_config(ESP_IF_WIFI_STA, &wifi_config);
+
+#ifdef CONFIG_WIFI_STATIC_IP
+	// Lease is reused as static IP only on cached access point, full scan goes back to DHCP
+	if(is_fast) {
+		tcpip_adapter_ip_info_t ip_info = { .ip.addr = cache.ip, .netmask.addr = cache.netmask, .gw.addr = cache.gateway };
+		tcpip_adapter_dns_info_t dns_info = { .ip.u_addr.ip4.addr = cache.dns, .ip.type = IPADDR_TYPE_V4 };
+		tcpip_adapter_dhcpc_stop(TCPIP_ADAPTER_IF_STA);
+		tcpip_adapter_set_ip_info(TCPIP_ADAPTER_IF_STA, &ip_info);
+		tcpip_adapter_set_dns_info(TCPIP_ADAPTER_IF_STA, TCPIP_ADAPTER_DNS_MAIN, &dns_info);
+	} else {
+		tcpip_adapter_dhcpc_start(TCPIP_ADAPTER_IF_STA);
+	}
+#endif
+
+	is_fast_connect = is_fast;
+	ESP_LOGI(WIFI_TAG, "%s", is_fast ? "Fast connect to cached access point" : "Full scan connect");
+}
+
+// Store access point and lease of connection, NVS skips write if nothing changed
+static void store_cache(const tcpip_adapter_ip_info_t *ip_info) {
+	wifi_ap_record_t ap_info;
+	if(esp_wifi_sta_get_ap_info(&ap_info) != ESP_OK) return;
+
+	tcpip_adapter_dns_info_t dns_info;
+	memset(&dns_info, 0, sizeof(dns_info));
+	tcpip_adapter_get_dns_info(TCPIP_ADAPTER_IF_STA, TCPIP_ADAPTER_DNS_MAIN, &dns_info);
+
+	strncpy(cache.ssid, get_network_settings()->wifi_ssid, sizeof(cache.ssid));
+	memcpy(cache.bssid, ap_info.bssid, sizeof(cache.bssid));
+	cache.channel = ap_info.primary;
+	cache.ip = ip_info->ip.addr;
+	cache.netmask = ip_info->netmask.addr;
+	cache.gateway = ip_info->gw.addr;
+	cache.dns = dns_info.ip.u_addr.ip4.addr;
+	is_cache_valid = true;
+
+	nvs_handle_t *handle = nvs_get_handle(NETWORK_SETTINGS_NVS_NAMESPACE);
+	nvs_add_settings(handle, WIFI_CACHE_KEY, WIFI_CACHE_VERSION, &cache, sizeof(cache));
+	nvs_commit_data(handle);
+}
+
+// Exponential backoff with jitter so devices behind same router don't reconnect in lockstep
+static uint32_t get_reconnect_delay() {
+	uint8_t shift = num_failures > 0 ? num_failures - 1 : 0;
+	uint32_t delay = CONFIG_WIFI_RECONNECT_MIN_DELAY << (shift < 16 ? shift : 16);
+	if(delay > CONFIG_WIFI_RECONNECT_MAX_DELAY) delay = CONFIG_WIFI_RECONNECT_MAX_DELAY;
+	return delay / 2 + esp_random() % (delay / 2 + 1);
+}
+
+static void wifi_supervisor(void *parameter) {
+	for(;;) {
+		// Wait till connection attempt fails or connection drops
+		ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+		if(!is_wifi_started) continue;
+
+		uint32_t delay = get_reconnect_delay();
+		ESP_LOGI(WIFI_TAG, "Reconnecting in %d ms, attempt %d", delay, num_failures + 1);
+		vTaskDelay(pdMS_TO_TICKS(delay));
+		if(!is_wifi_started || is_wifi_connected) continue;
+
+		set_sta_config(is_cache_valid && num_failures < WIFI_FAST_CONNECT_ATTEMPTS);
+		esp_wifi_connect();
+	}
+}
 
 static void wifi_event_handler(void *arg, esp_event_base_t event_base,		// WiFi Event Handler
 		int32_t event_id, void *event_data) {
-	const char *TAG = "Event_Handler";
-	ESP_LOGI(TAG, "Event dispatched from event loop base=%s, event_id=%d\n",
+	ESP_LOGI(WIFI_TAG, "Event dispatched from event loop base=%s, event_id=%d\n",
 			event_base, event_id);
 	// Check Event Type
 	if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
 		ip_event_got_ip_t *event = (ip_event_got_ip_t*) event_data;
-		ESP_LOGI(TAG, "got IP:%s", ip4addr_ntoa(&event->ip_info.ip));
-		retryNumber = 0;
-		is_wifi_connected = true; 
+		ESP_LOGI(WIFI_TAG, "got IP:%s", ip4addr_ntoa(&event->ip_info.ip));
+
+		if(stats.time_to_ip >= 0) stats.reconnects++;
+		stats.time_to_ip = (esp_timer_get_time() - connect_start) / 1000;
+		stats.is_fast_connect = is_fast_connect;
+		ESP_LOGI(WIFI_TAG, "Time to IP: %d ms", stats.time_to_ip);
+
+		num_failures = 0;
+		is_wifi_connected = true;
+		store_cache(&event->ip_info);
+		xEventGroupClearBits(wifi_event_group, WIFI_FAIL_BIT);
 		xEventGroupSetBits(wifi_event_group, WIFI_CONNECTED_BIT);
 	} else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START) {
-		ESP_ERROR_CHECK(esp_wifi_connect());
-		retryNumber = 0;
+		esp_wifi_connect();
+		num_failures = 0;
 	} else if (event_base == WIFI_EVENT
 			&& event_id == WIFI_EVENT_STA_DISCONNECTED) {
-		// Attempt Reconnection
-		if (retryNumber < RETRYMAX) {
-			esp_wifi_connect();
-			retryNumber++;
-		} else {
-			xEventGroupSetBits(wifi_event_group, WIFI_FAIL_BIT);
-		}
+		// Outage starts when connection drops, not when reconnect fails
+		if(is_wifi_connected) connect_start = esp_timer_get_time();
+		else if(num_failures < UINT8_MAX) num_failures++;
+
 		is_wifi_connected = false;
-		ESP_LOGI(TAG, "WIFI Connection Failed; Reconnecting....\n");
+		xEventGroupClearBits(wifi_event_group, WIFI_CONNECTED_BIT);
+		if(num_failures >= RETRYMAX) xEventGroupSetBits(wifi_event_group, WIFI_FAIL_BIT);
+
+		// Attempt Reconnection
+		xTaskNotifyGive(wifi_supervisor_task_handle);
+		ESP_LOGI(WIFI_TAG, "WIFI Connection Failed; Reconnecting....\n");
 	}
 }
 
 bool connect_wifi() {
-	const char *TAG = "WIFI";
-	ESP_LOGI(TAG, "Starting connect");
+	ESP_LOGI(WIFI_TAG, "Starting connect");
 
-	is_wifi_connected = false; 
+	is_wifi_connected = false;
+	num_failures = 0;
+	connect_start = esp_timer_get_time();
+
+	// Handlers and supervisor outlive stop_wifi, access point mode may stop and connect again
+	if(wifi_event_group == NULL) {
+		wifi_event_group = xEventGroupCreate();
+		ESP_ERROR_CHECK(esp_event_handler_register(WIFI_EVENT, ESP_EVENT_ANY_ID, &wifi_event_handler, NULL));
+		ESP_ERROR_CHECK(esp_event_handler_register(IP_EVENT, IP_EVENT_STA_GOT_IP, &wifi_event_handler, NULL));
+		xTaskCreatePinnedToCore(wifi_supervisor, "wifi_supervisor_task", 2500, NULL, WIFI_SUPERVISOR_TASK_PRIORITY, &wifi_supervisor_task_handle, 0);
+	}
+	xEventGroupClearBits(wifi_event_group, WIFI_CONNECTED_BIT | WIFI_FAIL_BIT);
+
+	// Cache of other network is ignored, network settings may have changed in access point mode
+	is_cache_valid = nvs_get_settings(NETWORK_SETTINGS_NVS_NAMESPACE, WIFI_CACHE_KEY, &cache, sizeof(cache)) != 0
+			&& strncmp(cache.ssid, get_network_settings()->wifi_ssid, sizeof(cache.ssid)) == 0;
 
 	const wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
-	wifi_event_group = xEventGroupCreate();
 	ESP_ERROR_CHECK(esp_wifi_init(&cfg));
-	ESP_ERROR_CHECK(esp_event_handler_register(WIFI_EVENT, ESP_EVENT_ANY_ID, &wifi_event_handler, NULL));
-	ESP_ERROR_CHECK(esp_event_handler_register(IP_EVENT, IP_EVENT_STA_GOT_IP, &wifi_event_handler, NULL));
-	ESP_ERROR_CHECK(esp_event_handler_register(WIFI_EVENT, WIFI_EVENT_STA_DISCONNECTED, &wifi_event_handler, NULL));
 	ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
+	set_sta_config(is_cache_valid);
 
-	wifi_config_t wifi_config;
-	memset(&wifi_config, 0, sizeof(wifi_config));
-	strcpy((char*)(wifi_config.sta.ssid), get_network_settings()->wifi_ssid);
-	strcpy((char*)(wifi_config.sta.password), get_network_settings()->wifi_pw);
-
-	ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config));
+	is_wifi_started = true;
 	ESP_ERROR_CHECK(esp_wifi_start());
 
-	// Do not proceed until WiFi is connected
+	// Do not proceed until WiFi is connected or failed often enough
 	EventBits_t sta_event_bits;
 	sta_event_bits = xEventGroupWaitBits(wifi_event_group, WIFI_CONNECTED_BIT | WIFI_FAIL_BIT, pdFALSE, pdFALSE, portMAX_DELAY);
 
 	// Return and log based on event bit
 	if ((sta_event_bits & WIFI_CONNECTED_BIT) != 0) {
-		ESP_LOGI(TAG,  "Connected");
-		is_wifi_connected = true;
+		ESP_LOGI(WIFI_TAG,  "Connected");
 		return true;
 	}
-	if ((sta_event_bits & WIFI_FAIL_BIT) != 0) {
-		ESP_LOGE(TAG, "Connection Failed");
-	} else {
-		ESP_LOGE(TAG, "Unexpected Event");
-	}
-	is_wifi_connected = false;
+	ESP_LOGE(WIFI_TAG, "Connection Failed, reconnecting in background");
 	return false;
 }
 
+void stop_wifi() {
+	is_wifi_started = false;
+	esp_wifi_stop();
+	esp_wifi_deinit();
+	is_wifi_connected = false;
+}
+
 bool get_is_wifi_connected() {
-	return is_wifi_connected; 
+	return is_wifi_connected;
+}
+
+void get_wifi_stats(struct wifi_stats *stats_out) {
+	memcpy(stats_out, &stats, sizeof(stats));
 }
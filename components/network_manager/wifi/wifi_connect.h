@@ -1,23 +1,65 @@
 #include <stdbool.h>
+#include <stdint.h>
 #include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
 #include <freertos/event_groups.h>
 #include <driver/gpio.h>
 
+#ifndef COMPONENTS_NETWORK_MANAGER_WIFI_WIFI_CONNECT_H_
+#define COMPONENTS_NETWORK_MANAGER_WIFI_WIFI_CONNECT_H_
+
+#define WIFI_TAG "WIFI"
+
 // WiFi bits
 #define WIFI_CONNECTED_BIT (1<<0)
 #define WIFI_FAIL_BIT      (1<<1)
 
-#define RETRYMAX 5 // WiFi MAX Reconnection Attempts
+#define RETRYMAX 5 // Failed attempts before connect is reported as failed, reconnecting carries on
+
+// Attempts on cached access point before falling back to full scan
+#define WIFI_FAST_CONNECT_ATTEMPTS 2
+
+// NVS key of last access point and lease
+#define WIFI_CACHE_KEY "WIFI_CACHE"
+#define WIFI_CACHE_VERSION 1
+
+// Last access point and DHCP lease, lets reconnect skip scan and optionally DHCP
+struct wifi_cache {
+	char ssid[32];				// Network cache belongs to, not terminated if 32 characters long
+	uint8_t bssid[6];
+	uint8_t channel;
+	uint32_t ip;
+	uint32_t netmask;
+	uint32_t gateway;
+	uint32_t dns;
+};
 
-int retryNumber;  // WiFi Reconnection Attempts
+// Connection timings reported in telemetry
+struct wifi_stats {
+	int32_t time_to_ip;			// ms from start of last connect or outage to IP, -1 before first connect
+	bool is_fast_connect;		// Whether last connect used cached access point
+	uint16_t reconnects;		// Connects after first one
+};
+
+#endif /* COMPONENTS_NETWORK_MANAGER_WIFI_WIFI_CONNECT_H_ */
 
 bool is_wifi_connected; // Is wifi connected
 
 // WiFi Coordination with Event Group
 EventGroupHandle_t wifi_event_group;
 
-// Connect ESP32 to wifi
+// Reconnect task handle
+TaskHandle_t wifi_supervisor_task_handle;
+
+// Connect ESP32 to wifi, tries cached access point first
+// Returns false if RETRYMAX attempts failed, wifi keeps reconnecting in background until stop_wifi is called
 bool connect_wifi();
 
+// Stop wifi and reconnecting
+void stop_wifi();
+
 //Getter for is_wifi_connected//
 bool get_is_wifi_connected();
+
+// Get connection timings
+void get_wifi_stats(struct wifi_stats *stats);
@@ -4,383 +4,444 @@
 #include <esp_system.h>
 #include <esp_event.h>
 #include <esp_log.h>
+#include <esp_timer.h>
 #include <nvs_flash.h>
+#include <esp32/rom/crc.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
 #include <stdlib.h>
 #include <string.h>
 
-void init_nvs() {
-	// Check if space available in NVS, if not reset NVS
-	esp_err_t ret = ret = nvs_flash_init();
-	if (ret == ESP_ERR_NVS_NO_FREE_PAGES
-			|| ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
-		ESP_ERROR_CHECK(nvs_flash_erase());
-		ret = nvs_flash_init();
+// Namespaces are opened once and stay open
+struct nvs_namespace {
+	char name[NVS_NAME_LENGTH];
+	nvs_handle_t handle;
+	bool is_committed;			// Namespace had values written in current flush
+};
+
+// Cached value, dirty values are waiting for next flush
+struct nvs_cache_entry {
+	struct nvs_namespace *namespace;
+	char key[NVS_NAME_LENGTH];
+	nvs_type_t type;
+	void *data;
+	size_t length;
+	bool is_dirty;
+	struct nvs_cache_entry *next;
+};
+
+static struct nvs_namespace namespaces[NVS_MAX_NAMESPACES];
+static uint8_t num_namespaces;
+static struct nvs_cache_entry *cache;
+
+static struct nvs_write_stats stats;
+
+// Cache is used by every task storing settings and by commit timer
+static SemaphoreHandle_t nvs_mutex;
+
+static esp_timer_handle_t commit_timer;
+static bool is_commit_pending;
+static int64_t first_commit_request;
+
+// --------------------------------------------------- Helper functions ----------------------------------------------
+
+static void nvs_log_set_error(esp_err_t err) {
+	if(err == ESP_ERR_NVS_NOT_ENOUGH_SPACE) {
+		ESP_LOGE(NVS_TAG, "NOT ENOUGH STORAGE");
+		// TODO take action, probably restart
+	} else {
+		ESP_LOGE(NVS_TAG, "Failed putting data in NVS, error:  %d", err);
 	}
-	ESP_ERROR_CHECK(ret);
 }
 
-void nvs_clear() {
-	ESP_ERROR_CHECK(nvs_flash_erase());
-	ESP_ERROR_CHECK(nvs_flash_init());
-}
-
-nvs_handle_t* nvs_get_handle(char *namespace) {
-	nvs_handle_t *handle = malloc(sizeof(nvs_handle_t));
-	nvs_open(namespace, NVS_READWRITE, handle);
-	return handle;
-}
+// Get open namespace, opens it on first use
+static struct nvs_namespace* nvs_find_namespace(const char *name) {
+	for(uint8_t i = 0; i < num_namespaces; ++i) {
+		if(strcmp(namespaces[i].name, name) == 0) return &namespaces[i];
+	}
 
-void nvs_add_uint8(nvs_handle_t *handle, char *key, uint8_t data) {
-	esp_err_t err = nvs_set_u8(*handle, key, data);
+	if(num_namespaces >= NVS_MAX_NAMESPACES) {
+		ESP_LOGE(NVS_TAG, "More than %d namespaces, unable to open %s", NVS_MAX_NAMESPACES, name);
+		return NULL;
+	}
 
+	struct nvs_namespace *namespace = &namespaces[num_namespaces];
+	esp_err_t err = nvs_open(name, NVS_READWRITE, &namespace->handle);
 	if(err != ESP_OK) {
-		if(err == ESP_ERR_NVS_NOT_ENOUGH_SPACE) {
-			ESP_LOGE(NVS_TAG, "NOT ENOUGH STORAGE");
-			// TODO take action, probably restart
-		} else {
-			ESP_LOGE(NVS_TAG, "Failed putting data in NVS, error:  %d", err);
-		}
+		ESP_LOGI(NVS_TAG, "Unable to open NVS");
+		return NULL;
 	}
+	strncpy(namespace->name, name, NVS_NAME_LENGTH - 1);
+	namespace->is_committed = false;
+	num_namespaces++;
+	return namespace;
 }
-void nvs_add_int8(nvs_handle_t *handle, char *key, int8_t data) {
-	esp_err_t err = nvs_set_i8(*handle, key, data);
 
-	if(err != ESP_OK) {
-		if(err == ESP_ERR_NVS_NOT_ENOUGH_SPACE) {
-			ESP_LOGE(NVS_TAG, "NOT ENOUGH STORAGE");
-			// TODO take action, probably restart
-		} else {
-			ESP_LOGE(NVS_TAG, "Failed putting data in NVS, error:  %d", err);
-		}
+static struct nvs_namespace* nvs_find_handle_namespace(nvs_handle_t *handle) {
+	for(uint8_t i = 0; i < num_namespaces; ++i) {
+		if(&namespaces[i].handle == handle) return &namespaces[i];
 	}
+	return NULL;
 }
-void nvs_add_uint16(nvs_handle_t *handle, char *key, uint16_t data) {
-	esp_err_t err = nvs_set_u16(*handle, key, data);
 
-	if(err != ESP_OK) {
-		if(err == ESP_ERR_NVS_NOT_ENOUGH_SPACE) {
-			ESP_LOGE(NVS_TAG, "NOT ENOUGH STORAGE");
-			// TODO take action, probably restart
-		} else {
-			ESP_LOGE(NVS_TAG, "Failed putting data in NVS, error:  %d", err);
-		}
+static struct nvs_cache_entry* nvs_find_entry(struct nvs_namespace *namespace, const char *key) {
+	for(struct nvs_cache_entry *entry = cache; entry != NULL; entry = entry->next) {
+		if(entry->namespace == namespace && strcmp(entry->key, key) == 0) return entry;
 	}
+	return NULL;
 }
-void nvs_add_int16(nvs_handle_t *handle, char *key, int16_t data) {
-	esp_err_t err = nvs_set_i16(*handle, key, data);
 
-	if(err != ESP_OK) {
-		if(err == ESP_ERR_NVS_NOT_ENOUGH_SPACE) {
-			ESP_LOGE(NVS_TAG, "NOT ENOUGH STORAGE");
-			// TODO take action, probably restart
-		} else {
-			ESP_LOGE(NVS_TAG, "Failed putting data in NVS, error:  %d", err);
-		}
+static void nvs_set_entry_data(struct nvs_cache_entry *entry, nvs_type_t type, const void *data, size_t length) {
+	if(entry->length != length) {
+		free(entry->data);
+		entry->data = malloc(length);
 	}
+	memcpy(entry->data, data, length);
+	entry->type = type;
+	entry->length = length;
 }
-void nvs_add_uint32(nvs_handle_t *handle, char *key, uint32_t data) {
-	esp_err_t err = nvs_set_u32(*handle, key, data);
 
-	if(err != ESP_OK) {
-		if(err == ESP_ERR_NVS_NOT_ENOUGH_SPACE) {
-			ESP_LOGE(NVS_TAG, "NOT ENOUGH STORAGE");
-			// TODO take action, probably restart
-		} else {
-			ESP_LOGE(NVS_TAG, "Failed putting data in NVS, error:  %d", err);
-		}
-	}
+static struct nvs_cache_entry* nvs_add_entry(struct nvs_namespace *namespace, const char *key, nvs_type_t type, const void *data, size_t length) {
+	struct nvs_cache_entry *entry = calloc(1, sizeof(struct nvs_cache_entry));
+	entry->namespace = namespace;
+	strncpy(entry->key, key, NVS_NAME_LENGTH - 1);
+	nvs_set_entry_data(entry, type, data, length);
+	entry->next = cache;
+	cache = entry;
+	return entry;
 }
-void nvs_add_int32(nvs_handle_t *handle, char *key, int32_t data) {
-	esp_err_t err = nvs_set_i32(*handle, key, data);
 
-	if(err != ESP_OK) {
-		if(err == ESP_ERR_NVS_NOT_ENOUGH_SPACE) {
-			ESP_LOGE(NVS_TAG, "NOT ENOUGH STORAGE");
-			// TODO take action, probably restart
-		} else {
-			ESP_LOGE(NVS_TAG, "Failed putting data in NVS, error:  %d", err);
+static void nvs_remove_entry(struct nvs_cache_entry *entry) {
+	for(struct nvs_cache_entry **link = &cache; *link != NULL; link = &(*link)->next) {
+		if(*link == entry) {
+			*link = entry->next;
+			break;
 		}
 	}
+	free(entry->data);
+	free(entry);
 }
-void nvs_add_uint64(nvs_handle_t *handle, char *key, uint64_t data) {
-	esp_err_t err = nvs_set_u64(*handle, key, data);
 
-	if(err != ESP_OK) {
-		if(err == ESP_ERR_NVS_NOT_ENOUGH_SPACE) {
-			ESP_LOGE(NVS_TAG, "NOT ENOUGH STORAGE");
-			// TODO take action, probably restart
-		} else {
-			ESP_LOGE(NVS_TAG, "Failed putting data in NVS, error:  %d", err);
-		}
+// Read value of any type from flash, length holds size of data and is set to size of value
+static esp_err_t nvs_read_value(nvs_handle_t handle, const char *key, nvs_type_t type, void *data, size_t *length) {
+	switch(type) {
+		case NVS_TYPE_U8: return nvs_get_u8(handle, key, data);
+		case NVS_TYPE_I8: return nvs_get_i8(handle, key, data);
+		case NVS_TYPE_U16: return nvs_get_u16(handle, key, data);
+		case NVS_TYPE_I16: return nvs_get_i16(handle, key, data);
+		case NVS_TYPE_U32: return nvs_get_u32(handle, key, data);
+		case NVS_TYPE_I32: return nvs_get_i32(handle, key, data);
+		case NVS_TYPE_U64: return nvs_get_u64(handle, key, data);
+		case NVS_TYPE_I64: return nvs_get_i64(handle, key, data);
+		case NVS_TYPE_STR: return nvs_get_str(handle, key, data, length);
+		default: return nvs_get_blob(handle, key, data, length);
 	}
 }
-void nvs_add_int64(nvs_handle_t *handle, char *key, int64_t data) {
-	esp_err_t err = nvs_set_i64(*handle, key, data);
 
-	if(err != ESP_OK) {
-		if(err == ESP_ERR_NVS_NOT_ENOUGH_SPACE) {
-			ESP_LOGE(NVS_TAG, "NOT ENOUGH STORAGE");
-			// TODO take action, probably restart
-		} else {
-			ESP_LOGE(NVS_TAG, "Failed putting data in NVS, error:  %d", err);
-		}
+static esp_err_t nvs_write_value(nvs_handle_t handle, const char *key, nvs_type_t type, const void *data, size_t length) {
+	switch(type) {
+		case NVS_TYPE_U8: return nvs_set_u8(handle, key, *(uint8_t*) data);
+		case NVS_TYPE_I8: return nvs_set_i8(handle, key, *(int8_t*) data);
+		case NVS_TYPE_U16: return nvs_set_u16(handle, key, *(uint16_t*) data);
+		case NVS_TYPE_I16: return nvs_set_i16(handle, key, *(int16_t*) data);
+		case NVS_TYPE_U32: return nvs_set_u32(handle, key, *(uint32_t*) data);
+		case NVS_TYPE_I32: return nvs_set_i32(handle, key, *(int32_t*) data);
+		case NVS_TYPE_U64: return nvs_set_u64(handle, key, *(uint64_t*) data);
+		case NVS_TYPE_I64: return nvs_set_i64(handle, key, *(int64_t*) data);
+		case NVS_TYPE_STR: return nvs_set_str(handle, key, data);
+		default: return nvs_set_blob(handle, key, data, length);
 	}
 }
-void nvs_add_float(nvs_handle_t *handle, char *key, float data) {
-	const size_t FLOAT_SIZE = 10;
-	char float_str[FLOAT_SIZE];
-	snprintf(float_str, FLOAT_SIZE, "%.2f", data);
 
-	esp_err_t err = nvs_set_str(*handle, key, float_str);
-
-	if(err != ESP_OK) {
-		if(err == ESP_ERR_NVS_NOT_ENOUGH_SPACE) {
-			ESP_LOGE(NVS_TAG, "NOT ENOUGH STORAGE");
-			// TODO take action, probably restart
-		} else {
-			ESP_LOGE(NVS_TAG, "Failed putting data in NVS, error:  %d", err);
-		}
-	}
+// Get size of stored string or blob, size of type otherwise
+static esp_err_t nvs_read_length(nvs_handle_t handle, const char *key, nvs_type_t type, size_t *length) {
+	if(type == NVS_TYPE_STR) return nvs_get_str(handle, key, NULL, length);
+	if(type == NVS_TYPE_BLOB) return nvs_get_blob(handle, key, NULL, length);
+	*length = type & 0x0F;
+	return ESP_OK;
 }
-void nvs_add_string(nvs_handle_t *handle, char *key, char *data) {
-	esp_err_t err = nvs_set_str(*handle, key, data);
 
-	if(err != ESP_OK) {
-		if(err == ESP_ERR_NVS_NOT_ENOUGH_SPACE) {
-			ESP_LOGE(NVS_TAG, "NOT ENOUGH STORAGE");
-			// TODO take action, probably restart
-		} else {
-			ESP_LOGE(NVS_TAG, "Failed putting data in NVS, error:  %d", err);
-		}
-	}
+// Read value from flash into new cache entry, NULL if value isn't stored
+static struct nvs_cache_entry* nvs_load_entry(struct nvs_namespace *namespace, const char *key, nvs_type_t type) {
+	size_t length;
+	esp_err_t err = nvs_read_length(namespace->handle, key, type, &length);
+	if(err != ESP_OK) return NULL;
+
+	void *data = malloc(length);
+	err = nvs_read_value(namespace->handle, key, type, data, &length);
+	struct nvs_cache_entry *entry = err == ESP_OK ? nvs_add_entry(namespace, key, type, data, length) : NULL;
+	free(data);
+	return entry;
 }
 
-void nvs_commit_data(nvs_handle_t *handle) {
-	esp_err_t err = nvs_commit(*handle);
+// Cache value and mark it for next flush, values equal to stored value aren't written again
+static void nvs_cache_set(nvs_handle_t *handle, const char *key, nvs_type_t type, const void *data, size_t length) {
+	xSemaphoreTake(nvs_mutex, portMAX_DELAY);
+	struct nvs_namespace *namespace = nvs_find_handle_namespace(handle);
+	if(namespace == NULL) {
+		xSemaphoreGive(nvs_mutex);
+		ESP_LOGE(NVS_TAG, "Failed putting data in NVS, handle not open");
+		return;
+	}
 
-	nvs_close(*handle);
-	free(handle);
+	struct nvs_cache_entry *entry = nvs_find_entry(namespace, key);
+	if(entry == NULL) entry = nvs_load_entry(namespace, key, type);
 
-	if(err != ESP_OK) {
-		ESP_LOGI(NVS_TAG, "Failed committing data to NVS");
+	if(entry != NULL && entry->type == type && entry->length == length && memcmp(entry->data, data, length) == 0) {
+		stats.skipped++;
+		if(!entry->is_dirty && entry->length > NVS_CACHE_MAX_VALUE) nvs_remove_entry(entry);
+	} else {
+		if(entry == NULL) entry = nvs_add_entry(namespace, key, type, data, length);
+		else nvs_set_entry_data(entry, type, data, length);
+		entry->is_dirty = true;
 	}
+	xSemaphoreGive(nvs_mutex);
 }
 
-bool nvs_get_uint8(char *namespace, char *key, uint8_t *data) {
-	nvs_handle_t handle;
-	esp_err_t err = nvs_open(namespace, NVS_READONLY, &handle);
-	if(err != ESP_OK) {
-		ESP_LOGI(NVS_TAG, "Unable to open NVS");
-		nvs_close(handle);
+// Get value from cache, reads flash and caches value on first use
+static bool nvs_cache_get(const char *namespace_name, const char *key, nvs_type_t type, void *data, size_t *length) {
+	xSemaphoreTake(nvs_mutex, portMAX_DELAY);
+	struct nvs_namespace *namespace = nvs_find_namespace(namespace_name);
+	if(namespace == NULL) {
+		xSemaphoreGive(nvs_mutex);
 		return false;
 	}
 
-	err = nvs_get_u8(handle, key, data);
+	bool is_found = false;
+	struct nvs_cache_entry *entry = nvs_find_entry(namespace, key);
+	if(entry != NULL && entry->type == type) {
+		if(entry->length <= *length) {
+			memcpy(data, entry->data, entry->length);
+			is_found = true;
+		}
+		*length = entry->length;
+	} else if(entry == NULL) {
+		esp_err_t err = nvs_read_value(namespace->handle, key, type, data, length);
+		is_found = err == ESP_OK;
+		if(!is_found) ESP_LOGI(NVS_TAG, "failed getting data from NVS. Error: %d, namespace: %s, key: %s", err, namespace_name, key);
+		else if(*length <= NVS_CACHE_MAX_VALUE) nvs_add_entry(namespace, key, type, data, *length);
+	}
+	xSemaphoreGive(nvs_mutex);
+	return is_found;
+}
 
-	nvs_close(handle);
+// Write dirty values and commit every namespace they are in, mutex has to be held
+// Returns false if any value couldn't be written
+static bool nvs_write_pending() {
+	uint32_t num_written = 0;
+	bool is_written = true;
+	struct nvs_cache_entry *entry = cache;
+	while(entry != NULL) {
+		struct nvs_cache_entry *next = entry->next;
+		if(entry->is_dirty) {
+			esp_err_t err = nvs_write_value(entry->namespace->handle, entry->key, entry->type, entry->data, entry->length);
+			if(err != ESP_OK) {
+				// Entry stays dirty so value is written again on next flush
+				nvs_log_set_error(err);
+				is_written = false;
+				entry = next;
+				continue;
+			}
+			entry->is_dirty = false;
+			entry->namespace->is_committed = true;
+			num_written++;
+
+			// Large blobs are only held till they are written
+			if(entry->length > NVS_CACHE_MAX_VALUE) nvs_remove_entry(entry);
+		}
+		entry = next;
+	}
 
-	if(err != ESP_OK) {
-		ESP_LOGI(NVS_TAG, "failed getting data from NVS. Error: %d, namespace: %s, key: %s", err, namespace, key);
-		return false;
+	for(uint8_t i = 0; i < num_namespaces; ++i) {
+		if(!namespaces[i].is_committed) continue;
+		if(nvs_commit(namespaces[i].handle) != ESP_OK) ESP_LOGI(NVS_TAG, "Failed committing data to NVS");
+		namespaces[i].is_committed = false;
+		stats.commits++;
 	}
 
-	return true;
+	stats.writes += num_written;
+	is_commit_pending = false;
+	if(num_written > 0) ESP_LOGI(NVS_TAG, "Wrote %d values, %d writes and %d unchanged values skipped since boot", num_written, stats.writes, stats.skipped);
+	return is_written;
 }
-bool nvs_get_int8(char *namespace, char *key, int8_t *data) {
-	nvs_handle_t handle;
-	esp_err_t err = nvs_open(namespace, NVS_READONLY, &handle);
-	if(err != ESP_OK) {
-		ESP_LOGI(NVS_TAG, "Unable to open NVS");
-		nvs_close(handle);
-		return false;
-	}
 
-	err = nvs_get_i8(handle, key, data);
+static void nvs_commit_timer_callback(void *arg) { nvs_flush(); }
 
-	nvs_close(handle);
+// --------------------------------------------------------------------------------------------------------------------
 
-	if(err != ESP_OK) {
-		ESP_LOGI(NVS_TAG, "failed getting data from NVS. Error: %d, namespace: %s, key: %s", err, namespace, key);
-		return false;
+void init_nvs() {
+	// Check if space available in NVS, if not reset NVS
+	esp_err_t ret = ret = nvs_flash_init();
+	if (ret == ESP_ERR_NVS_NO_FREE_PAGES
+			|| ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+		ESP_ERROR_CHECK(nvs_flash_erase());
+		ret = nvs_flash_init();
 	}
+	ESP_ERROR_CHECK(ret);
 
-	return true;
+	nvs_mutex = xSemaphoreCreateMutex();
+	const esp_timer_create_args_t timer_args = { .callback = &nvs_commit_timer_callback, .name = "nvs_commit" };
+	ESP_ERROR_CHECK(esp_timer_create(&timer_args, &commit_timer));
 }
-bool nvs_get_uint16(char *namespace, char *key, uint16_t *data) {
-	nvs_handle_t handle;
-	esp_err_t err = nvs_open(namespace, NVS_READONLY, &handle);
-	if(err != ESP_OK) {
-		ESP_LOGI(NVS_TAG, "Unable to open NVS");
-		nvs_close(handle);
-		return false;
-	}
 
-	err = nvs_get_u16(handle, key, data);
-
-	nvs_close(handle);
-
-	if(err != ESP_OK) {
-		ESP_LOGI(NVS_TAG, "failed getting data from NVS. Error: %d, namespace: %s, key: %s", err, namespace, key);
-		return false;
-	}
+void nvs_clear() {
+	xSemaphoreTake(nvs_mutex, portMAX_DELAY);
+	while(cache != NULL) nvs_remove_entry(cache);
+	for(uint8_t i = 0; i < num_namespaces; ++i) nvs_close(namespaces[i].handle);
+	num_namespaces = 0;
+	is_commit_pending = false;
 
-	return true;
+	ESP_ERROR_CHECK(nvs_flash_erase());
+	ESP_ERROR_CHECK(nvs_flash_init());
+	xSemaphoreGive(nvs_mutex);
 }
-bool nvs_get_int16(char *namespace, char *key, int16_t *data) {
-	nvs_handle_t handle;
-	esp_err_t err = nvs_open(namespace, NVS_READONLY, &handle);
-	if(err != ESP_OK) {
-		ESP_LOGI(NVS_TAG, "Unable to open NVS");
-		nvs_close(handle);
-		return false;
-	}
 
-	err = nvs_get_i16(handle, key, data);
-
-	nvs_close(handle);
+nvs_handle_t* nvs_get_handle(char *namespace) {
+	xSemaphoreTake(nvs_mutex, portMAX_DELAY);
+	struct nvs_namespace *open_namespace = nvs_find_namespace(namespace);
+	xSemaphoreGive(nvs_mutex);
+	return open_namespace != NULL ? &open_namespace->handle : NULL;
+}
 
-	if(err != ESP_OK) {
-		ESP_LOGI(NVS_TAG, "failed getting data from NVS. Error: %d, namespace: %s, key: %s", err, namespace, key);
-		return false;
-	}
+void nvs_remove_key(nvs_handle_t *handle, char *key) {
+	xSemaphoreTake(nvs_mutex, portMAX_DELAY);
+	struct nvs_namespace *namespace = nvs_find_handle_namespace(handle);
+	// Erase goes to flash at once, so cached value replacing erased one has to be written first
+	if(namespace != NULL && !nvs_write_pending()) {
+		ESP_LOGW(NVS_TAG, "Kept %s, cached values couldn't be written", key);
+	} else if(namespace != NULL) {
+		struct nvs_cache_entry *entry = nvs_find_entry(namespace, key);
+		if(entry != NULL) nvs_remove_entry(entry);
+
+		esp_err_t err = nvs_erase_key(namespace->handle, key);
+		if(err == ESP_OK) namespace->is_committed = true;
+		else if(err != ESP_ERR_NVS_NOT_FOUND) ESP_LOGE(NVS_TAG, "Failed erasing %s, error: %d", key, err);
+	}
+	xSemaphoreGive(nvs_mutex);
+}
 
-	return true;
+void nvs_add_uint8(nvs_handle_t *handle, char *key, uint8_t data) { nvs_cache_set(handle, key, NVS_TYPE_U8, &data, sizeof(data)); }
+void nvs_add_int8(nvs_handle_t *handle, char *key, int8_t data) { nvs_cache_set(handle, key, NVS_TYPE_I8, &data, sizeof(data)); }
+void nvs_add_uint16(nvs_handle_t *handle, char *key, uint16_t data) { nvs_cache_set(handle, key, NVS_TYPE_U16, &data, sizeof(data)); }
+void nvs_add_int16(nvs_handle_t *handle, char *key, int16_t data) { nvs_cache_set(handle, key, NVS_TYPE_I16, &data, sizeof(data)); }
+void nvs_add_uint32(nvs_handle_t *handle, char *key, uint32_t data) { nvs_cache_set(handle, key, NVS_TYPE_U32, &data, sizeof(data)); }
+void nvs_add_int32(nvs_handle_t *handle, char *key, int32_t data) { nvs_cache_set(handle, key, NVS_TYPE_I32, &data, sizeof(data)); }
+void nvs_add_uint64(nvs_handle_t *handle, char *key, uint64_t data) { nvs_cache_set(handle, key, NVS_TYPE_U64, &data, sizeof(data)); }
+void nvs_add_int64(nvs_handle_t *handle, char *key, int64_t data) { nvs_cache_set(handle, key, NVS_TYPE_I64, &data, sizeof(data)); }
+void nvs_add_float(nvs_handle_t *handle, char *key, float data) {
+	const size_t FLOAT_SIZE = 10;
+	char float_str[FLOAT_SIZE];
+	snprintf(float_str, FLOAT_SIZE, "%.2f", data);
+	nvs_cache_set(handle, key, NVS_TYPE_STR, float_str, strlen(float_str) + 1);
 }
-bool nvs_get_uint32(char *namespace, char *key, uint32_t *data) {
-	nvs_handle_t handle;
-	esp_err_t err = nvs_open(namespace, NVS_READONLY, &handle);
-	if(err != ESP_OK) {
-		ESP_LOGI(NVS_TAG, "Unable to open NVS");
-		nvs_close(handle);
-		return false;
-	}
+void nvs_add_string(nvs_handle_t *handle, char *key, char *data) { nvs_cache_set(handle, key, NVS_TYPE_STR, data, strlen(data) + 1); }
+void nvs_add_blob(nvs_handle_t *handle, char *key, const void *data, size_t length) { nvs_cache_set(handle, key, NVS_TYPE_BLOB, data, length); }
 
-	err = nvs_get_u32(handle, key, data);
+void nvs_commit_data(nvs_handle_t *handle) {
+	// Restart delay on every commit so burst of updates is written once, but don't hold data back for longer than max delay
+	xSemaphoreTake(nvs_mutex, portMAX_DELAY);
+	int64_t now = esp_timer_get_time();
+	if(!is_commit_pending) {
+		is_commit_pending = true;
+		first_commit_request = now;
+	}
+	if(now - first_commit_request < NVS_COMMIT_MAX_DELAY * 1000LL) {
+		esp_timer_stop(commit_timer);
+		esp_timer_start_once(commit_timer, NVS_COMMIT_DELAY * 1000ULL);
+	}
+	xSemaphoreGive(nvs_mutex);
+}
 
-	nvs_close(handle);
+void nvs_flush() {
+	xSemaphoreTake(nvs_mutex, portMAX_DELAY);
+	esp_timer_stop(commit_timer);
+	nvs_write_pending();
+	xSemaphoreGive(nvs_mutex);
+}
 
-	if(err != ESP_OK) {
-		ESP_LOGI(NVS_TAG, "failed getting data from NVS. Error: %d, namespace: %s, key: %s", err, namespace, key);
-		return false;
-	}
+void nvs_get_write_stats(struct nvs_write_stats *stats_out) {
+	xSemaphoreTake(nvs_mutex, portMAX_DELAY);
+	*stats_out = stats;
+	xSemaphoreGive(nvs_mutex);
+}
 
-	return true;
+bool nvs_get_uint8(char *namespace, char *key, uint8_t *data) {
+	size_t length = sizeof(*data);
+	return nvs_cache_get(namespace, key, NVS_TYPE_U8, data, &length);
+}
+bool nvs_get_int8(char *namespace, char *key, int8_t *data) {
+	size_t length = sizeof(*data);
+	return nvs_cache_get(namespace, key, NVS_TYPE_I8, data, &length);
+}
+bool nvs_get_uint16(char *namespace, char *key, uint16_t *data) {
+	size_t length = sizeof(*data);
+	return nvs_cache_get(namespace, key, NVS_TYPE_U16, data, &length);
+}
+bool nvs_get_int16(char *namespace, char *key, int16_t *data) {
+	size_t length = sizeof(*data);
+	return nvs_cache_get(namespace, key, NVS_TYPE_I16, data, &length);
+}
+bool nvs_get_uint32(char *namespace, char *key, uint32_t *data) {
+	size_t length = sizeof(*data);
+	return nvs_cache_get(namespace, key, NVS_TYPE_U32, data, &length);
 }
 bool nvs_get_int32(char *namespace, char *key, int32_t *data) {
-	nvs_handle_t handle;
-	esp_err_t err = nvs_open(namespace, NVS_READONLY, &handle);
-	if(err != ESP_OK) {
-		ESP_LOGI(NVS_TAG, "Unable to open NVS");
-		nvs_close(handle);
-		return false;
-	}
-
-	err = nvs_get_i32(handle, key, data);
-
-	nvs_close(handle);
-
-	if(err != ESP_OK) {
-		ESP_LOGI(NVS_TAG, "failed getting data from NVS. Error: %d, namespace: %s, key: %s", err, namespace, key);
-		return false;
-	}
-
-	return true;
+	size_t length = sizeof(*data);
+	return nvs_cache_get(namespace, key, NVS_TYPE_I32, data, &length);
 }
 bool nvs_get_uint64(char *namespace, char *key, uint64_t *data) {
-	nvs_handle_t handle;
-	esp_err_t err = nvs_open(namespace, NVS_READONLY, &handle);
-	if(err != ESP_OK) {
-		ESP_LOGI(NVS_TAG, "Unable to open NVS");
-		nvs_close(handle);
-		return false;
-	}
-
-	err = nvs_get_u64(handle, key, data);
-
-	nvs_close(handle);
-
-	if(err != ESP_OK) {
-		ESP_LOGI(NVS_TAG, "failed getting data from NVS. Error: %d, namespace: %s, key: %s", err, namespace, key);
-		return false;
-	}
-
-	return true;
+	size_t length = sizeof(*data);
+	return nvs_cache_get(namespace, key, NVS_TYPE_U64, data, &length);
 }
 bool nvs_get_int64(char *namespace, char *key, int64_t *data) {
-	nvs_handle_t handle;
-	esp_err_t err = nvs_open(namespace, NVS_READONLY, &handle);
-	if(err != ESP_OK) {
-		ESP_LOGI(NVS_TAG, "Unable to open NVS");
-		nvs_close(handle);
-		return false;
-	}
-
-	err = nvs_get_i64(handle, key, data);
-
-	nvs_close(handle);
-
-	if(err != ESP_OK) {
-		ESP_LOGI(NVS_TAG, "failed getting data from NVS. Error: %d, namespace: %s, key: %s", err, namespace, key);
-		return false;
-	}
-
-	return true;
+	size_t length = sizeof(*data);
+	return nvs_cache_get(namespace, key, NVS_TYPE_I64, data, &length);
 }
 bool nvs_get_float(char *namespace, char *key, float *data) {
-	nvs_handle_t handle;
-	esp_err_t err = nvs_open(namespace, NVS_READONLY, &handle);
-	if(err != ESP_OK) {
-		ESP_LOGI(NVS_TAG, "Unable to open NVS");
-		nvs_close(handle);
-		return false;
-	}
+	char float_str[NVS_CACHE_MAX_VALUE];
+	size_t length = sizeof(float_str);
+	if(!nvs_cache_get(namespace, key, NVS_TYPE_STR, float_str, &length)) return false;
 
-	size_t str_size;
-	err = nvs_get_str(handle, key, NULL, &str_size);
-	if(err != ESP_OK) {
-		ESP_LOGI(NVS_TAG, "failed getting data from NVS. Error: %d, namespace: %s, key: %s", err, namespace, key);
-		nvs_close(handle);
-		return false;
-	}
-
-	char *fl_str = malloc(str_size * sizeof(char));
-	err = nvs_get_str(handle, key, fl_str, &str_size);
-	nvs_close(handle);
-
-	if(err != ESP_OK) {
-		ESP_LOGI(NVS_TAG, "failed getting data from NVS. Error: %d, namespace: %s, key: %s", err, namespace, key);
-		free(fl_str);
-		return false;
-	}
-
-	*data = atof(fl_str);
-	free(fl_str);
+	*data = atof(float_str);
 	return true;
 }
 bool nvs_get_string(char *namespace, char *key, char *data) {
-	nvs_handle_t handle;
-	esp_err_t err = nvs_open(namespace, NVS_READONLY, &handle);
-	if(err != ESP_OK) {
-		ESP_LOGI(NVS_TAG, "Unable to open NVS");
-		nvs_close(handle);
-		return false;
-	}
+	// Caller buffer has to fit stored string
+	size_t length = SIZE_MAX;
+	return nvs_cache_get(namespace, key, NVS_TYPE_STR, data, &length);
+}
 
-	size_t str_size;
-	err = nvs_get_str(handle, key, NULL, &str_size);
-	if(err != ESP_OK) {
-		ESP_LOGI(NVS_TAG, "failed getting data from NVS. Error: %d, namespace: %s, key: %s", err, namespace, key);
-		nvs_close(handle);
-		return false;
+bool nvs_get_blob_data(char *namespace, char *key, void *data, size_t *length) {
+	return nvs_cache_get(namespace, key, NVS_TYPE_BLOB, data, length);
+}
+
+void nvs_add_settings(nvs_handle_t *handle, char *key, uint16_t version, const void *settings, size_t length) {
+	uint8_t blob[sizeof(struct nvs_settings_header) + NVS_SETTINGS_MAX_SIZE];
+	if(length > NVS_SETTINGS_MAX_SIZE) {
+		ESP_LOGE(NVS_TAG, "Settings %s are larger than %d bytes", key, NVS_SETTINGS_MAX_SIZE);
+		return;
 	}
 
-	err = nvs_get_str(handle, key, data, &str_size);
-	nvs_close(handle);
+	struct nvs_settings_header header = { .version = version, .length = length, .crc = crc32_le(0, settings, length) };
+	memcpy(blob, &header, sizeof(header));
+	memcpy(blob + sizeof(header), settings, length);
+	nvs_add_blob(handle, key, blob, sizeof(header) + length);
+}
 
-	if(err != ESP_OK) {
-		ESP_LOGI(NVS_TAG, "failed getting data from NVS. Error: %d, namespace: %s, key: %s", err, namespace, key);
-		return false;
+uint16_t nvs_get_settings(char *namespace, char *key, void *settings, size_t length) {
+	uint8_t blob[sizeof(struct nvs_settings_header) + NVS_SETTINGS_MAX_SIZE];
+	size_t blob_length = sizeof(blob);
+	if(!nvs_get_blob_data(namespace, key, blob, &blob_length) || blob_length < sizeof(struct nvs_settings_header)) return 0;
+
+	struct nvs_settings_header header;
+	memcpy(&header, blob, sizeof(header));
+	uint8_t *stored = blob + sizeof(header);
+	if(header.version == 0 || header.length != blob_length - sizeof(header) || header.crc != crc32_le(0, stored, header.length)) {
+		ESP_LOGE(NVS_TAG, "Settings %s in namespace %s are corrupt", key, namespace);
+		return 0;
 	}
 
-	return true;
+	// Newer firmware may have appended fields this firmware doesn't know
+	memcpy(settings, stored, header.length < length ? header.length : length);
+	return header.version;
 }
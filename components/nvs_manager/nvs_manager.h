@@ -2,8 +2,40 @@
 #include <stdio.h>
 #include <nvs.h>
 
+#ifndef COMPONENTS_NVS_MANAGER_NVS_MANAGER_H_
+#define COMPONENTS_NVS_MANAGER_NVS_MANAGER_H_
+
 #define NVS_TAG "NVS_MANAGER"
 
+// Namespaces stay open, one handle per namespace
+#define NVS_MAX_NAMESPACES 24
+#define NVS_NAME_LENGTH 16
+
+// Values up to this size stay cached in RAM, larger blobs are only cached till they are written
+#define NVS_CACHE_MAX_VALUE 64
+
+// Committed values are written once no commit came for delay, at most max delay after first commit (ms)
+#define NVS_COMMIT_DELAY 2000
+#define NVS_COMMIT_MAX_DELAY 10000
+
+// Flash writes since boot
+struct nvs_write_stats {
+	uint32_t writes;		// Values written to flash
+	uint32_t skipped;		// Values not written because stored value was equal
+	uint32_t commits;		// Namespace commits
+};
+
+// Largest settings struct stored as settings blob
+#define NVS_SETTINGS_MAX_SIZE 256
+
+// Header of settings blob, packed settings struct follows header
+struct nvs_settings_header {
+	uint16_t version;		// Schema version of settings struct, 0 is never stored
+	uint16_t length;		// Size of settings struct
+	uint32_t crc;			// CRC32 of settings struct
+} __attribute__((packed));
+
+#endif /* COMPONENTS_NVS_MANAGER_NVS_MANAGER_H_ */
 
 // ----------------------------------------------------- MEMBER FUNCTIONS -----------------------------------------------------------------------
 
@@ -13,10 +45,10 @@ void init_nvs();
 // Clear nvs data
 void nvs_clear();
 
-// Get NVS handle
+// Get NVS handle of namespace, handle stays open and must not be freed
 nvs_handle_t* nvs_get_handle(char *namespace);
 
-// NVS setters
+// NVS setters, values are cached and written to flash after commit
 void nvs_add_uint8(nvs_handle_t *handle, char *key, uint8_t data);
 void nvs_add_int8(nvs_handle_t *handle, char *key, int8_t data);
 void nvs_add_uint16(nvs_handle_t *handle, char *key, uint16_t data);
@@ -27,10 +59,21 @@ void nvs_add_uint64(nvs_handle_t *handle, char *key, uint64_t data);
 void nvs_add_int64(nvs_handle_t *handle, char *key, int64_t data);
 void nvs_add_float(nvs_handle_t *handle, char *key, float data);
 void nvs_add_string(nvs_handle_t *handle, char *key, char *data);
+void nvs_add_blob(nvs_handle_t *handle, char *key, const void *data, size_t length);
 
-// Commit data
+// Erase value from flash now, cached values are written first so value replacing erased one isn't lost
+// Value is kept if cached values couldn't be written
+void nvs_remove_key(nvs_handle_t *handle, char *key);
+
+// Commit data, burst of commits is written to flash once
 void nvs_commit_data(nvs_handle_t *handle);
 
+// Write committed data now, called before restart or sleep
+void nvs_flush();
+
+// Get flash write counts
+void nvs_get_write_stats(struct nvs_write_stats *stats_out);
+
 // NVS getters
 bool nvs_get_uint8(char *namespace, char *key, uint8_t *data);
 bool nvs_get_int8(char *namespace, char *key, int8_t *data);
@@ -42,3 +85,13 @@ bool nvs_get_uint64(char *namespace, char *key, uint64_t *data);
 bool nvs_get_int64(char *namespace, char *key, int64_t *data);
 bool nvs_get_float(char *namespace, char *key, float *data);
 bool nvs_get_string(char *namespace, char *key, char *data);
+
+// Length holds size of data and is set to size of stored blob, fails if blob doesn't fit
+bool nvs_get_blob_data(char *namespace, char *key, void *data, size_t *length);
+
+// Store settings struct as one versioned, CRC protected blob
+void nvs_add_settings(nvs_handle_t *handle, char *key, uint16_t version, const void *settings, size_t length);
+
+// Get settings struct, returns stored version or 0 if settings are missing or corrupt
+// Settings older than struct only fill their own length, so fields added later keep values set before call
+uint16_t nvs_get_settings(char *namespace, char *key, void *settings, size_t length);
@@ -15,6 +15,9 @@
 #define PH_NVS_NAMESPACE "PH"
 #define WATER_TEMP_NVS_NAMESPACE "WATER_TEMP"
 
+// Dosing pump calibration namespace
+#define PUMP_CALIBRATION_NVS_NAMESPACE "PUMP_CALIB"
+
 // Water reservoir namespace
 #define WATER_RESERVOIR_NVS_NAMESPACE "RESERVOIR"
 
@@ -24,6 +27,15 @@
 // Grow lights namespace
 #define GROW_LIGHT_NVS_NAMESPACE "GROWLIGHT"
 
+// Sensor history namespace
+#define SENSOR_HISTORY_NVS_NAMESPACE "HISTORY"
+
+// Sensor alarms namespace
+#define SENSOR_ALARMS_NVS_NAMESPACE "ALARMS"
+
+// Grow recipe namespace
+#define RECIPE_NVS_NAMESPACE "RECIPE"
+
 // RF transmitter namespace
 #define RF_TRANSMITTER_NVS_NAMESPACE "RF"
 
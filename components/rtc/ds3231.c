@@ -413,10 +413,18 @@ void init_timer(struct timer *timer, void (*trigger_function)(void), bool repeat
 	// Set initial parameters
 	timer->active = false;
 	timer->trigger_function = trigger_function;
+	timer->trigger_arg_function = NULL;
+	timer->trigger_arg = NULL;
 	timer->repeat = repeat;
 	timer->high_priority = high_priority;
 }
 
+void init_timer_with_arg(struct timer *timer, void (*trigger_function)(void *arg), void *arg, bool repeat, bool high_priority) {
+	init_timer(timer, NULL, repeat, high_priority);
+	timer->trigger_arg_function = trigger_function;
+	timer->trigger_arg = arg;
+}
+
 void enable_timer(i2c_dev_t *dev, struct timer *timer, uint32_t duration) {
 	// Get unix time
 	time_t unix_time;
@@ -438,7 +446,8 @@ void check_timer(i2c_dev_t *dev, struct timer *timer, time_t unix_time) {
 			else timer->active = false;
 
 			// Call trigger function
-			timer->trigger_function();
+			if(timer->trigger_arg_function != NULL) timer->trigger_arg_function(timer->trigger_arg);
+			else timer->trigger_function();
 		}
 	}
 }
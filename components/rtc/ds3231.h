@@ -80,6 +80,8 @@ struct timer {
 	time_t end_time;
 	bool repeat;
 	void (*trigger_function)(void);
+	void (*trigger_arg_function)(void *arg);
+	void *trigger_arg;
 	bool high_priority;
 };
 
@@ -314,6 +316,16 @@ esp_err_t get_unix_time(i2c_dev_t *dev, time_t *seconds);
  */
 void init_timer(struct timer *timer, void (*trigger_function)(void), bool repeat, bool high_priority);
 
+/**
+ * @brief initialize timer struct with function that takes an argument
+ * @param timer struct
+ * @param function to call when timer is done
+ * @param argument passed to function
+ * @param is timer repeated or not
+ * @param is timer time sensitive
+ */
+void init_timer_with_arg(struct timer *timer, void (*trigger_function)(void *arg), void *arg, bool repeat, bool high_priority);
+
 /**
  * @brief enable timer so it's checked every cycle
  * @param dev Device descriptor
@@ -1,5 +1,6 @@
 #include "rtc.h"
 #include <string.h>
+#include <sys/time.h>
 #include <esp_log.h>
 #include <esp_sntp.h>
 #include <freertos/FreeRTOS.h>
@@ -12,13 +13,38 @@
 #include "nvs_namespace_keys.h"
 #include "ports.h"
 #include "sensor_control.h"
+#include "control_channels.h"
 #include "grow_manager.h"
-
-void reservoir_change() {
-	set_reservoir_change_flag(true);
-	// TODO turn water pump off
-	irrigation_timer.active = false;
-}
+#include "pump_calibration.h"
+#include "water_temp_control.h"
+#include "settings_schema.h"
+#include "boot.h"
+
+// Irrigation timings in seconds, received in minutes
+struct irrigation_settings {
+	uint32_t on_time;
+	uint32_t off_time;
+};
+
+static const struct setting_field irrigation_settings_fields[] = {
+	SETTING(IRRIGATION_ON_KEY, SETTING_MINUTES, 1, 1440, struct irrigation_settings, on_time, IRRIGATION_ON_KEY),
+	SETTING(IRRIGATION_OFF_KEY, SETTING_MINUTES, 1, 1440, struct irrigation_settings, off_time, IRRIGATION_OFF_KEY)
+};
+static const struct settings_schema irrigation_settings_schema = SETTINGS_SCHEMA(irrigation_settings_fields);
+
+// Grow light times of day, hour is followed by minute
+struct grow_light_settings {
+	uint8_t on_hr;
+	uint8_t on_min;
+	uint8_t off_hr;
+	uint8_t off_min;
+};
+
+static const struct setting_field grow_light_settings_fields[] = {
+	SETTING_TIME(LIGHTS_ON_KEY, struct grow_light_settings, on_hr, LIGHTS_ON_HR_KEY, LIGHTS_ON_MIN_KEY),
+	SETTING_TIME(LIGHTS_OFF_KEY, struct grow_light_settings, off_hr, LIGHTS_OFF_HR_KEY, LIGHTS_OFF_MIN_KEY)
+};
+static const struct settings_schema grow_light_settings_schema = SETTINGS_SCHEMA(grow_light_settings_fields);
 
 // Enable day time routine
 void day() {
@@ -36,36 +62,49 @@ void night() {
 }
 
 
-void do_nothing() {}
-
 void init_rtc() { // Init RTC
 	memset(&dev, 0, sizeof(i2c_dev_t));
 	ESP_ERROR_CHECK(ds3231_init_desc(&dev, 0, SDA_GPIO, SCL_GPIO));
-	set_time();
+	load_time();
 
 
 	// Initialize timers
 	init_timer(&irrigation_timer, &irrigation_control, false, false);
-	init_timer(control_get_dose_timer(get_ph_control()), &ph_pump_off, false, true);
-	init_timer(control_get_wait_timer(get_ph_control()), &do_nothing, false, false);
-	init_timer(control_get_dose_timer(get_ec_control()), &ec_dose, false, true);
-	init_timer(control_get_wait_timer(get_ec_control()), &do_nothing, false, false);
-	init_timer(&reservoir_change_timer, &reservoir_change, false, false);
+	for(uint8_t i = 0; i < NUM_CONTROL_CHANNELS; ++i) control_channel_init_timers(get_control_channel(i));
+	init_timer(&reservoir_change_timer, &update_reservoir_change, true, false);
+	init_timer(get_pump_calibration_timer(), &pump_calibration_stop, false, true);
 
 	// Initialize alarms
 	init_alarm(&night_time_alarm, &night, true, false);
 	init_alarm(&day_time_alarm, &day, true, false);
 }
 
+// Called from SNTP on every sync, keeps RTC on network time
+static void sntp_time_synced(struct timeval *tv) {
+	set_time();
+	boot_mark_milestone(BOOT_MILESTONE_TIME_SYNCED);
+}
+
 void init_sntp() {
 	sntp_setoperatingmode(SNTP_OPMODE_POLL);
     sntp_setservername(0, "pool.ntp.org");
+	sntp_set_time_sync_notification_cb(&sntp_time_synced);
 	sntp_init();
+}
+
+void load_time() {
+	// Time is kept while RTC runs on battery, oscillator stop flag means it stopped
+	bool is_stopped;
+	if(ds3231_get_oscillator_stop_flag(&dev, &is_stopped) != ESP_OK || is_stopped) {
+		ESP_LOGW("", "RTC time lost, timers run from unknown time until SNTP sets it");
+		return;
+	}
 
-	while (sntp_get_sync_status() == SNTP_SYNC_STATUS_RESET) {
-        ESP_LOGI("", "Waiting for system time to be set...");
-        vTaskDelay(pdMS_TO_TICKS(2000));
-    }
+	struct tm date_time;
+	ds3231_get_time(&dev, &date_time);
+	struct timeval now = { .tv_sec = mktime(&date_time), .tv_usec = 0 };
+	settimeofday(&now, NULL);
+	ESP_LOGI("", "Time loaded from RTC: %li", now.tv_sec);
 }
 
 void set_time() { // Set current time to some date
@@ -74,8 +113,13 @@ void set_time() { // Set current time to some date
 	time(&now);
 	localtime_r(&now, &dateTime);
 	ESP_LOGI("", "Current time: %li", now);
-	ESP_ERROR_CHECK(ds3231_set_time(&dev, &dateTime));
 
+	// Runs on every SNTP sync, a failed write is retried on next one
+	if(ds3231_set_time(&dev, &dateTime) != ESP_OK) {
+		ESP_LOGE("", "Failed to set RTC time");
+		return;
+	}
+	ds3231_clear_oscillator_stop_flag(&dev);
 }
 
 void get_date_time(struct tm *time) {
@@ -93,10 +137,9 @@ void manage_timers_alarms(void *parameter) {
 
 		// Check if timers are done
 		check_timer(&dev, &irrigation_timer, unix_time);
-		check_timer(&dev, control_get_dose_timer(get_ph_control()), unix_time);
-		check_timer(&dev, control_get_wait_timer(get_ph_control()), unix_time);
-		check_timer(&dev, control_get_dose_timer(get_ec_control()), unix_time);
-		check_timer(&dev, control_get_wait_timer(get_ec_control()), unix_time);
+		for(uint8_t i = 0; i < NUM_CONTROL_CHANNELS; ++i) control_channel_check_timers(get_control_channel(i), unix_time);
+		check_timer(&dev, get_pump_calibration_timer(), unix_time);
+		check_timer(&dev, &reservoir_change_timer, unix_time);
 
 		// Check if alarms are done
 		check_alarm(&dev, &night_time_alarm, unix_time);
@@ -104,7 +147,8 @@ void manage_timers_alarms(void *parameter) {
 		check_alarm(&dev, get_reservoir_alarm(), unix_time);
 
 		// Check if any timer or alarm is urgent
-		bool urgent = (irrigation_timer.active && irrigation_timer.high_priority) || (get_ph_control()->dose_timer.active && get_ph_control()->dose_timer.high_priority) || (get_ph_control()->wait_timer.active && get_ph_control()->wait_timer.high_priority) || (get_ec_control()->dose_timer.active && get_ec_control()->dose_timer.high_priority) || (get_ec_control()->wait_timer.active && get_ec_control()->wait_timer.high_priority) || (night_time_alarm.alarm_timer.active && night_time_alarm.alarm_timer.high_priority) || (day_time_alarm.alarm_timer.active && day_time_alarm.alarm_timer.high_priority);
+		bool urgent = (irrigation_timer.active && irrigation_timer.high_priority) || (get_pump_calibration_timer()->active && get_pump_calibration_timer()->high_priority) || (reservoir_change_timer.active && reservoir_change_timer.high_priority) || (night_time_alarm.alarm_timer.active && night_time_alarm.alarm_timer.high_priority) || (day_time_alarm.alarm_timer.active && day_time_alarm.alarm_timer.high_priority);
+		for(uint8_t i = 0; i < NUM_CONTROL_CHANNELS; ++i) urgent = urgent || control_channel_is_urgent(get_control_channel(i));
 
 		// Set priority and delay based on urgency of timers and alarms
 		vTaskPrioritySet(timer_alarm_task_handle, urgent ? (configMAX_PRIORITIES - 1) : TIMER_ALARM_TASK_PRIORITY);
@@ -357,62 +401,37 @@ void irrigation_control() {
 	}
 }
 
-void update_irrigation_timings(cJSON *obj) {
-	const char* UPDATE_IRRIGATION_KEY = "UPDATE_IRRIGATION";
-	bool updatedIrrigationTimings = false;
-
-	cJSON *element = obj->child;
-	nvs_handle_t *handle = nvs_get_handle(IRRIGATION_NVS_NAMESPACE);
+bool update_irrigation_timings(const struct json_document *doc, int object, char *error) {
+	struct irrigation_settings settings = { .on_time = irrigation_on_time, .off_time = irrigation_off_time };
+	if(!settings_decode(&irrigation_settings_schema, doc, object, &settings, error)) return false;
 
-	while(element != NULL) {
-		if(strcmp(element->string, IRRIGATION_ON_KEY) == 0) {
-			irrigation_on_time = element->valueint * 60;
-			nvs_add_uint32(handle, IRRIGATION_ON_KEY, irrigation_on_time);
-			updatedIrrigationTimings = true;
-			ESP_LOGI(UPDATE_IRRIGATION_KEY, "Updated irrigation on time to: %d", irrigation_on_time);
-		} else if(strcmp(element->string, IRRIGATION_OFF_KEY) == 0) {
-			irrigation_off_time = element->valueint * 60;
-			nvs_add_uint32(handle, IRRIGATION_OFF_KEY, irrigation_off_time);
-			updatedIrrigationTimings = true;
-			ESP_LOGI(UPDATE_IRRIGATION_KEY, "Updated irrigation off time to: %d", irrigation_off_time);
-		} else {
-			ESP_LOGE(UPDATE_IRRIGATION_KEY, "Error: Invalid Key");
-		}
-		element = element->next;
-	}
+	// Restarting timer delays next switch, so repeated settings leave running cycle alone
+	bool is_changed = settings.on_time != irrigation_on_time || settings.off_time != irrigation_off_time;
+	irrigation_on_time = settings.on_time;
+	irrigation_off_time = settings.off_time;
+	if(is_changed) enable_timer(&dev, &irrigation_timer, irrigation_on_time);
 
-	if(updatedIrrigationTimings) enable_timer(&dev, &irrigation_timer, irrigation_on_time);
+	nvs_handle_t *handle = nvs_get_handle(IRRIGATION_NVS_NAMESPACE);
+	settings_store(&irrigation_settings_schema, doc, object, &settings, handle);
 	nvs_commit_data(handle);
+	return true;
 }
 
-void update_grow_light_timings(cJSON *obj) {
-	const char* UPDATE_GROW_LIGHTS_KEY = "UPDATE_GROW_LIGHTS";
-	struct tm lights_on, lights_off;
+bool update_grow_light_timings(const struct json_document *doc, int object, char *error) {
+	// Time missing from message keeps stored time
+	struct grow_light_settings settings = { 0 };
+	nvs_get_uint8(GROW_LIGHT_NVS_NAMESPACE, LIGHTS_ON_HR_KEY, &settings.on_hr);
+	nvs_get_uint8(GROW_LIGHT_NVS_NAMESPACE, LIGHTS_ON_MIN_KEY, &settings.on_min);
+	nvs_get_uint8(GROW_LIGHT_NVS_NAMESPACE, LIGHTS_OFF_HR_KEY, &settings.off_hr);
+	nvs_get_uint8(GROW_LIGHT_NVS_NAMESPACE, LIGHTS_OFF_MIN_KEY, &settings.off_min);
+	if(!settings_decode(&grow_light_settings_schema, doc, object, &settings, error)) return false;
 
-	cJSON *element = obj->child;
 	nvs_handle_t *handle = nvs_get_handle(GROW_LIGHT_NVS_NAMESPACE);
-
-	while(element != NULL) {
-		if(strcmp(element->string, LIGHTS_ON_KEY) == 0) {
-			parse_iso_timestamp(element->valuestring, &lights_on);
-			
-			nvs_add_uint8(handle, LIGHTS_ON_HR_KEY, lights_on.tm_hour);
-			nvs_add_uint8(handle, LIGHTS_ON_MIN_KEY, lights_on.tm_min);
-			ESP_LOGI(UPDATE_GROW_LIGHTS_KEY, "Lights on time: %d hr and %d min", lights_on.tm_hour, lights_on.tm_min);
-		} else if(strcmp(element->string, LIGHTS_OFF_KEY) == 0) {
-			parse_iso_timestamp(element->valuestring, &lights_off);
-
-			nvs_add_uint8(handle, LIGHTS_OFF_HR_KEY, lights_off.tm_hour);
-			nvs_add_uint8(handle, LIGHTS_OFF_MIN_KEY, lights_off.tm_min);
-			ESP_LOGI(UPDATE_GROW_LIGHTS_KEY, "Lights off time: %d hr and %d min", lights_off.tm_hour, lights_off.tm_min);
-		} else {
-			ESP_LOGE(UPDATE_GROW_LIGHTS_KEY, "Error: Invalid Key: %s", element->string);
-		}
-		element = element->next;
-	}
+	settings_store(&grow_light_settings_schema, doc, object, &settings, handle);
 	nvs_commit_data(handle);
 
-	update_grow_light_alarms(lights_on.tm_hour, lights_on.tm_min, lights_off.tm_hour, lights_off.tm_min);
+	update_grow_light_alarms(settings.on_hr, settings.on_min, settings.off_hr, settings.off_min);
+	return true;
 }
 
 void irrigation_on() {
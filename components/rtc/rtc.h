@@ -1,6 +1,7 @@
 #include "ds3231.h"
 
 #include <cJSON.h>
+#include "json_tokenizer.h"
 
 // RTC dev
 i2c_dev_t dev;
@@ -39,13 +40,16 @@ bool is_irrigation_on;
 // Day or night time
 bool is_day;
 
-// Initialize rtc
+// Initialize rtc and start system time from it
 void init_rtc();
 
-// Initialize sntp server
+// Initialize sntp server, system time and rtc are set whenever it syncs
 void init_sntp();
 
-// Set current time
+// Set system time from rtc, left unset if rtc lost time
+void load_time();
+
+// Set rtc to system time
 void set_time();
 
 // Get current day and time
@@ -63,8 +67,8 @@ void init_irrigation();
 // Control irrigation
 void irrigation_control();
 
-// Update irrigation timings
-void update_irrigation_timings(cJSON *obj);
+// Update irrigation timings, nothing is changed and error is set if any value is invalid
+bool update_irrigation_timings(const struct json_document *doc, int object, char *error);
 
 // Initialize grow light control
 void init_lights();
@@ -72,8 +76,8 @@ void init_lights();
 // Update Grow Light Alarms
 void update_grow_light_alarms(uint8_t on_hr, uint8_t on_min, uint8_t off_hr, uint8_t off_min);
 
-// Update growlight timings
-void update_grow_light_timings(cJSON *obj);
+// Update growlight timings, nothing is changed and error is set if any value is invalid
+bool update_grow_light_timings(const struct json_document *doc, int object, char *error);
 
 // Turn irrigation on/off
 void irrigation_on();
@@ -0,0 +1,172 @@
+#include "control_channels.h"
+
+#include <esp_log.h>
+#include <string.h>
+
+#include "rtc.h"
+#include "nvs_manager.h"
+#include "nvs_namespace_keys.h"
+#include "control_settings_keys.h"
+#include "ph_control.h"
+#include "ec_control.h"
+#include "water_temp_control.h"
+#include "ph_reading.h"
+#include "ec_reading.h"
+#include "water_temp_reading.h"
+
+// Water temperature is shared by all reservoirs
+static void control_channel_check_water_temp(uint8_t reservoir) { (void) reservoir; check_water_temp(); }
+static void control_channel_water_temp_outlet_off(uint8_t reservoir) { (void) reservoir; water_temp_outlet_off(); }
+
+// Control settings schema of channel, targets and alarm limits have to be in range of sensor
+#define CONTROL_SETTINGS_SCHEMA(schema_name, min_value, max_value) \
+	static const struct setting_field schema_name##_dosing_fields[] = { \
+		SETTING_FIELD(DOSING_TIME, SETTING_FLOAT, 0, 3600, struct control_settings, dose_time), \
+		SETTING_FIELD(DOSING_INTERVAL, SETTING_FLOAT, 0, 86400, struct control_settings, wait_time), \
+		SETTING_FIELD(DOSING_VOLUME, SETTING_FLOAT, 0, 10000, struct control_settings, dose_volume), \
+		SETTING_FIELD(DOSING_RESPONSE, SETTING_FLOAT, 0, 100, struct control_settings, dose_response), \
+		SETTING_FIELD(DAY_AND_NIGHT, SETTING_BOOL, 0, 1, struct control_settings, is_day_night_active), \
+		SETTING_FIELD(DAY_TARGET_VALUE, SETTING_FLOAT, min_value, max_value, struct control_settings, target_value), \
+		SETTING_FIELD(TARGET_VALUE, SETTING_FLOAT, min_value, max_value, struct control_settings, target_value), \
+		SETTING_FIELD(NIGHT_TARGET_VALUE, SETTING_FLOAT, min_value, max_value, struct control_settings, night_target_value), \
+		SETTING_FIELD(UP_CONTROL, SETTING_BOOL, 0, 1, struct control_settings, is_up_control), \
+		SETTING_FIELD(DOWN_CONTROL, SETTING_BOOL, 0, 1, struct control_settings, is_down_control) \
+	}; \
+	static const struct settings_schema schema_name##_dosing = SETTINGS_SCHEMA(schema_name##_dosing_fields); \
+	static const struct setting_field schema_name##_fields[] = { \
+		SETTING_FIELD(MONITORING_ONLY, SETTING_INVERTED_BOOL, 0, 1, struct control_settings, is_control_enabled), \
+		SETTING_NESTED(CONTROL, &schema_name##_dosing), \
+		SETTING_FIELD(ALARM_MIN, SETTING_NULLABLE_FLOAT, min_value, max_value, struct control_settings, alarm_min), \
+		SETTING_FIELD(ALARM_MAX, SETTING_NULLABLE_FLOAT, min_value, max_value, struct control_settings, alarm_max), \
+		SETTING_FIELD(ALARM_HYSTERESIS, SETTING_FLOAT, 0, (max_value) - (min_value), struct control_settings, alarm_hysteresis), \
+		SETTING_FIELD(ALARM_RATE, SETTING_FLOAT, 0, (max_value) - (min_value), struct control_settings, alarm_rate), \
+		SETTING_FIELD(ALARM_STALE, SETTING_UINT32, 0, 86400, struct control_settings, alarm_stale) \
+	}; \
+	static const struct settings_schema schema_name = SETTINGS_SCHEMA(schema_name##_fields)
+
+CONTROL_SETTINGS_SCHEMA(ec_settings_schema, EC_MIN_VALUE, EC_MAX_VALUE);
+CONTROL_SETTINGS_SCHEMA(ph_settings_schema, PH_MIN_VALUE, PH_MAX_VALUE);
+CONTROL_SETTINGS_SCHEMA(water_temp_settings_schema, WATER_TEMP_MIN_VALUE, WATER_TEMP_MAX_VALUE);
+
+// Ec and ph channels of reservoir, settings keys, status keys and namespaces of reservoir get suffix appended
+#define RESERVOIR_CHANNELS(index, suffix) \
+	{ \
+		.name = EC_TAG suffix, \
+		.settings_key = "ec" suffix, \
+		.status_key = "ec_control" suffix, \
+		.nvs_namespace = EC_NAMESPACE suffix, \
+		.reservoir = index, \
+		.type = DOSER_CONTROL, \
+		.margin_error = EC_MARGIN_ERROR, \
+		.control = &ec_controls[index], \
+		.sensor = &ec_sensors[index], \
+		.check = &check_ec, \
+		.dose_done = &ec_dose, \
+		.is_dose_urgent = true, \
+		.settings_schema = &ec_settings_schema, \
+		.update_settings = &ec_update_pump_settings, \
+		.get_nvs_settings = &ec_get_pump_nvs_settings \
+	}, \
+	{ \
+		.name = PH_TAG suffix, \
+		.settings_key = "ph" suffix, \
+		.status_key = "ph_control" suffix, \
+		.nvs_namespace = PH_NAMESPACE suffix, \
+		.reservoir = index, \
+		.type = DOSER_CONTROL, \
+		.margin_error = PH_MARGIN_ERROR, \
+		.control = &ph_controls[index], \
+		.sensor = &ph_sensors[index], \
+		.check = &check_ph, \
+		.dose_done = &ph_pump_off, \
+		.is_dose_urgent = true, \
+		.settings_schema = &ph_settings_schema \
+	}
+
+// Channels are checked in table order, ec comes first so ph control can wait for ec doses
+static struct control_channel control_channels[NUM_CONTROL_CHANNELS] = {
+	RESERVOIR_CHANNELS(0, ""),
+#if NUM_RESERVOIRS > 1
+	RESERVOIR_CHANNELS(1, "_2"),
+#endif
+	{
+		.name = WATER_TEMP_TAG,
+		.settings_key = "water_temp",
+		.status_key = "water_temp_control",
+		.nvs_namespace = WATER_TEMP_NVS_NAMESPACE,
+		.type = OUTLET_CONTROL,
+		.margin_error = WATER_TEMP_MARGIN_ERROR,
+		.control = &water_temp_control,
+		.sensor = &water_temp_sensor,
+		.init = &init_water_temp_model,
+		.check = &control_channel_check_water_temp,
+		.dose_done = &control_channel_water_temp_outlet_off,
+		.is_dose_urgent = false,
+		.settings_schema = &water_temp_settings_schema
+	}
+};
+
+// Wait timers only need to run out
+static void control_channel_wait_done() {}
+
+// Dose timers end dose of the reservoir channel belongs to
+static void control_channel_dose_done(void *arg) {
+	struct control_channel *channel = arg;
+	channel->dose_done(channel->reservoir);
+}
+
+struct control_channel* get_control_channel(uint8_t index) { return index < NUM_CONTROL_CHANNELS ? &control_channels[index] : NULL; }
+
+struct control_channel* find_control_channel(const char *settings_key) {
+	for(uint8_t i = 0; i < NUM_CONTROL_CHANNELS; ++i) {
+		if(strcmp(control_channels[i].settings_key, settings_key) == 0) return &control_channels[i];
+	}
+	return NULL;
+}
+
+void control_channel_init(struct control_channel *channel, cJSON *status_object) {
+	init_sensor_control(channel->control, channel->name, status_object, channel->margin_error);
+	channel->control->reservoir = channel->reservoir;
+	if(channel->type == DOSER_CONTROL) init_doser_control(channel->control);
+	if(channel->init != NULL) channel->init();
+}
+
+void control_channel_init_timers(struct control_channel *channel) {
+	init_timer_with_arg(control_get_dose_timer(channel->control), &control_channel_dose_done, channel, false, channel->is_dose_urgent);
+	init_timer(control_get_wait_timer(channel->control), &control_channel_wait_done, false, false);
+}
+
+void control_channel_check_timers(struct control_channel *channel, time_t unix_time) {
+	check_timer(&dev, control_get_dose_timer(channel->control), unix_time);
+	check_timer(&dev, control_get_wait_timer(channel->control), unix_time);
+}
+
+bool control_channel_is_urgent(struct control_channel *channel) {
+	struct timer *dose_timer = control_get_dose_timer(channel->control);
+	struct timer *wait_timer = control_get_wait_timer(channel->control);
+	return (dose_timer->active && dose_timer->high_priority) || (wait_timer->active && wait_timer->high_priority);
+}
+
+bool control_channel_update_settings(struct control_channel *channel, const struct json_document *doc, int object, char *error) {
+	// Settings are decoded over stored settings, running recipe targets never become stored targets
+	struct control_settings settings;
+	control_get_stored_settings(channel->control, channel->nvs_namespace, &settings);
+	if(!settings_decode(channel->settings_schema, doc, object, &settings, error)) return false;
+
+	// Channel settings are checked before anything is applied, channel can change common settings
+	nvs_handle_t *handle = nvs_get_handle(channel->nvs_namespace);
+	if(channel->update_settings != NULL && !channel->update_settings(channel->reservoir, doc, object, &settings, handle, error)) return false;
+
+	control_set_settings(channel->control, &settings);
+	control_store_nvs_settings(&settings, handle);
+
+	nvs_commit_data(handle);
+	ESP_LOGI(channel->name, "Updated settings and committed data to NVS");
+	return true;
+}
+
+void control_channel_get_nvs_settings(struct control_channel *channel) {
+	control_get_nvs_settings(channel->control, channel->nvs_namespace);
+	if(channel->get_nvs_settings != NULL) channel->get_nvs_settings(channel->reservoir, channel->nvs_namespace);
+	ESP_LOGI(channel->name, "Updated settings from NVS");
+}
@@ -0,0 +1,64 @@
+#include <stdbool.h>
+#include <time.h>
+#include <cJSON.h>
+#include <nvs.h>
+
+#include "sensor.h"
+#include "sensor_control.h"
+#include "settings_schema.h"
+#include "ports.h"
+
+#ifndef COMPONENTS_SENSORS_CONTROL_CONTROL_CHANNELS_H_
+#define COMPONENTS_SENSORS_CONTROL_CONTROL_CHANNELS_H_
+
+// Number of channels in channel table, ec and ph of every reservoir and water temperature
+#define NUM_CONTROL_CHANNELS (2 * NUM_RESERVOIRS + 1)
+
+// How channel acts on reservoir
+enum control_type {
+	DOSER_CONTROL,		// Doses solution with pumps and waits between doses
+	OUTLET_CONTROL		// Switches rf outlets
+};
+
+// Control channel, described once in channel table and iterated by every subsystem
+struct control_channel {
+	char *name;							// Control name and log tag
+	char *settings_key;					// Key of channel settings received over MQTT
+	char *status_key;					// Key of control status in equipment status
+	char *nvs_namespace;				// Namespace channel settings are stored in
+	uint8_t reservoir;					// Reservoir channel acts on, passed to channel functions
+	enum control_type type;
+	float margin_error;
+	struct sensor_control *control;
+	struct sensor *sensor;				// Sensor channel reacts to
+	void (*init)();						// Extra controller setup, can be NULL
+	void (*check)(uint8_t reservoir);	// Check sensor and adjust, called every measurement period
+	void (*dose_done)(uint8_t reservoir);	// Turn actuators off, called by dose timer
+	bool is_dose_urgent;				// Dose timer needs to end on time
+	const struct settings_schema *settings_schema;	// Schema of control settings, decoded into struct control_settings
+	// Validate and apply channel specific settings before decoded control settings are applied, can be NULL
+	bool (*update_settings)(uint8_t reservoir, const struct json_document *doc, int object, struct control_settings *settings, nvs_handle_t *handle, char *error);
+	void (*get_nvs_settings)(uint8_t reservoir, char *nvs_namespace);	// Get channel specific settings from NVS, can be NULL
+};
+
+#endif /* COMPONENTS_SENSORS_CONTROL_CONTROL_CHANNELS_H_ */
+
+// Get channel, NULL if index is out of range
+struct control_channel* get_control_channel(uint8_t index);
+
+// Get channel with settings key, NULL if there is none
+struct control_channel* find_control_channel(const char *settings_key);
+
+// Initialize control of channel, status object is updated with control status
+void control_channel_init(struct control_channel *channel, cJSON *status_object);
+
+// Initialize, check and get urgency of dose and wait timers of channel
+void control_channel_init_timers(struct control_channel *channel);
+void control_channel_check_timers(struct control_channel *channel, time_t unix_time);
+bool control_channel_is_urgent(struct control_channel *channel);
+
+// Update settings using JSON object and store them in channel namespace, nothing is changed and error is set if any value is invalid
+bool control_channel_update_settings(struct control_channel *channel, const struct json_document *doc, int object, char *error);
+
+// Get channel settings stored in NVS
+void control_channel_get_nvs_settings(struct control_channel *channel);
@@ -6,6 +6,8 @@
 #define CONTROL "control"
 #define DOSING_TIME "dose_time"
 #define DOSING_INTERVAL "dose_interv"
+#define DOSING_VOLUME "dose_vol"
+#define DOSING_RESPONSE "dose_resp"
 #define DAY_AND_NIGHT "d_n_enabled"
 #define DAY_TARGET_VALUE "day_tgt"
 #define NIGHT_TARGET_VALUE "night_tgt"
@@ -15,9 +17,13 @@
 #define PUMPS "pumps"
 #define ALARM_MIN "alarm_min"
 #define ALARM_MAX "alarm_max"
+#define ALARM_HYSTERESIS "alarm_hyst"
+#define ALARM_RATE "alarm_rate"
+#define ALARM_STALE "alarm_stale"
 
 // ec specific keys
 #define PUMP_NUM "pump_"
+#define MAX_ACTIVE_PUMPS "max_pumps"
 
 // Sensor namespaces
 #define PH_NAMESPACE "PH"
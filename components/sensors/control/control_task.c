@@ -4,23 +4,23 @@
 #include <sdkconfig.h>
 
 #include "sensor_control.h"
+#include "control_channels.h"
+#include "sensor_alarms.h"
+#include "recipe.h"
 #include "reservoir_control.h"
 #include "ph_control.h"
 #include "ec_control.h"
 #include "water_temp_control.h"
+#include "pump_calibration.h"
 #include "control_settings_keys.h"
 #include "sync_sensors.h"
 #include "ports.h"
 #include "mqtt_manager.h"
 #include "rf_transmitter.h"
+#include "boot.h"
 
 void init_control() {
-	ec_pump_gpios[0] = EC_NUTRIENT_1_PUMP_GPIO;
-	ec_pump_gpios[1] = EC_NUTRIENT_2_PUMP_GPIO;
-	ec_pump_gpios[2] = EC_NUTRIENT_3_PUMP_GPIO;
-	ec_pump_gpios[3] = EC_NUTRIENT_4_PUMP_GPIO;
-	ec_pump_gpios[4] = EC_NUTRIENT_5_PUMP_GPIO;
-	ec_pump_gpios[5] = EC_NUTRIENT_6_PUMP_GPIO;
+	for(uint8_t reservoir = 0; reservoir < NUM_RESERVOIRS; ++reservoir) ec_max_active_pumps[reservoir] = EC_DEFAULT_MAX_ACTIVE_PUMPS;
 
 	// Float Switch Port Setup
 	gpio_pad_select_gpio(FLOAT_SWITCH_TOP_GPIO);
@@ -29,16 +29,13 @@ void init_control() {
 	gpio_pad_select_gpio(FLOAT_SWITCH_BOTTOM_GPIO);
 	gpio_set_direction(FLOAT_SWITCH_BOTTOM_GPIO, GPIO_MODE_INPUT);
 
-	init_sensor_control(get_ph_control(), "PH_CONTROL", get_ph_control_status(), PH_MARGIN_ERROR);
-	init_doser_control(get_ph_control());
+	for(uint8_t i = 0; i < NUM_CONTROL_CHANNELS; ++i) control_channel_init(get_control_channel(i), get_control_status(i));
 
-	init_sensor_control(get_ec_control(), "EC_CONTROL", get_ec_control_status(), EC_MARGIN_ERROR);
-	init_doser_control(get_ec_control());
+	init_reservoir();
 
-	init_sensor_control(get_water_temp_control(), "WATER_TEMP_CONTROL", get_water_temp_control_status(), WATER_TEMP_MARGIN_ERROR);
-	is_water_cooler_on = false;
+	pump_get_nvs_settings();
 
-	init_reservoir();
+	sensor_alarms_init();
 
 	water_in_rf_message.rf_address_ptr = water_in_address;
 	water_out_rf_message.rf_address_ptr = water_out_address;
@@ -48,9 +45,21 @@ void sensor_control (void *parameter) {
 	for(;;)  {
 		// Check sensors
 		if(reservoir_control_active) check_water_level(); // TODO remove if statement for consistency
-		check_ec();
-		check_ph();
-		check_water_temp();
+
+		// Move targets along grow recipe before checking against them
+		recipe_update();
+		bool is_checked = false;
+		for(uint8_t i = 0; i < NUM_CONTROL_CHANNELS; ++i) {
+			struct control_channel *channel = get_control_channel(i);
+
+			// Don't act on sensors that dropped out at boot or are sitting in calibration solution
+			if(sensor_get_active_status(channel->sensor) && !sensor_calib_status(channel->sensor)) {
+				channel->check(channel->reservoir);
+				is_checked = true;
+			}
+		}
+		if(is_checked) boot_mark_milestone(BOOT_MILESTONE_CONTROL);
+		sensor_alarms_check_stale();
 
 		// Wait till next sensor readings
 		vTaskDelay(pdMS_TO_TICKS(SENSOR_MEASUREMENT_PERIOD));
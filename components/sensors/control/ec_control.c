@@ -3,6 +3,7 @@
 #include <stdbool.h>
 #include <esp_log.h>
 #include <esp_err.h>
+#include <stdio.h>
 #include <string.h>
 
 #include "control_settings_keys.h"
@@ -13,101 +14,156 @@
 #include "control_task.h"
 #include "sync_sensors.h"
 #include "ports.h"
+#include "pump_calibration.h"
+#include "reservoir_control.h"
+#include "settings_schema.h"
 
-struct sensor_control* get_ec_control() { return &ec_control; }
+struct sensor_control* get_ec_control(uint8_t reservoir) { return &ec_controls[reservoir]; }
 
-void check_ec() {
-	if(!control_get_active(get_ph_control())) {
-		int result = control_check_sensor(&ec_control, sensor_get_value(get_ec_sensor()));
+// Dosing state of reservoir
+struct ec_dose_state {
+	uint8_t dose_order[EC_NUM_PUMPS];		// Pumps to dose in start order (longest dose first)
+	uint8_t dose_order_len;
+	uint8_t nutrient_index;					// Index of next pump in dosing order
+	time_t pump_end_times[EC_NUM_PUMPS];	// Time each running pump is due to stop, 0 if pump is off
+};
+
+static struct ec_dose_state ec_dose_states[NUM_RESERVOIRS];
+
+float ec_get_pump_dose_time(uint8_t reservoir, uint8_t pump) {
+	return control_get_pump_dose_time(&ec_controls[reservoir], pump_get_index(reservoir, pump), ec_nutrient_proportions[reservoir][pump]);
+}
+
+void check_ec(uint8_t reservoir) {
+	struct sensor_control *ec_control = &ec_controls[reservoir];
+	if(!control_get_active(get_ph_control(reservoir)) && !pump_is_calibrating() && !reservoir_is_changing(reservoir)) {
+		float ec = sensor_get_value(get_ec_sensor(reservoir));
+		int result = control_check_sensor(ec_control, ec);
 		if(result == -1) {
-			ec_nutrient_index = 0;
-			ec_dose();
+			control_calculate_dose_volume(ec_control, ec);
+			ec_start_dose(reservoir);
 		} else if(result == 1) {
 			// TODO dilute ec with water
 		}
 	}
 }
 
-void ec_dose() {
-	// Check if last nutrient was pumped
-	if(ec_nutrient_index == EC_NUM_PUMPS) {
-		// Turn off last pump
-		set_gpio_off(ec_pump_gpios[ec_nutrient_index - 1]);
+void ec_start_dose(uint8_t reservoir) {
+	struct ec_dose_state *state = &ec_dose_states[reservoir];
+	state->dose_order_len = 0;
+	state->nutrient_index = 0;
 
-		// Enable wait timer and reset nutrient index
-		control_start_wait_timer(&ec_control);
-		ec_nutrient_index = 0;
-		ESP_LOGI(EC_TAG, "EC dosing done");
+	// Queue pumps with dosing proportions > 0, longest dose first so the total dose time is as short as possible
+	for(uint8_t pump = 0; pump < EC_NUM_PUMPS; ++pump) {
+		if(ec_nutrient_proportions[reservoir][pump] <= 1e-4) continue;
 
-		// Still nutrients left
-	} else {
-		// Turn off last pump as long as this isn't first pump and turn on next pump
-		if(ec_nutrient_index != 0) set_gpio_off(ec_pump_gpios[ec_nutrient_index - 1]);
-
-		// Only dose if dosing proportions > 0
-		if(ec_nutrient_proportions[ec_nutrient_index] > 1e-4) {
-			set_gpio_on(ec_pump_gpios[ec_nutrient_index]);
-
-			// Enable dose timer based on nutrient proportion
-			control_set_dose_percentage(&ec_control, ec_nutrient_proportions[ec_nutrient_index]);
-			control_start_dose_timer(&ec_control);
-			ESP_LOGI(EC_TAG, "Dosing nutrient %d for %.2f seconds", ec_nutrient_index  + 1, control_get_dose_time(&ec_control));
-			ec_nutrient_index++;
-		} else {
-			ec_nutrient_index++;
-			ec_dose();
+		uint8_t i = state->dose_order_len++;
+		while(i > 0 && ec_get_pump_dose_time(reservoir, state->dose_order[i - 1]) < ec_get_pump_dose_time(reservoir, pump)) {
+			state->dose_order[i] = state->dose_order[i - 1];
+			i--;
 		}
+		state->dose_order[i] = pump;
 	}
+
+	ESP_LOGI(ec_controls[reservoir].name, "Dosing %d nutrients with up to %d pumps at once", state->dose_order_len, ec_max_active_pumps[reservoir]);
+	ec_dose(reservoir);
 }
 
-void ec_update_settings(cJSON *item) {
-	nvs_handle_t *handle = nvs_get_handle(EC_NAMESPACE);
-	control_update_settings(&ec_control, item, handle);
-	if (get_ec_control()->is_control_enabled) {
-		get_ec_control()->is_up_control = true;
-		nvs_add_uint8(handle, UP_CONTROL, 1);
-		ESP_LOGI(get_ec_control()->name, "Updated up control status to: %s", 1 ? "true" : "false");
-	} else {
-		get_ec_control()->is_up_control = false;
-		nvs_add_uint8(handle, UP_CONTROL, 0);
-		ESP_LOGI(get_ec_control()->name, "Updated up control status to: %s", 0 ? "true" : "false");
+void ec_dose(uint8_t reservoir) {
+	struct sensor_control *ec_control = &ec_controls[reservoir];
+	struct ec_dose_state *state = &ec_dose_states[reservoir];
+	time_t now;
+	get_unix_time(&dev, &now);
+
+	// Turn off pumps that are done
+	uint8_t active_pumps = 0;
+	for(uint8_t pump = 0; pump < EC_NUM_PUMPS; ++pump) {
+		if(state->pump_end_times[pump] == 0) continue;
+
+		if(now >= state->pump_end_times[pump]) {
+			set_gpio_off(pump_get_gpio(pump_get_index(reservoir, pump)));
+			state->pump_end_times[pump] = 0;
+			ESP_LOGI(ec_control->name, "Nutrient %d pump off", pump + 1);
+		} else {
+			active_pumps++;
+		}
 	}
 
-	cJSON *element = item->child;
-	while(element != NULL) {
-		char *key = element->string;
-		if(strcmp(key, CONTROL) == 0) {
-			cJSON *control_element = element->child;
-			while(control_element != NULL) {
-				char *control_key = control_element->string;
-				if(strcmp(control_key, PUMPS) == 0) {
-					cJSON *pumps_element = control_element->child;
-					while(pumps_element != NULL) {
-						char *pumps_key = pumps_element->string;
-						uint8_t pump_num = pumps_key[PUMP_NUM_INDEX] - '1';
-						float pump_val = pumps_element->valuedouble;
-
-						ec_nutrient_proportions[pump_num] = pump_val;
-						ESP_LOGI("Updated ec pump", "%d to: %f", pump_num+1, pump_val);
-						nvs_add_float(handle, pumps_key, pump_val);
-
-						pumps_element = pumps_element->next;
-					}
-				}
-				control_element = control_element->next;
-			}
-		}
-		element = element->next;
+	// Start queued pumps as long as power supply budget allows it
+	uint8_t max_active_pumps = ec_max_active_pumps[reservoir] > 0 ? ec_max_active_pumps[reservoir] : 1;
+	while(state->nutrient_index < state->dose_order_len && active_pumps < max_active_pumps) {
+		uint8_t pump = state->dose_order[state->nutrient_index++];
+		float dose_time = ec_get_pump_dose_time(reservoir, pump);
+
+		// Timers have a resolution of one second
+		uint32_t dose_seconds = (uint32_t)(dose_time + 0.5f);
+		if(dose_seconds == 0) dose_seconds = 1;
+
+		set_gpio_on(pump_get_gpio(pump_get_index(reservoir, pump)));
+		state->pump_end_times[pump] = now + dose_seconds;
+		active_pumps++;
+		ESP_LOGI(ec_control->name, "Dosing nutrient %d for %.2f seconds", pump + 1, dose_time);
 	}
 
-	nvs_commit_data(handle);
-	ESP_LOGI(EC_TAG, "Updating settings and committed data to NVS");
+	// Enable wait timer once all pumps are done
+	if(active_pumps == 0) {
+		control_start_wait_timer(ec_control);
+		state->nutrient_index = 0;
+		ESP_LOGI(ec_control->name, "EC dosing done");
+		return;
+	}
+
+	// Wake up again when next pump is done
+	time_t next_end_time = 0;
+	for(uint8_t pump = 0; pump < EC_NUM_PUMPS; ++pump) {
+		if(state->pump_end_times[pump] != 0 && (next_end_time == 0 || state->pump_end_times[pump] < next_end_time)) next_end_time = state->pump_end_times[pump];
+	}
+	enable_timer(&dev, control_get_dose_timer(ec_control), next_end_time - now);
 }
 
-void ec_get_nvs_settings() {
-	control_get_nvs_settings(&ec_control, EC_NAMESPACE);
+static void ec_get_pump_settings(uint8_t reservoir, struct ec_pump_settings *settings) {
+	memcpy(settings->proportions, ec_nutrient_proportions[reservoir], sizeof(settings->proportions));
+	settings->max_active_pumps = ec_max_active_pumps[reservoir];
+}
 
-	// Get ec proportions from NVS
+// Pump proportions and max active pumps, nested in control object of ec settings
+static const struct setting_field ec_pump_proportion_fields[] = {
+	SETTING_FIELD(PUMP_NUM "1", SETTING_FLOAT, 0, 100, struct ec_pump_settings, proportions[0]),
+	SETTING_FIELD(PUMP_NUM "2", SETTING_FLOAT, 0, 100, struct ec_pump_settings, proportions[1]),
+	SETTING_FIELD(PUMP_NUM "3", SETTING_FLOAT, 0, 100, struct ec_pump_settings, proportions[2]),
+	SETTING_FIELD(PUMP_NUM "4", SETTING_FLOAT, 0, 100, struct ec_pump_settings, proportions[3]),
+	SETTING_FIELD(PUMP_NUM "5", SETTING_FLOAT, 0, 100, struct ec_pump_settings, proportions[4])
+};
+static const struct settings_schema ec_pump_proportion_schema = SETTINGS_SCHEMA(ec_pump_proportion_fields);
+
+static const struct setting_field ec_pump_control_fields[] = {
+	SETTING_NESTED(PUMPS, &ec_pump_proportion_schema),
+	SETTING_FIELD(MAX_ACTIVE_PUMPS, SETTING_UINT8, 1, EC_NUM_PUMPS, struct ec_pump_settings, max_active_pumps)
+};
+static const struct settings_schema ec_pump_control_schema = SETTINGS_SCHEMA(ec_pump_control_fields);
+
+static const struct setting_field ec_pump_fields[] = {
+	SETTING_NESTED(CONTROL, &ec_pump_control_schema)
+};
+static const struct settings_schema ec_pump_schema = SETTINGS_SCHEMA(ec_pump_fields);
+
+bool ec_update_pump_settings(uint8_t reservoir, const struct json_document *doc, int object, struct control_settings *settings, nvs_handle_t *handle, char *error) {
+	struct ec_pump_settings pump_settings;
+	ec_get_pump_settings(reservoir, &pump_settings);
+	if(!settings_decode(&ec_pump_schema, doc, object, &pump_settings, error)) return false;
+
+	// Ec only doses up
+	settings->is_up_control = settings->is_control_enabled;
+
+	memcpy(ec_nutrient_proportions[reservoir], pump_settings.proportions, sizeof(pump_settings.proportions));
+	ec_max_active_pumps[reservoir] = pump_settings.max_active_pumps;
+	nvs_add_settings(handle, EC_PUMP_SETTINGS_KEY, EC_PUMP_SETTINGS_VERSION, &pump_settings, sizeof(pump_settings));
+	return true;
+}
+
+// Pump settings stored as one key per value before pump settings blob, returns whether any were stored
+static bool ec_get_pump_key_nvs_settings(uint8_t reservoir, char *nvs_namespace) {
+	bool is_found = false;
 	size_t num_index = strlen(PUMP_NUM);
 	char *key = malloc((num_index + 2) * sizeof(char));
 	strcpy(key, PUMP_NUM);
@@ -115,10 +171,43 @@ void ec_get_nvs_settings() {
 
 	for(int i = 0; i < EC_NUM_PUMPS; ++i) {
 		key[num_index] = i + '1';
-		nvs_get_float(EC_NAMESPACE, key, &ec_nutrient_proportions[i]);
+		is_found |= nvs_get_float(nvs_namespace, key, &ec_nutrient_proportions[reservoir][i]);
 	}
 
 	free(key);
 
-	ESP_LOGI(EC_TAG, "Updated settings from NVS");
+	is_found |= nvs_get_uint8(nvs_namespace, MAX_ACTIVE_PUMPS, &ec_max_active_pumps[reservoir]);
+	return is_found;
+}
+
+void ec_get_pump_nvs_settings(uint8_t reservoir, char *nvs_namespace) {
+	// Current values are kept for fields older settings don't have
+	struct ec_pump_settings settings;
+	ec_get_pump_settings(reservoir, &settings);
+	uint16_t version = nvs_get_settings(nvs_namespace, EC_PUMP_SETTINGS_KEY, &settings, sizeof(settings));
+
+	bool is_stored = true;
+	if(version == 0) {
+		is_stored = ec_get_pump_key_nvs_settings(reservoir, nvs_namespace);
+	} else {
+		memcpy(ec_nutrient_proportions[reservoir], settings.proportions, sizeof(settings.proportions));
+		ec_max_active_pumps[reservoir] = settings.max_active_pumps;
+	}
+	if(ec_max_active_pumps[reservoir] == 0) ec_max_active_pumps[reservoir] = EC_DEFAULT_MAX_ACTIVE_PUMPS;
+
+	// Store settings of older schema in current schema
+	if(is_stored && version < EC_PUMP_SETTINGS_VERSION) {
+		ec_get_pump_settings(reservoir, &settings);
+		nvs_handle_t *handle = nvs_get_handle(nvs_namespace);
+		nvs_add_settings(handle, EC_PUMP_SETTINGS_KEY, EC_PUMP_SETTINGS_VERSION, &settings, sizeof(settings));
+		if(version == 0) {
+			char key[NVS_NAME_LENGTH];
+			for(uint8_t i = 0; i < EC_NUM_PUMPS; ++i) {
+				snprintf(key, sizeof(key), "%s%d", PUMP_NUM, i + 1);
+				nvs_remove_key(handle, key);
+			}
+			nvs_remove_key(handle, MAX_ACTIVE_PUMPS);
+		}
+		nvs_commit_data(handle);
+	}
 }
@@ -2,41 +2,57 @@
 #include <esp_system.h>
 #include <cJSON.h>
 #include "sensor_control.h"
+#include "json_tokenizer.h"
+#include "ports.h"
 
 #define EC_TAG "EC_CONTROL"
 
 // Margin of error
-static const float EC_MARGIN_ERROR = 0.1;
+#define EC_MARGIN_ERROR 0.1
+
+// Range targets and alarm limits are accepted in, mS/cm
+#define EC_MIN_VALUE 0
+#define EC_MAX_VALUE 20
 
 // Number of pumps
 #define EC_NUM_PUMPS 5
 
-// Index of pump number in tag
-#define PUMP_NUM_INDEX 5
+// Default number of pumps allowed to run at the same time
+#define EC_DEFAULT_MAX_ACTIVE_PUMPS 1
+
+// Key and schema version of pump settings blob, stored next to control settings blob
+#define EC_PUMP_SETTINGS_KEY "pump_settings"
+#define EC_PUMP_SETTINGS_VERSION 1
+
+// Pump settings as stored in NVS, new fields are only appended
+struct ec_pump_settings {
+	float proportions[EC_NUM_PUMPS];
+	uint8_t max_active_pumps;
+} __attribute__((packed));
 
-// Control struct
-struct sensor_control ec_control;
+// Control structs, one per reservoir
+struct sensor_control ec_controls[NUM_RESERVOIRS];
 
-// Get control struct
-struct sensor_control* get_ec_control();
+// Get control of reservoir
+struct sensor_control* get_ec_control(uint8_t reservoir);
 
-// Index of current pump
-uint32_t ec_nutrient_index;
+// Maximum number of pumps of reservoir running at the same time (power supply budget)
+uint8_t ec_max_active_pumps[NUM_RESERVOIRS];
 
-// Percent split of pumps
-float ec_nutrient_proportions[6];
+// Percent split of pumps of each reservoir
+float ec_nutrient_proportions[NUM_RESERVOIRS][6];
 
-// GPIOS of pumps
-uint32_t ec_pump_gpios[6];
+// Check ec of reservoir and adjust accordingly
+void check_ec(uint8_t reservoir);
 
-// Check ec and adjust accordingly
-void check_ec();
+// Start dosing ec nutrients based on proportions
+void ec_start_dose(uint8_t reservoir);
 
-// Dose ec nutrients based on proportions
-void ec_dose();
+// Turn finished pumps off and start queued pumps, called by dose timer
+void ec_dose(uint8_t reservoir);
 
-// Update settings
-void ec_update_settings(cJSON *item);
+// Update pump settings, common control settings are handled by control channel
+bool ec_update_pump_settings(uint8_t reservoir, const struct json_document *doc, int object, struct control_settings *settings, nvs_handle_t *handle, char *error);
 
-// Get and store settings from NVS
-void ec_get_nvs_settings();
+// Get pump settings of reservoir from its NVS namespace
+void ec_get_pump_nvs_settings(uint8_t reservoir, char *nvs_namespace);
@@ -13,51 +13,46 @@
 #include "control_settings_keys.h"
 #include "ec_control.h"
 #include "sensor.h"
+#include "pump_calibration.h"
+#include "reservoir_control.h"
 
-struct sensor_control* get_ph_control() { return &ph_control; }
+struct sensor_control* get_ph_control(uint8_t reservoir) { return &ph_controls[reservoir]; }
 
-void check_ph() { // Check ph
-	if(!control_get_active(get_ec_control())) {
-		int result = control_check_sensor(&ph_control, sensor_get_value(get_ph_sensor()));
-		if(result == -1) ph_up_pump();
-		else if(result == 1) ph_down_pump();
+void check_ph(uint8_t reservoir) { // Check ph
+	struct sensor_control *ph_control = &ph_controls[reservoir];
+	if(!control_get_active(get_ec_control(reservoir)) && !pump_is_calibrating() && !reservoir_is_changing(reservoir)) {
+		float ph = sensor_get_value(get_ph_sensor(reservoir));
+		int result = control_check_sensor(ph_control, ph);
+		if(result != 0) control_calculate_dose_volume(ph_control, ph);
+
+		if(result == -1) ph_up_pump(reservoir);
+		else if(result == 1) ph_down_pump(reservoir);
 	}
 }
 
-void ph_up_pump() {
-	set_gpio_on(PH_UP_PUMP_GPIO);
-	ESP_LOGI(PH_TAG, "pH up pump on");
+void ph_up_pump(uint8_t reservoir) {
+	uint8_t pump = pump_get_index(reservoir, PH_UP_PUMP);
+	set_gpio_on(pump_get_gpio(pump));
+	ESP_LOGI(ph_controls[reservoir].name, "pH up pump on");
 
 	// Enable dose timer
-	control_start_dose_timer(&ph_control);
+	control_start_pump_dose_timer(&ph_controls[reservoir], pump);
 }
 
-void ph_down_pump() {
-	set_gpio_on(PH_DOWN_PUMP_GPIO);
-	ESP_LOGI(PH_TAG, "pH down pump on");
+void ph_down_pump(uint8_t reservoir) {
+	uint8_t pump = pump_get_index(reservoir, PH_DOWN_PUMP);
+	set_gpio_on(pump_get_gpio(pump));
+	ESP_LOGI(ph_controls[reservoir].name, "pH down pump on");
 
 	// Enable dose timer
-	control_start_dose_timer(&ph_control);
+	control_start_pump_dose_timer(&ph_controls[reservoir], pump);
 }
 
-void ph_pump_off() {
-	set_gpio_off(PH_UP_PUMP_GPIO);
-	set_gpio_off(PH_DOWN_PUMP_GPIO);
-	ESP_LOGI(PH_TAG, "pH pumps off");
+void ph_pump_off(uint8_t reservoir) {
+	set_gpio_off(pump_get_gpio(pump_get_index(reservoir, PH_UP_PUMP)));
+	set_gpio_off(pump_get_gpio(pump_get_index(reservoir, PH_DOWN_PUMP)));
+	ESP_LOGI(ph_controls[reservoir].name, "pH pumps off");
 
 	// Enable wait timer
-	control_start_wait_timer(&ph_control);
-}
-
-void ph_update_settings(cJSON *item) {
-	nvs_handle_t *handle = nvs_get_handle(PH_NAMESPACE);
-	control_update_settings(&ph_control, item, handle);
-
-	nvs_commit_data(handle);
-	ESP_LOGI(PH_TAG, "Updated settings and committed data to NVS");
-}
-
-void ph_get_nvs_settings() {
-	control_get_nvs_settings(&ph_control, PH_NAMESPACE);
-	ESP_LOGI(PH_TAG ,"Updated settings from NVS");
+	control_start_wait_timer(&ph_controls[reservoir]);
 }
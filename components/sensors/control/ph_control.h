@@ -1,32 +1,31 @@
 #include <stdbool.h>
 #include <cJSON.h>
 #include "sensor_control.h"
+#include "ports.h"
 
 #define PH_TAG "PH_CONTROL"
 
 // Margin of error
-static const float PH_MARGIN_ERROR = 0.3;
+#define PH_MARGIN_ERROR 0.3
 
-// Control struct
-struct sensor_control ph_control;
+// Range targets and alarm limits are accepted in
+#define PH_MIN_VALUE 0
+#define PH_MAX_VALUE 14
 
-// Get control
-struct sensor_control* get_ph_control();
+// Control structs, one per reservoir
+struct sensor_control ph_controls[NUM_RESERVOIRS];
 
-// Checks and adjust ph
-void check_ph();
+// Get control of reservoir
+struct sensor_control* get_ph_control(uint8_t reservoir);
+
+// Checks and adjust ph of reservoir
+void check_ph(uint8_t reservoir);
 
 // Turn ph up pump on
-void ph_up_pump();
+void ph_up_pump(uint8_t reservoir);
 
 // Turn ph down pump on
-void ph_down_pump();
+void ph_down_pump(uint8_t reservoir);
 
 // Turn ph pumps off
-void ph_pump_off();
-
-// Update settings
-void ph_update_settings(cJSON *item);
-
-// Get and store settings from NVS
-void ph_get_nvs_settings();
+void ph_pump_off(uint8_t reservoir);
@@ -0,0 +1,141 @@
+#include "pump_calibration.h"
+
+#include <esp_log.h>
+#include <esp_err.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "ports.h"
+#include "nvs_manager.h"
+#include "nvs_namespace_keys.h"
+#include "ph_control.h"
+#include "ec_control.h"
+
+static const uint32_t pump_gpios[NUM_DOSING_PUMPS] = {
+	EC_NUTRIENT_1_PUMP_GPIO,
+	EC_NUTRIENT_2_PUMP_GPIO,
+	EC_NUTRIENT_3_PUMP_GPIO,
+	EC_NUTRIENT_4_PUMP_GPIO,
+	EC_NUTRIENT_5_PUMP_GPIO,
+	EC_NUTRIENT_6_PUMP_GPIO,
+	PH_UP_PUMP_GPIO,
+	PH_DOWN_PUMP_GPIO
+};
+
+// Pump currently running for calibration and how long each pump last ran for
+static int8_t calibration_pump = -1;
+static float calibration_run_times[NUM_PUMPS];
+
+void pump_make_key(char *key, uint8_t pump) {
+	snprintf(key, PUMP_FLOW_RATE_KEY_LENGTH, "%s%d", PUMP_FLOW_RATE_KEY, pump + 1);
+}
+
+struct timer* get_pump_calibration_timer() { return &pump_calibration_timer; }
+
+uint8_t pump_get_index(uint8_t reservoir, uint8_t pump) { return reservoir * NUM_DOSING_PUMPS + pump; }
+
+uint32_t pump_get_gpio(uint8_t pump) { return pump_gpios[pump % NUM_DOSING_PUMPS] + (pump / NUM_DOSING_PUMPS) * RESERVOIR_PUMP_GPIO_OFFSET; }
+
+bool pump_is_calibrating() { return calibration_pump != -1; }
+
+float pump_get_flow_rate(uint8_t pump) {
+	if(pump >= NUM_PUMPS) return 0;
+	return pump_flow_rates[pump];
+}
+
+float pump_get_dose_time(uint8_t pump, float volume) {
+	float flow_rate = pump_get_flow_rate(pump);
+	if(flow_rate <= 1e-4) return -1;
+	return volume / flow_rate;
+}
+
+esp_err_t pump_calibration_start(uint8_t pump, float run_time) {
+	if(pump >= NUM_PUMPS || run_time <= 0 || run_time > PUMP_CALIBRATION_MAX_TIME) {
+		ESP_LOGE(PUMP_CALIBRATION_TAG, "Invalid calibration run, pump: %d, time: %.2f", pump + 1, run_time);
+		return ESP_ERR_INVALID_ARG;
+	}
+	if(calibration_pump != -1) {
+		ESP_LOGE(PUMP_CALIBRATION_TAG, "Pump %d is already running for calibration", calibration_pump + 1);
+		return ESP_ERR_INVALID_STATE;
+	}
+
+	// Don't run calibration in the middle of a dose
+	for(uint8_t reservoir = 0; reservoir < NUM_RESERVOIRS; ++reservoir) {
+		if(control_get_active(get_ph_control(reservoir)) || control_get_active(get_ec_control(reservoir))) {
+			ESP_LOGE(PUMP_CALIBRATION_TAG, "Unable to calibrate while pH or ec is being dosed");
+			return ESP_ERR_INVALID_STATE;
+		}
+	}
+
+	// Timers have a resolution of one second
+	uint32_t run_seconds = (uint32_t)(run_time + 0.5f);
+	calibration_pump = pump;
+	calibration_run_times[pump] = run_seconds;
+
+	set_gpio_on(pump_get_gpio(pump));
+	enable_timer(&dev, &pump_calibration_timer, run_seconds);
+	ESP_LOGI(PUMP_CALIBRATION_TAG, "Running pump %d for %d seconds", pump + 1, run_seconds);
+
+	return ESP_OK;
+}
+
+void pump_calibration_stop() {
+	if(calibration_pump == -1) return;
+
+	set_gpio_off(pump_get_gpio(calibration_pump));
+	ESP_LOGI(PUMP_CALIBRATION_TAG, "Pump %d calibration run done, waiting for measured volume", calibration_pump + 1);
+	calibration_pump = -1;
+}
+
+esp_err_t pump_calibration_finish(uint8_t pump, float volume) {
+	if(pump >= NUM_PUMPS || volume <= 0) {
+		ESP_LOGE(PUMP_CALIBRATION_TAG, "Invalid calibration volume, pump: %d, volume: %.2f", pump + 1, volume);
+		return ESP_ERR_INVALID_ARG;
+	}
+	if(calibration_pump == pump || calibration_run_times[pump] <= 0) {
+		ESP_LOGE(PUMP_CALIBRATION_TAG, "Pump %d has no finished calibration run", pump + 1);
+		return ESP_ERR_INVALID_STATE;
+	}
+
+	pump_flow_rates[pump] = volume / calibration_run_times[pump];
+	calibration_run_times[pump] = 0;
+
+	pump_store_flow_rates();
+
+	ESP_LOGI(PUMP_CALIBRATION_TAG, "Pump %d flow rate set to %.3f ml/s", pump + 1, pump_flow_rates[pump]);
+	return ESP_OK;
+}
+
+// Floats are stored as raw bytes, rates of peristaltic pumps are well below precision of float strings
+void pump_store_flow_rates() {
+	nvs_handle_t *handle = nvs_get_handle(PUMP_CALIBRATION_NVS_NAMESPACE);
+	nvs_add_settings(handle, PUMP_FLOW_RATES_KEY, PUMP_FLOW_RATES_VERSION, pump_flow_rates, sizeof(pump_flow_rates));
+	nvs_commit_data(handle);
+}
+
+void pump_get_nvs_settings() {
+	memset(pump_flow_rates, 0, sizeof(pump_flow_rates));
+	if(nvs_get_settings(PUMP_CALIBRATION_NVS_NAMESPACE, PUMP_FLOW_RATES_KEY, pump_flow_rates, sizeof(pump_flow_rates)) != 0) {
+		ESP_LOGI(PUMP_CALIBRATION_TAG, "Updated flow rates from NVS");
+		return;
+	}
+
+	// Older firmware stored rate of each pump as string with two decimals, rates lost to rounding need calibration again
+	char key[PUMP_FLOW_RATE_KEY_LENGTH];
+	bool is_stored = false;
+	for(uint8_t pump = 0; pump < NUM_PUMPS; ++pump) {
+		pump_make_key(key, pump);
+		if(nvs_get_float(PUMP_CALIBRATION_NVS_NAMESPACE, key, &pump_flow_rates[pump])) is_stored = true;
+		else pump_flow_rates[pump] = 0;
+	}
+	if(!is_stored) return;
+
+	pump_store_flow_rates();
+	nvs_handle_t *handle = nvs_get_handle(PUMP_CALIBRATION_NVS_NAMESPACE);
+	for(uint8_t pump = 0; pump < NUM_PUMPS; ++pump) {
+		pump_make_key(key, pump);
+		nvs_remove_key(handle, key);
+	}
+	nvs_commit_data(handle);
+	ESP_LOGI(PUMP_CALIBRATION_TAG, "Migrated flow rates to settings version %d", PUMP_FLOW_RATES_VERSION);
+}
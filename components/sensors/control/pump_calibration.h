@@ -0,0 +1,73 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "rtc.h"
+#include "ports.h"
+
+#ifndef COMPONENTS_SENSORS_CONTROL_PUMP_CALIBRATION_H_
+#define COMPONENTS_SENSORS_CONTROL_PUMP_CALIBRATION_H_
+
+#define PUMP_CALIBRATION_TAG "PUMP_CALIBRATION"
+
+// Dosing pump indexes within reservoir, ec nutrient pumps use 0 to EC_NUM_PUMPS - 1
+#define NUM_DOSING_PUMPS 8
+#define PH_UP_PUMP 6
+#define PH_DOWN_PUMP 7
+
+// Pumps of all reservoirs, pumps of reservoir r are numbered from r * NUM_DOSING_PUMPS
+#define NUM_PUMPS (NUM_DOSING_PUMPS * NUM_RESERVOIRS)
+
+// Longest time a pump is allowed to run for calibration
+#define PUMP_CALIBRATION_MAX_TIME 120
+
+// Keys
+#define PUMP_FLOW_RATES_KEY "FLOW_RATES"
+#define PUMP_FLOW_RATES_VERSION 1
+#define PUMP_FLOW_RATE_KEY "flow_"				// Flow rate of one pump before rates were stored as settings
+#define PUMP_CALIBRATION_PUMP_KEY "pump"
+#define PUMP_CALIBRATION_TIME_KEY "time"
+#define PUMP_CALIBRATION_VOLUME_KEY "volume"
+
+// Flow rate key is prefix and pump number, 3 digits fit any uint8_t pump
+#define PUMP_FLOW_RATE_KEY_LENGTH (sizeof(PUMP_FLOW_RATE_KEY) + 3)
+
+#endif /* COMPONENTS_SENSORS_CONTROL_PUMP_CALIBRATION_H_ */
+
+// Calibrated flow rates in ml/s, 0 if pump hasn't been calibrated
+float pump_flow_rates[NUM_PUMPS];
+
+// Timer that turns pump off after calibration run
+struct timer pump_calibration_timer;
+
+// Get calibration timer
+struct timer* get_pump_calibration_timer();
+
+// Get pump number of reservoir pump
+uint8_t pump_get_index(uint8_t reservoir, uint8_t pump);
+
+// Get GPIO of pump
+uint32_t pump_get_gpio(uint8_t pump);
+
+// Check if a pump is currently running for calibration
+bool pump_is_calibrating();
+
+// Get flow rate of pump in ml/s, 0 if not calibrated
+float pump_get_flow_rate(uint8_t pump);
+
+// Get time in seconds pump has to run to dose volume, returns -1 if pump isn't calibrated
+float pump_get_dose_time(uint8_t pump, float volume);
+
+// Run pump for a known time in seconds
+esp_err_t pump_calibration_start(uint8_t pump, float run_time);
+
+// Turn pump off after calibration run, called by calibration timer
+void pump_calibration_stop();
+
+// Set flow rate of pump from volume measured during last calibration run
+esp_err_t pump_calibration_finish(uint8_t pump, float volume);
+
+// Store flow rates of all pumps in NVS
+void pump_store_flow_rates();
+
+// Get flow rates stored in NVS
+void pump_get_nvs_settings();
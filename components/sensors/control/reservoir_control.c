@@ -6,11 +6,14 @@
 #include "ec_control.h"
 #include "ports.h"
 #include "ec_reading.h"
+#include "water_level_reading.h"
 #include "sync_sensors.h"
 #include "control_settings_keys.h"
 #include "control_task.h"
 #include "sensor_control.h"
 #include "nvs_namespace_keys.h"
+#include "mqtt_manager.h"
+#include "settings_schema.h"
 #include "time.h"
 #include <string.h>
 #include <inttypes.h>
@@ -19,21 +22,45 @@
 
 char *TAG = "RESERVOIR_CONTROL";
 
-SemaphoreHandle_t float_switch_top_semaphore = NULL;
-SemaphoreHandle_t float_switch_bottom_semaphore = NULL;
+// Reservoir settings as received over MQTT, every value is stored under its own key
+struct reservoir_settings {
+	uint16_t replacement_interval;	// Days
+	uint8_t is_enabled;
+	uint64_t next_replacement;		// Unix time
+	float volume;					// Litres
+	float sensor_height;			// cm
+	float tank_length;
+	float tank_width;
+	float tank_diameter;
+};
+
+static const struct setting_field reservoir_settings_fields[] = {
+	SETTING(RESERVOIR_REPLACEMENT_INTERVAL_KEY, SETTING_UINT16, 0, 365, struct reservoir_settings, replacement_interval, RESERVOIR_REPLACEMENT_INTERVAL_KEY),
+	SETTING(RESERVOIR_ENABLED_KEY, SETTING_BOOL, 0, 1, struct reservoir_settings, is_enabled, RESERVOIR_ENABLED_KEY),
+	SETTING(RESERVOIR_NEXT_REPLACEMENT_DATE_KEY, SETTING_DATE, 0, 0, struct reservoir_settings, next_replacement, RESERVOIR_NEXT_REPLACEMENT_DATE_KEY),
+	SETTING(RESERVOIR_VOLUME_KEY, SETTING_FLOAT, 0, 10000, struct reservoir_settings, volume, RESERVOIR_VOLUME_KEY),
+	SETTING(RESERVOIR_SENSOR_HEIGHT_KEY, SETTING_FLOAT, 0, 1000, struct reservoir_settings, sensor_height, RESERVOIR_SENSOR_HEIGHT_KEY),
+	SETTING(RESERVOIR_TANK_LENGTH_KEY, SETTING_FLOAT, 0, 1000, struct reservoir_settings, tank_length, RESERVOIR_TANK_LENGTH_KEY),
+	SETTING(RESERVOIR_TANK_WIDTH_KEY, SETTING_FLOAT, 0, 1000, struct reservoir_settings, tank_width, RESERVOIR_TANK_WIDTH_KEY),
+	SETTING(RESERVOIR_TANK_DIAMETER_KEY, SETTING_FLOAT, 0, 1000, struct reservoir_settings, tank_diameter, RESERVOIR_TANK_DIAMETER_KEY)
+};
+static const struct settings_schema reservoir_settings_schema = SETTINGS_SCHEMA(reservoir_settings_fields);
+
+// End of timeout or settling time of current step
+static time_t reservoir_step_end_time;
 
 struct alarm* get_reservoir_alarm() { return &reservoir_replacement_alarm; }
 
 // ISR handler for top float switch
 void IRAM_ATTR top_float_switch_isr_handler(void* arg) {
 	gpio_isr_handler_remove(FLOAT_SWITCH_TOP_GPIO); // Remove ISR handler of top float switch in order to prevent multiple interrupts due to switch bounce
-	xSemaphoreGiveFromISR(float_switch_top_semaphore, NULL); // Signal that interrupt occurred
+	top_float_switch_trigger = true; // Signal that interrupt occurred
 }
 
 // ISR handler for bottom float switch
 void IRAM_ATTR bottom_float_switch_isr_handler(void* arg) {
 	gpio_isr_handler_remove(FLOAT_SWITCH_BOTTOM_GPIO); // Remove ISR handler of bottom float switch in order to prevent multiple interrupts due to switch bounce
-	xSemaphoreGiveFromISR(float_switch_bottom_semaphore, NULL); // Signal that interrupt occurred
+	bottom_float_switch_trigger = true; // Signal that interrupt occurred
 }
 
 // Setter for reservoir change flag
@@ -42,104 +69,142 @@ void set_reservoir_change_flag(bool active) {
 	reservoir_change_flag = active;
 }
 
-// Drain reservoir using wireless sump pump
-esp_err_t drain_tank() {
-	bool logic_level = gpio_get_level(FLOAT_SWITCH_BOTTOM_GPIO); // Tank is empty when float switch reads 0 and vice versa
-	if(logic_level == 0) { // Check if tank is already empty
-		ESP_LOGI(TAG, "Tank is already empty");
-		return ESP_OK;
-	} else {
-		ESP_LOGI(TAG, "Tank is not empty");
-		float_switch_bottom_semaphore = xSemaphoreCreateBinary();
-		gpio_set_intr_type(FLOAT_SWITCH_BOTTOM_GPIO, GPIO_INTR_NEGEDGE);	// Create interrupt that gets triggered on falling edge (1 -> 0)
-		gpio_isr_handler_add(FLOAT_SWITCH_BOTTOM_GPIO, bottom_float_switch_isr_handler, NULL);
-		ESP_LOGI(TAG, "drain power outlet on");
-		water_out_rf_message.state = POWER_OUTLET_ON;
-		xQueueSend(rf_transmitter_queue, &water_out_rf_message, portMAX_DELAY);	// Turn on water out power outlet
-
-		// TODO Replace port max delay with approximate time it might take to drain reservoir
-		bool is_complete = xSemaphoreTake(float_switch_bottom_semaphore, portMAX_DELAY); // Wait until interrupt gets triggered
-
-		ESP_LOGI(TAG, "drain power outlet off");
-		water_out_rf_message.state = POWER_OUTLET_OFF;
-		xQueueSend(rf_transmitter_queue, &water_out_rf_message, portMAX_DELAY); // Turn off water out power outlet
-
-		if(is_complete == pdFALSE) {
-			// TODO Report system error as tank was not drained within expected time
-			return PENDING;
-		} else {
-			ESP_LOGI(TAG, "Fully Drained");
-			return ESP_OK;
-		}
-	}
+float reservoir_get_volume(uint8_t reservoir) {
+	float measured_volume = reservoir == CHANGED_RESERVOIR ? water_level_get_volume() : -1;
+	return measured_volume >= 0 ? measured_volume : reservoir_volume;
+}
+
+bool reservoir_is_changing(uint8_t reservoir) {
+	if(reservoir != CHANGED_RESERVOIR) return false;
+	return reservoir_state == RESERVOIR_DRAINING || reservoir_state == RESERVOIR_FILLING || reservoir_state == RESERVOIR_SETTLING;
+}
+
+// Update state and publish it with equipment status
+void set_reservoir_state(enum reservoir_state state, time_t step_time) {
+	time_t now;
+	get_unix_time(&dev, &now);
+	reservoir_step_end_time = now + step_time;
+	reservoir_state = state;
+
+	cJSON_SetNumberValue(get_reservoir_state_status(), reservoir_state);
+	cJSON_SetNumberValue(get_reservoir_fault_status(), reservoir_fault);
+	publish_equipment_status();
+	ESP_LOGI(TAG, "Reservoir state: %d", reservoir_state);
+}
+
+// Drain reservoir using wireless sump pump, water out is turned off once bottom float switch triggers
+void start_draining() {
+	bottom_float_switch_trigger = false;
+	gpio_set_intr_type(FLOAT_SWITCH_BOTTOM_GPIO, GPIO_INTR_NEGEDGE);	// Create interrupt that gets triggered on falling edge (1 -> 0)
+	gpio_isr_handler_add(FLOAT_SWITCH_BOTTOM_GPIO, bottom_float_switch_isr_handler, NULL);
+
+	ESP_LOGI(TAG, "drain power outlet on");
+	control_power_outlet(RESERVOIR_WATER_OUT, true);
+	set_reservoir_state(RESERVOIR_DRAINING, RESERVOIR_DRAIN_TIMEOUT);
+}
+
+// Fill up reservoir using wireless solenoid valve, water in is turned off once top float switch triggers
+void start_filling() {
+	top_float_switch_trigger = false;
+	gpio_set_intr_type(FLOAT_SWITCH_TOP_GPIO, GPIO_INTR_POSEDGE); // Create interrupt that gets triggered on rising edge (0 -> 1)
+	gpio_isr_handler_add(FLOAT_SWITCH_TOP_GPIO, top_float_switch_isr_handler, NULL);
+
+	ESP_LOGI(TAG, "fillup power outlet on");
+	control_power_outlet(RESERVOIR_WATER_IN, true);
+	set_reservoir_state(RESERVOIR_FILLING, RESERVOIR_FILL_TIMEOUT);
+}
+
+// Stop reservoir change, fault is published if change didn't complete
+void stop_reservoir_change(enum reservoir_fault fault) {
+	reservoir_change_timer.active = false;
+	reservoir_fault = fault;
+	set_reservoir_change_flag(false);
+	set_reservoir_state(RESERVOIR_IDLE, 0);
+
+	if(fault != RESERVOIR_NO_FAULT) ESP_LOGE(TAG, "Reservoir change aborted, fault: %d", fault);
 }
 
-// Fill up reservoir using wireless solenoid valve
-esp_err_t fill_up_tank() {
-	bool logic_level = gpio_get_level(FLOAT_SWITCH_TOP_GPIO); // Tank is empty when float switch reads 0 and vice versa
-	if(logic_level == 1) { // Check if tank is already filled to the top
-		ESP_LOGI(TAG, "Tank is already full");
-		return ESP_OK;
+void check_water_level() {
+	// Flag stays set while change runs, so only idle reservoir starts change
+	if(!reservoir_change_flag || reservoir_state != RESERVOIR_IDLE) return;
+
+	// Wait for running doses to finish
+	if(get_ph_control(CHANGED_RESERVOIR)->dose_timer.active || get_ec_control(CHANGED_RESERVOIR)->dose_timer.active) return;
+
+	// Irrigation is paused until reservoir is full again
+	irrigation_timer.active = false;
+	if(is_irrigation_on) {
+		irrigation_off();
+		is_irrigation_on = false;
+	}
+
+	reservoir_fault = RESERVOIR_NO_FAULT;
+	if(gpio_get_level(FLOAT_SWITCH_BOTTOM_GPIO) == 0) { // Tank is empty when float switch reads 0 and vice versa
+		ESP_LOGI(TAG, "Tank is already empty");
+		start_filling();
 	} else {
-		ESP_LOGI(TAG, "Tank is empty");
-		float_switch_top_semaphore = xSemaphoreCreateBinary();
-		gpio_set_intr_type(FLOAT_SWITCH_TOP_GPIO, GPIO_INTR_POSEDGE); // Create interrupt that gets triggered on rising edge (0 -> 1)
-		gpio_isr_handler_add(FLOAT_SWITCH_TOP_GPIO, top_float_switch_isr_handler, NULL);
-		ESP_LOGI(TAG, "fillup power outlet on");
-		water_in_rf_message.state = POWER_OUTLET_ON;
-		xQueueSend(rf_transmitter_queue, &water_in_rf_message, portMAX_DELAY);	// Turn on water in power outlet
-
-		// TODO Replace port max delay with approximate time it might take to fill reservoir
-		bool is_complete = xSemaphoreTake(float_switch_top_semaphore, portMAX_DELAY); // Wait until interrupt gets triggered
-
-		water_in_rf_message.state = POWER_OUTLET_OFF;
-		ESP_LOGI(TAG, "fillup power outlet off");
-		xQueueSend(rf_transmitter_queue, &water_in_rf_message, portMAX_DELAY); // Turn off water in power outlet
-
-		if(is_complete == pdFALSE) {
-			// TODO Report system error as tank was not filled within expected time
-			return PENDING;
-		} else {
-			ESP_LOGI(TAG, "Filled to the top");
-			return ESP_OK;
-		}
+		start_draining();
 	}
+
+	// Progress is checked every second without blocking control task
+	enable_timer(&dev, &reservoir_change_timer, 1);
 }
 
-void check_water_level() {
-	// Check if ph and ec is currently being altered
-	bool ec_control = control_get_active(get_ec_control());
-	bool ph_control = control_get_active(get_ph_control());
-
-	if(!ec_control || !ph_control) {
-		if(reservoir_change_flag) {
-			esp_err_t error;
-			error = drain_tank(); // Drain reservoir using sump pump
-			if(error == PENDING) {
-				// TODO Report System Error
-				return;
-			} else if(error != ESP_OK) {
-				// TODO Report Unknown Error
-				return;
-			}
+void update_reservoir_change() {
+	time_t now;
+	get_unix_time(&dev, &now);
 
-			error = fill_up_tank(); // Fill up reservoir using solenoid valve
+	switch(reservoir_state) {
+		case RESERVOIR_DRAINING:
+			if(bottom_float_switch_trigger || gpio_get_level(FLOAT_SWITCH_BOTTOM_GPIO) == 0) {
+				ESP_LOGI(TAG, "drain power outlet off");
+				control_power_outlet(RESERVOIR_WATER_OUT, false);
+				ESP_LOGI(TAG, "Fully Drained");
 
-			if(error == PENDING) {
-				// TODO Report System Error
-				return;
-			} else if(error != ESP_OK) {
-				// TODO Report Unknown Error
-				return;
+				if(gpio_get_level(FLOAT_SWITCH_TOP_GPIO) == 1) { // Check if tank is already filled to the top
+					ESP_LOGI(TAG, "Tank is already full");
+					set_reservoir_state(RESERVOIR_SETTLING, RESERVOIR_SETTLE_TIME);
+				} else {
+					start_filling();
+				}
+			} else if(now >= reservoir_step_end_time) {
+				gpio_isr_handler_remove(FLOAT_SWITCH_BOTTOM_GPIO);
+				control_power_outlet(RESERVOIR_WATER_OUT, false);
+				stop_reservoir_change(RESERVOIR_DRAIN_TIMEOUT_FAULT);
 			}
-			set_reservoir_change_flag(false); // Set Reservoir Change flag to false as process is successfully complete
-			enable_timer(&dev, &irrigation_timer, irrigation_off_time); // TODO this has to be replaced
-			return;
-		}
-		if(top_float_switch_trigger) {
+			break;
+		case RESERVOIR_FILLING:
+			if(top_float_switch_trigger || gpio_get_level(FLOAT_SWITCH_TOP_GPIO) == 1) {
+				ESP_LOGI(TAG, "fillup power outlet off");
+				control_power_outlet(RESERVOIR_WATER_IN, false);
+				ESP_LOGI(TAG, "Filled to the top");
 
-			top_float_switch_trigger = false;
-		}
+				enable_timer(&dev, &irrigation_timer, irrigation_off_time); // TODO this has to be replaced
+				set_reservoir_state(RESERVOIR_SETTLING, RESERVOIR_SETTLE_TIME);
+			} else if(now >= reservoir_step_end_time) {
+				gpio_isr_handler_remove(FLOAT_SWITCH_TOP_GPIO);
+				control_power_outlet(RESERVOIR_WATER_IN, false);
+				stop_reservoir_change(RESERVOIR_FILL_TIMEOUT_FAULT);
+			}
+			break;
+		case RESERVOIR_SETTLING:
+			if(now >= reservoir_step_end_time) {
+				// Fresh water needs new doses, don't wait for old wait timers
+				control_restart(get_ph_control(CHANGED_RESERVOIR));
+				control_restart(get_ec_control(CHANGED_RESERVOIR));
+				set_reservoir_state(RESERVOIR_REDOSING, (NUM_CHECKS + 1) * (SENSOR_MEASUREMENT_PERIOD / 1000));
+			}
+			break;
+		case RESERVOIR_REDOSING:
+			// Done once controls had time to check sensors and are no longer dosing
+			if(now >= reservoir_step_end_time && !control_get_active(get_ph_control(CHANGED_RESERVOIR)) && !control_get_active(get_ec_control(CHANGED_RESERVOIR))) {
+				stop_reservoir_change(RESERVOIR_NO_FAULT);
+				ESP_LOGI(TAG, "Reservoir change done");
+			}
+			break;
+		default:
+			reservoir_change_timer.active = false;
+			break;
 	}
 }
 
@@ -162,6 +227,12 @@ void init_reservoir() {
 	uint64_t next_replacement_in_seconds;
 	init_alarm(&reservoir_replacement_alarm, &replace_reservoir, false, false);
 
+	if(!nvs_get_float(WATER_RESERVOIR_NVS_NAMESPACE, RESERVOIR_VOLUME_KEY, &reservoir_volume)) reservoir_volume = 0;
+	if(!nvs_get_float(WATER_RESERVOIR_NVS_NAMESPACE, RESERVOIR_SENSOR_HEIGHT_KEY, &tank_geometry.sensor_height)) tank_geometry.sensor_height = 0;
+	if(!nvs_get_float(WATER_RESERVOIR_NVS_NAMESPACE, RESERVOIR_TANK_LENGTH_KEY, &tank_geometry.length)) tank_geometry.length = 0;
+	if(!nvs_get_float(WATER_RESERVOIR_NVS_NAMESPACE, RESERVOIR_TANK_WIDTH_KEY, &tank_geometry.width)) tank_geometry.width = 0;
+	if(!nvs_get_float(WATER_RESERVOIR_NVS_NAMESPACE, RESERVOIR_TANK_DIAMETER_KEY, &tank_geometry.diameter)) tank_geometry.diameter = 0;
+
 	if( !nvs_get_uint16(WATER_RESERVOIR_NVS_NAMESPACE, RESERVOIR_REPLACEMENT_INTERVAL_KEY, &reservoir_replacement_interval) ||
 		!nvs_get_uint8(WATER_RESERVOIR_NVS_NAMESPACE, RESERVOIR_ENABLED_KEY, (uint8_t*) (&reservoir_control_active)) ||
 		!nvs_get_uint64(WATER_RESERVOIR_NVS_NAMESPACE, RESERVOIR_NEXT_REPLACEMENT_DATE_KEY, &next_replacement_in_seconds) ) {
@@ -175,38 +246,42 @@ void init_reservoir() {
 	}
 }
 
-void update_reservoir_settings(cJSON* obj) {
+bool update_reservoir_settings(const struct json_document *doc, int object, char *error) {
 	char* TAG = "Update Reservoir Settings";
-	cJSON *element = obj->child;
-	nvs_handle_t *handle = nvs_get_handle(WATER_RESERVOIR_NVS_NAMESPACE);
+	struct reservoir_settings settings = {
+		.replacement_interval = reservoir_replacement_interval,
+		.is_enabled = reservoir_control_active,
+		.next_replacement = (uint64_t) mktime(&next_replacement_date),
+		.volume = reservoir_volume,
+		.sensor_height = tank_geometry.sensor_height,
+		.tank_length = tank_geometry.length,
+		.tank_width = tank_geometry.width,
+		.tank_diameter = tank_geometry.diameter
+	};
+	if(!settings_decode(&reservoir_settings_schema, doc, object, &settings, error)) return false;
 
-	while(element != NULL) {
-		if(strcmp(element->string, RESERVOIR_REPLACEMENT_INTERVAL_KEY) == 0) {
-			reservoir_replacement_interval = element->valueint;
-			nvs_add_uint16(handle, RESERVOIR_REPLACEMENT_INTERVAL_KEY, reservoir_replacement_interval);
-			ESP_LOGI(TAG, "Updated Reservoir Replacement Interval to: %d", reservoir_replacement_interval);
-		} else if(strcmp(element->string, RESERVOIR_ENABLED_KEY) == 0) {
-			reservoir_control_active = element->valueint;
-			if(reservoir_control_active) {
-				enable_alarm(&reservoir_replacement_alarm, next_replacement_date);
-			} else {
-				disable_alarm(&reservoir_replacement_alarm);
-			}
-			nvs_add_uint8(handle, RESERVOIR_ENABLED_KEY, (uint8_t)(reservoir_control_active));
-			ESP_LOGI(TAG, "Updated Reservoir Enabled to: %s", element->valueint == 0 ? "false" : "true");
-		} else if(strcmp(element->string, RESERVOIR_NEXT_REPLACEMENT_DATE_KEY) == 0) {
-			parse_iso_timestamp(element->valuestring, &next_replacement_date);
-			ESP_LOGI(TAG, "Date: %d, %d, %d, %d, %d", next_replacement_date.tm_year, next_replacement_date.tm_mon, next_replacement_date.tm_mday, next_replacement_date.tm_hour, next_replacement_date.tm_min);
-			uint64_t next_replacement_in_seconds = (uint64_t)(mktime(&next_replacement_date));
+	reservoir_replacement_interval = settings.replacement_interval;
+	reservoir_volume = settings.volume;
+	tank_geometry.sensor_height = settings.sensor_height;
+	tank_geometry.length = settings.tank_length;
+	tank_geometry.width = settings.tank_width;
+	tank_geometry.diameter = settings.tank_diameter;
+
+	// Replacement alarm follows new date or enabled status
+	if(json_get_object_item(doc, object, RESERVOIR_NEXT_REPLACEMENT_DATE_KEY) >= 0 || json_get_object_item(doc, object, RESERVOIR_ENABLED_KEY) >= 0) {
+		time_t next_replacement_in_seconds = settings.next_replacement;
+		memcpy(&next_replacement_date, gmtime(&next_replacement_in_seconds), sizeof(struct tm));
+		reservoir_control_active = settings.is_enabled;
+		if(reservoir_control_active) {
 			enable_alarm(&reservoir_replacement_alarm, next_replacement_date);
-			nvs_add_uint64(handle, RESERVOIR_NEXT_REPLACEMENT_DATE_KEY, next_replacement_in_seconds);
-			ESP_LOGI(TAG, "Updated Next Reservoir Replacement Date to : %" PRIu64 "", next_replacement_in_seconds);
 		} else {
-			ESP_LOGE(TAG, "Error: Invalid Key");
+			disable_alarm(&reservoir_replacement_alarm);
 		}
-		
-		element = element->next;
+		ESP_LOGI(TAG, "Reservoir replacement %s, next date: %" PRIu64 "", reservoir_control_active ? "enabled" : "disabled", settings.next_replacement);
 	}
 
+	nvs_handle_t *handle = nvs_get_handle(WATER_RESERVOIR_NVS_NAMESPACE);
+	settings_store(&reservoir_settings_schema, doc, object, &settings, handle);
 	nvs_commit_data(handle);
+	return true;
 }
\ No newline at end of file
@@ -2,10 +2,39 @@
 #include "rf_transmitter.h"
 #include "time.h"
 #include "rtc.h"
+#include "json_tokenizer.h"
 
 #define RESERVOIR_REPLACEMENT_INTERVAL_KEY "replace_interv"
 #define RESERVOIR_ENABLED_KEY "is_control"
 #define RESERVOIR_NEXT_REPLACEMENT_DATE_KEY "replace_date"
+#define RESERVOIR_VOLUME_KEY "volume"
+#define RESERVOIR_SENSOR_HEIGHT_KEY "sensor_height"
+#define RESERVOIR_TANK_LENGTH_KEY "tank_length"
+#define RESERVOIR_TANK_WIDTH_KEY "tank_width"
+#define RESERVOIR_TANK_DIAMETER_KEY "tank_diameter"
+
+// Longest time draining and filling may take before change is aborted, in seconds
+#define RESERVOIR_DRAIN_TIMEOUT 1800
+#define RESERVOIR_FILL_TIMEOUT 1800
+
+// Time fresh water is left to mix before dosing resumes, in seconds
+#define RESERVOIR_SETTLE_TIME 300
+
+// Reservoir change steps, published as equipment status
+enum reservoir_state {
+	RESERVOIR_IDLE,
+	RESERVOIR_DRAINING,
+	RESERVOIR_FILLING,
+	RESERVOIR_SETTLING,
+	RESERVOIR_REDOSING
+};
+
+// Reason last reservoir change was aborted
+enum reservoir_fault {
+	RESERVOIR_NO_FAULT,
+	RESERVOIR_DRAIN_TIMEOUT_FAULT,
+	RESERVOIR_FILL_TIMEOUT_FAULT
+};
 
 bool reservoir_control_active;
 bool reservoir_change_flag;
@@ -13,6 +42,9 @@ bool top_float_switch_trigger;
 bool bottom_float_switch_trigger;
 uint16_t reservoir_replacement_interval;
 
+// Volume of reservoir in litres, 0 if unknown
+float reservoir_volume;
+
 struct rf_message water_in_rf_message;
 struct rf_message water_out_rf_message;
 
@@ -20,16 +52,32 @@ struct alarm reservoir_replacement_alarm;
 
 struct tm next_replacement_date;
 
+enum reservoir_state reservoir_state;
+enum reservoir_fault reservoir_fault;
+
 void set_reservoir_change_flag(bool active);
 
+// Start reservoir change if one is requested and no pump is dosing
 void check_water_level();
 
+// Reservoir that float switches, water in/out outlets and level sensor belong to
+#define CHANGED_RESERVOIR 0
+
+// Check if reservoir is being drained, filled or left to settle, dosing is paused until it's done
+bool reservoir_is_changing(uint8_t reservoir);
+
+// Advance reservoir change on float switch events and timeouts, called every second by reservoir change timer
+void update_reservoir_change();
+
+// Get current reservoir volume in litres, measured by water level sensor if available and configured volume otherwise
+float reservoir_get_volume(uint8_t reservoir);
+
 void get_reservoir_nvs_settings();
 
 struct alarm* get_reservoir_alarm();
 
 void replace_reservoir();
 
-void update_reservoir_settings(cJSON* obj);
+bool update_reservoir_settings(const struct json_document *doc, int object, char *error);
 
 void init_reservoir();
@@ -0,0 +1,171 @@
+#include "sensor_alarms.h"
+
+#include <esp_log.h>
+#include <math.h>
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+#include "nvs_manager.h"
+#include "nvs_namespace_keys.h"
+#include "mqtt_manager.h"
+
+static struct sensor_alarm_state alarm_states[NUM_CONTROL_CHANNELS];
+
+// Samples come from sensor tasks, stale checks from control task and publishing from publish task
+static SemaphoreHandle_t alarms_mutex;
+static bool is_alarm_pending;
+
+static const char *alarm_type_names[NUM_SENSOR_ALARM_TYPES] = { "low", "high", "rate", "stale" };
+
+// --------------------------------------------------- Helper functions ----------------------------------------------
+
+static bool sensor_alarm_is_active(const struct sensor_alarm_state *state, enum sensor_alarm_type type) { return state->active & (1 << type); }
+
+static void sensor_alarms_persist() {
+	uint8_t active[NUM_CONTROL_CHANNELS];
+	for(uint8_t i = 0; i < NUM_CONTROL_CHANNELS; ++i) active[i] = alarm_states[i].active;
+
+	nvs_handle_t *handle = nvs_get_handle(SENSOR_ALARMS_NVS_NAMESPACE);
+	nvs_add_blob(handle, SENSOR_ALARMS_ACTIVE_KEY, active, sizeof(active));
+	nvs_commit_data(handle);
+}
+
+// Raise or clear alarm, alarm that is active only clears once clear condition holds so it doesn't flap at limit
+static bool sensor_alarm_update(struct control_channel *channel, struct sensor_alarm_state *state, enum sensor_alarm_type type, bool raise, bool clear) {
+	bool is_active = sensor_alarm_is_active(state, type);
+	if(is_active ? !clear : !raise) return false;
+
+	state->active ^= 1 << type;
+	if(is_active) {
+		ESP_LOGI(SENSOR_ALARMS_TAG, "%s %s alarm cleared", channel->settings_key, alarm_type_names[type]);
+	} else {
+		ESP_LOGE(SENSOR_ALARMS_TAG, "%s %s alarm raised, value: %f", channel->settings_key, alarm_type_names[type], state->last_value);
+	}
+	return true;
+}
+
+// Alarm state changed, persist it and wake publish task so alarm goes out before next telemetry
+static void sensor_alarms_changed() {
+	sensor_alarms_persist();
+	is_alarm_pending = true;
+	if(publish_task_handle != NULL) xTaskNotifyGive(publish_task_handle);
+}
+
+// --------------------------------------------------------------------------------------------------------------------
+
+void sensor_alarms_init() {
+	alarms_mutex = xSemaphoreCreateMutex();
+
+	uint8_t active[NUM_CONTROL_CHANNELS];
+	size_t length = sizeof(active);
+	bool is_loaded = nvs_get_blob_data(SENSOR_ALARMS_NVS_NAMESPACE, SENSOR_ALARMS_ACTIVE_KEY, active, &length) && length == sizeof(active);
+
+	TickType_t now = xTaskGetTickCount();
+	for(uint8_t i = 0; i < NUM_CONTROL_CHANNELS; ++i) {
+		memset(&alarm_states[i], 0, sizeof(struct sensor_alarm_state));
+		alarm_states[i].last_sample = now;
+		if(is_loaded) alarm_states[i].active = active[i];
+		if(alarm_states[i].active != 0) is_alarm_pending = true;
+	}
+}
+
+void sensor_alarms_check_sample(struct sensor *sensor) {
+	float value = sensor_get_value(sensor);
+	TickType_t now = xTaskGetTickCount();
+	bool is_changed = false;
+
+	xSemaphoreTake(alarms_mutex, portMAX_DELAY);
+	for(uint8_t i = 0; i < NUM_CONTROL_CHANNELS; ++i) {
+		struct control_channel *channel = get_control_channel(i);
+		if(channel->sensor != sensor) continue;
+
+		struct sensor_alarm_state *state = &alarm_states[i];
+		struct sensor_control *control = channel->control;
+
+		// Rate over time since last sample, first sample after boot has no rate
+		float minutes = (float) (now - state->last_sample) * portTICK_PERIOD_MS / 60000;
+		bool has_rate = state->has_sample && minutes > 0;
+		if(has_rate) state->rate = (value - state->last_value) / minutes;
+		state->has_sample = true;
+		state->last_value = value;
+		state->last_sample = now;
+
+		is_changed |= sensor_alarm_update(channel, state, SENSOR_ALARM_LOW, !isnan(control->alarm_min) && value < control->alarm_min,
+				isnan(control->alarm_min) || value >= control->alarm_min + control->alarm_hysteresis);
+		is_changed |= sensor_alarm_update(channel, state, SENSOR_ALARM_HIGH, !isnan(control->alarm_max) && value > control->alarm_max,
+				isnan(control->alarm_max) || value <= control->alarm_max - control->alarm_hysteresis);
+		if(has_rate || control->alarm_rate <= 0) {
+			is_changed |= sensor_alarm_update(channel, state, SENSOR_ALARM_RATE, control->alarm_rate > 0 && fabsf(state->rate) > control->alarm_rate,
+					control->alarm_rate <= 0 || fabsf(state->rate) <= control->alarm_rate * SENSOR_ALARM_RATE_CLEAR_FRACTION);
+		}
+		is_changed |= sensor_alarm_update(channel, state, SENSOR_ALARM_STALE, false, true);
+	}
+	if(is_changed) sensor_alarms_changed();
+	xSemaphoreGive(alarms_mutex);
+}
+
+void sensor_alarms_check_stale() {
+	TickType_t now = xTaskGetTickCount();
+	bool is_changed = false;
+
+	xSemaphoreTake(alarms_mutex, portMAX_DELAY);
+	for(uint8_t i = 0; i < NUM_CONTROL_CHANNELS; ++i) {
+		struct control_channel *channel = get_control_channel(i);
+		struct sensor_alarm_state *state = &alarm_states[i];
+		uint32_t stale_time = channel->control->alarm_stale;
+
+		// Sensors that dropped out at boot never sample and calibrating sensors stop sampling on purpose
+		if(!sensor_get_active_status(channel->sensor) || sensor_calib_status(channel->sensor)) continue;
+
+		bool is_stale = stale_time > 0 && now - state->last_sample > pdMS_TO_TICKS(stale_time * 1000);
+		is_changed |= sensor_alarm_update(channel, state, SENSOR_ALARM_STALE, is_stale, stale_time == 0);
+	}
+	if(is_changed) sensor_alarms_changed();
+	xSemaphoreGive(alarms_mutex);
+}
+
+void sensor_alarms_restart() {
+	TickType_t now = xTaskGetTickCount();
+	xSemaphoreTake(alarms_mutex, portMAX_DELAY);
+	for(uint8_t i = 0; i < NUM_CONTROL_CHANNELS; ++i) {
+		alarm_states[i].last_sample = now;
+		alarm_states[i].has_sample = false;
+	}
+	xSemaphoreGive(alarms_mutex);
+}
+
+bool sensor_alarms_take_pending() {
+	xSemaphoreTake(alarms_mutex, portMAX_DELAY);
+	bool is_pending = is_alarm_pending;
+	is_alarm_pending = false;
+	xSemaphoreGive(alarms_mutex);
+	return is_pending;
+}
+
+void sensor_alarms_get_json(cJSON **obj) {
+	*obj = cJSON_CreateObject();
+	cJSON *alarm_arr = cJSON_CreateArray();
+
+	xSemaphoreTake(alarms_mutex, portMAX_DELAY);
+	for(uint8_t i = 0; i < NUM_CONTROL_CHANNELS; ++i) {
+		struct control_channel *channel = get_control_channel(i);
+		struct sensor_alarm_state *state = &alarm_states[i];
+		struct sensor_control *control = channel->control;
+
+		for(uint8_t type = 0; type < NUM_SENSOR_ALARM_TYPES; ++type) {
+			if(!sensor_alarm_is_active(state, type)) continue;
+
+			float limits[NUM_SENSOR_ALARM_TYPES] = { control->alarm_min, control->alarm_max, control->alarm_rate, control->alarm_stale };
+			cJSON *alarm = cJSON_CreateObject();
+			cJSON_AddStringToObject(alarm, "channel", channel->settings_key);
+			cJSON_AddStringToObject(alarm, "type", alarm_type_names[type]);
+			cJSON_AddNumberToObject(alarm, "value", type == SENSOR_ALARM_RATE ? state->rate : state->last_value);
+			if(!isnan(limits[type])) cJSON_AddNumberToObject(alarm, "limit", limits[type]);
+			cJSON_AddItemToArray(alarm_arr, alarm);
+		}
+	}
+	xSemaphoreGive(alarms_mutex);
+
+	cJSON_AddItemToObject(*obj, "alarms", alarm_arr);
+}
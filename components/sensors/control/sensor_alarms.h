@@ -0,0 +1,53 @@
+#include <stdbool.h>
+#include <cJSON.h>
+#include "sensor.h"
+#include "control_channels.h"
+
+#ifndef COMPONENTS_SENSORS_CONTROL_SENSOR_ALARMS_H_
+#define COMPONENTS_SENSORS_CONTROL_SENSOR_ALARMS_H_
+
+#define SENSOR_ALARMS_TAG "SENSOR_ALARMS"
+
+// Rate alarm clears once rate drops below this fraction of limit
+#define SENSOR_ALARM_RATE_CLEAR_FRACTION 0.8
+
+// NVS key of active alarms of all channels
+#define SENSOR_ALARMS_ACTIVE_KEY "active"
+
+// Alarm types, active alarms of a channel are kept as bits
+enum sensor_alarm_type {
+	SENSOR_ALARM_LOW,
+	SENSOR_ALARM_HIGH,
+	SENSOR_ALARM_RATE,
+	SENSOR_ALARM_STALE,
+	NUM_SENSOR_ALARM_TYPES
+};
+
+// Evaluation state of channel
+struct sensor_alarm_state {
+	uint8_t active;				// Bit per alarm type
+	bool has_sample;
+	float last_value;
+	TickType_t last_sample;
+	float rate;					// Change per minute between last two samples
+};
+
+#endif /* COMPONENTS_SENSORS_CONTROL_SENSOR_ALARMS_H_ */
+
+// Load alarms that were active before reboot, call after control channels are initialized
+void sensor_alarms_init();
+
+// Evaluate limits and rate of channels of sensor with its current value, called for every sample
+void sensor_alarms_check_sample(struct sensor *sensor);
+
+// Raise stale alarms of sensors without recent samples, called every measurement period
+void sensor_alarms_check_stale();
+
+// Restart stale timeouts, called when measurement tasks resume after a pause
+void sensor_alarms_restart();
+
+// Check and clear whether alarm state changed since last publish
+bool sensor_alarms_take_pending();
+
+// Get JSON of active alarms
+void sensor_alarms_get_json(cJSON **obj);
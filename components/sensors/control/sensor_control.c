@@ -1,11 +1,14 @@
 #include "sensor_control.h"
 
 #include <string.h>
+#include <math.h>
 #include <esp_log.h>
 #include <esp_err.h>
 #include "rtc.h"
 #include "sync_sensors.h"
 #include "control_settings_keys.h"
+#include "pump_calibration.h"
+#include "reservoir_control.h"
 
 // --------------------------------------------------- Helper functions ----------------------------------------------
 
@@ -41,6 +44,12 @@ void init_sensor_control(struct sensor_control *control_in, char *name_in, cJSON
 	control_in->is_doser = false;
 	control_in->margin_error = margin_error_in;
 
+	control_in->alarm_min = NAN;
+	control_in->alarm_max = NAN;
+	control_in->alarm_hysteresis = 0;
+	control_in->alarm_rate = 0;
+	control_in->alarm_stale = 0;
+
 	control_reset_checks(control_in);
 
 	ESP_LOGI(control_in->name, "Control initialized");
@@ -48,6 +57,9 @@ void init_sensor_control(struct sensor_control *control_in, char *name_in, cJSON
 void init_doser_control(struct sensor_control *control_in) {
 	control_in->is_doser = true;
 	control_in->dose_percentage = 1.;
+	control_in->dose_volume = 0;
+	control_in->dose_response = 0;
+	control_in->current_dose_volume = 0;
 
 	ESP_LOGI(control_in->name, "Doser initialized");
 }
@@ -76,6 +88,14 @@ void control_disable(struct sensor_control *control_in) {
 	ESP_LOGI(control_in->name, "Disabled");
 }
 
+void control_restart(struct sensor_control *control_in) {
+	control_in->is_control_active = false;
+	control_in->wait_timer.active = false;
+	control_reset_checks(control_in);
+
+	ESP_LOGI(control_in->name, "Restarted");
+}
+
 bool control_is_under_target(struct sensor_control *control_in, float current_value) {
 	return current_value < (control_get_target_value(control_in) - control_in->margin_error);
 }
@@ -111,65 +131,81 @@ void control_start_wait_timer(struct sensor_control *control_in) { enable_timer(
 void control_set_dose_percentage(struct sensor_control *control_in, float value) { control_in->dose_percentage = value; }
 float control_get_dose_time(struct sensor_control *control_in) { return control_in->dose_time * control_in->dose_percentage; }
 
-void control_update_settings(struct sensor_control *control_in, cJSON *item, nvs_handle_t *handle) {
-	cJSON *element = item->child;
-	while(element != NULL) {
-		char *key = element->string;
-		if(strcmp(key, MONITORING_ONLY) == 0) {
-			!element->valueint ? control_enable(control_in) : control_disable(control_in);
-			nvs_add_uint8(handle, MONITORING_ONLY, (uint8_t)(control_in->is_control_enabled));
-			ESP_LOGI(control_in->name, "Updated control only to: %s", element->valueint != 0 ? "false" : "true");
-		} else if(strcmp(key, CONTROL) == 0) {
-			cJSON *control_element = element->child;
-			while(control_element != NULL) {
-				char *control_key = control_element->string;
-				if(strcmp(control_key, DOSING_TIME) == 0) {
-					control_in->dose_time = control_element->valuedouble;
-					nvs_add_float(handle, DOSING_TIME, control_in->dose_time);
-					ESP_LOGI(control_in->name, "Updated dosing time to: %f", control_element->valuedouble);
-				} else if(strcmp(control_key, DOSING_INTERVAL) == 0) {
-					control_in->wait_time = control_element->valuedouble;
-					nvs_add_float(handle, DOSING_INTERVAL, control_in->wait_time);
-					ESP_LOGI(control_in->name, "Updated wait time to: %f", control_element->valuedouble);
-				} else if(strcmp(control_key, DAY_AND_NIGHT) == 0) {
-					control_in->is_day_night_active = control_element->valueint;
-					nvs_add_uint8(handle, DAY_AND_NIGHT, control_element->valueint);
-					ESP_LOGI(control_in->name,"Updated day night control status to: %s", control_element->valueint == 0 ? "false" : "true");
-				} else if(strcmp(control_key, DAY_TARGET_VALUE) == 0 || strcmp(control_key, TARGET_VALUE) == 0) {
-					control_in->target_value = control_element->valuedouble;
-					nvs_add_float(handle, TARGET_VALUE, control_in->target_value);
-					ESP_LOGI(control_in->name, "Updated target value to: %f", control_element->valuedouble);
-				} else if(strcmp(control_key, NIGHT_TARGET_VALUE) == 0) {
-					control_in->night_target_value = control_element->valuedouble;
-					nvs_add_float(handle, NIGHT_TARGET_VALUE, (control_in->night_target_value));
-					ESP_LOGI(control_in->name, "Updated night target value to: %f", control_element->valuedouble);
-				} else if(strcmp(control_key, UP_CONTROL) == 0) {
-					control_in->is_up_control = control_element->valueint;
-					nvs_add_uint8(handle, UP_CONTROL, control_element->valueint);
-					ESP_LOGI(control_in->name, "Updated up control status to: %s", control_element->valueint ? "true" : "false");
-				} else if(strcmp(control_key, DOWN_CONTROL) == 0) {
-					control_in->is_down_control = control_element->valueint;
-					nvs_add_uint8(handle, DOWN_CONTROL, control_element->valueint);
-					ESP_LOGI(control_in->name, "Updated down control status to: %s", control_element->valueint ? "true" : "false");
-				}
-				control_element = control_element->next;
-			}
-		}
-		// TODO add alarm functionality
-		//else if(strcmp(key, ALARM_MIN) == 0) {
-//			//TODO update alarm min
-//			ESP_LOGI("Updated ph alarm min to: ", "%d", element->valueint);
-//		} else if(strcmp(key, ALARM_MAX) == 0) {
-//			//TODO update alarm min
-//			ESP_LOGI("Updated ph alarm max to: ", "%d", element->valueint);
-//		}
-
-		element = element->next;
+void control_calculate_dose_volume(struct sensor_control *control_in, float current_value) {
+	float volume = control_in->dose_volume;
+
+	// Dose exactly what's needed to reach target if response of solution and reservoir volume are known
+	float volume_litres = reservoir_get_volume(control_in->reservoir);
+	if(control_in->dose_response > 1e-4 && volume_litres > 0) {
+		float difference = control_get_target_value(control_in) - current_value;
+		if(difference < 0) difference = -difference;
+
+		float needed_volume = difference * volume_litres / control_in->dose_response;
+
+		// Dose volume acts as limit of a single dose
+		if(volume <= 0 || needed_volume < volume) volume = needed_volume;
 	}
-	ESP_LOGI(control_in->name, "Finished updating all values");
+
+	control_in->current_dose_volume = volume;
+	if(volume > 0) ESP_LOGI(control_in->name, "Dose volume: %.2f ml", volume);
 }
 
-void control_get_nvs_settings(struct sensor_control *control_in, char *namespace) {
+float control_get_pump_dose_time(struct sensor_control *control_in, uint8_t pump, float share) {
+	// Fall back to time based dosing if no volume is set or pump isn't calibrated
+	float dose_time = control_in->current_dose_volume > 0 ? pump_get_dose_time(pump, control_in->current_dose_volume * share) : -1;
+	return dose_time >= 0 ? dose_time : control_in->dose_time * share;
+}
+
+void control_start_pump_dose_timer(struct sensor_control *control_in, uint8_t pump) {
+	// Timers have a resolution of one second
+	uint32_t dose_seconds = (uint32_t)(control_get_pump_dose_time(control_in, pump, control_in->dose_percentage) + 0.5f);
+	enable_timer(&dev, &control_in->dose_timer, dose_seconds > 0 ? dose_seconds : 1);
+}
+
+void control_get_settings(struct sensor_control *control_in, struct control_settings *settings) {
+	settings->is_control_enabled = control_in->is_control_enabled;
+	settings->is_day_night_active = control_in->is_day_night_active;
+	settings->is_up_control = control_in->is_up_control;
+	settings->is_down_control = control_in->is_down_control;
+	settings->target_value = control_in->target_value;
+	settings->night_target_value = control_in->night_target_value;
+	settings->dose_time = control_in->dose_time;
+	settings->wait_time = control_in->wait_time;
+	settings->dose_volume = control_in->dose_volume;
+	settings->dose_response = control_in->dose_response;
+	settings->alarm_min = control_in->alarm_min;
+	settings->alarm_max = control_in->alarm_max;
+	settings->alarm_hysteresis = control_in->alarm_hysteresis;
+	settings->alarm_rate = control_in->alarm_rate;
+	settings->alarm_stale = control_in->alarm_stale;
+}
+
+void control_set_settings(struct sensor_control *control_in, const struct control_settings *settings) {
+	settings->is_control_enabled ? control_enable(control_in) : control_disable(control_in);
+	control_in->is_day_night_active = settings->is_day_night_active;
+	control_in->is_up_control = settings->is_up_control;
+	control_in->is_down_control = settings->is_down_control;
+	control_in->target_value = settings->target_value;
+	control_in->night_target_value = settings->night_target_value;
+	control_in->dose_time = settings->dose_time;
+	control_in->wait_time = settings->wait_time;
+	control_in->dose_volume = settings->dose_volume;
+	control_in->dose_response = settings->dose_response;
+	control_in->alarm_min = settings->alarm_min;
+	control_in->alarm_max = settings->alarm_max;
+	control_in->alarm_hysteresis = settings->alarm_hysteresis;
+	control_in->alarm_rate = settings->alarm_rate;
+	control_in->alarm_stale = settings->alarm_stale;
+}
+
+// Keys of settings stored as one key per value, erased once settings are migrated to blob
+static char *control_setting_keys[] = {
+	MONITORING_ONLY, TARGET_VALUE, DAY_AND_NIGHT, NIGHT_TARGET_VALUE, UP_CONTROL, DOWN_CONTROL, DOSING_TIME, DOSING_INTERVAL,
+	DOSING_VOLUME, DOSING_RESPONSE, ALARM_MIN, ALARM_MAX, ALARM_HYSTERESIS, ALARM_RATE, ALARM_STALE
+};
+
+// Settings stored as one key per value before settings blob
+static void control_get_key_nvs_settings(struct sensor_control *control_in, char *namespace) {
 	uint8_t enable_status;
 	nvs_get_uint8(namespace, MONITORING_ONLY, (uint8_t*)(&enable_status));
 	enable_status ? control_enable(control_in) : control_disable(control_in);
@@ -181,6 +217,50 @@ void control_get_nvs_settings(struct sensor_control *control_in, char *namespace
 	nvs_get_uint8(namespace, DOWN_CONTROL, (uint8_t*)(&control_in->is_down_control));
 	nvs_get_float(namespace, DOSING_TIME, &control_in->dose_time);
 	nvs_get_float(namespace, DOSING_INTERVAL, &control_in->wait_time);
+	if(!nvs_get_float(namespace, DOSING_VOLUME, &control_in->dose_volume)) control_in->dose_volume = 0;
+	if(!nvs_get_float(namespace, DOSING_RESPONSE, &control_in->dose_response)) control_in->dose_response = 0;
+	if(!nvs_get_float(namespace, ALARM_MIN, &control_in->alarm_min)) control_in->alarm_min = NAN;
+	if(!nvs_get_float(namespace, ALARM_MAX, &control_in->alarm_max)) control_in->alarm_max = NAN;
+	if(!nvs_get_float(namespace, ALARM_HYSTERESIS, &control_in->alarm_hysteresis)) control_in->alarm_hysteresis = 0;
+	if(!nvs_get_float(namespace, ALARM_RATE, &control_in->alarm_rate)) control_in->alarm_rate = 0;
+	if(!nvs_get_uint32(namespace, ALARM_STALE, &control_in->alarm_stale)) control_in->alarm_stale = 0;
+}
+
+void control_get_stored_settings(struct sensor_control *control_in, char *namespace, struct control_settings *settings) {
+	// Control settings are only missing before first settings message, control runs defaults then
+	control_get_settings(control_in, settings);
+	nvs_get_settings(namespace, CONTROL_SETTINGS_KEY, settings, sizeof(struct control_settings));
+}
+
+void control_store_nvs_settings(const struct control_settings *settings, nvs_handle_t *handle) {
+	nvs_add_settings(handle, CONTROL_SETTINGS_KEY, CONTROL_SETTINGS_VERSION, settings, sizeof(struct control_settings));
+}
+
+void control_get_nvs_settings(struct sensor_control *control_in, char *namespace) {
+	// Current values are kept for fields older settings don't have
+	struct control_settings settings;
+	control_get_settings(control_in, &settings);
+	uint16_t version = nvs_get_settings(namespace, CONTROL_SETTINGS_KEY, &settings, sizeof(settings));
+
+	uint8_t enable_status;
+	if(version == 0) {
+		if(!nvs_get_uint8(namespace, MONITORING_ONLY, &enable_status)) return;
+		control_get_key_nvs_settings(control_in, namespace);
+	} else {
+		control_set_settings(control_in, &settings);
+	}
+
+	// Store settings of older schema in current schema
+	if(version < CONTROL_SETTINGS_VERSION) {
+		nvs_handle_t *handle = nvs_get_handle(namespace);
+		control_get_settings(control_in, &settings);
+		control_store_nvs_settings(&settings, handle);
+		if(version == 0) {
+			for(uint8_t i = 0; i < sizeof(control_setting_keys) / sizeof(control_setting_keys[0]); ++i) nvs_remove_key(handle, control_setting_keys[i]);
+		}
+		nvs_commit_data(handle);
+		ESP_LOGI(control_in->name, "Migrated settings from version %d to %d", version, CONTROL_SETTINGS_VERSION);
+	}
 }
 
 // --------------------------------------------------------------------------------------------------------------------
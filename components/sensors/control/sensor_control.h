@@ -17,6 +17,7 @@
 // TODO separate out struct vars
 struct sensor_control {
 	char name[25];
+	uint8_t reservoir;
 	cJSON *status_object;
 	bool is_control_enabled;
 	bool is_control_active;
@@ -34,8 +35,39 @@ struct sensor_control {
 	float dose_time;
 	float wait_time;
 	float dose_percentage;
+	float dose_volume;
+	float dose_response;
+	float current_dose_volume;
+	float alarm_min;			// NAN if alarm is off
+	float alarm_max;			// NAN if alarm is off
+	float alarm_hysteresis;		// Distance value has to move back inside limit before alarm clears
+	float alarm_rate;			// Largest change per minute, 0 if alarm is off
+	uint32_t alarm_stale;		// Seconds without reading before sensor is stale, 0 if alarm is off
 };
 
+// Key and schema version of control settings blob, version 0 is one key per value
+#define CONTROL_SETTINGS_KEY "settings"
+#define CONTROL_SETTINGS_VERSION 1
+
+// Control settings as stored in NVS, new fields are only appended so older blobs stay readable
+struct control_settings {
+	uint8_t is_control_enabled;
+	uint8_t is_day_night_active;
+	uint8_t is_up_control;
+	uint8_t is_down_control;
+	float target_value;
+	float night_target_value;
+	float dose_time;
+	float wait_time;
+	float dose_volume;
+	float dose_response;
+	float alarm_min;
+	float alarm_max;
+	float alarm_hysteresis;
+	float alarm_rate;
+	uint32_t alarm_stale;
+} __attribute__((packed));
+
 #endif /* COMPONENTS_SENSORS_CONTROL_SENSOR_CONTROL_H_ */
 
 // TODO add RME's
@@ -56,6 +88,12 @@ struct timer* control_get_wait_timer(struct sensor_control *control_in);
 void control_enable(struct sensor_control *control_in);
 void control_disable(struct sensor_control *control_in);
 
+// Get target value, uses night target at night if day and night control is active
+float control_get_target_value(struct sensor_control *control_in);
+
+// Forget checks and wait time so control reacts to new conditions right away
+void control_restart(struct sensor_control *control_in);
+
 // Checks if sensor is out of range
 bool control_is_under_target(struct sensor_control *control_in, float current_value);
 bool control_is_over_target(struct sensor_control *control_in, float current_value);
@@ -70,8 +108,21 @@ void control_start_wait_timer(struct sensor_control *control_in);
 void control_set_dose_percentage(struct sensor_control *control_in, float value);
 float control_get_dose_time(struct sensor_control *control_in);
 
-// Update settings using JSON string
-void control_update_settings(struct sensor_control *control_in, cJSON *item, nvs_handle_t *handle);
+// Deal with volume based dosing
+// Dose volume is in ml, dose response is the change in sensor value per ml of solution per litre of reservoir
+void control_calculate_dose_volume(struct sensor_control *control_in, float current_value);
+float control_get_pump_dose_time(struct sensor_control *control_in, uint8_t pump, float share);
+void control_start_pump_dose_timer(struct sensor_control *control_in, uint8_t pump);
+
+// Copy settings of control to settings struct and apply settings struct to control
+void control_get_settings(struct sensor_control *control_in, struct control_settings *settings);
+void control_set_settings(struct sensor_control *control_in, const struct control_settings *settings);
+
+// Get settings received through device settings, control may run recipe targets instead
+void control_get_stored_settings(struct sensor_control *control_in, char *namespace, struct control_settings *settings);
+
+// Store settings as settings blob
+void control_store_nvs_settings(const struct control_settings *settings, nvs_handle_t *handle);
 
-// Get sensor settings stored in NVS
+// Get sensor settings stored in NVS, settings stored as keys are migrated to settings blob
 void control_get_nvs_settings(struct sensor_control *control_in, char *namespace);
@@ -0,0 +1,223 @@
+#include "settings_schema.h"
+
+#include <esp_log.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "rtc.h"
+#include "nvs_manager.h"
+
+// --------------------------------------------------- Helper functions ----------------------------------------------
+
+static const struct setting_field* settings_find_field(const struct settings_schema *schema, const struct json_document *doc, int key) {
+	for(uint8_t i = 0; i < schema->num_fields; ++i) {
+		if(json_string_equals(doc, key, schema->fields[i].key)) return &schema->fields[i];
+	}
+	return NULL;
+}
+
+// Timestamp has to be long enough and laid out like YYYY-MM-DDTHH:mm:ss before it is parsed
+static bool settings_parse_timestamp(const struct json_document *doc, int index, struct tm *time) {
+	char timestamp[SETTINGS_TIMESTAMP_LENGTH];
+	if(!json_get_string(doc, index, timestamp, sizeof(timestamp))) return false;
+	if(strlen(timestamp) < 19 || timestamp[4] != '-' || timestamp[7] != '-' || timestamp[10] != 'T' || timestamp[13] != ':' || timestamp[16] != ':') return false;
+
+	memset(time, 0, sizeof(struct tm));
+	parse_iso_timestamp(timestamp, time);
+	return time->tm_mon >= 0 && time->tm_mon < 12 && time->tm_mday >= 1 && time->tm_mday <= 31 && time->tm_hour >= 0 && time->tm_hour < 24 && time->tm_min >= 0 && time->tm_min < 60;
+}
+
+// Check value of field, error names first invalid key
+static bool settings_validate_field(const struct setting_field *field, const struct json_document *doc, int index, char *error) {
+	struct tm time;
+	bool is_true;
+	double number;
+	switch(field->type) {
+	case SETTING_BOOL:
+	case SETTING_INVERTED_BOOL:
+		if(json_get_bool(doc, index, &is_true)) return true;
+		if(json_get_number(doc, index, &number) && (number == 0 || number == 1)) return true;
+		snprintf(error, SETTINGS_ERROR_LENGTH, "%s: not a bool", field->key);
+		return false;
+	case SETTING_NULLABLE_FLOAT:
+		if(json_get_type(doc, index) == JSON_NULL) return true;
+		// fall through
+	case SETTING_UINT8:
+	case SETTING_UINT16:
+	case SETTING_UINT32:
+	case SETTING_MINUTES:
+	case SETTING_FLOAT:
+		if(!json_get_number(doc, index, &number)) {
+			snprintf(error, SETTINGS_ERROR_LENGTH, "%s: not a number", field->key);
+			return false;
+		}
+		if(number < field->min || number > field->max) {
+			snprintf(error, SETTINGS_ERROR_LENGTH, "%s: %g not in %g to %g", field->key, number, field->min, field->max);
+			return false;
+		}
+		// Integers would be truncated, minutes are converted to seconds so they may have fraction
+		if((field->type == SETTING_UINT8 || field->type == SETTING_UINT16 || field->type == SETTING_UINT32) && number != floor(number)) {
+			snprintf(error, SETTINGS_ERROR_LENGTH, "%s: %g not an integer", field->key, number);
+			return false;
+		}
+		return true;
+	case SETTING_TIME_OF_DAY:
+	case SETTING_DATE:
+		if(settings_parse_timestamp(doc, index, &time)) return true;
+		snprintf(error, SETTINGS_ERROR_LENGTH, "%s: not an ISO timestamp", field->key);
+		return false;
+	case SETTING_OBJECT:
+		if(json_get_type(doc, index) == JSON_OBJECT) return true;
+		snprintf(error, SETTINGS_ERROR_LENGTH, "%s: not an object", field->key);
+		return false;
+	}
+	return false;
+}
+
+static bool settings_validate(const struct settings_schema *schema, const struct json_document *doc, int object, char *error) {
+	int key;
+	JSON_FOR_EACH(doc, object, key) {
+		const struct setting_field *field = settings_find_field(schema, doc, key);
+		if(field == NULL) continue;
+		if(!settings_validate_field(field, doc, key + 1, error)) return false;
+		if(field->type == SETTING_OBJECT && !settings_validate(field->schema, doc, key + 1, error)) return false;
+	}
+	return true;
+}
+
+// Write value of validated field, settings structs are packed so values are copied instead of assigned
+static void settings_apply_field(const struct setting_field *field, const struct json_document *doc, int index, uint8_t *settings) {
+	uint8_t *value = settings + field->offset;
+	enum json_type type = json_get_type(doc, index);
+	double number = 0;
+	uint16_t value_16;
+	uint32_t value_32;
+	uint64_t value_64;
+	float value_float;
+	struct tm time;
+	json_get_number(doc, index, &number);
+	switch(field->type) {
+	case SETTING_BOOL:
+		*value = type == JSON_TRUE || (type == JSON_NUMBER && number != 0);
+		ESP_LOGI(SETTINGS_SCHEMA_TAG, "Updated %s to: %s", field->key, *value ? "true" : "false");
+		break;
+	case SETTING_INVERTED_BOOL:
+		*value = type == JSON_FALSE || (type == JSON_NUMBER && number == 0);
+		ESP_LOGI(SETTINGS_SCHEMA_TAG, "Updated %s to: %s", field->key, *value ? "false" : "true");
+		break;
+	case SETTING_UINT8:
+		*value = number;
+		ESP_LOGI(SETTINGS_SCHEMA_TAG, "Updated %s to: %d", field->key, *value);
+		break;
+	case SETTING_UINT16:
+		value_16 = number;
+		memcpy(value, &value_16, sizeof(value_16));
+		ESP_LOGI(SETTINGS_SCHEMA_TAG, "Updated %s to: %d", field->key, value_16);
+		break;
+	case SETTING_UINT32:
+	case SETTING_MINUTES:
+		value_32 = field->type == SETTING_MINUTES ? number * 60 : number;
+		memcpy(value, &value_32, sizeof(value_32));
+		ESP_LOGI(SETTINGS_SCHEMA_TAG, "Updated %s to: %d", field->key, value_32);
+		break;
+	case SETTING_FLOAT:
+	case SETTING_NULLABLE_FLOAT:
+		value_float = type == JSON_NULL ? NAN : number;
+		memcpy(value, &value_float, sizeof(value_float));
+		ESP_LOGI(SETTINGS_SCHEMA_TAG, "Updated %s to: %f", field->key, value_float);
+		break;
+	case SETTING_TIME_OF_DAY:
+		settings_parse_timestamp(doc, index, &time);
+		value[0] = time.tm_hour;
+		value[1] = time.tm_min;
+		ESP_LOGI(SETTINGS_SCHEMA_TAG, "Updated %s to: %d hr and %d min", field->key, time.tm_hour, time.tm_min);
+		break;
+	case SETTING_DATE:
+		settings_parse_timestamp(doc, index, &time);
+		value_64 = (uint64_t) mktime(&time);
+		memcpy(value, &value_64, sizeof(value_64));
+		ESP_LOGI(SETTINGS_SCHEMA_TAG, "Updated %s to: %" PRIu64 "", field->key, value_64);
+		break;
+	case SETTING_OBJECT:
+		break;
+	}
+}
+
+static void settings_apply(const struct settings_schema *schema, const struct json_document *doc, int object, uint8_t *settings) {
+	int key;
+	JSON_FOR_EACH(doc, object, key) {
+		const struct setting_field *field = settings_find_field(schema, doc, key);
+		if(field == NULL) continue;
+		if(field->type == SETTING_OBJECT) settings_apply(field->schema, doc, key + 1, settings);
+		else settings_apply_field(field, doc, key + 1, settings);
+	}
+}
+
+static void settings_store_field(const struct setting_field *field, const uint8_t *settings, nvs_handle_t *handle) {
+	const uint8_t *value = settings + field->offset;
+	uint16_t value_16;
+	uint32_t value_32;
+	uint64_t value_64;
+	float value_float;
+	switch(field->type) {
+	case SETTING_BOOL:
+	case SETTING_INVERTED_BOOL:
+	case SETTING_UINT8:
+		nvs_add_uint8(handle, field->nvs_key, *value);
+		break;
+	case SETTING_UINT16:
+		memcpy(&value_16, value, sizeof(value_16));
+		nvs_add_uint16(handle, field->nvs_key, value_16);
+		break;
+	case SETTING_UINT32:
+	case SETTING_MINUTES:
+		memcpy(&value_32, value, sizeof(value_32));
+		nvs_add_uint32(handle, field->nvs_key, value_32);
+		break;
+	case SETTING_FLOAT:
+	case SETTING_NULLABLE_FLOAT:
+		memcpy(&value_float, value, sizeof(value_float));
+		nvs_add_float(handle, field->nvs_key, value_float);
+		break;
+	case SETTING_TIME_OF_DAY:
+		nvs_add_uint8(handle, field->nvs_key, value[0]);
+		nvs_add_uint8(handle, field->nvs_minute_key, value[1]);
+		break;
+	case SETTING_DATE:
+		memcpy(&value_64, value, sizeof(value_64));
+		nvs_add_uint64(handle, field->nvs_key, value_64);
+		break;
+	case SETTING_OBJECT:
+		break;
+	}
+}
+
+// --------------------------------------------------------------------------------------------------------------------
+
+bool settings_decode(const struct settings_schema *schema, const struct json_document *doc, int object, void *settings, char *error) {
+	if(json_get_type(doc, object) != JSON_OBJECT) {
+		snprintf(error, SETTINGS_ERROR_LENGTH, "settings: not an object");
+		return false;
+	}
+
+	// Whole message is checked before anything is written so settings are never left half updated
+	if(!settings_validate(schema, doc, object, error)) {
+		ESP_LOGE(SETTINGS_SCHEMA_TAG, "Rejected settings, %s", error);
+		return false;
+	}
+	settings_apply(schema, doc, object, settings);
+	return true;
+}
+
+void settings_store(const struct settings_schema *schema, const struct json_document *doc, int object, const void *settings, nvs_handle_t *handle) {
+	int key;
+	JSON_FOR_EACH(doc, object, key) {
+		const struct setting_field *field = settings_find_field(schema, doc, key);
+		if(field == NULL) continue;
+		if(field->type == SETTING_OBJECT) settings_store(field->schema, doc, key + 1, settings, handle);
+		else if(field->nvs_key != NULL) settings_store_field(field, settings, handle);
+	}
+}
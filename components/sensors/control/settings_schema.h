@@ -0,0 +1,69 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <nvs.h>
+
+#include "json_tokenizer.h"
+
+#ifndef COMPONENTS_SENSORS_CONTROL_SETTINGS_SCHEMA_H_
+#define COMPONENTS_SENSORS_CONTROL_SETTINGS_SCHEMA_H_
+
+#define SETTINGS_SCHEMA_TAG "SETTINGS_SCHEMA"
+
+// Length of reason settings message was rejected, published back to cloud
+#define SETTINGS_ERROR_LENGTH 64
+
+// Longest ISO timestamp accepted
+#define SETTINGS_TIMESTAMP_LENGTH 40
+
+// Type of JSON value and of struct field it is stored in
+enum setting_type {
+	SETTING_BOOL,				// uint8_t, true/false or number
+	SETTING_INVERTED_BOOL,		// uint8_t, stored inverted
+	SETTING_UINT8,
+	SETTING_UINT16,
+	SETTING_UINT32,
+	SETTING_MINUTES,			// uint32_t seconds, received in minutes
+	SETTING_FLOAT,
+	SETTING_NULLABLE_FLOAT,		// float, null is stored as NAN
+	SETTING_TIME_OF_DAY,		// uint8_t hour followed by uint8_t minute, received as ISO timestamp
+	SETTING_DATE,				// uint64_t unix time, received as ISO timestamp
+	SETTING_OBJECT				// Nested object decoded with its own schema into same struct
+};
+
+// Field of settings message
+struct setting_field {
+	char *key;
+	enum setting_type type;
+	float min;					// Range of numbers, minutes are checked before conversion
+	float max;
+	size_t offset;				// Offset of value in settings struct
+	char *nvs_key;				// Key value is stored under, NULL if settings struct is stored as a whole
+	char *nvs_minute_key;		// Key of minute of time of day
+	const struct settings_schema *schema;	// Schema of nested object
+};
+
+// Fields of settings message, keys missing from message keep their value and unknown keys are left to other schemas
+struct settings_schema {
+	const struct setting_field *fields;
+	uint8_t num_fields;
+};
+
+// Declare schema from field array
+#define SETTINGS_SCHEMA(fields_in) { .fields = fields_in, .num_fields = sizeof(fields_in) / sizeof(fields_in[0]) }
+
+// Field with range, field without NVS key, time of day field and nested object field
+#define SETTING(key_in, type_in, min_in, max_in, settings_struct, member, nvs_key_in) \
+	{ .key = key_in, .type = type_in, .min = min_in, .max = max_in, .offset = offsetof(settings_struct, member), .nvs_key = nvs_key_in }
+#define SETTING_FIELD(key_in, type_in, min_in, max_in, settings_struct, member) SETTING(key_in, type_in, min_in, max_in, settings_struct, member, NULL)
+#define SETTING_TIME(key_in, settings_struct, member, nvs_key_in, nvs_minute_key_in) \
+	{ .key = key_in, .type = SETTING_TIME_OF_DAY, .offset = offsetof(settings_struct, member), .nvs_key = nvs_key_in, .nvs_minute_key = nvs_minute_key_in }
+#define SETTING_NESTED(key_in, schema_in) { .key = key_in, .type = SETTING_OBJECT, .schema = schema_in }
+
+#endif /* COMPONENTS_SENSORS_CONTROL_SETTINGS_SCHEMA_H_ */
+
+// Validate JSON object against schema and write its values to settings, settings is left untouched and error is set if any value is invalid
+bool settings_decode(const struct settings_schema *schema, const struct json_document *doc, int object, void *settings, char *error);
+
+// Store fields of JSON object that have NVS keys, call after object was decoded into settings
+void settings_store(const struct settings_schema *schema, const struct json_document *doc, int object, const void *settings, nvs_handle_t *handle);
@@ -1,53 +1,176 @@
 #include "water_temp_control.h"
 
 #include <esp_log.h>
+#include <math.h>
 
+#include "rtc.h"
 #include "rf_transmitter.h"
 #include "nvs_namespace_keys.h"
 #include "sensor.h"
 #include "water_temp_reading.h"
 
+#define NO_OUTLET -1
+
 struct sensor_control* get_water_temp_control() { return &water_temp_control; }
 
+// Current duty cycle, duty is positive for heating and negative for cooling
+static time_t cycle_start_time;
+static time_t cycle_end_time;
+static float cycle_duty;
+static int active_outlet = NO_OUTLET;
+
+// Sums for least squares fit of temperature over current duty cycle
+static uint32_t num_samples;
+static double sum_t, sum_temp, sum_t_t, sum_t_temp;
+
+// --------------------------------------------------- Helper functions ----------------------------------------------
+
+static void water_temp_add_sample(time_t now, float temp) {
+	double t = now - cycle_start_time;
+	num_samples++;
+	sum_t += t;
+	sum_temp += temp;
+	sum_t_t += t * t;
+	sum_t_temp += t * temp;
+}
+
+// Fit line through samples of last cycle, returns false if there aren't enough samples
+static bool water_temp_fit_cycle(float *rate, float *end_temp) {
+	double denominator = num_samples * sum_t_t - sum_t * sum_t;
+	if(num_samples < 3 || denominator <= 0) return false;
+
+	double slope = (num_samples * sum_t_temp - sum_t * sum_temp) / denominator;
+	double intercept = (sum_temp - slope * sum_t) / num_samples;
+
+	*rate = slope;
+	*end_temp = intercept + slope * (cycle_end_time - cycle_start_time);
+	return true;
+}
+
+static void water_temp_update_model(float rate) {
+	struct water_temp_model *model = &water_temp_model;
+	float predicted_rate = model->passive_rate;
+	if(cycle_duty > 0) predicted_rate += cycle_duty * model->heating_rate;
+	else if(cycle_duty < 0) predicted_rate += cycle_duty * model->cooling_rate;
+
+	// Blame error on equipment that ran for a meaningful part of cycle, otherwise on surroundings
+	float error = WATER_TEMP_LEARNING_RATE * (rate - predicted_rate);
+	if(cycle_duty >= WATER_TEMP_MIN_LEARNING_DUTY) model->heating_rate += error / cycle_duty;
+	else if(cycle_duty <= -WATER_TEMP_MIN_LEARNING_DUTY) model->cooling_rate += error / cycle_duty;
+	else model->passive_rate += error;
+
+	// Equipment that has no effect would make duty infinite
+	if(model->heating_rate < WATER_TEMP_DEFAULT_RATE / 10) model->heating_rate = WATER_TEMP_DEFAULT_RATE / 10;
+	if(model->cooling_rate < WATER_TEMP_DEFAULT_RATE / 10) model->cooling_rate = WATER_TEMP_DEFAULT_RATE / 10;
+
+	ESP_LOGI(WATER_TEMP_TAG, "Measured rate: %.5f, passive: %.5f, heating: %.5f, cooling: %.5f", rate, model->passive_rate, model->heating_rate, model->cooling_rate);
+}
+
+// Duty needed to correct error over correction time, positive for heating and negative for cooling
+static float water_temp_get_duty(float temp) {
+	float error = control_get_target_value(&water_temp_control) - temp;
+	float needed_rate = error / WATER_TEMP_CORRECTION_TIME - water_temp_model.passive_rate;
+
+	float duty = 0;
+	if(needed_rate > 0 && water_temp_control.is_up_control) duty = needed_rate / water_temp_model.heating_rate;
+	else if(needed_rate < 0 && water_temp_control.is_down_control) duty = needed_rate / water_temp_model.cooling_rate;
+
+	if(duty > 1) duty = 1;
+	else if(duty < -1) duty = -1;
+	return duty;
+}
+
+// Round on time so outlets are never switched for less than minimum on and off times
+static uint32_t water_temp_get_on_time(float duty) {
+	uint32_t on_time = (uint32_t)(fabsf(duty) * WATER_TEMP_DUTY_PERIOD + 0.5f);
+
+	if(on_time < WATER_TEMP_MIN_ON_TIME) on_time = on_time * 2 >= WATER_TEMP_MIN_ON_TIME ? WATER_TEMP_MIN_ON_TIME : 0;
+	if(WATER_TEMP_DUTY_PERIOD - on_time < WATER_TEMP_MIN_OFF_TIME) {
+		on_time = (WATER_TEMP_DUTY_PERIOD - on_time) * 2 >= WATER_TEMP_MIN_OFF_TIME ? WATER_TEMP_DUTY_PERIOD - WATER_TEMP_MIN_OFF_TIME : WATER_TEMP_DUTY_PERIOD;
+	}
+	return on_time;
+}
+
+static void water_temp_start_cycle(time_t now, float temp) {
+	// Learn from last cycle and use fitted temperature, which is less noisy than last reading
+	float rate;
+	if(cycle_end_time != 0 && water_temp_fit_cycle(&rate, &temp)) water_temp_update_model(rate);
+
+	float duty = water_temp_get_duty(temp);
+	uint32_t on_time = water_temp_get_on_time(duty);
+	int outlet = on_time == 0 ? NO_OUTLET : (duty > 0 ? WATER_HEATER : WATER_COOLER);
+
+	// Outlet that stays on isn't sent again to save rf messages
+	if(active_outlet != outlet) {
+		water_temp_outlet_off();
+		if(outlet == WATER_HEATER) heat_water();
+		else if(outlet == WATER_COOLER) cool_water();
+	}
+	if(on_time > 0 && on_time < WATER_TEMP_DUTY_PERIOD) enable_timer(&dev, control_get_dose_timer(&water_temp_control), on_time);
+
+	cycle_duty = (duty > 0 ? 1.0f : -1.0f) * on_time / WATER_TEMP_DUTY_PERIOD;
+	cycle_start_time = now;
+	cycle_end_time = now + WATER_TEMP_DUTY_PERIOD;
+	num_samples = 0;
+	sum_t = sum_temp = sum_t_t = sum_t_temp = 0;
+
+	ESP_LOGI(WATER_TEMP_TAG, "Started duty cycle, temperature: %.2f, duty: %.2f", temp, cycle_duty);
+}
+
+// --------------------------------------------------------------------------------------------------------------------
+
+void init_water_temp_model() {
+	water_temp_model.passive_rate = 0;
+	water_temp_model.heating_rate = WATER_TEMP_DEFAULT_RATE;
+	water_temp_model.cooling_rate = WATER_TEMP_DEFAULT_RATE;
+
+	cycle_end_time = 0;
+	active_outlet = NO_OUTLET;
+	is_water_cooler_on = false;
+}
+
 void check_water_temp() {
-    int result = control_check_sensor(&water_temp_control, sensor_get_value(get_water_temp_sensor()));
-    if(!is_water_cooler_on && result == -1) {
-        heat_water();
-        is_water_cooler_on = true;
-    } else if(!is_water_cooler_on && result == 1) {
-        cool_water();
-        is_water_cooler_on = true;
-    } else if(is_water_cooler_on && result == 0) {
-        stop_water_adjustment();
-        is_water_cooler_on = false;
-    }
+	if(!control_get_enabled(&water_temp_control)) {
+		if(is_water_cooler_on) stop_water_adjustment();
+		cycle_end_time = 0;
+		return;
+	}
+
+	time_t now;
+	get_unix_time(&dev, &now);
+	float temp = sensor_get_value(get_water_temp_sensor());
+
+	if(now >= cycle_end_time) water_temp_start_cycle(now, temp);
+	water_temp_add_sample(now, temp);
 }
 
 void heat_water() {
     ESP_LOGI(WATER_TEMP_TAG, "Turning on water heater");
     control_power_outlet(WATER_HEATER, true);
+    active_outlet = WATER_HEATER;
+    is_water_cooler_on = true;
 }
 
 void cool_water() {
     ESP_LOGI(WATER_TEMP_TAG, "Turning on water cooler");
     control_power_outlet(WATER_COOLER, true);
+    active_outlet = WATER_COOLER;
+    is_water_cooler_on = true;
 }
 
 void stop_water_adjustment() {
     ESP_LOGI(WATER_TEMP_TAG, "Turning off water heater and cooler");
     control_power_outlet(WATER_HEATER, false);
     control_power_outlet(WATER_COOLER, false);
+    active_outlet = NO_OUTLET;
+    is_water_cooler_on = false;
 }
 
-void water_temp_update_settings(cJSON *item) {
-    nvs_handle_t *handle = nvs_get_handle(WATER_TEMP_NVS_NAMESPACE);
-	control_update_settings(&water_temp_control, item, handle);
+void water_temp_outlet_off() {
+    if(active_outlet == NO_OUTLET) return;
 
-	nvs_commit_data(handle);
-	ESP_LOGI(WATER_TEMP_TAG, "Updated settings and committed data to NVS");
+    ESP_LOGI(WATER_TEMP_TAG, "Turning off water %s", active_outlet == WATER_HEATER ? "heater" : "cooler");
+    control_power_outlet(active_outlet, false);
+    active_outlet = NO_OUTLET;
+    is_water_cooler_on = false;
 }
-
-void water_temp_get_nvs_settings() {
-	control_get_nvs_settings(&water_temp_control, WATER_TEMP_NVS_NAMESPACE);
-	ESP_LOGI(WATER_TEMP_TAG ,"Updated settings from NVS");
-}
\ No newline at end of file
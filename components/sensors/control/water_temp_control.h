@@ -6,18 +6,52 @@
 #define WATER_TEMP_TAG "WATER_TEMP_CONTROL"
 
 // Margin of error
-static const float WATER_TEMP_MARGIN_ERROR = 5;
+#define WATER_TEMP_MARGIN_ERROR 5
+
+// Range targets and alarm limits are accepted in, degrees celsius
+#define WATER_TEMP_MIN_VALUE 0
+#define WATER_TEMP_MAX_VALUE 50
+
+// Heater and cooler are run for part of every duty cycle, times in seconds
+#define WATER_TEMP_DUTY_PERIOD 600
+#define WATER_TEMP_MIN_ON_TIME 60
+#define WATER_TEMP_MIN_OFF_TIME 60
+
+// Time to correct a temperature error over, shorter is faster but overshoots more
+#define WATER_TEMP_CORRECTION_TIME 1800
+
+// Heating and cooling rate used until rates are learned, in degrees per second
+#define WATER_TEMP_DEFAULT_RATE 0.001
+
+// Weight of last duty cycle when updating learned rates
+#define WATER_TEMP_LEARNING_RATE 0.3
+
+// Smallest duty cycle to learn heating or cooling rate from
+#define WATER_TEMP_MIN_LEARNING_DUTY 0.25
+
+// Thermal model of reservoir learned from temperature history, rates in degrees per second
+struct water_temp_model {
+	float passive_rate;		// Change with heater and cooler off
+	float heating_rate;		// Extra change with heater on
+	float cooling_rate;		// Extra change with cooler on (positive)
+};
 
 // Control struct
 struct sensor_control water_temp_control;
 
+// Learned thermal model
+struct water_temp_model water_temp_model;
+
 // Track when any water temperature equipment is on
 bool is_water_cooler_on;
 
 // Get control
 struct sensor_control* get_water_temp_control();
 
-// Checks and adjust water temperature
+// Reset thermal model and duty cycle
+void init_water_temp_model();
+
+// Checks and adjust water temperature, starts new duty cycle when last one is done
 void check_water_temp();
 
 // Turn water heater on
@@ -26,11 +60,8 @@ void heat_water();
 // Turn water cooler on
 void cool_water();
 
-// Turn ph pumps off
+// Turn water heater and cooler off
 void stop_water_adjustment();
 
-// Update settings
-void water_temp_update_settings(cJSON *item);
-
-// Get and store settings from NVS
-void water_temp_get_nvs_settings();
\ No newline at end of file
+// Turn outlet that is on off, called by dose timer at end of on time
+void water_temp_outlet_off();
\ No newline at end of file
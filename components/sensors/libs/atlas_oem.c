@@ -0,0 +1,373 @@
+/*
+ * atlas_oem.c
+ *
+ *  Generic driver for Atlas Scientific OEM circuits.
+ */
+
+#include "atlas_oem.h"
+#include <esp_log.h>
+#include <esp_err.h>
+#include <math.h>
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+/* MACRO for checkng argument paramters */
+#define CHECK_ARG(VAL) do { if (!(VAL)) return ESP_ERR_INVALID_ARG; } while (0)
+/* I2C Protocol Speed Parameter (10-100 kHz for OEM Device) */
+#define I2C_FREQ_HZ 10000
+/* Time device needs to process calibration and hibernation commands */
+#define PROCESSING_DELAY 1000
+/* New reading flag is polled this often (ms), circuits take a reading every 420 to 640 ms */
+#define NEW_READING_POLL_INTERVAL 50
+/* Give up if no new reading arrives within this time (ms) */
+#define NEW_READING_TIMEOUT 3000
+/* MACRO for calibration function*/
+#define STABILIZATION_ACCURACY 0.002
+/* MACRO for calibration function */
+#define STABILIZATION_COUNT_MAX 10
+/* Give up waiting for stable reading after this many attempts, disconnected or dry probe never settles */
+#define STABILIZATION_ATTEMPTS_MAX 120
+/* Temperature compensation range, default point is used outside of it */
+#define MIN_COMPENSATION_TEMP 10.0
+#define MAX_COMPENSATION_TEMP 35.0
+#define DEFAULT_COMPENSATION_TEMP 25.0
+
+// --------------------------------------------------- Families ---------------------------------------------------------
+
+// Mid point clears other points, so it has to be stored first
+static const struct atlas_oem_calibration_point ph_points[] = {
+	{ .key = "mid", .name = "7.0", .min_reading = 5.5, .max_reading = 8.5, .value = 7.0, .request = 3, .confirm_mask = 1 << 1 },
+	{ .key = "low", .name = "4.0", .min_reading = 2.5, .max_reading = 5.5, .value = 4.0, .request = 2, .confirm_mask = 1 << 0 },
+	{ .key = "high", .name = "10.0", .min_reading = 8.5, .max_reading = 11.5, .value = 10.0, .request = 4, .confirm_mask = 1 << 2 }
+};
+
+const struct atlas_oem_family atlas_oem_ph = {
+	.tag = "Atlas PH Sensor",
+	.device_type = 1,
+	.addr_base = 0x65,
+	.scale = 1000,
+	.reading_reg = 0x16,
+	.temp_comp_reg = 0x0E,
+	.temp_confirm_reg = 0x12,
+	.calib_value_reg = 0x08,
+	.calib_request_reg = 0x0C,
+	.calib_confirm_reg = 0x0D,
+	.clear_request = 1,
+	.points = ph_points,
+	.num_points = sizeof(ph_points) / sizeof(ph_points[0])
+};
+
+// Dry calibration comes first, probe reads close to 0 in air
+static const struct atlas_oem_calibration_point ec_points[] = {
+	{ .key = "dry", .name = "Dry", .min_reading = -1, .max_reading = 1, .request = 2, .confirm_mask = 1 << 0 },
+	{ .key = "single", .name = "12.88 millisiemens", .min_reading = 5, .max_reading = 20, .value = 12.88, .request = 3, .confirm_mask = 1 << 1 }
+};
+
+const struct atlas_oem_family atlas_oem_ec = {
+	.tag = "Atlas EC Sensor",
+	.device_type = 4,
+	.addr_base = 0x64,
+	.scale = 100,
+	.reading_reg = 0x18,
+	.temp_comp_reg = 0x10,
+	.temp_confirm_reg = 0x14,
+	.calib_value_reg = 0x0A,
+	.calib_request_reg = 0x0E,
+	.calib_confirm_reg = 0x0F,
+	.clear_request = 1,
+	.points = ec_points,
+	.num_points = sizeof(ec_points) / sizeof(ec_points[0])
+};
+
+static const struct atlas_oem_calibration_point orp_points[] = {
+	{ .key = "single", .name = "225 mV", .min_reading = 150, .max_reading = 300, .value = 225, .request = 2, .confirm_mask = 1 << 0 }
+};
+
+const struct atlas_oem_family atlas_oem_orp = {
+	.tag = "Atlas ORP Sensor",
+	.device_type = 2,
+	.addr_base = 0x66,
+	.scale = 10,
+	.reading_reg = 0x0E,
+	.temp_comp_reg = ATLAS_OEM_NO_REGISTER,
+	.temp_confirm_reg = ATLAS_OEM_NO_REGISTER,
+	.calib_value_reg = 0x08,
+	.calib_request_reg = 0x0C,
+	.calib_confirm_reg = 0x0D,
+	.clear_request = 1,
+	.points = orp_points,
+	.num_points = sizeof(orp_points) / sizeof(orp_points[0])
+};
+
+// Dissolved oxygen calibrates against air and zero solution, values are fixed by circuit
+static const struct atlas_oem_calibration_point do_points[] = {
+	{ .key = "zero", .name = "Zero", .min_reading = -1, .max_reading = 1, .request = 3, .confirm_mask = 1 << 1 },
+	{ .key = "atmospheric", .name = "Atmospheric", .min_reading = 1, .max_reading = 50, .request = 2, .confirm_mask = 1 << 0 }
+};
+
+const struct atlas_oem_family atlas_oem_do = {
+	.tag = "Atlas DO Sensor",
+	.device_type = 3,
+	.addr_base = 0x67,
+	.scale = 100,
+	.reading_reg = 0x22,
+	.temp_comp_reg = 0x12,
+	.temp_confirm_reg = 0x1E,
+	.calib_value_reg = ATLAS_OEM_NO_REGISTER,
+	.calib_request_reg = 0x08,
+	.calib_confirm_reg = 0x09,
+	.clear_request = 1,
+	.points = do_points,
+	.num_points = sizeof(do_points) / sizeof(do_points[0])
+};
+
+// --------------------------------------------------- Helper functions -------------------------------------------------
+
+// Write value as 4 byte big endian register block in one transaction, registers auto increment
+static esp_err_t atlas_oem_write_value(i2c_dev_t *dev, uint8_t reg, float value, float scale) {
+	int32_t raw = (int32_t) roundf(value * scale);
+	uint8_t bytes[4] = { (raw >> 24) & 0xFF, (raw >> 16) & 0xFF, (raw >> 8) & 0xFF, raw & 0xFF };
+
+	I2C_DEV_TAKE_MUTEX(dev);
+	I2C_DEV_CHECK(dev, i2c_dev_write_reg(dev, reg, bytes, sizeof(bytes)));
+	I2C_DEV_GIVE_MUTEX(dev);
+	return ESP_OK;
+}
+
+// Read 4 byte big endian register block in one transaction
+static esp_err_t atlas_oem_read_value(i2c_dev_t *dev, uint8_t reg, float scale, float *value) {
+	uint8_t bytes[4];
+
+	I2C_DEV_TAKE_MUTEX(dev);
+	I2C_DEV_CHECK(dev, i2c_dev_read_reg(dev, reg, bytes, sizeof(bytes)));
+	I2C_DEV_GIVE_MUTEX(dev);
+
+	int32_t raw = ((uint32_t) bytes[0] << 24) | ((uint32_t) bytes[1] << 16) | ((uint32_t) bytes[2] << 8) | bytes[3];
+	*value = ((float) raw) / scale;
+	return ESP_OK;
+}
+
+static esp_err_t atlas_oem_write_byte(i2c_dev_t *dev, uint8_t reg, uint8_t data) {
+	I2C_DEV_TAKE_MUTEX(dev);
+	I2C_DEV_CHECK(dev, i2c_dev_write_reg(dev, reg, &data, sizeof(data)));
+	I2C_DEV_GIVE_MUTEX(dev);
+	return ESP_OK;
+}
+
+static esp_err_t atlas_oem_read_byte(i2c_dev_t *dev, uint8_t reg, uint8_t *data) {
+	I2C_DEV_TAKE_MUTEX(dev);
+	I2C_DEV_CHECK(dev, i2c_dev_read_reg(dev, reg, data, sizeof(*data)));
+	I2C_DEV_GIVE_MUTEX(dev);
+	return ESP_OK;
+}
+
+// Set temperature compensation point, readings taken from now on use it
+static esp_err_t atlas_oem_set_compensation(i2c_dev_t *dev, const struct atlas_oem_family *family, float temperature) {
+	if (temperature <= MIN_COMPENSATION_TEMP || temperature >= MAX_COMPENSATION_TEMP) temperature = DEFAULT_COMPENSATION_TEMP;
+	float nearest = roundf(temperature * 100) / 100;
+
+	esp_err_t err = atlas_oem_write_value(dev, family->temp_comp_reg, nearest, 100);
+	if (err != ESP_OK) return err;
+
+	// Compensation register is applied immediately, one readback is enough to confirm it
+	float check_temp = 0;
+	err = atlas_oem_read_value(dev, family->temp_confirm_reg, 100, &check_temp);
+	if (err != ESP_OK) return err;
+	if (fabsf(check_temp - nearest) > 0.005) ESP_LOGE(family->tag, "Unable to set temperature compensation point.");
+
+	return ESP_OK;
+}
+
+// Poll new reading flag until device took a reading and clear it for next use
+static esp_err_t atlas_oem_wait_new_reading(i2c_dev_t *dev, const struct atlas_oem_family *family) {
+	uint8_t new_reading = 0;
+	for (uint32_t waited = 0; waited <= NEW_READING_TIMEOUT; waited += NEW_READING_POLL_INTERVAL) {
+		esp_err_t err = atlas_oem_read_byte(dev, ATLAS_OEM_NEW_READING_REG, &new_reading);
+		if (err != ESP_OK) return err;
+		if (new_reading == 1) return atlas_oem_write_byte(dev, ATLAS_OEM_NEW_READING_REG, 0);
+
+		vTaskDelay(pdMS_TO_TICKS(NEW_READING_POLL_INTERVAL));
+	}
+
+	ESP_LOGE(family->tag, "Unable to get new reading.");
+	return ESP_ERR_TIMEOUT;
+}
+
+// Send calibration request and read confirmation register once device processed it
+static esp_err_t atlas_oem_request_calibration(i2c_dev_t *dev, const struct atlas_oem_family *family, uint8_t request, uint8_t *confirm) {
+	esp_err_t err = atlas_oem_write_byte(dev, family->calib_request_reg, request);
+	if (err != ESP_OK) return err;
+	vTaskDelay(pdMS_TO_TICKS(PROCESSING_DELAY));
+
+	return atlas_oem_read_byte(dev, family->calib_confirm_reg, confirm);
+}
+
+// ----------------------------------------------------------------------------------------------------------------------
+
+esp_err_t atlas_oem_init(i2c_dev_t *dev, const struct atlas_oem_family *family, i2c_port_t port, uint8_t addr, int8_t sda_gpio, int8_t scl_gpio) {
+	// Check Arguments
+	CHECK_ARG(dev && family);
+	if (addr < family->addr_base || addr > family->addr_base + 7) {
+		ESP_LOGE(family->tag, "Invalid device address: 0x%02x", addr);
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	// Setup I2C settings
+	dev->port = port;
+	dev->addr = addr;
+	dev->cfg.sda_io_num = sda_gpio;
+	dev->cfg.scl_io_num = scl_gpio;
+	dev->cfg.master.clk_speed = I2C_FREQ_HZ;
+
+	return i2c_dev_create_mutex(dev);
+}
+
+esp_err_t atlas_oem_detect(i2c_dev_t *dev, const struct atlas_oem_family *family) {
+	uint8_t device_type = 0;
+	esp_err_t err = atlas_oem_read_byte(dev, ATLAS_OEM_DEVICE_TYPE_REG, &device_type);
+	if (err != ESP_OK) return err;
+
+	if (device_type != family->device_type) {
+		ESP_LOGE(family->tag, "Device at 0x%02x has type %d, expected %d", dev->addr, device_type, family->device_type);
+		return ESP_ERR_NOT_FOUND;
+	}
+	return ESP_OK;
+}
+
+esp_err_t atlas_oem_get_firmware(i2c_dev_t *dev, uint8_t *version) {
+	return atlas_oem_read_byte(dev, ATLAS_OEM_FIRMWARE_REG, version);
+}
+
+esp_err_t atlas_oem_activate(i2c_dev_t *dev) {
+	esp_err_t err = atlas_oem_write_byte(dev, ATLAS_OEM_ACTIVE_REG, 0x01);
+	vTaskDelay(pdMS_TO_TICKS(PROCESSING_DELAY));
+	return err;
+}
+
+esp_err_t atlas_oem_hibernate(i2c_dev_t *dev) {
+	esp_err_t err = atlas_oem_write_byte(dev, ATLAS_OEM_ACTIVE_REG, 0x00);
+	vTaskDelay(pdMS_TO_TICKS(PROCESSING_DELAY));
+	return err;
+}
+
+esp_err_t atlas_oem_read(i2c_dev_t *dev, const struct atlas_oem_family *family, float temperature, float *value) {
+	CHECK_ARG(dev && family && value);
+	esp_err_t err;
+
+	if (family->temp_comp_reg != ATLAS_OEM_NO_REGISTER && temperature != ATLAS_OEM_NO_COMPENSATION) {
+		err = atlas_oem_set_compensation(dev, family, temperature);
+		if (err != ESP_OK) return err;
+
+		// Drop pending reading, it was taken with the old compensation point
+		err = atlas_oem_write_byte(dev, ATLAS_OEM_NEW_READING_REG, 0);
+		if (err != ESP_OK) return err;
+	}
+
+	err = atlas_oem_wait_new_reading(dev, family);
+	if (err != ESP_OK) return err;
+
+	return atlas_oem_read_value(dev, family->reading_reg, family->scale, value);
+}
+
+esp_err_t atlas_oem_wait_stable(i2c_dev_t *dev, const struct atlas_oem_family *family, float temperature, float *value) {
+	uint8_t count = 0;
+	float min = 0;
+	float max = 0;
+
+	// Keep restarting until 10 consecutive values are within stabilization accuracy range
+	for (uint16_t attempt = 0; count < STABILIZATION_COUNT_MAX; ++attempt) {
+		if (attempt == STABILIZATION_ATTEMPTS_MAX) {
+			ESP_LOGE(family->tag, "reading not stable after %d attempts", STABILIZATION_ATTEMPTS_MAX);
+			return ESP_ERR_TIMEOUT;
+		}
+
+		esp_err_t err = atlas_oem_read(dev, family, temperature, value);
+		if (err != ESP_OK) {
+			ESP_LOGI(family->tag, "response code: %d", err);
+			vTaskDelay(pdMS_TO_TICKS(PROCESSING_DELAY));
+			continue;
+		}
+		ESP_LOGI(family->tag, "reading: %f", *value);
+
+		if (count == 0) {	// If first reading, then calculate stabilization range
+			min = *value - fabsf(*value) * STABILIZATION_ACCURACY;
+			max = *value + fabsf(*value) * STABILIZATION_ACCURACY;
+			ESP_LOGI(family->tag, "min: %f, max: %f", min, max);
+			count++;
+		} else if (*value >= min && *value <= max) {	// increment count if reading is within range
+			count++;
+		} else {
+			count = 0;	// reset count to zero if reading is not within range
+		}
+	}
+	return ESP_OK;
+}
+
+const struct atlas_oem_calibration_point* atlas_oem_find_point(const struct atlas_oem_family *family, float reading) {
+	for (uint8_t i = 0; i < family->num_points; ++i) {
+		if (reading >= family->points[i].min_reading && reading < family->points[i].max_reading) return &family->points[i];
+	}
+	return NULL;
+}
+
+const struct atlas_oem_calibration_point* atlas_oem_find_point_by_key(const struct atlas_oem_family *family, const char *key) {
+	for (uint8_t i = 0; i < family->num_points; ++i) {
+		if (strcmp(family->points[i].key, key) == 0) return &family->points[i];
+	}
+	return NULL;
+}
+
+esp_err_t atlas_oem_calibrate_point(i2c_dev_t *dev, const struct atlas_oem_family *family, const struct atlas_oem_calibration_point *point) {
+	CHECK_ARG(dev && family && point);
+	esp_err_t err;
+
+	// Send value of calibration solution before requesting calibration
+	if (family->calib_value_reg != ATLAS_OEM_NO_REGISTER) {
+		err = atlas_oem_write_value(dev, family->calib_value_reg, point->value, family->scale);
+		if (err != ESP_OK) return err;
+		vTaskDelay(pdMS_TO_TICKS(PROCESSING_DELAY));
+	}
+
+	uint8_t confirm = 0;
+	err = atlas_oem_request_calibration(dev, family, point->request, &confirm);
+	if (err != ESP_OK) return err;
+
+	// Make sure calibration confirmation register confirmed calibration setting
+	if ((confirm & point->confirm_mask) == 0) {
+		ESP_LOGE(family->tag, "%s calibration unable to be set", point->name);
+		return ESP_FAIL;
+	}
+	ESP_LOGI(family->tag, "%s calibration set", point->name);
+	return ESP_OK;
+}
+
+esp_err_t atlas_oem_calibrate(i2c_dev_t *dev, const struct atlas_oem_family *family, float temperature) {
+	float reading = 0;
+	esp_err_t err = atlas_oem_wait_stable(dev, family, temperature, &reading);
+	if (err != ESP_OK) return err;
+
+	// Identify calibration solution from stable reading
+	const struct atlas_oem_calibration_point *point = atlas_oem_find_point(family, reading);
+	if (point == NULL) {
+		ESP_LOGE(family->tag, "calibration solution not identified, reading %f is out of range of all solutions", reading);
+		return ESP_FAIL;
+	}
+	ESP_LOGI(family->tag, "%s solution identified", point->name);
+
+	return atlas_oem_calibrate_point(dev, family, point);
+}
+
+esp_err_t atlas_oem_clear_calibration(i2c_dev_t *dev, const struct atlas_oem_family *family) {
+	uint8_t confirm = 0xFF;
+	esp_err_t err = atlas_oem_request_calibration(dev, family, family->clear_request, &confirm);
+	if (err != ESP_OK) return err;
+
+	// Make sure calibration confirmation register confirmed calibration clear setting
+	if (confirm != 0) {
+		ESP_LOGE(family->tag, "Calibration data not cleared");
+		return ESP_FAIL;
+	}
+	ESP_LOGI(family->tag, "Calibration data cleared");
+	return ESP_OK;
+}
@@ -0,0 +1,149 @@
+/*
+ * atlas_oem.h
+ *
+ *  Generic driver for Atlas Scientific OEM circuits (pH, EC, ORP, DO).
+ *  Families share register protocol and differ in register map, scale and calibration points,
+ *  which are described by a family descriptor.
+ */
+
+#ifndef ATLAS_OEM_H
+#define ATLAS_OEM_H
+
+#include <esp_err.h>
+#include <stdbool.h>
+#include "i2cdev.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Registers shared by all families */
+#define ATLAS_OEM_DEVICE_TYPE_REG 0x00
+#define ATLAS_OEM_FIRMWARE_REG 0x01
+#define ATLAS_OEM_ACTIVE_REG 0x06
+#define ATLAS_OEM_NEW_READING_REG 0x07
+
+/* Register address of features a family doesn't have */
+#define ATLAS_OEM_NO_REGISTER 0x00
+
+/* Pass as temperature to read without temperature compensation */
+#define ATLAS_OEM_NO_COMPENSATION -1000.0f
+
+/**
+ * Calibration point, solution is identified by the stable reading falling into [min_reading, max_reading)
+ */
+struct atlas_oem_calibration_point {
+	const char *key;			// Short name used to request point
+	const char *name;
+	float min_reading;
+	float max_reading;
+	float value;				// Value of calibration solution, written to calibration value register if family has one
+	uint8_t request;			// Written to calibration request register
+	uint8_t confirm_mask;		// Bits set in calibration confirm register once point is stored
+};
+
+/**
+ * Family descriptor, register addresses are first registers of 4 byte big endian values
+ */
+struct atlas_oem_family {
+	const char *tag;
+	uint8_t device_type;		// Content of device type register
+	uint8_t addr_base;			// Default address, devices can be moved up to 7 addresses above it
+	float scale;				// Register value is reading * scale
+	uint8_t reading_reg;
+	uint8_t temp_comp_reg;		// ATLAS_OEM_NO_REGISTER if readings aren't temperature compensated
+	uint8_t temp_confirm_reg;
+	uint8_t calib_value_reg;	// ATLAS_OEM_NO_REGISTER if calibration points have fixed values
+	uint8_t calib_request_reg;
+	uint8_t calib_confirm_reg;
+	uint8_t clear_request;		// Calibration request clearing all points
+	const struct atlas_oem_calibration_point *points;	// In order device requires when calibrating several points
+	uint8_t num_points;
+};
+
+/* Supported families */
+extern const struct atlas_oem_family atlas_oem_ph;
+extern const struct atlas_oem_family atlas_oem_ec;
+extern const struct atlas_oem_family atlas_oem_orp;
+extern const struct atlas_oem_family atlas_oem_do;
+
+/**
+ * @brief Setup I2C communication
+ * @param dev I2C device descriptor
+ * @param family Family of device
+ * @param port I2C port
+ * @param addr I2C address
+ * @param sda_gpio SDA GPIO
+ * @param scl_gpio SCL GPIO
+ * @return ESP_ERR_INVALID_ARG if address doesn't belong to family
+ */
+esp_err_t atlas_oem_init(i2c_dev_t *dev, const struct atlas_oem_family *family, i2c_port_t port, uint8_t addr, int8_t sda_gpio, int8_t scl_gpio);
+
+/**
+ * @brief Check that a device of family answers at address of descriptor
+ * @return ESP_ERR_NOT_FOUND if another device type answers, I2C error if nothing answers
+ */
+esp_err_t atlas_oem_detect(i2c_dev_t *dev, const struct atlas_oem_family *family);
+
+/**
+ * @brief Read firmware version
+ */
+esp_err_t atlas_oem_get_firmware(i2c_dev_t *dev, uint8_t *version);
+
+/**
+ * @brief Wake up device, first reading is ready one processing delay later
+ */
+esp_err_t atlas_oem_activate(i2c_dev_t *dev);
+
+/**
+ * @brief Put device in hibernation mode
+ */
+esp_err_t atlas_oem_hibernate(i2c_dev_t *dev);
+
+/**
+ * @brief Read newest reading
+ * @param temperature Temperature compensation point, ATLAS_OEM_NO_COMPENSATION to leave it unchanged
+ * @param value pointer to reading
+ * @return ESP_ERR_TIMEOUT if device doesn't take a new reading
+ */
+esp_err_t atlas_oem_read(i2c_dev_t *dev, const struct atlas_oem_family *family, float temperature, float *value);
+
+/**
+ * @brief Read until STABILIZATION_COUNT_MAX consecutive readings are within stabilization accuracy
+ * @param value pointer to last, stable reading
+ * @return ESP_ERR_TIMEOUT if reading doesn't settle within STABILIZATION_ATTEMPTS_MAX attempts
+ */
+esp_err_t atlas_oem_wait_stable(i2c_dev_t *dev, const struct atlas_oem_family *family, float temperature, float *value);
+
+/**
+ * @brief Find calibration point of family whose solution range contains reading
+ * @return NULL if reading isn't in range of any calibration solution
+ */
+const struct atlas_oem_calibration_point* atlas_oem_find_point(const struct atlas_oem_family *family, float reading);
+
+/**
+ * @brief Find calibration point of family by key
+ * @return NULL if family has no point with key
+ */
+const struct atlas_oem_calibration_point* atlas_oem_find_point_by_key(const struct atlas_oem_family *family, const char *key);
+
+/**
+ * @brief Store calibration point and confirm device accepted it
+ */
+esp_err_t atlas_oem_calibrate_point(i2c_dev_t *dev, const struct atlas_oem_family *family, const struct atlas_oem_calibration_point *point);
+
+/**
+ * @brief Wait for stable reading, identify calibration solution and store calibration point
+ */
+esp_err_t atlas_oem_calibrate(i2c_dev_t *dev, const struct atlas_oem_family *family, float temperature);
+
+/**
+ * @brief Clear all calibration points
+ */
+esp_err_t atlas_oem_clear_calibration(i2c_dev_t *dev, const struct atlas_oem_family *family);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ATLAS_OEM_H */
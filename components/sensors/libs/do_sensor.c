@@ -0,0 +1,27 @@
+/*
+ * do_sensor.c
+ *
+ *  Dissolved oxygen circuit on top of generic Atlas OEM driver.
+ */
+
+#include "do_sensor.h"
+#include "atlas_oem.h"
+
+esp_err_t do_init(do_sensor_t *dev, i2c_port_t port, uint8_t addr, int8_t sda_gpio, int8_t scl_gpio) {
+	return atlas_oem_init(dev, &atlas_oem_do, port, addr, sda_gpio, scl_gpio);
+}
+
+esp_err_t activate_do(do_sensor_t *dev) { return atlas_oem_activate(dev); }
+
+esp_err_t hibernate_do(do_sensor_t *dev) { return atlas_oem_hibernate(dev); }
+
+esp_err_t clear_calibration_do(do_sensor_t *dev) { return atlas_oem_clear_calibration(dev, &atlas_oem_do); }
+
+// Probe is calibrated in air or zero solution at current temperature
+esp_err_t calibrate_do(do_sensor_t *dev) { return atlas_oem_calibrate(dev, &atlas_oem_do, ATLAS_OEM_NO_COMPENSATION); }
+
+esp_err_t read_do_with_temperature(do_sensor_t *dev, float temperature, float *dissolved_oxygen) {
+	return atlas_oem_read(dev, &atlas_oem_do, temperature, dissolved_oxygen);
+}
+
+esp_err_t read_do(do_sensor_t *dev, float *dissolved_oxygen) { return atlas_oem_read(dev, &atlas_oem_do, ATLAS_OEM_NO_COMPENSATION, dissolved_oxygen); }
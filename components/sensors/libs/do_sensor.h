@@ -0,0 +1,80 @@
+/*
+ * do_sensor.h
+ *
+ *  dissolved oxygen circuit on top of generic Atlas OEM driver.
+ */
+
+#ifndef DO_SENSOR_H
+#define DO_SENSOR_H
+
+#include <esp_err.h>
+#include "i2cdev.h"
+#define DO_ADDR_BASE 0x67
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef i2c_dev_t do_sensor_t;
+
+/**
+ * @brief Setup dissolved oxygen I2C communication
+ * @param dev I2C device descriptor
+ * @param port I2C port
+ * @param addr I2C address
+ * @param sda_gpio SDA GPIO
+ * @param scl_gpio SCL GPIO
+ * @return ESP_OK to indicate success
+ */
+esp_err_t do_init(do_sensor_t *dev, i2c_port_t port, uint8_t addr, int8_t sda_gpio, int8_t scl_gpio);
+
+/**
+ * @brief Wake up dissolved oxygen sensor
+ * @param dev I2C device descriptor
+ * @return ESP_OK to indicate success
+ */
+esp_err_t activate_do(do_sensor_t *dev);
+
+/**
+ * @brief Hibernate dissolved oxygen sensor
+ * @param dev I2C device descriptor
+ * @return ESP_OK to indicate success
+ */
+esp_err_t hibernate_do(do_sensor_t *dev);
+
+/**
+ * @brief Calibrate dissolved oxygen sensor, solution is identified from stable reading
+ * @param dev I2C device descriptor
+ * @return ESP_OK to indicate success
+ */
+esp_err_t calibrate_do(do_sensor_t *dev);
+
+/**
+ * @brief Clear calibration settings
+ * @param dev I2C device descriptor
+ * @return ESP_OK to indicate success
+ */
+esp_err_t clear_calibration_do(do_sensor_t *dev);
+
+/**
+ * @brief Read dissolved oxygen in mg/L with temperature compensation
+ * @param dev I2C device descriptor
+ * @param temperature This value is required for temperature compensation
+ * @param dissolved_oxygen pointer to dissolved oxygen variable
+ * @return ESP_OK to indicate success
+ */
+esp_err_t read_do_with_temperature(do_sensor_t *dev, float temperature, float *dissolved_oxygen);
+
+/**
+ * @brief Read dissolved oxygen in mg/L without temperature compensation
+ * @param dev I2C device descriptor
+ * @param dissolved_oxygen pointer to dissolved oxygen variable
+ * @return ESP_OK to indicate success
+ */
+esp_err_t read_do(do_sensor_t *dev, float *dissolved_oxygen);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DO_SENSOR_H */
@@ -0,0 +1,22 @@
+/*
+ * orp_sensor.c
+ *
+ *  ORP circuit on top of generic Atlas OEM driver.
+ */
+
+#include "orp_sensor.h"
+#include "atlas_oem.h"
+
+esp_err_t orp_init(orp_sensor_t *dev, i2c_port_t port, uint8_t addr, int8_t sda_gpio, int8_t scl_gpio) {
+	return atlas_oem_init(dev, &atlas_oem_orp, port, addr, sda_gpio, scl_gpio);
+}
+
+esp_err_t activate_orp(orp_sensor_t *dev) { return atlas_oem_activate(dev); }
+
+esp_err_t hibernate_orp(orp_sensor_t *dev) { return atlas_oem_hibernate(dev); }
+
+esp_err_t clear_calibration_orp(orp_sensor_t *dev) { return atlas_oem_clear_calibration(dev, &atlas_oem_orp); }
+
+esp_err_t calibrate_orp(orp_sensor_t *dev) { return atlas_oem_calibrate(dev, &atlas_oem_orp, ATLAS_OEM_NO_COMPENSATION); }
+
+esp_err_t read_orp(orp_sensor_t *dev, float *orp) { return atlas_oem_read(dev, &atlas_oem_orp, ATLAS_OEM_NO_COMPENSATION, orp); }
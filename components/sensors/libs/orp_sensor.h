@@ -0,0 +1,71 @@
+/*
+ * orp_sensor.h
+ *
+ *  ORP circuit on top of generic Atlas OEM driver.
+ */
+
+#ifndef ORP_SENSOR_H
+#define ORP_SENSOR_H
+
+#include <esp_err.h>
+#include "i2cdev.h"
+#define ORP_ADDR_BASE 0x66
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef i2c_dev_t orp_sensor_t;
+
+/**
+ * @brief Setup ORP I2C communication
+ * @param dev I2C device descriptor
+ * @param port I2C port
+ * @param addr I2C address
+ * @param sda_gpio SDA GPIO
+ * @param scl_gpio SCL GPIO
+ * @return ESP_OK to indicate success
+ */
+esp_err_t orp_init(orp_sensor_t *dev, i2c_port_t port, uint8_t addr, int8_t sda_gpio, int8_t scl_gpio);
+
+/**
+ * @brief Wake up ORP sensor
+ * @param dev I2C device descriptor
+ * @return ESP_OK to indicate success
+ */
+esp_err_t activate_orp(orp_sensor_t *dev);
+
+/**
+ * @brief Hibernate ORP sensor
+ * @param dev I2C device descriptor
+ * @return ESP_OK to indicate success
+ */
+esp_err_t hibernate_orp(orp_sensor_t *dev);
+
+/**
+ * @brief Calibrate ORP sensor, solution is identified from stable reading
+ * @param dev I2C device descriptor
+ * @return ESP_OK to indicate success
+ */
+esp_err_t calibrate_orp(orp_sensor_t *dev);
+
+/**
+ * @brief Clear calibration settings
+ * @param dev I2C device descriptor
+ * @return ESP_OK to indicate success
+ */
+esp_err_t clear_calibration_orp(orp_sensor_t *dev);
+
+/**
+ * @brief Read ORP in mV
+ * @param dev I2C device descriptor
+ * @param orp pointer to orp variable
+ * @return ESP_OK to indicate success
+ */
+esp_err_t read_orp(orp_sensor_t *dev, float *orp);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ORP_SENSOR_H */
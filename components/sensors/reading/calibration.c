@@ -0,0 +1,274 @@
+#include "calibration.h"
+
+#include <esp_log.h>
+#include <math.h>
+#include <string.h>
+
+#include "sync_sensors.h"
+#include "sensor_registry.h"
+#include "water_temp_reading.h"
+#include "grow_manager.h"
+#include "mqtt_manager.h"
+
+static struct calibration calibrations[MAX_CALIBRATIONS];
+
+// Calibrations are started from MQTT task while calibration task steps them
+static portMUX_TYPE calibration_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static bool calibration_is_active(const struct calibration *calibration) {
+	return calibration->state == CALIBRATION_WAITING_FOR_SOLUTION || calibration->state == CALIBRATION_STABILIZING;
+}
+
+static bool calibration_is_compensated(const struct calibration *calibration) {
+	return calibration->family->temp_comp_reg != ATLAS_OEM_NO_REGISTER;
+}
+
+void calibration_default_settings(struct calibration_settings *settings) {
+	settings->window = CALIBRATION_DEFAULT_WINDOW;
+	settings->accuracy = CALIBRATION_DEFAULT_ACCURACY;
+	settings->timeout = CALIBRATION_DEFAULT_TIMEOUT;
+}
+
+bool calibration_is_running(struct sensor *sensor) {
+	for(uint8_t i = 0; i < MAX_CALIBRATIONS; ++i) {
+		if(calibrations[i].sensor == sensor && calibration_is_active(&calibrations[i])) return true;
+	}
+	return false;
+}
+
+bool calibration_needs_temperature() {
+	for(uint8_t i = 0; i < MAX_CALIBRATIONS; ++i) {
+		if(calibration_is_active(&calibrations[i]) && calibration_is_compensated(&calibrations[i])) return true;
+	}
+	return false;
+}
+
+const char* calibration_get_state_name(enum calibration_state state) {
+	switch(state) {
+	case CALIBRATION_WAITING_FOR_SOLUTION: return "waiting_for_solution";
+	case CALIBRATION_STABILIZING: return "stabilizing";
+	case CALIBRATION_DONE: return "done";
+	case CALIBRATION_FAILED: return "failed";
+	default: return "idle";
+	}
+}
+
+// Find index of point in family, points are stored in that order
+static uint8_t calibration_point_order(const struct atlas_oem_family *family, const struct atlas_oem_calibration_point *point) {
+	return point - family->points;
+}
+
+esp_err_t calibration_start(struct sensor *sensor, i2c_dev_t *dev, const struct atlas_oem_family *family, uint8_t reservoir,
+		const char **keys, uint8_t num_keys, const struct calibration_settings *settings, const struct calibration_hooks *hooks) {
+	if(num_keys > CALIBRATION_MAX_POINTS) return ESP_ERR_INVALID_ARG;
+
+	// Resolve keys before claiming a slot, sequence is sorted by insertion since it has at most a few points
+	const struct atlas_oem_calibration_point *points[CALIBRATION_MAX_POINTS] = { NULL };
+	uint8_t num_points = 0;
+	for(uint8_t i = 0; i < num_keys; ++i) {
+		const struct atlas_oem_calibration_point *point = atlas_oem_find_point_by_key(family, keys[i]);
+		if(point == NULL) {
+			ESP_LOGE(CALIBRATION_TAG, "%s has no calibration point %s", family->tag, keys[i]);
+			return ESP_ERR_NOT_FOUND;
+		}
+
+		uint8_t j = num_points++;
+		for(; j > 0 && calibration_point_order(family, points[j - 1]) > calibration_point_order(family, point); --j) points[j] = points[j - 1];
+		points[j] = point;
+	}
+	if(num_points == 0) num_points = 1;		// Single point identified from reading
+
+	struct calibration *calibration = NULL;
+	portENTER_CRITICAL(&calibration_mux);
+	for(uint8_t i = 0; i < MAX_CALIBRATIONS; ++i) {
+		if(calibration_is_active(&calibrations[i]) && calibrations[i].sensor == sensor) {
+			portEXIT_CRITICAL(&calibration_mux);
+			ESP_LOGE(CALIBRATION_TAG, "Reservoir %d %s is already calibrating", reservoir + 1, sensor->name);
+			return ESP_ERR_INVALID_STATE;
+		}
+		if(calibration == NULL && !calibration_is_active(&calibrations[i])) calibration = &calibrations[i];
+	}
+	if(calibration == NULL) {
+		portEXIT_CRITICAL(&calibration_mux);
+		return ESP_ERR_NO_MEM;
+	}
+
+	calibration->sensor = sensor;
+	calibration->dev = dev;
+	calibration->family = family;
+	calibration->reservoir = reservoir;
+	calibration->hooks = hooks;
+	calibration->is_prepared = false;
+	memcpy(calibration->points, points, sizeof(points));
+	calibration->num_points = num_points;
+	calibration->point_index = 0;
+	calibration->settings = *settings;
+	calibration->stable_count = 0;
+	calibration->last_reading = 0;
+	calibration->point_start = xTaskGetTickCount();
+	calibration->state = CALIBRATION_WAITING_FOR_SOLUTION;	// Set last, slot belongs to calibration task from now on
+	portEXIT_CRITICAL(&calibration_mux);
+
+	// Calibrating sensor stops taking part in sync rounds and control until it is done
+	sensor_set_calib_status(sensor, true);
+	set_sensor_sync_bits();
+
+	// Temperature task is suspended while no grow cycle runs but compensated readings need it
+	if(calibration_is_compensated(calibration) && !get_is_grow_active()) sensor_registry_resume_task(get_water_temp_sensor());
+
+	ESP_LOGI(CALIBRATION_TAG, "Reservoir %d %s calibration started, %d points", reservoir + 1, sensor->name, num_points);
+	xTaskNotifyGive(calibration_task_handle);
+	return ESP_OK;
+}
+
+// ---------------------------------------------------- Calibration task ------------------------------------------------
+
+static cJSON* calibration_get_progress_json(const struct calibration *calibration, enum calibration_state state, const char *error) {
+	const struct atlas_oem_calibration_point *point = calibration->point_index < calibration->num_points ? calibration->points[calibration->point_index] : NULL;
+
+	cJSON *progress = cJSON_CreateObject();
+	cJSON_AddStringToObject(progress, "sensor", calibration->sensor->name);
+	cJSON_AddNumberToObject(progress, "reservoir", calibration->reservoir + 1);
+	cJSON_AddStringToObject(progress, "state", calibration_get_state_name(state));
+	if(point != NULL) cJSON_AddStringToObject(progress, "point", point->key);
+	cJSON_AddNumberToObject(progress, "point_index", calibration->point_index);
+	cJSON_AddNumberToObject(progress, "num_points", calibration->num_points);
+	cJSON_AddNumberToObject(progress, "reading", calibration->last_reading);
+	cJSON_AddNumberToObject(progress, "stable", calibration->stable_count);
+	cJSON_AddNumberToObject(progress, "window", calibration->settings.window);
+	cJSON_AddNumberToObject(progress, "elapsed", (xTaskGetTickCount() - calibration->point_start) * portTICK_PERIOD_MS / 1000);
+	if(error != NULL) cJSON_AddStringToObject(progress, "error", error);
+	return progress;
+}
+
+static void calibration_publish_progress(const struct calibration *calibration, const char *error) {
+	cJSON *progress = calibration_get_progress_json(calibration, calibration->state, error);
+	publish_calibration_progress(progress);
+	cJSON_Delete(progress);
+}
+
+static void calibration_finish(struct calibration *calibration, enum calibration_state state, const char *error) {
+	if(state == CALIBRATION_DONE) {
+		ESP_LOGI(CALIBRATION_TAG, "Reservoir %d %s calibration done", calibration->reservoir + 1, calibration->sensor->name);
+	} else {
+		ESP_LOGE(CALIBRATION_TAG, "Reservoir %d %s calibration failed: %s", calibration->reservoir + 1, calibration->sensor->name, error);
+	}
+
+	if(calibration->hooks != NULL && calibration->hooks->finish != NULL) calibration->hooks->finish(calibration->reservoir);
+	sensor_set_calib_status(calibration->sensor, false);
+
+	// Slot can be started again once state is set, everything needed afterwards is copied first
+	cJSON *progress = calibration_get_progress_json(calibration, state, error);
+	bool is_compensated = calibration_is_compensated(calibration);
+	portENTER_CRITICAL(&calibration_mux);
+	calibration->state = state;
+	portEXIT_CRITICAL(&calibration_mux);
+
+	publish_calibration_progress(progress);
+	cJSON_Delete(progress);
+	set_sensor_sync_bits();
+
+	if(is_compensated && !calibration_needs_temperature() && !get_is_grow_active()) {
+		sensor_registry_suspend_task(get_water_temp_sensor());
+	}
+}
+
+// Start new stability window at reading
+static void calibration_restart_window(struct calibration *calibration, float reading) {
+	calibration->window_reading = reading;
+	calibration->stable_count = 1;
+}
+
+// Take one reading and advance calibration
+static void calibration_step(struct calibration *calibration) {
+	if(!calibration->is_prepared) {
+		if(calibration->hooks != NULL && calibration->hooks->prepare != NULL) calibration->hooks->prepare(calibration->reservoir);
+		calibration->is_prepared = true;
+		calibration->point_start = xTaskGetTickCount();
+	}
+
+	if(xTaskGetTickCount() - calibration->point_start > pdMS_TO_TICKS(calibration->settings.timeout * 1000)) {
+		calibration_finish(calibration, CALIBRATION_FAILED, calibration->state == CALIBRATION_WAITING_FOR_SOLUTION ? "solution not found" : "reading not stable");
+		return;
+	}
+
+	float temperature = ATLAS_OEM_NO_COMPENSATION;
+	if(calibration_is_compensated(calibration) && sensor_get_active_status(get_water_temp_sensor())) temperature = sensor_get_value(get_water_temp_sensor());
+
+	float reading;
+	if(atlas_oem_read(calibration->dev, calibration->family, temperature, &reading) != ESP_OK) {
+		// Read errors only count towards timeout
+		calibration->stable_count = 0;
+		calibration_publish_progress(calibration, "read failed");
+		return;
+	}
+	calibration->last_reading = reading;
+
+	// Probe is still in previous solution or rinse water while reading is outside of expected solution range
+	const struct atlas_oem_calibration_point *expected = calibration->points[calibration->point_index];
+	if(expected != NULL && (reading < expected->min_reading || reading >= expected->max_reading)) {
+		calibration->state = CALIBRATION_WAITING_FOR_SOLUTION;
+		calibration->stable_count = 0;
+		calibration_publish_progress(calibration, NULL);
+		return;
+	}
+
+	// Tolerance of readings close to 0 would vanish, register resolution bounds it from below
+	float tolerance = fmaxf(fabsf(calibration->window_reading) * calibration->settings.accuracy, CALIBRATION_MIN_COUNTS / calibration->family->scale);
+	if(calibration->stable_count > 0 && fabsf(reading - calibration->window_reading) <= tolerance) {
+		calibration->stable_count++;
+	} else {
+		calibration_restart_window(calibration, reading);
+	}
+	calibration->state = CALIBRATION_STABILIZING;
+
+	if(calibration->stable_count < calibration->settings.window) {
+		calibration_publish_progress(calibration, NULL);
+		return;
+	}
+
+	const struct atlas_oem_calibration_point *point = expected != NULL ? expected : atlas_oem_find_point(calibration->family, reading);
+	if(point == NULL) {
+		// Stable, but not in any calibration solution
+		calibration->state = CALIBRATION_WAITING_FOR_SOLUTION;
+		calibration->stable_count = 0;
+		calibration_publish_progress(calibration, NULL);
+		return;
+	}
+
+	ESP_LOGI(CALIBRATION_TAG, "Reservoir %d %s stable at %f, storing %s point", calibration->reservoir + 1, calibration->sensor->name, reading, point->name);
+	if(atlas_oem_calibrate_point(calibration->dev, calibration->family, point) != ESP_OK) {
+		calibration_finish(calibration, CALIBRATION_FAILED, "point not stored");
+		return;
+	}
+
+	calibration->points[calibration->point_index++] = point;
+	if(calibration->point_index >= calibration->num_points) {
+		calibration_finish(calibration, CALIBRATION_DONE, NULL);
+		return;
+	}
+
+	// Next solution, probe has to be moved before readings count again
+	calibration->state = CALIBRATION_WAITING_FOR_SOLUTION;
+	calibration->stable_count = 0;
+	calibration->point_start = xTaskGetTickCount();
+	calibration_publish_progress(calibration, NULL);
+}
+
+void calibration_task(void *parameter) {		// Calibration Task
+	for(;;) {
+		bool is_running = false;
+		for(uint8_t i = 0; i < MAX_CALIBRATIONS; ++i) {
+			if(!calibration_is_active(&calibrations[i])) continue;
+			calibration_step(&calibrations[i]);
+			is_running = true;
+		}
+
+		// Sleep until next calibration is started
+		if(is_running) {
+			vTaskDelay(pdMS_TO_TICKS(CALIBRATION_STEP_PERIOD));
+		} else {
+			ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+		}
+	}
+}
@@ -0,0 +1,88 @@
+#include <stdbool.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "sensor.h"
+#include "atlas_oem.h"
+#include "ports.h"
+
+#ifndef COMPONENTS_SENSORS_READING_CALIBRATION_H_
+#define COMPONENTS_SENSORS_READING_CALIBRATION_H_
+
+#define CALIBRATION_TAG "CALIBRATION"
+
+// Calibrations that can run at the same time, one per ph and ec sensor
+#define MAX_CALIBRATIONS (2 * NUM_RESERVOIRS)
+
+// Most points a sequence can have
+#define CALIBRATION_MAX_POINTS 3
+
+// Time between calibration steps in ms, each step takes one reading of every running calibration
+#define CALIBRATION_STEP_PERIOD 1000
+
+// Defaults of stability window, consecutive readings have to stay within accuracy of first reading of window
+#define CALIBRATION_DEFAULT_WINDOW 10
+#define CALIBRATION_DEFAULT_ACCURACY 0.002	// Relative to reading
+#define CALIBRATION_DEFAULT_TIMEOUT 300		// Seconds a point may take before calibration fails
+
+// Readings closer to 0 than this many register counts use count based tolerance instead of relative accuracy
+#define CALIBRATION_MIN_COUNTS 2
+
+enum calibration_state { CALIBRATION_IDLE, CALIBRATION_WAITING_FOR_SOLUTION, CALIBRATION_STABILIZING, CALIBRATION_DONE, CALIBRATION_FAILED };
+
+struct calibration_settings {
+	uint8_t window;		// Consecutive stable readings needed to store point
+	float accuracy;
+	uint32_t timeout;	// Seconds per point
+};
+
+// Called from calibration task with reservoir of sensor, NULL if sensor module has nothing to do
+struct calibration_hooks {
+	void (*prepare)(uint8_t reservoir);		// Before first reading, wakes up device
+	void (*finish)(uint8_t reservoir);		// Once calibration is done or failed
+};
+
+struct calibration {
+	struct sensor *sensor;
+	i2c_dev_t *dev;
+	const struct atlas_oem_family *family;
+	uint8_t reservoir;
+	const struct calibration_hooks *hooks;
+	bool is_prepared;
+
+	// Points in order they are stored, NULL point is identified from stable reading
+	const struct atlas_oem_calibration_point *points[CALIBRATION_MAX_POINTS];
+	uint8_t num_points;
+	uint8_t point_index;
+
+	struct calibration_settings settings;
+	enum calibration_state state;
+	uint8_t stable_count;
+	float window_reading;		// First reading of current stability window
+	float last_reading;
+	TickType_t point_start;
+};
+
+#endif
+
+TaskHandle_t calibration_task_handle;
+
+// Fill settings with defaults
+void calibration_default_settings(struct calibration_settings *settings);
+
+// Start calibration of sensor, keys select points of family and are sorted in order family requires
+// No keys calibrates one point identified from stable reading
+// Returns ESP_ERR_INVALID_STATE if sensor is already calibrating, ESP_ERR_NOT_FOUND for unknown keys
+esp_err_t calibration_start(struct sensor *sensor, i2c_dev_t *dev, const struct atlas_oem_family *family, uint8_t reservoir,
+		const char **keys, uint8_t num_keys, const struct calibration_settings *settings, const struct calibration_hooks *hooks);
+
+// Check if sensor is being calibrated
+bool calibration_is_running(struct sensor *sensor);
+
+// Check if a temperature compensated sensor is being calibrated
+bool calibration_needs_temperature();
+
+// Get name of state used in progress messages
+const char* calibration_get_state_name(enum calibration_state state);
+
+// Steps running calibrations, sleeps while none is running
+void calibration_task(void *parameter);
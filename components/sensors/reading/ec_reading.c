@@ -3,66 +3,84 @@
 #include <esp_log.h>
 #include "string.h"
 #include "sync_sensors.h"
+#include "sensor_registry.h"
+#include "atlas_oem.h"
 #include "task_priorities.h"
 #include "ports.h"
 #include "water_temp_reading.h"
+#include "calibration.h"
 #include <stdbool.h>
 
-struct sensor* get_ec_sensor() { return &ec_sensor; }
+struct sensor* get_ec_sensor(uint8_t reservoir) { return &ec_sensors[reservoir]; }
 
-ec_sensor_t* get_ec_dev() {return &ec_dev; }
+ec_sensor_t* get_ec_dev(uint8_t reservoir) {return &ec_devs[reservoir]; }
 
-bool get_is_ec_activated() {return is_ec_activated; }
+bool get_is_ec_activated(uint8_t reservoir) {return is_ec_activated[reservoir]; }
 
-void set_is_ec_activated(bool is_active) {is_ec_activated = is_active;}
+void set_is_ec_activated(uint8_t reservoir, bool is_active) {is_ec_activated[reservoir] = is_active;}
 
+// Device may be hibernating while no grow cycle runs
+static void ec_prepare_calibration(uint8_t reservoir) {
+	if(!is_ec_activated[reservoir]) {
+		activate_ec(&ec_devs[reservoir]);
+		is_ec_activated[reservoir] = true;
+	}
+}
+
+static void ec_finish_calibration(uint8_t reservoir) {
+	if(!get_is_grow_active() && is_ec_activated[reservoir]) {
+		hibernate_ec(&ec_devs[reservoir]);
+		is_ec_activated[reservoir] = false;
+	}
+}
+
+static const struct calibration_hooks ec_calibration_hooks = { .prepare = &ec_prepare_calibration, .finish = &ec_finish_calibration };
+
+esp_err_t ec_start_calibration(uint8_t reservoir, const char **keys, uint8_t num_keys, const struct calibration_settings *settings) {
+	if(!sensor_get_active_status(&ec_sensors[reservoir])) return ESP_ERR_NOT_FOUND;
+	return calibration_start(&ec_sensors[reservoir], &ec_devs[reservoir], &atlas_oem_ec, reservoir, keys, num_keys, settings, &ec_calibration_hooks);
+}
+
+void register_ec_sensors() {
+	for(uint32_t reservoir = 0; reservoir < NUM_RESERVOIRS; ++reservoir) {
+		sensor_registry_register(&ec_sensors[reservoir], "ec", "mS/cm", SENSOR_MEASUREMENT_PERIOD, &measure_ec, (void *) reservoir, EC_TASK_PRIORITY, reservoir);
+	}
+}
+
+// One task runs per reservoir, sensors wait out their processing delays in parallel
 void measure_ec(void *parameter) {				// EC Sensor Measurement Task
 	const char *TAG = "EC_Task";
+	uint8_t reservoir = (uint32_t)parameter;
+	struct sensor *ec_sensor = &ec_sensors[reservoir];
+	ec_sensor_t *ec_dev = &ec_devs[reservoir];
 
-	init_sensor(&ec_sensor, "ec", true, false);
-	dry_calib = false;
-
-	memset(&ec_dev, 0, sizeof(ec_sensor_t));
-	ESP_ERROR_CHECK(ec_init(&ec_dev, 0, EC_ADDR_BASE, SDA_GPIO, SCL_GPIO)); // Initialize EC I2C communication
+	memset(ec_dev, 0, sizeof(ec_sensor_t));
+	// Sensors that aren't connected drop out instead of stalling sync rounds
+	if(ec_init(ec_dev, 0, EC_RESERVOIR_ADDR(reservoir), SDA_GPIO, SCL_GPIO) != ESP_OK || atlas_oem_detect(ec_dev, &atlas_oem_ec) != ESP_OK) {
+		sensor_registry_drop(ec_sensor);
+		vTaskDelete(NULL);
+	}
 
-	is_ec_activated = false;
+	is_ec_activated[reservoir] = false;
 
-	ESP_ERROR_CHECK(activate_ec(&ec_dev));
+	ESP_ERROR_CHECK(activate_ec(ec_dev));
 
-	is_ec_activated = true; 
+	is_ec_activated[reservoir] = true; 
 
 	for (;;) {
-		if(sensor_calib_status(&ec_sensor)) { // Calibration Mode is activated
-			ESP_LOGI(TAG, "EC Wet Calibration Started");
-            calibrate_sensor(&ec_sensor, &calibrate_ec, &ec_dev);
-            sensor_set_calib_status(&ec_sensor, false);
-            if (!get_is_grow_active()) {
-                ESP_LOGI(TAG, "EC task Suspended");
-                vTaskSuspend(*sensor_get_task_handle(&ec_sensor));
-            }
-            ESP_LOGI(TAG, "EC Wet Calibration Completed");
-
-		} if(dry_calib) {
-			ESP_LOGI(TAG, "EC Dry Calibration Started");
-            calibrate_sensor(&ec_sensor, &calibrate_ec_dry, &ec_dev);
-            dry_calib = false;
-            if (!get_is_grow_active()) {
-                ESP_LOGI(TAG, "EC task Suspended");
-                vTaskSuspend(*sensor_get_task_handle(&ec_sensor));
-            }
-            ESP_LOGI(TAG, "EC Dry Calibration Completed");
-
-		} else {		// EC sensor is Active
-			if (!get_is_ec_activated()) {
-				ESP_ERROR_CHECK(activate_ec(&ec_dev));
-				is_ec_activated = true;
-			}
-			read_ec_with_temperature(&ec_dev, sensor_get_value(get_water_temp_sensor()), sensor_get_address_value(&ec_sensor));
-			ESP_LOGI(TAG, "EC: %f", sensor_get_value(&ec_sensor));
-
-			// Sync with other sensor tasks
-			// Wait up to 10 seconds to let other tasks end
-			xEventGroupSync(sensor_event_group, EC_BIT, sensor_sync_bits, pdMS_TO_TICKS(SENSOR_MEASUREMENT_PERIOD));
+		// Calibration task owns device while sensor is calibrating
+		if(sensor_calib_status(ec_sensor)) {
+			vTaskDelay(pdMS_TO_TICKS(SENSOR_MEASUREMENT_PERIOD));
+			continue;
+		}
+
+		if (!get_is_ec_activated(reservoir)) {
+			ESP_ERROR_CHECK(activate_ec(ec_dev));
+			is_ec_activated[reservoir] = true;
 		}
+		bool is_read = read_ec_with_temperature(ec_dev, sensor_get_value(get_water_temp_sensor()), sensor_get_address_value(ec_sensor)) == ESP_OK;
+		ESP_LOGI(TAG, "Reservoir %d EC: %f", reservoir + 1, sensor_get_value(ec_sensor));
+
+		sensor_registry_sync(ec_sensor, is_read);
 	}
 }
@@ -3,27 +3,37 @@
 #include <freertos/task.h>
 #include "sensor.h"
 #include "ec_sensor.h"
+#include "calibration.h"
+#include "ports.h"
 
-struct sensor ec_sensor;
+// I2C address of ec sensor of reservoir, addresses are 2 apart so they don't collide with ph sensors
+#define EC_RESERVOIR_ADDR(reservoir) (EC_ADDR_BASE + 2 * (reservoir))
 
-ec_sensor_t ec_dev;
+// One sensor per reservoir
+struct sensor ec_sensors[NUM_RESERVOIRS];
 
-bool dry_calib;
+ec_sensor_t ec_devs[NUM_RESERVOIRS];
 
 //variable to check if ec sensor is activated
-bool is_ec_activated;
+bool is_ec_activated[NUM_RESERVOIRS];
 
 //get status of is_activated
-bool get_is_ec_activated();
+bool get_is_ec_activated(uint8_t reservoir);
 
 //set is_activated variable
-void set_is_ec_activated(bool is_active);
+void set_is_ec_activated(uint8_t reservoir, bool is_active);
 
-// Get sensor object
-struct sensor* get_ec_sensor();
+// Get sensor object of reservoir
+struct sensor* get_ec_sensor(uint8_t reservoir);
 
 //Get ec dev 
-ec_sensor_t* get_ec_dev();
+ec_sensor_t* get_ec_dev(uint8_t reservoir);
 
-// Measures water ph
-void measure_ec();
+// Start calibration of ec sensor of reservoir with points "dry" and "single", no keys identifies solution from reading
+esp_err_t ec_start_calibration(uint8_t reservoir, const char **keys, uint8_t num_keys, const struct calibration_settings *settings);
+
+// Register sensors of all reservoirs
+void register_ec_sensors();
+
+// Measures water ec, parameter is reservoir index
+void measure_ec(void *parameter);
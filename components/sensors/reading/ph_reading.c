@@ -3,55 +3,84 @@
 #include <esp_log.h>
 #include <string.h>
 #include "sync_sensors.h"
+#include "sensor_registry.h"
+#include "atlas_oem.h"
 #include "task_priorities.h"
 #include "ports.h"
 #include "water_temp_reading.h"
+#include "calibration.h"
 
-struct sensor* get_ph_sensor() { return &ph_sensor; }
+struct sensor* get_ph_sensor(uint8_t reservoir) { return &ph_sensors[reservoir]; }
 
-ph_sensor_t* get_ph_dev() { return &ph_dev; }
+ph_sensor_t* get_ph_dev(uint8_t reservoir) { return &ph_devs[reservoir]; }
 
-bool get_is_ph_activated() {return is_ph_activated; }
+bool get_is_ph_activated(uint8_t reservoir) {return is_ph_activated[reservoir]; }
 
-void set_is_ph_activated(bool is_active) {is_ph_activated = is_active;}
+void set_is_ph_activated(uint8_t reservoir, bool is_active) {is_ph_activated[reservoir] = is_active;}
 
-void measure_ph(void *parameter) {		// pH Sensor Measurement Task
+// Device may be hibernating while no grow cycle runs
+static void ph_prepare_calibration(uint8_t reservoir) {
+	if(!is_ph_activated[reservoir]) {
+		activate_ph(&ph_devs[reservoir]);
+		is_ph_activated[reservoir] = true;
+	}
+}
 
-	const char *TAG = "PH_Task";
+static void ph_finish_calibration(uint8_t reservoir) {
+	if(!get_is_grow_active() && is_ph_activated[reservoir]) {
+		hibernate_ph(&ph_devs[reservoir]);
+		is_ph_activated[reservoir] = false;
+	}
+}
 
-	init_sensor(&ph_sensor, "ph", true, false);
+static const struct calibration_hooks ph_calibration_hooks = { .prepare = &ph_prepare_calibration, .finish = &ph_finish_calibration };
 
-	memset(&ph_dev, 0, sizeof(ph_sensor_t));
+esp_err_t ph_start_calibration(uint8_t reservoir, const char **keys, uint8_t num_keys, const struct calibration_settings *settings) {
+	if(!sensor_get_active_status(&ph_sensors[reservoir])) return ESP_ERR_NOT_FOUND;
+	return calibration_start(&ph_sensors[reservoir], &ph_devs[reservoir], &atlas_oem_ph, reservoir, keys, num_keys, settings, &ph_calibration_hooks);
+}
 
-	ESP_ERROR_CHECK(ph_init(&ph_dev, 0, PH_ADDR_BASE, SDA_GPIO, SCL_GPIO)); // Initialize PH I2C communication
+void register_ph_sensors() {
+	for(uint32_t reservoir = 0; reservoir < NUM_RESERVOIRS; ++reservoir) {
+		sensor_registry_register(&ph_sensors[reservoir], "ph", "pH", SENSOR_MEASUREMENT_PERIOD, &measure_ph, (void *) reservoir, PH_TASK_PRIORITY, reservoir);
+	}
+}
 
-	is_ph_activated = false;
+// One task runs per reservoir, sensors wait out their processing delays in parallel so more reservoirs barely lengthen measurement cycle
+void measure_ph(void *parameter) {		// pH Sensor Measurement Task
+	const char *TAG = "PH_Task";
+	uint8_t reservoir = (uint32_t)parameter;
+	struct sensor *ph_sensor = &ph_sensors[reservoir];
+	ph_sensor_t *ph_dev = &ph_devs[reservoir];
+
+	memset(ph_dev, 0, sizeof(ph_sensor_t));
+
+	// Sensors that aren't connected drop out instead of stalling sync rounds
+	if(ph_init(ph_dev, 0, PH_RESERVOIR_ADDR(reservoir), SDA_GPIO, SCL_GPIO) != ESP_OK || atlas_oem_detect(ph_dev, &atlas_oem_ph) != ESP_OK) {
+		sensor_registry_drop(ph_sensor);
+		vTaskDelete(NULL);
+	}
+
+	is_ph_activated[reservoir] = false;
 
-	ESP_ERROR_CHECK(activate_ph(&ph_dev));
+	ESP_ERROR_CHECK(activate_ph(ph_dev));
 
-	is_ph_activated = true;
+	is_ph_activated[reservoir] = true;
 
 	vTaskDelay(pdMS_TO_TICKS(1000));
 	for (;;) {
-		if(sensor_calib_status(&ph_sensor)) {
-			ESP_LOGE(TAG, "PH Calibration Started");
-            calibrate_sensor(&ph_sensor, &calibrate_ph, &ph_dev);
-            sensor_set_calib_status(&ph_sensor, false); // Disable calibration mode, activate pH sensor and revert task back to regular priority
-            if (!get_is_grow_active()) {
-				vTaskSuspend(*sensor_get_task_handle(get_water_temp_sensor()));
-                vTaskSuspend(*sensor_get_task_handle(&ph_sensor));
-                ESP_LOGE(TAG, "PH and Water Temp task suspended");
-            }
-            ESP_LOGE(TAG, "PH Calibration Completed");
-		} else {
-			if (!get_is_ph_activated()) {
-				ESP_ERROR_CHECK(activate_ph(&ph_dev));
-				is_ph_activated = true;
-			}
-			read_ph_with_temperature(&ph_dev, sensor_get_value(get_water_temp_sensor()), sensor_get_address_value(&ph_sensor));
-			ESP_LOGI(TAG, "PH: %f", sensor_get_value(&ph_sensor));
-			// Sync with other sensor tasks and wait up to 10 seconds to let other tasks end
-			xEventGroupSync(sensor_event_group, PH_BIT, sensor_sync_bits, pdMS_TO_TICKS(SENSOR_MEASUREMENT_PERIOD));
+		// Calibration task owns device while sensor is calibrating
+		if(sensor_calib_status(ph_sensor)) {
+			vTaskDelay(pdMS_TO_TICKS(SENSOR_MEASUREMENT_PERIOD));
+			continue;
+		}
+
+		if (!get_is_ph_activated(reservoir)) {
+			ESP_ERROR_CHECK(activate_ph(ph_dev));
+			is_ph_activated[reservoir] = true;
 		}
+		bool is_read = read_ph_with_temperature(ph_dev, sensor_get_value(get_water_temp_sensor()), sensor_get_address_value(ph_sensor)) == ESP_OK;
+		ESP_LOGI(TAG, "Reservoir %d PH: %f", reservoir + 1, sensor_get_value(ph_sensor));
+		sensor_registry_sync(ph_sensor, is_read);
 	}
 }
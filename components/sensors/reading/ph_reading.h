@@ -3,27 +3,39 @@
 #include <freertos/task.h>
 #include "sensor.h"
 #include "ph_sensor.h"
+#include "calibration.h"
+#include "ports.h"
 
-struct sensor ph_sensor;
+// I2C address of pH sensor of reservoir, addresses are 2 apart so they don't collide with ec sensors
+#define PH_RESERVOIR_ADDR(reservoir) (PH_ADDR_BASE + 2 * (reservoir))
 
-ph_sensor_t ph_dev;
+// One sensor per reservoir
+struct sensor ph_sensors[NUM_RESERVOIRS];
+
+ph_sensor_t ph_devs[NUM_RESERVOIRS];
 
 //variable to check if ph sensor is activated
-bool is_ph_activated;
+bool is_ph_activated[NUM_RESERVOIRS];
 
 //get status of is_activated
-bool get_is_ph_activated();
+bool get_is_ph_activated(uint8_t reservoir);
 
 //set is_activated variable
-void set_is_ph_activated(bool is_active);
+void set_is_ph_activated(uint8_t reservoir, bool is_active);
+
+// Get ph sensor of reservoir
+struct sensor* get_ph_sensor(uint8_t reservoir);
 
-// Get ph sensor
-struct sensor* get_ph_sensor();
+// Start calibration of ph sensor of reservoir with points "low", "mid" and "high", no keys identifies solution from reading
+esp_err_t ph_start_calibration(uint8_t reservoir, const char **keys, uint8_t num_keys, const struct calibration_settings *settings);
 
 //Get ph dev 
-ph_sensor_t* get_ph_dev();
+ph_sensor_t* get_ph_dev(uint8_t reservoir);
+
+// Register sensors of all reservoirs
+void register_ph_sensors();
 
-// Measures water ph
-void measure_ph();
+// Measures water ph, parameter is reservoir index
+void measure_ph(void *parameter);
 
 
@@ -24,31 +24,6 @@ void sensor_set_active_status(struct sensor *sensor_in, bool status) { sensor_in
 bool sensor_calib_status(struct sensor *sensor_in) { return sensor_in->is_calib; }
 void sensor_set_calib_status(struct sensor *sensor_in, bool status) { sensor_in->is_calib = status; }
 
-void calibrate_sensor(struct sensor *sensor_in, esp_err_t (*calib_func)(i2c_dev_t*), i2c_dev_t *dev) {
-	ESP_LOGI(sensor_in->name, "Start Calibration");
-
-	int task_priority = uxTaskPriorityGet(&sensor_in->task_handle);
-	vTaskPrioritySet(sensor_in->task_handle, (configMAX_PRIORITIES - 1));	// Temporarily increase priority so that calibration can take place without interruption
-
-	esp_err_t error = (*calib_func)(dev); // Calibrate EC
-	/*
-	esp_err_t error = ESP_FAIL; 
-	if (strcmp(sensor_in->name, "ph") == 0) {
-		error = (*calib_func)(dev, 25);
-	} else if (strcmp(sensor_in->name, "ec") == 0) {
-		error = (*calib_func)(dev, 0);
-	} //TODO ADD if any other sensor needs calibration 
-	*/
-
-	if (error != ESP_OK) {
-		ESP_LOGE(sensor_in->name, "Calibration Failed: %d", error);
-	} else {
-		ESP_LOGI(sensor_in->name, "Calibration Success");
-	}
-
-	vTaskPrioritySet(&sensor_in->task_handle, task_priority);
-}
-
 void sensor_get_json(struct sensor *sensor_in, cJSON **obj) {
 	*obj = cJSON_CreateObject();
 	cJSON *name, *value;
@@ -37,8 +37,5 @@ void sensor_set_active_status(struct sensor *sensor_in, bool status);
 bool sensor_calib_status(struct sensor *sensor_in);
 void sensor_set_calib_status(struct sensor *sensor_in, bool status);
 
-// Calibrate sensor
-void calibrate_sensor(struct sensor *sensor_in, esp_err_t (*calib_func)(i2c_dev_t*), i2c_dev_t *dev);
-
 // Get JSON object of sensor dat
 void sensor_get_json(struct sensor *sensor_in, cJSON **obj);
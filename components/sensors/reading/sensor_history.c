@@ -0,0 +1,383 @@
+#include "sensor_history.h"
+
+#include <esp_log.h>
+#include <string.h>
+
+#include "rtc.h"
+#include "nvs_manager.h"
+#include "nvs_namespace_keys.h"
+
+// Longest record is 36 bit timestamp and 44 bit value, block is closed once it can't fit another
+#define HISTORY_MAX_RECORD_BITS 80
+
+// NVS keys are at most 15 characters
+#define HISTORY_NVS_KEY_SIZE 16
+
+// Encoder has no previous meaningful bit window yet
+#define HISTORY_NO_WINDOW 0xFF
+
+static struct history_channel history_channels[HISTORY_MAX_CHANNELS];
+static uint8_t num_history_channels;
+
+// Channels are written by sync task and read by MQTT queries
+static SemaphoreHandle_t history_mutex;
+
+// ------------------------------------------------------ Bit stream --------------------------------------------------
+
+struct history_reader {
+	const struct history_block *block;
+	uint16_t position;
+};
+
+static void history_write_bits(struct history_block *block, uint32_t value, uint8_t num_bits) {
+	for(int8_t i = num_bits - 1; i >= 0; --i) {
+		uint16_t bit = block->bit_length++;
+		if((value >> i) & 1) block->data[bit / 8] |= 0x80 >> (bit % 8);
+	}
+}
+
+static uint32_t history_read_bits(struct history_reader *reader, uint8_t num_bits) {
+	uint32_t value = 0;
+	for(uint8_t i = 0; i < num_bits; ++i) {
+		uint16_t bit = reader->position++;
+		value = (value << 1) | ((reader->block->data[bit / 8] >> (7 - bit % 8)) & 1);
+	}
+	return value;
+}
+
+static int32_t history_sign_extend(uint32_t value, uint8_t num_bits) {
+	return num_bits < 32 && (value & (1u << (num_bits - 1))) ? (int32_t) (value | (~0u << num_bits)) : (int32_t) value;
+}
+
+static uint32_t history_float_bits(float value) {
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	return bits;
+}
+
+static float history_bits_float(uint32_t bits) {
+	float value;
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+// ------------------------------------------------------ Raw tier ----------------------------------------------------
+
+// Timestamp delta of delta, sensors sample at fixed period so it is usually 0 and takes one bit
+static void history_encode_time(struct history_block *block, int32_t delta_of_delta) {
+	if(delta_of_delta == 0) {
+		history_write_bits(block, 0x0, 1);
+	} else if(delta_of_delta >= -64 && delta_of_delta <= 63) {
+		history_write_bits(block, 0x2, 2);
+		history_write_bits(block, delta_of_delta & 0x7F, 7);
+	} else if(delta_of_delta >= -256 && delta_of_delta <= 255) {
+		history_write_bits(block, 0x6, 3);
+		history_write_bits(block, delta_of_delta & 0x1FF, 9);
+	} else if(delta_of_delta >= -2048 && delta_of_delta <= 2047) {
+		history_write_bits(block, 0xE, 4);
+		history_write_bits(block, delta_of_delta & 0xFFF, 12);
+	} else {
+		history_write_bits(block, 0xF, 4);
+		history_write_bits(block, delta_of_delta, 32);
+	}
+}
+
+static int32_t history_decode_time(struct history_reader *reader) {
+	if(history_read_bits(reader, 1) == 0) return 0;
+	if(history_read_bits(reader, 1) == 0) return history_sign_extend(history_read_bits(reader, 7), 7);
+	if(history_read_bits(reader, 1) == 0) return history_sign_extend(history_read_bits(reader, 9), 9);
+	if(history_read_bits(reader, 1) == 0) return history_sign_extend(history_read_bits(reader, 12), 12);
+	return history_read_bits(reader, 32);
+}
+
+// Value XOR'd with previous value, meaningful bits are stored in window of previous value if they fit
+static void history_encode_value(struct history_channel *channel, struct history_block *block, uint32_t value) {
+	uint32_t xor = value ^ channel->last_value;
+	channel->last_value = value;
+	if(xor == 0) {
+		history_write_bits(block, 0x0, 1);
+		return;
+	}
+
+	uint8_t leading = __builtin_clz(xor);
+	uint8_t trailing = __builtin_ctz(xor);
+	if(channel->last_leading != HISTORY_NO_WINDOW && leading >= channel->last_leading && trailing >= channel->last_trailing) {
+		history_write_bits(block, 0x2, 2);
+		history_write_bits(block, xor >> channel->last_trailing, 32 - channel->last_leading - channel->last_trailing);
+		return;
+	}
+
+	uint8_t length = 32 - leading - trailing;
+	history_write_bits(block, 0x3, 2);
+	history_write_bits(block, leading, 5);
+	history_write_bits(block, length - 1, 5);
+	history_write_bits(block, xor >> trailing, length);
+	channel->last_leading = leading;
+	channel->last_trailing = trailing;
+}
+
+struct history_decoder {
+	struct history_reader reader;
+	uint16_t index;
+	uint32_t time;
+	int32_t delta;
+	uint32_t value;
+	uint8_t leading;
+	uint8_t trailing;
+};
+
+static void history_decoder_init(struct history_decoder *decoder, const struct history_block *block) {
+	decoder->reader.block = block;
+	decoder->reader.position = 0;
+	decoder->index = 0;
+	decoder->time = block->start_time;
+	decoder->delta = 0;
+	decoder->value = 0;
+	decoder->leading = 0;
+	decoder->trailing = 0;
+}
+
+// Decode next sample of block, returns false once block is exhausted
+static bool history_decoder_next(struct history_decoder *decoder, uint32_t *time, float *value) {
+	if(decoder->index >= decoder->reader.block->count) return false;
+
+	if(decoder->index == 0) {
+		decoder->value = history_read_bits(&decoder->reader, 32);
+	} else {
+		decoder->delta += history_decode_time(&decoder->reader);
+		decoder->time += decoder->delta;
+
+		if(history_read_bits(&decoder->reader, 1) == 1) {
+			if(history_read_bits(&decoder->reader, 1) == 1) {
+				decoder->leading = history_read_bits(&decoder->reader, 5);
+				uint8_t length = history_read_bits(&decoder->reader, 5) + 1;
+				decoder->trailing = 32 - decoder->leading - length;
+			}
+			uint8_t length = 32 - decoder->leading - decoder->trailing;
+			decoder->value ^= history_read_bits(&decoder->reader, length) << decoder->trailing;
+		}
+	}
+
+	decoder->index++;
+	*time = decoder->time;
+	*value = history_bits_float(decoder->value);
+	return true;
+}
+
+static void history_record_raw(struct history_channel *channel, uint32_t time, float value) {
+	struct history_block *block = &channel->blocks[channel->newest_block];
+	uint32_t bits = history_float_bits(value);
+
+	// Start new block when newest is full or clock went back, timestamps of a block only move forward
+	if(channel->num_blocks == 0 || block->bit_length + HISTORY_MAX_RECORD_BITS > HISTORY_BLOCK_SIZE * 8 || time < channel->last_time) {
+		if(channel->num_blocks > 0) channel->newest_block = (channel->newest_block + 1) % HISTORY_RAW_BLOCKS;
+		if(channel->num_blocks < HISTORY_RAW_BLOCKS) channel->num_blocks++;
+
+		block = &channel->blocks[channel->newest_block];
+		memset(block, 0, sizeof(struct history_block));
+		block->start_time = time;
+		block->count = 1;
+		history_write_bits(block, bits, 32);
+
+		channel->last_time = time;
+		channel->last_delta = 0;
+		channel->last_value = bits;
+		channel->last_leading = HISTORY_NO_WINDOW;
+		return;
+	}
+
+	int32_t delta = time - channel->last_time;
+	history_encode_time(block, delta - channel->last_delta);
+	history_encode_value(channel, block, bits);
+	block->count++;
+
+	channel->last_time = time;
+	channel->last_delta = delta;
+}
+
+// --------------------------------------------------- Aggregated tiers ------------------------------------------------
+
+static void history_ring_init(struct history_ring *ring, struct history_point *points, uint16_t size) {
+	ring->points = points;
+	ring->size = size;
+	ring->head = 0;
+	ring->count = 0;
+}
+
+static void history_ring_push(struct history_ring *ring, const struct history_point *point) {
+	ring->points[ring->head] = *point;
+	ring->head = (ring->head + 1) % ring->size;
+	if(ring->count < ring->size) ring->count++;
+}
+
+// Get point by age order, index 0 is oldest point
+static const struct history_point* history_ring_get(const struct history_ring *ring, uint16_t index) {
+	return &ring->points[(ring->head + ring->size - ring->count + index) % ring->size];
+}
+
+// Add sample to aggregate of period starting at start, returns true and finished point if a period ended
+static bool history_aggregate_add(struct history_aggregate *aggregate, uint32_t start, float value, struct history_point *finished) {
+	bool is_finished = false;
+	if(aggregate->count > 0 && aggregate->start != start) {
+		finished->time = aggregate->start;
+		finished->min = aggregate->min;
+		finished->max = aggregate->max;
+		finished->mean = aggregate->sum / aggregate->count;
+		is_finished = true;
+		aggregate->count = 0;
+	}
+
+	if(aggregate->count == 0) {
+		aggregate->start = start;
+		aggregate->min = value;
+		aggregate->max = value;
+		aggregate->sum = 0;
+	}
+	if(value < aggregate->min) aggregate->min = value;
+	if(value > aggregate->max) aggregate->max = value;
+	aggregate->sum += value;
+	aggregate->count++;
+	return is_finished;
+}
+
+// NVS key is sensor name, followed by reservoir for sensors of a single reservoir
+static void history_get_nvs_key(const struct history_channel *channel, char *key) {
+	if(channel->entry->reservoir == SENSOR_SHARED_RESERVOIR) {
+		snprintf(key, HISTORY_NVS_KEY_SIZE, "%.14s", channel->entry->sensor->name);
+	} else {
+		snprintf(key, HISTORY_NVS_KEY_SIZE, "%.13s%u", channel->entry->sensor->name, channel->entry->reservoir);
+	}
+}
+
+static void history_persist_hours(struct history_channel *channel) {
+	static struct history_point persisted[HISTORY_PERSISTED_HOURS];
+	uint16_t count = channel->hours.count < HISTORY_PERSISTED_HOURS ? channel->hours.count : HISTORY_PERSISTED_HOURS;
+	for(uint16_t i = 0; i < count; ++i) persisted[i] = *history_ring_get(&channel->hours, channel->hours.count - count + i);
+
+	char key[HISTORY_NVS_KEY_SIZE];
+	history_get_nvs_key(channel, key);
+	nvs_handle_t *handle = nvs_get_handle(SENSOR_HISTORY_NVS_NAMESPACE);
+	nvs_add_blob(handle, key, persisted, count * sizeof(struct history_point));
+	nvs_commit_data(handle);
+}
+
+static void history_load_hours(struct history_channel *channel) {
+	static struct history_point persisted[HISTORY_PERSISTED_HOURS];
+	char key[HISTORY_NVS_KEY_SIZE];
+	history_get_nvs_key(channel, key);
+
+	size_t length = sizeof(persisted);
+	if(!nvs_get_blob_data(SENSOR_HISTORY_NVS_NAMESPACE, key, persisted, &length)) return;
+	for(uint16_t i = 0; i < length / sizeof(struct history_point); ++i) history_ring_push(&channel->hours, &persisted[i]);
+	ESP_LOGI(SENSOR_HISTORY_TAG, "Loaded %d hours of %s", channel->hours.count, key);
+}
+
+// --------------------------------------------------------------------------------------------------------------------
+
+void sensor_history_init() {
+	history_mutex = xSemaphoreCreateMutex();
+
+	num_history_channels = 0;
+	for(uint8_t i = 0; i < sensor_registry_count() && num_history_channels < HISTORY_MAX_CHANNELS; ++i) {
+		struct history_channel *channel = &history_channels[num_history_channels++];
+		memset(channel, 0, sizeof(struct history_channel));
+		channel->entry = sensor_registry_get(i);
+		history_ring_init(&channel->minutes, channel->minute_points, HISTORY_MINUTE_POINTS);
+		history_ring_init(&channel->hours, channel->hour_points, HISTORY_HOUR_POINTS);
+		history_load_hours(channel);
+	}
+}
+
+void sensor_history_sample() {
+	time_t now;
+	get_unix_time(&dev, &now);
+
+	xSemaphoreTake(history_mutex, portMAX_DELAY);
+	for(uint8_t i = 0; i < num_history_channels; ++i) {
+		struct history_channel *channel = &history_channels[i];
+		struct sensor *sensor = channel->entry->sensor;
+		if(!channel->entry->is_published || !sensor_get_active_status(sensor) || sensor_calib_status(sensor)) continue;
+
+		float value = sensor_get_value(sensor);
+		history_record_raw(channel, now, value);
+
+		struct history_point finished;
+		if(history_aggregate_add(&channel->minute, now - now % 60, value, &finished)) history_ring_push(&channel->minutes, &finished);
+		if(history_aggregate_add(&channel->hour, now - now % 3600, value, &finished)) {
+			history_ring_push(&channel->hours, &finished);
+			history_persist_hours(channel);
+		}
+	}
+	xSemaphoreGive(history_mutex);
+}
+
+struct history_channel* sensor_history_find(const char *name, uint8_t reservoir) {
+	for(uint8_t i = 0; i < num_history_channels; ++i) {
+		struct registered_sensor *entry = history_channels[i].entry;
+		if(strcmp(entry->sensor->name, name) != 0) continue;
+		if(entry->reservoir == reservoir || entry->reservoir == SENSOR_SHARED_RESERVOIR) return &history_channels[i];
+	}
+	return NULL;
+}
+
+enum history_tier sensor_history_select_tier(struct history_channel *channel, uint32_t from) {
+	enum history_tier tier = HISTORY_HOUR;
+	xSemaphoreTake(history_mutex, portMAX_DELAY);
+	if(channel->num_blocks > 0) {
+		uint8_t oldest_block = (channel->newest_block + HISTORY_RAW_BLOCKS - channel->num_blocks + 1) % HISTORY_RAW_BLOCKS;
+		if(from >= channel->blocks[oldest_block].start_time) tier = HISTORY_RAW;
+	}
+	if(tier == HISTORY_HOUR && channel->minutes.count > 0 && from >= history_ring_get(&channel->minutes, 0)->time) tier = HISTORY_MINUTE;
+	xSemaphoreGive(history_mutex);
+	return tier;
+}
+
+const char* sensor_history_get_tier_name(enum history_tier tier) {
+	switch(tier) {
+	case HISTORY_RAW: return "raw";
+	case HISTORY_MINUTE: return "minute";
+	default: return "hour";
+	}
+}
+
+bool sensor_history_parse_tier(const char *name, enum history_tier *tier) {
+	if(strcmp(name, "raw") == 0) *tier = HISTORY_RAW;
+	else if(strcmp(name, "minute") == 0) *tier = HISTORY_MINUTE;
+	else if(strcmp(name, "hour") == 0) *tier = HISTORY_HOUR;
+	else return false;
+	return true;
+}
+
+uint16_t sensor_history_query(struct history_channel *channel, enum history_tier tier, uint32_t from, uint32_t to,
+		struct history_point *points, uint16_t max_points) {
+	uint16_t num_points = 0;
+	xSemaphoreTake(history_mutex, portMAX_DELAY);
+
+	if(tier == HISTORY_RAW) {
+		for(uint8_t i = 0; i < channel->num_blocks && num_points < max_points; ++i) {
+			uint8_t index = (channel->newest_block + HISTORY_RAW_BLOCKS - channel->num_blocks + 1 + i) % HISTORY_RAW_BLOCKS;
+			struct history_decoder decoder;
+			history_decoder_init(&decoder, &channel->blocks[index]);
+
+			uint32_t time;
+			float value;
+			while(num_points < max_points && history_decoder_next(&decoder, &time, &value)) {
+				if(time < from || time > to) continue;
+				points[num_points].time = time;
+				points[num_points].min = value;
+				points[num_points].max = value;
+				points[num_points].mean = value;
+				num_points++;
+			}
+		}
+	} else {
+		struct history_ring *ring = tier == HISTORY_MINUTE ? &channel->minutes : &channel->hours;
+		for(uint16_t i = 0; i < ring->count && num_points < max_points; ++i) {
+			const struct history_point *point = history_ring_get(ring, i);
+			if(point->time >= from && point->time <= to) points[num_points++] = *point;
+		}
+	}
+
+	xSemaphoreGive(history_mutex);
+	return num_points;
+}
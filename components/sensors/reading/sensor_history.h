@@ -0,0 +1,108 @@
+#include <stdbool.h>
+#include <time.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include "sensor_registry.h"
+#include "ports.h"
+
+#ifndef COMPONENTS_SENSORS_READING_SENSOR_HISTORY_H_
+#define COMPONENTS_SENSORS_READING_SENSOR_HISTORY_H_
+
+#define SENSOR_HISTORY_TAG "SENSOR_HISTORY"
+
+// Channels with history, ph and ec of every reservoir plus shared water temperature, level and volume
+#define HISTORY_MAX_CHANNELS (2 * NUM_RESERVOIRS + 3)
+
+// Raw samples are compressed into blocks, timestamps as delta of delta and values XOR'd with previous value
+// A block holds about 30 noisy to 120 constant samples, oldest block is reused once all are full
+#define HISTORY_BLOCK_SIZE 128
+#define HISTORY_RAW_BLOCKS 12
+
+// Aggregated tiers, minute tier covers 3 hours and hour tier a week
+#define HISTORY_MINUTE_POINTS 180
+#define HISTORY_HOUR_POINTS 168
+
+// Newest hours stored in NVS so history survives restarts, written once per hour
+#define HISTORY_PERSISTED_HOURS 48
+
+// Points per history response message
+#define HISTORY_CHUNK_POINTS 60
+
+enum history_tier { HISTORY_RAW, HISTORY_MINUTE, HISTORY_HOUR };
+
+// Point of any tier, raw points have min, max and mean set to sample
+struct history_point {
+	uint32_t time;		// Unix time of sample or start of minute/hour
+	float min;
+	float max;
+	float mean;
+};
+
+struct history_block {
+	uint32_t start_time;
+	uint16_t count;
+	uint16_t bit_length;
+	uint8_t data[HISTORY_BLOCK_SIZE];
+};
+
+// Fixed size ring of aggregated points
+struct history_ring {
+	struct history_point *points;
+	uint16_t size;
+	uint16_t head;		// Index newest point is written to next
+	uint16_t count;
+};
+
+// Running min/max/mean of current minute or hour
+struct history_aggregate {
+	uint32_t start;
+	float min;
+	float max;
+	float sum;
+	uint16_t count;
+};
+
+struct history_channel {
+	struct registered_sensor *entry;
+
+	struct history_block blocks[HISTORY_RAW_BLOCKS];
+	uint8_t newest_block;
+	uint8_t num_blocks;
+
+	// Encoder state of newest block
+	uint32_t last_time;
+	int32_t last_delta;
+	uint32_t last_value;
+	uint8_t last_leading;
+	uint8_t last_trailing;
+
+	struct history_point minute_points[HISTORY_MINUTE_POINTS];
+	struct history_point hour_points[HISTORY_HOUR_POINTS];
+	struct history_ring minutes;
+	struct history_ring hours;
+	struct history_aggregate minute;
+	struct history_aggregate hour;
+};
+
+#endif
+
+// Assign channels to registered sensors and load persisted hours, call after sensors are registered
+void sensor_history_init();
+
+// Record values of active, published sensors that aren't calibrating, called after every sync round
+void sensor_history_sample();
+
+// Find channel of sensor name and reservoir, NULL if sensor has no history
+struct history_channel* sensor_history_find(const char *name, uint8_t reservoir);
+
+// Get tier whose oldest point is older than time, falls back to hour tier
+enum history_tier sensor_history_select_tier(struct history_channel *channel, uint32_t from);
+
+// Get name of tier used in queries
+const char* sensor_history_get_tier_name(enum history_tier tier);
+bool sensor_history_parse_tier(const char *name, enum history_tier *tier);
+
+// Copy up to max_points points of tier with from <= time <= to in chronological order, returns number of copied points
+// Continue query with from set to time of last point + 1
+uint16_t sensor_history_query(struct history_channel *channel, enum history_tier tier, uint32_t from, uint32_t to,
+		struct history_point *points, uint16_t max_points);
@@ -0,0 +1,190 @@
+#include "sensor_registry.h"
+
+#include <esp_log.h>
+#include <math.h>
+#include <string.h>
+
+#include "sync_sensors.h"
+#include "sensor_alarms.h"
+
+static struct registered_sensor registered_sensors[MAX_REGISTERED_SENSORS];
+static uint8_t num_registered_sensors;
+
+// Windows are updated by sensor tasks and closed by publish task
+static portMUX_TYPE window_mux = portMUX_INITIALIZER_UNLOCKED;
+
+// Next free sync bit, bit 0 is delay bit
+static uint8_t next_sync_bit = 1;
+
+// Publishes since windows were last closed
+static uint8_t num_window_publishes;
+
+struct registered_sensor* sensor_registry_register(struct sensor *sensor, char *name, char *unit, uint32_t period,
+		TaskFunction_t task, void *task_parameter, UBaseType_t task_priority, uint8_t reservoir) {
+	if(num_registered_sensors >= MAX_REGISTERED_SENSORS) {
+		ESP_LOGE(SENSOR_REGISTRY_TAG, "Registry full, %s not registered", name);
+		return NULL;
+	}
+
+	init_sensor(sensor, name, true, false);
+
+	struct registered_sensor *entry = &registered_sensors[num_registered_sensors++];
+	entry->sensor = sensor;
+	entry->unit = unit;
+	entry->period = period;
+	entry->task = task;
+	entry->task_parameter = task_parameter;
+	entry->task_priority = task_priority;
+	entry->reservoir = reservoir;
+	entry->is_published = true;
+
+	// Only sensors measuring with sync task period take part in sync rounds
+	entry->sync_bit = (task != NULL && period == SENSOR_MEASUREMENT_PERIOD) ? (1 << next_sync_bit++) : 0;
+
+	ESP_LOGI(SENSOR_REGISTRY_TAG, "Registered %s", name);
+	return entry;
+}
+
+uint8_t sensor_registry_count() { return num_registered_sensors; }
+struct registered_sensor* sensor_registry_get(uint8_t index) { return index < num_registered_sensors ? &registered_sensors[index] : NULL; }
+
+struct registered_sensor* sensor_registry_find(struct sensor *sensor) {
+	for(uint8_t i = 0; i < num_registered_sensors; ++i) {
+		if(registered_sensors[i].sensor == sensor) return &registered_sensors[i];
+	}
+	return NULL;
+}
+
+void sensor_registry_start_tasks() {
+	set_sensor_sync_bits();
+
+	for(uint8_t i = 0; i < num_registered_sensors; ++i) {
+		struct registered_sensor *entry = &registered_sensors[i];
+		if(entry->task == NULL) continue;
+		xTaskCreatePinnedToCore(entry->task, entry->sensor->name, 2500, entry->task_parameter, entry->task_priority, sensor_get_task_handle(entry->sensor), 1);
+	}
+}
+
+void sensor_registry_drop(struct sensor *sensor) {
+	struct registered_sensor *entry = sensor_registry_find(sensor);
+	if(entry == NULL) return;
+
+	ESP_LOGE(SENSOR_REGISTRY_TAG, "%s not detected, removed from sync rounds and telemetry", sensor->name);
+	sensor_set_active_status(sensor, false);
+	entry->is_published = false;
+	set_sensor_sync_bits();
+}
+
+void sensor_registry_set_published(struct sensor *sensor, bool is_published) {
+	struct registered_sensor *entry = sensor_registry_find(sensor);
+	if(entry != NULL) entry->is_published = is_published;
+}
+
+// Dropped sensors deleted their task, their handle must not be used anymore
+static bool sensor_registry_has_task(struct registered_sensor *entry) {
+	return entry != NULL && entry->task != NULL && sensor_get_active_status(entry->sensor);
+}
+
+void sensor_registry_suspend_tasks() {
+	for(uint8_t i = 0; i < num_registered_sensors; ++i) {
+		if(sensor_registry_has_task(&registered_sensors[i])) vTaskSuspend(*sensor_get_task_handle(registered_sensors[i].sensor));
+	}
+}
+
+void sensor_registry_resume_tasks() {
+	for(uint8_t i = 0; i < num_registered_sensors; ++i) {
+		if(sensor_registry_has_task(&registered_sensors[i])) vTaskResume(*sensor_get_task_handle(registered_sensors[i].sensor));
+	}
+}
+
+void sensor_registry_suspend_task(struct sensor *sensor) {
+	if(sensor_registry_has_task(sensor_registry_find(sensor))) vTaskSuspend(*sensor_get_task_handle(sensor));
+}
+
+void sensor_registry_resume_task(struct sensor *sensor) {
+	if(sensor_registry_has_task(sensor_registry_find(sensor))) vTaskResume(*sensor_get_task_handle(sensor));
+}
+
+void sensor_registry_record(struct sensor *sensor) {
+	struct registered_sensor *entry = sensor_registry_find(sensor);
+	if(entry == NULL) return;
+
+	float value = sensor_get_value(sensor);
+	portENTER_CRITICAL(&window_mux);
+	struct sensor_window *window = &entry->window;
+	if(window->count == 0) {
+		window->min = value;
+		window->max = value;
+	}
+	if(value < window->min) window->min = value;
+	if(value > window->max) window->max = value;
+
+	window->count++;
+	float delta = value - window->mean;
+	window->mean += delta / window->count;
+	window->m2 += delta * (value - window->mean);
+	portEXIT_CRITICAL(&window_mux);
+}
+
+void sensor_registry_close_windows() {
+	// Publishes in between carry last value only, so same statistics aren't sent again
+	bool is_closed = ++num_window_publishes >= SENSOR_WINDOW_PUBLISHES;
+	if(is_closed) num_window_publishes = 0;
+
+	portENTER_CRITICAL(&window_mux);
+	for(uint8_t i = 0; i < num_registered_sensors; ++i) {
+		if(is_closed) {
+			registered_sensors[i].published_window = registered_sensors[i].window;
+			memset(&registered_sensors[i].window, 0, sizeof(struct sensor_window));
+		} else {
+			memset(&registered_sensors[i].published_window, 0, sizeof(struct sensor_window));
+		}
+	}
+	portEXIT_CRITICAL(&window_mux);
+}
+
+void sensor_registry_sync(struct sensor *sensor, bool is_read) {
+	// Failed read leaves previous value in sensor, it isn't a new sample
+	if(is_read) {
+		sensor_registry_record(sensor);
+		if(!sensor_calib_status(sensor)) sensor_alarms_check_sample(sensor);
+	}
+
+	struct registered_sensor *entry = sensor_registry_find(sensor);
+	if(entry != NULL && entry->sync_bit == 0) {
+		vTaskDelay(pdMS_TO_TICKS(entry->period));
+		return;
+	}
+
+	// Sync with other sensor tasks
+	// Wait up to 10 seconds to let other tasks end
+	xEventGroupSync(sensor_event_group, entry != NULL ? entry->sync_bit : 0, sensor_sync_bits, pdMS_TO_TICKS(SENSOR_MEASUREMENT_PERIOD));
+}
+
+void sensor_registry_get_json(uint8_t reservoir, cJSON *sensor_arr) {
+	for(uint8_t i = 0; i < num_registered_sensors; ++i) {
+		struct registered_sensor *entry = &registered_sensors[i];
+		if(!entry->is_published || !sensor_get_active_status(entry->sensor)) continue;
+		if(entry->reservoir != reservoir && entry->reservoir != SENSOR_SHARED_RESERVOIR) continue;
+
+		cJSON *sensor;
+		sensor_get_json(entry->sensor, &sensor);
+		cJSON_AddStringToObject(sensor, "unit", entry->unit);
+
+		// Statistics are formatted like value, single sample has nothing to add to value
+		const struct sensor_window *window = &entry->published_window;
+		if(window->count > 1) {
+			char stat_str[12];
+			snprintf(stat_str, sizeof(stat_str), "%.2f", window->min);
+			cJSON_AddStringToObject(sensor, "min", stat_str);
+			snprintf(stat_str, sizeof(stat_str), "%.2f", window->max);
+			cJSON_AddStringToObject(sensor, "max", stat_str);
+			snprintf(stat_str, sizeof(stat_str), "%.2f", window->mean);
+			cJSON_AddStringToObject(sensor, "mean", stat_str);
+			snprintf(stat_str, sizeof(stat_str), "%.3f", sqrtf(window->m2 / (window->count - 1)));
+			cJSON_AddStringToObject(sensor, "stddev", stat_str);
+			cJSON_AddNumberToObject(sensor, "count", window->count);
+		}
+		cJSON_AddItemToArray(sensor_arr, sensor);
+	}
+}
@@ -0,0 +1,85 @@
+#include <stdbool.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/event_groups.h>
+#include "sensor.h"
+
+#ifndef COMPONENTS_SENSORS_READING_SENSOR_REGISTRY_H_
+#define COMPONENTS_SENSORS_READING_SENSOR_REGISTRY_H_
+
+#define SENSOR_REGISTRY_TAG "SENSOR_REGISTRY"
+
+// Event group has 24 bits, bit 0 is delay bit of sync task
+#define MAX_REGISTERED_SENSORS 23
+
+// Reservoir of sensors that belong to every reservoir
+#define SENSOR_SHARED_RESERVOIR 0xFF
+
+// Publishes a statistics window spans, sensors measure about once per publish so window needs several
+#define SENSOR_WINDOW_PUBLISHES 6
+
+// Streaming statistics of values measured within a publish window, Welford's update keeps memory constant
+struct sensor_window {
+	uint32_t count;
+	float min;
+	float max;
+	float mean;
+	float m2;		// Sum of squared differences from mean
+};
+
+// Sensor registered at boot, telemetry, grow cycle suspend/resume and sampling coordination iterate registry
+struct registered_sensor {
+	struct sensor *sensor;		// JSON key of sensor is its name
+	char *unit;
+	uint32_t period;			// Measurement period in ms, sensors measuring every SENSOR_MEASUREMENT_PERIOD take part in sync rounds
+	TaskFunction_t task;		// Measurement task, NULL if value is derived from another sensor
+	void *task_parameter;
+	UBaseType_t task_priority;
+	uint8_t reservoir;			// Reservoir sensor data is published for
+	EventBits_t sync_bit;		// 0 if sensor doesn't take part in sync rounds
+	bool is_published;			// Sensor has a value worth publishing
+	struct sensor_window window;			// Measurements since window was last closed
+	struct sensor_window published_window;	// Window closed by this publish, empty on publishes that don't close it
+};
+
+#endif /* COMPONENTS_SENSORS_READING_SENSOR_REGISTRY_H_ */
+
+// Register sensor and initialize it, returns NULL if registry is full
+struct registered_sensor* sensor_registry_register(struct sensor *sensor, char *name, char *unit, uint32_t period,
+		TaskFunction_t task, void *task_parameter, UBaseType_t task_priority, uint8_t reservoir);
+
+// Get number of registered sensors and registered sensor at index
+uint8_t sensor_registry_count();
+struct registered_sensor* sensor_registry_get(uint8_t index);
+
+// Find registry entry of sensor, NULL if sensor isn't registered
+struct registered_sensor* sensor_registry_find(struct sensor *sensor);
+
+// Start measurement tasks of all registered sensors
+void sensor_registry_start_tasks();
+
+// Remove sensor that failed detection from sync rounds and telemetry, called by its task before it deletes itself
+void sensor_registry_drop(struct sensor *sensor);
+
+// Set whether sensor is included in telemetry
+void sensor_registry_set_published(struct sensor *sensor, bool is_published);
+
+// Suspend or resume measurement tasks of all active sensors
+void sensor_registry_suspend_tasks();
+void sensor_registry_resume_tasks();
+
+// Suspend or resume measurement task of sensor, does nothing if sensor dropped out
+void sensor_registry_suspend_task(struct sensor *sensor);
+void sensor_registry_resume_task(struct sensor *sensor);
+
+// Add current value of sensor to its publish window, sync does this for sensors with a task
+void sensor_registry_record(struct sensor *sensor);
+
+// End measurement of sensor, records value if read succeeded and waits for sync round or sensor period
+void sensor_registry_sync(struct sensor *sensor, bool is_read);
+
+// Called once per publish before JSON is created, every SENSOR_WINDOW_PUBLISHES publishes windows of all sensors are closed and new ones started
+void sensor_registry_close_windows();
+
+// Add JSON of published sensors of reservoir to array, statistics are added if this publish closed window of more than one sample
+void sensor_registry_get_json(uint8_t reservoir, cJSON *sensor_arr);
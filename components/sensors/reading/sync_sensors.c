@@ -6,13 +6,18 @@
 #include <esp_log.h>
 #include <esp_system.h>
 
-#include "ec_reading.h"
-#include "ph_reading.h"
-#include "water_temp_reading.h"
+#include "sensor_registry.h"
 #include "sensor.h"
+#include "sensor_history.h"
 
 void set_sensor_sync_bits() {
-	sensor_sync_bits = DELAY_BIT | EC_BIT | PH_BIT | (sensor_get_active_status(get_water_temp_sensor()) ? WATER_TEMPERATURE_BIT : 0);
+	uint32_t sync_bits = DELAY_BIT;
+	for(uint8_t i = 0; i < sensor_registry_count(); ++i) {
+		struct registered_sensor *entry = sensor_registry_get(i);
+		// Calibrating sensors don't measure, sync rounds would wait for them
+		if(sensor_get_active_status(entry->sensor) && !sensor_calib_status(entry->sensor)) sync_bits |= entry->sync_bit;
+	}
+	sensor_sync_bits = sync_bits;
 }
 
 void sync_task(void *parameter) {				// Sensor Synchronization Task
@@ -28,5 +33,8 @@ void sync_task(void *parameter) {				// Sensor Synchronization Task
 		} else {
 			ESP_LOGE(TAG, "Failed to Complete On Time");
 		}
+
+		// Every round adds one raw sample per sensor to history
+		sensor_history_sample();
 	}
 }
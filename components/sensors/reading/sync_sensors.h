@@ -9,16 +9,12 @@ TaskHandle_t sync_task_handle;
 
 // Sensor Task Coordination with Event Group
 EventGroupHandle_t sensor_event_group;
-#define DELAY_BIT		    (1<<0)
-#define WATER_TEMPERATURE_BIT	(1<<1)
-#define EC_BIT 	        (1<<2)
-#define PH_BIT		    (1<<3)
-#define ULTRASONIC_BIT    (1<<4)
+#define DELAY_BIT		    (1<<0)		// Sensor bits are handed out by sensor registry
 
 // Sensor sync bits
 uint32_t sensor_sync_bits;
 
-// Set sync bit based on active sensors
+// Set sync bits of active registered sensors that aren't calibrating
 void set_sensor_sync_bits();
 
 // Sync sensors together
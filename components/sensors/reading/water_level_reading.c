@@ -0,0 +1,162 @@
+#include "water_level_reading.h"
+
+#include <esp_err.h>
+#include <esp_log.h>
+#include <math.h>
+
+#include "sync_sensors.h"
+#include "sensor_registry.h"
+#include "task_priorities.h"
+#include "ports.h"
+#include "reservoir_control.h"
+#include "rtc.h"
+#include "mqtt_manager.h"
+
+static const char *TAG = "Water_Level_Task";
+
+static bool is_volume_valid;
+
+// Volume leak check is compared against
+static bool has_leak_reference;
+static float leak_reference_volume;
+static TickType_t leak_reference_ticks;
+
+struct sensor* get_water_level_sensor() { return &water_level_sensor; }
+struct sensor* get_water_volume_sensor() { return &water_volume_sensor; }
+
+float water_level_get_volume() { return is_volume_valid ? sensor_get_value(&water_volume_sensor) : -1; }
+
+void register_water_level_sensors() {
+	sensor_registry_register(&water_level_sensor, "water_level", "cm", SENSOR_MEASUREMENT_PERIOD, &measure_water_level, NULL, ULTRASONIC_TASK_PRIORITY, 0);
+
+	// Volume is derived from level, it has no task of its own
+	sensor_registry_register(&water_volume_sensor, "water_volume", "L", SENSOR_MEASUREMENT_PERIOD, NULL, NULL, 0, 0);
+}
+
+// Level and volume are only published while tank geometry is set and measurements succeed
+static void water_level_set_volume_valid(bool is_valid) {
+	is_volume_valid = is_valid;
+	sensor_registry_set_published(&water_level_sensor, is_valid);
+	sensor_registry_set_published(&water_volume_sensor, is_valid);
+}
+
+// --------------------------------------------------- Helper functions ----------------------------------------------
+
+// Ping sensor several times and take median distance, returns false if too few echoes came back
+static bool water_level_measure_distance(float *distance) {
+	float distances[WATER_LEVEL_NUM_PINGS];
+	uint8_t num_distances = 0;
+
+	for(uint8_t i = 0; i < WATER_LEVEL_NUM_PINGS; ++i) {
+		float value;
+		esp_err_t error = ultrasonic_measure_cm(&water_level_dev, WATER_LEVEL_MAX_DISTANCE, &value);
+		if(error == ESP_OK) {
+			// Insertion sort, bursts are small
+			uint8_t j = num_distances++;
+			for(; j > 0 && distances[j - 1] > value; --j) distances[j] = distances[j - 1];
+			distances[j] = value;
+		} else if(error == ESP_ERR_ULTRASONIC_PING) {
+			ESP_LOGE(TAG, "Invalid ping state");
+		} else if(error == ESP_ERR_ULTRASONIC_PING_TIMEOUT) {
+			ESP_LOGE(TAG, "Ping timeout, sensor not connected");
+		} else if(error == ESP_ERR_ULTRASONIC_ECHO_TIMEOUT) {
+			ESP_LOGE(TAG, "Echo timeout, water out of range");
+		}
+
+		vTaskDelay(pdMS_TO_TICKS(WATER_LEVEL_PING_DELAY));
+	}
+
+	if(num_distances * 2 < WATER_LEVEL_NUM_PINGS) return false;
+
+	*distance = distances[num_distances / 2];
+	return true;
+}
+
+// Get area of tank in cm^2, 0 if geometry isn't set
+static float water_level_get_area() {
+	if(tank_geometry.diameter > 0) return M_PI * tank_geometry.diameter * tank_geometry.diameter / 4;
+	return tank_geometry.length * tank_geometry.width;
+}
+
+static void water_level_set_leaking(bool is_leaking) {
+	if(is_reservoir_leaking == is_leaking) return;
+	is_reservoir_leaking = is_leaking;
+	cJSON_SetNumberValue(get_reservoir_leak_status(), is_reservoir_leaking);
+	publish_equipment_status();
+}
+
+// Flag leak if volume keeps dropping while reservoir isn't being changed or irrigated, clear it once volume holds
+static void water_level_check_leak(float volume) {
+	TickType_t now = xTaskGetTickCount();
+
+	// Reservoir change and irrigation (e.g. ebb and flow fill) drain reservoir on purpose, reference starts over from level they leave
+	bool is_changing = reservoir_is_changing(CHANGED_RESERVOIR);
+	if(is_changing || is_irrigation_on || !has_leak_reference) {
+		if(is_changing) water_level_set_leaking(false);
+		has_leak_reference = true;
+		leak_reference_volume = volume;
+		leak_reference_ticks = now;
+		return;
+	}
+
+	if(now - leak_reference_ticks < pdMS_TO_TICKS(WATER_LEVEL_LEAK_WINDOW * 1000)) return;
+
+	float loss = leak_reference_volume - volume;
+	if(loss > leak_reference_volume * WATER_LEVEL_LEAK_FRACTION) {
+		if(!is_reservoir_leaking) ESP_LOGE(TAG, "Reservoir leak detected, lost %.1f litres in %d seconds", loss, WATER_LEVEL_LEAK_WINDOW);
+		water_level_set_leaking(true);
+	} else if(is_reservoir_leaking) {
+		ESP_LOGI(TAG, "Reservoir volume held for %d seconds, leak cleared", WATER_LEVEL_LEAK_WINDOW);
+		water_level_set_leaking(false);
+	}
+
+	leak_reference_volume = volume;
+	leak_reference_ticks = now;
+}
+
+// --------------------------------------------------------------------------------------------------------------------
+
+void measure_water_level(void *parameter) {		// Water Level Measurement Task
+	water_level_dev.trigger_pin = ULTRASONIC_TRIGGER_GPIO;
+	water_level_dev.echo_pin = ULTRASONIC_ECHO_GPIO;
+	if(ultrasonic_init(&water_level_dev) != ESP_OK) {
+		ESP_LOGE(TAG, "Failed to initialize ultrasonic sensor");
+		sensor_registry_drop(&water_level_sensor);
+		sensor_registry_drop(&water_volume_sensor);
+		vTaskDelete(NULL);
+	}
+
+	water_level_set_volume_valid(false);
+	has_leak_reference = false;
+
+	for (;;) {
+		float distance;
+		bool is_read = false;
+		if(tank_geometry.sensor_height <= 0) {
+			water_level_set_volume_valid(false);
+		} else if(!water_level_measure_distance(&distance)) {
+			ESP_LOGE(TAG, "Too few echoes, level not updated");
+			water_level_set_volume_valid(false);
+			has_leak_reference = false;
+		} else {
+			float level = tank_geometry.sensor_height - distance;
+			if(level < 0) level = 0;
+			sensor_set_value(&water_level_sensor, level);
+			is_read = true;
+
+			float area = water_level_get_area();
+			water_level_set_volume_valid(area > 0);
+			if(is_volume_valid) {
+				sensor_set_value(&water_volume_sensor, area * level / 1000);
+
+				// Volume has no task of its own, so its window is filled here
+				sensor_registry_record(&water_volume_sensor);
+				water_level_check_leak(sensor_get_value(&water_volume_sensor));
+			}
+
+			ESP_LOGI(TAG, "level: %.1f cm, volume: %.1f L", level, water_level_get_volume());
+		}
+
+		sensor_registry_sync(&water_level_sensor, is_read);
+	}
+}
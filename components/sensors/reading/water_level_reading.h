@@ -0,0 +1,55 @@
+#include <stdbool.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "sensor.h"
+#include "ultrasonic.h"
+
+// Pings per measurement, median of pings rejects echo outliers
+#define WATER_LEVEL_NUM_PINGS 7
+
+// Time between pings in ms so echoes of last ping die out
+#define WATER_LEVEL_PING_DELAY 60
+
+// Longest distance that can be measured in cm
+#define WATER_LEVEL_MAX_DISTANCE 400
+
+// Reservoir is leaking if volume drops by more than this fraction within leak window while no change or irrigation is running
+// Leak is cleared by a later window in which volume holds
+#define WATER_LEVEL_LEAK_FRACTION 0.05
+#define WATER_LEVEL_LEAK_WINDOW 3600
+
+#ifndef COMPONENTS_SENSORS_READING_WATER_LEVEL_READING_H_
+#define COMPONENTS_SENSORS_READING_WATER_LEVEL_READING_H_
+
+// Tank dimensions in cm, tank is cylindrical if diameter is set and rectangular otherwise
+struct tank_geometry {
+	float sensor_height;	// Distance from sensor to bottom of tank
+	float length;
+	float width;
+	float diameter;
+};
+
+#endif
+
+ultrasonic_sensor_t water_level_dev;
+
+// Water level (cm above bottom of tank) and volume (litres) sensors
+struct sensor water_level_sensor;
+struct sensor water_volume_sensor;
+
+struct tank_geometry tank_geometry;
+
+bool is_reservoir_leaking;
+
+// Get sensors
+struct sensor *get_water_level_sensor();
+struct sensor *get_water_volume_sensor();
+
+// Get measured reservoir volume in litres, -1 if tank geometry isn't set or last measurement failed
+float water_level_get_volume();
+
+// Register level and volume sensors
+void register_water_level_sensors();
+
+// Measures water level and reservoir volume
+void measure_water_level(void *parameter);
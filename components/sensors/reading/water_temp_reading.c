@@ -5,16 +5,20 @@
 
 #include "ds18x20.h"
 #include "sync_sensors.h"
+#include "sensor_registry.h"
+#include "task_priorities.h"
 #include "ports.h"
-#include "ph_reading.h"
+#include "calibration.h"
 
 struct sensor* get_water_temp_sensor() { return &water_temp_sensor; }
 
+void register_water_temp_sensor() {
+	sensor_registry_register(&water_temp_sensor, "water_temp", "C", SENSOR_MEASUREMENT_PERIOD, &measure_water_temperature, NULL, WATER_TEMPERATURE_TASK_PRIORITY, SENSOR_SHARED_RESERVOIR);
+}
+
 void measure_water_temperature(void *parameter) {		// Water Temperature Measurement Task
 	const char *TAG = "Temperature_Task";
 
-	init_sensor(&water_temp_sensor, "water_temp", true, false);
-
 	ds18x20_addr_t ds18b20_address[1];
 
 	gpio_config_t temperature_gpio_config = { (BIT(TEMPERATURE_SENSOR_GPIO)), GPIO_MODE_OUTPUT };
@@ -28,7 +32,11 @@ void measure_water_temperature(void *parameter) {		// Water Temperature Measurem
 			ds18b20_address, 1);
 	vTaskDelay(pdMS_TO_TICKS(1000));
 
-	if(sensor_count < 1) ESP_LOGE(TAG, "Sensor Not Found");
+	if(sensor_count < 1) {
+		ESP_LOGE(TAG, "Sensor Not Found");
+		sensor_registry_drop(&water_temp_sensor);
+		vTaskDelete(NULL);
+	}
 
 	for (;;) {
 		// Perform Temperature Calculation and Read Temperature; vTaskDelay in the source code of this function
@@ -45,12 +53,10 @@ void measure_water_temperature(void *parameter) {		// Water Temperature Measurem
 			ESP_LOGE(TAG, "Unknown Error\n");
 		}
 
-		// Sync with other sensor tasks
-		// Wait up to 10 seconds to let other tasks end
-		if (!sensor_calib_status(get_ph_sensor())) {
-                xEventGroupSync(sensor_event_group, WATER_TEMPERATURE_BIT, sensor_sync_bits, pdMS_TO_TICKS(SENSOR_MEASUREMENT_PERIOD));
+		if (!calibration_needs_temperature()) {
+                sensor_registry_sync(&water_temp_sensor, error == ESP_OK);
         } else {
-			//If ph calibration on, get frequent water temp readings// 
+			//If compensated sensor is calibrating, get frequent water temp readings// 
             vTaskDelay(pdMS_TO_TICKS(2000));
         }
 	}
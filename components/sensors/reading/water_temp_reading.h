@@ -9,5 +9,8 @@ struct sensor water_temp_sensor;
 // Get sensor
 struct sensor *get_water_temp_sensor();
 
+// Register sensor
+void register_water_temp_sensor();
+
 // Measures water temperature
 void measure_water_temperature();
@@ -0,0 +1,281 @@
+// Compares firmware JSON tokenizer with cJSON on inbound message corpus and fuzzes tokenizer with mutated corpus messages
+//
+// Usage: json_benchmark [--iterations=N] [--fuzz=N] [--seed=N] corpus/*.json
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "json_tokenizer.h"
+
+#ifdef HAS_CJSON
+#include "cJSON.h"
+#endif
+
+// Same token budget as MQTT manager
+#define BENCHMARK_MAX_TOKENS 128
+
+struct benchmark_settings {
+	long iterations;		// Parses timed per message and parser
+	long fuzz;				// Mutations tried per message
+	long seed;
+};
+
+static struct benchmark_settings settings = { .iterations = 10000, .fuzz = 0, .seed = 1 };
+
+struct message {
+	const char *name;
+	char *json;				// Not terminated so reads past end show up under sanitizers
+	size_t length;
+};
+
+// --------------------------------------------------- Heap accounting -----------------------------------------------
+
+#ifdef HAS_CJSON
+static size_t heap_used;
+static size_t heap_peak;
+static size_t heap_allocations;
+
+// Size is kept in front of block so free can account for it
+static void* counting_malloc(size_t size) {
+	size_t *block = malloc(sizeof(size_t) + size);
+	if(block == NULL) return NULL;
+	*block = size;
+	heap_used += size;
+	heap_allocations++;
+	if(heap_used > heap_peak) heap_peak = heap_used;
+	return block + 1;
+}
+
+static void counting_free(void *pointer) {
+	if(pointer == NULL) return;
+	size_t *block = (size_t *) pointer - 1;
+	heap_used -= *block;
+	free(block);
+}
+
+// cJSON needs terminated text
+static cJSON* cjson_parse(const struct message *message) {
+	char *text = malloc(message->length + 1);
+	memcpy(text, message->json, message->length);
+	text[message->length] = '\0';
+
+	// Trailing text is an error for tokenizer too
+	cJSON *root = cJSON_ParseWithOpts(text, NULL, true);
+	free(text);
+	return root;
+}
+#endif
+
+// --------------------------------------------------- Helpers -------------------------------------------------------
+
+static double elapsed_ns(const struct timespec *start, const struct timespec *end) {
+	return (end->tv_sec - start->tv_sec) * 1e9 + (end->tv_nsec - start->tv_nsec);
+}
+
+static bool load_message(const char *path, struct message *message) {
+	FILE *file = fopen(path, "rb");
+	if(file == NULL) return false;
+
+	fseek(file, 0, SEEK_END);
+	long length = ftell(file);
+	fseek(file, 0, SEEK_SET);
+
+	message->name = strrchr(path, '/') != NULL ? strrchr(path, '/') + 1 : path;
+	message->length = length;
+	message->json = malloc(length > 0 ? length : 1);
+	bool is_read = fread(message->json, 1, length, file) == (size_t) length;
+	fclose(file);
+	return is_read;
+}
+
+// Check structure of tokens of valid JSON, returns false if any token is inconsistent
+static bool check_tokens(const struct json_document *doc, size_t length) {
+	if(doc->num_tokens == 0 || doc->tokens[0].skip != doc->num_tokens) return false;
+
+	for(int i = 0; i < doc->num_tokens; ++i) {
+		const struct json_token *token = &doc->tokens[i];
+		if(token->start > token->end || token->end > length || token->skip <= i || token->skip > doc->num_tokens) return false;
+
+		// Walk children the way handlers do and count them
+		if(token->type == JSON_OBJECT || token->type == JSON_ARRAY) {
+			int child;
+			uint16_t num_children = 0;
+			JSON_FOR_EACH(doc, i, child) {
+				if(token->type == JSON_OBJECT && json_get_type(doc, child) != JSON_STRING) return false;
+				num_children++;
+			}
+			if(num_children != token->size) return false;
+		}
+
+		// Accessors only read inside token
+		char string[64];
+		double number;
+		bool is_true;
+		json_get_string(doc, i, string, sizeof(string));
+		json_get_number(doc, i, &number);
+		json_get_bool(doc, i, &is_true);
+	}
+	return true;
+}
+
+static void mutate(const struct message *source, struct message *mutated) {
+	static const char alphabet[] = "{}[]:,\"\\-+.0123456789eEtrufalsn \n";
+	memcpy(mutated->json, source->json, source->length);
+	mutated->length = source->length;
+
+	uint8_t num_mutations = 1 + rand() % 4;
+	for(uint8_t i = 0; i < num_mutations && mutated->length > 0; ++i) {
+		size_t pos = rand() % mutated->length;
+		switch(rand() % 4) {
+		case 0:
+			// Replace character
+			mutated->json[pos] = rand() % 2 ? alphabet[rand() % (sizeof(alphabet) - 1)] : (char) rand();
+			break;
+		case 1:
+			// Delete character
+			memmove(&mutated->json[pos], &mutated->json[pos + 1], mutated->length - pos - 1);
+			mutated->length--;
+			break;
+		case 2:
+			// Insert character, buffer has room for one extra character per mutation
+			memmove(&mutated->json[pos + 1], &mutated->json[pos], mutated->length - pos);
+			mutated->json[pos] = alphabet[rand() % (sizeof(alphabet) - 1)];
+			mutated->length++;
+			break;
+		default:
+			// Truncate
+			mutated->length = pos;
+			break;
+		}
+	}
+}
+
+// --------------------------------------------------- Benchmark and fuzzing ------------------------------------------
+
+static void benchmark_message(const struct message *message) {
+	struct json_token tokens[BENCHMARK_MAX_TOKENS];
+	struct json_document doc;
+	struct timespec start, end;
+
+	bool is_valid = json_parse(&doc, message->json, message->length, tokens, BENCHMARK_MAX_TOKENS);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(long i = 0; i < settings.iterations; ++i) json_parse(&doc, message->json, message->length, tokens, BENCHMARK_MAX_TOKENS);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	double tokenizer_ns = elapsed_ns(&start, &end) / settings.iterations;
+
+	printf("%-30s %6zu %6s %7u %10.0f", message->name, message->length, is_valid ? "yes" : "no", doc.num_tokens * (unsigned) sizeof(struct json_token), tokenizer_ns);
+
+#ifdef HAS_CJSON
+	heap_used = heap_peak = heap_allocations = 0;
+	cJSON *root = cjson_parse(message);
+	size_t peak = heap_peak, allocations = heap_allocations;
+	cJSON_Delete(root);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(long i = 0; i < settings.iterations; ++i) cJSON_Delete(cjson_parse(message));
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	printf(" %6s %7zu %7zu %10.0f", root != NULL ? "yes" : "no", peak, allocations, elapsed_ns(&start, &end) / settings.iterations);
+#endif
+	printf("\n");
+}
+
+// Returns number of mutations tokenizer handled wrongly
+static long fuzz_message(const struct message *message, long *num_valid, long *num_disagreements) {
+	struct json_token tokens[BENCHMARK_MAX_TOKENS];
+	struct json_document doc;
+	long num_failures = 0;
+
+	// Room for one insertion per mutation
+	struct message mutated = { .name = message->name, .json = malloc(message->length + 4) };
+	for(long i = 0; i < settings.fuzz; ++i) {
+		mutate(message, &mutated);
+
+		// Exact size copy so sanitizers catch reads past end
+		char *json = malloc(mutated.length > 0 ? mutated.length : 1);
+		memcpy(json, mutated.json, mutated.length);
+		bool is_valid = json_parse(&doc, json, mutated.length, tokens, BENCHMARK_MAX_TOKENS);
+		if(is_valid) (*num_valid)++;
+		if((is_valid && !check_tokens(&doc, mutated.length)) || (!is_valid && doc.num_tokens != 0)) {
+			fprintf(stderr, "%s: inconsistent tokens for: %.*s\n", message->name, (int) mutated.length, mutated.json);
+			num_failures++;
+		}
+
+#ifdef HAS_CJSON
+		// cJSON accepts some JSON tokenizer rejects (leading zeros, control characters in strings), counted but not failures
+		struct message copy = { .json = json, .length = mutated.length };
+		cJSON *root = cjson_parse(&copy);
+		if((root != NULL) != is_valid && doc.num_tokens < BENCHMARK_MAX_TOKENS) (*num_disagreements)++;
+		cJSON_Delete(root);
+#else
+		(void) num_disagreements;
+#endif
+		free(json);
+	}
+	free(mutated.json);
+	return num_failures;
+}
+
+// --------------------------------------------------------------------------------------------------------------------
+
+static bool parse_args(int argc, char **argv, int *first_file) {
+	int i;
+	for(i = 1; i < argc && strncmp(argv[i], "--", 2) == 0; ++i) {
+		char *value = strchr(argv[i], '=');
+		if(value == NULL) return false;
+		if(strncmp(argv[i], "--iterations=", 13) == 0) settings.iterations = strtol(value + 1, NULL, 10);
+		else if(strncmp(argv[i], "--fuzz=", 7) == 0) settings.fuzz = strtol(value + 1, NULL, 10);
+		else if(strncmp(argv[i], "--seed=", 7) == 0) settings.seed = strtol(value + 1, NULL, 10);
+		else return false;
+	}
+	*first_file = i;
+	return i < argc && settings.iterations > 0;
+}
+
+int main(int argc, char **argv) {
+	int first_file;
+	if(!parse_args(argc, argv, &first_file)) {
+		printf("Usage: %s [--iterations=N] [--fuzz=N] [--seed=N] corpus/*.json\n", argv[0]);
+		return 1;
+	}
+	srand(settings.seed);
+
+#ifdef HAS_CJSON
+	cJSON_Hooks hooks = { .malloc_fn = &counting_malloc, .free_fn = &counting_free };
+	cJSON_InitHooks(&hooks);
+#endif
+
+	int num_messages = argc - first_file;
+	struct message *messages = calloc(num_messages, sizeof(struct message));
+	for(int i = 0; i < num_messages; ++i) {
+		if(!load_message(argv[first_file + i], &messages[i])) {
+			fprintf(stderr, "Unable to read %s\n", argv[first_file + i]);
+			return 1;
+		}
+	}
+
+	// Tokenizer memory is token array only, allocated by caller (stack or static), bytes like cJSON peak
+	printf("%-30s %6s %6s %7s %10s", "message", "bytes", "valid", "memory", "ns/parse");
+#ifdef HAS_CJSON
+	printf(" %6s %7s %7s %10s", "cjson", "peak", "allocs", "ns/parse");
+#endif
+	printf("\n");
+	for(int i = 0; i < num_messages; ++i) benchmark_message(&messages[i]);
+
+	long num_failures = 0, num_valid = 0, num_disagreements = 0;
+	if(settings.fuzz > 0) {
+		for(int i = 0; i < num_messages; ++i) num_failures += fuzz_message(&messages[i], &num_valid, &num_disagreements);
+		printf("\nfuzz: %ld mutations, %ld valid, %ld failures", settings.fuzz * num_messages, num_valid, num_failures);
+#ifdef HAS_CJSON
+		printf(", %ld validity disagreements with cJSON", num_disagreements);
+#endif
+		printf("\n");
+	}
+
+	for(int i = 0; i < num_messages; ++i) free(messages[i].json);
+	free(messages);
+	return num_failures > 0;
+}
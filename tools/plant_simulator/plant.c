@@ -0,0 +1,134 @@
+#include "plant.h"
+
+#include <math.h>
+#include <string.h>
+
+// --------------------------------------------------- Helper functions ----------------------------------------------
+
+static float plant_random_uniform(struct plant *plant) {
+	// xorshift64, good enough for sensor noise and reproducible across platforms
+	plant->random_state ^= plant->random_state << 13;
+	plant->random_state ^= plant->random_state >> 7;
+	plant->random_state ^= plant->random_state << 17;
+	return ((plant->random_state >> 40) + 0.5f) / (float)(1 << 24);
+}
+
+static float plant_random_gaussian(struct plant *plant, float deviation) {
+	if(deviation <= 0) return 0;
+
+	// Box-Muller transform
+	float u1 = plant_random_uniform(plant);
+	float u2 = plant_random_uniform(plant);
+	return deviation * sqrtf(-2 * logf(u1)) * cosf(2 * (float)M_PI * u2);
+}
+
+static void plant_switch_outlet(bool *is_on, bool request, float *switch_time, float time) {
+	if(*is_on != request && time >= *switch_time) *is_on = request;
+}
+
+// --------------------------------------------------------------------------------------------------------------------
+
+
+// --------------------------------------------------- Public interface ----------------------------------------------
+
+void plant_default_config(struct plant_config *config) {
+	memset(config, 0, sizeof(*config));
+
+	config->volume = 100;
+
+	config->ph = 7;
+	config->ec = 0.8;
+	config->water_temp = 14;
+
+	config->ph_up_response = 1.5;
+	config->ph_down_response = 2;
+	config->ec_response = 0.6;
+	config->ph_drift = 0.05;
+	config->ec_drift = -0.02;
+	config->mixing_time = 90;
+
+	for(int pump = 0; pump < PLANT_NUM_PUMPS; ++pump) config->flow_rates[pump] = 1.2;
+
+	config->heater_power = 300;
+	config->cooler_power = 250;
+	config->ambient_temp = 14;
+	config->heat_loss = 4;
+	config->rf_delay = 3;
+
+	config->ph_noise = 0.02;
+	config->ec_noise = 0.01;
+	config->water_temp_noise = 0.1;
+
+	config->seed = 1;
+}
+
+void init_plant(struct plant *plant, const struct plant_config *config) {
+	memset(plant, 0, sizeof(*plant));
+	plant->config = *config;
+
+	plant->ph = config->ph;
+	plant->ec = config->ec;
+	plant->water_temp = config->water_temp;
+
+	plant->random_state = ((uint64_t)config->seed << 1) | 1;
+}
+
+void plant_step(struct plant *plant, float dt) {
+	const struct plant_config *config = &plant->config;
+	plant->time += dt;
+
+	// Dosed solution first collects near pump outlet
+	for(int pump = 0; pump < PLANT_NUM_PUMPS; ++pump) {
+		if(!plant->pumps[pump]) continue;
+
+		float volume = config->flow_rates[pump] * dt;
+		float concentration = volume / config->volume;
+		plant->dosed_volumes[pump] += volume;
+
+		if(pump == PLANT_PH_UP_PUMP) plant->unmixed_ph += concentration * config->ph_up_response;
+		else if(pump == PLANT_PH_DOWN_PUMP) plant->unmixed_ph -= concentration * config->ph_down_response;
+		else plant->unmixed_ec += concentration * config->ec_response;
+	}
+
+	// Then mixes into reservoir as a first order lag
+	float mixed = config->mixing_time > 0 ? 1 - expf(-dt / config->mixing_time) : 1;
+	plant->ph += plant->unmixed_ph * mixed;
+	plant->ec += plant->unmixed_ec * mixed;
+	plant->unmixed_ph -= plant->unmixed_ph * mixed;
+	plant->unmixed_ec -= plant->unmixed_ec * mixed;
+
+	// Plants slowly change reservoir
+	plant->ph += config->ph_drift * dt / 3600;
+	plant->ec += config->ec_drift * dt / 3600;
+	if(plant->ec < 0) plant->ec = 0;
+
+	// Outlets switch after rf delay
+	plant_switch_outlet(&plant->is_heater_on, plant->heater_request, &plant->heater_switch_time, plant->time);
+	plant_switch_outlet(&plant->is_cooler_on, plant->cooler_request, &plant->cooler_switch_time, plant->time);
+
+	// Heat balance of reservoir
+	float power = config->heat_loss * (config->ambient_temp - plant->water_temp);
+	if(plant->is_heater_on) power += config->heater_power;
+	if(plant->is_cooler_on) power -= config->cooler_power;
+	plant->water_temp += power * dt / (WATER_SPECIFIC_HEAT * config->volume);
+}
+
+void plant_set_pump(struct plant *plant, uint8_t pump, bool state) {
+	if(pump < PLANT_NUM_PUMPS) plant->pumps[pump] = state;
+}
+
+void plant_set_heater(struct plant *plant, bool state) {
+	plant->heater_request = state;
+	plant->heater_switch_time = plant->time + plant->config.rf_delay;
+}
+
+void plant_set_cooler(struct plant *plant, bool state) {
+	plant->cooler_request = state;
+	plant->cooler_switch_time = plant->time + plant->config.rf_delay;
+}
+
+float plant_read_ph(struct plant *plant) { return plant->ph + plant_random_gaussian(plant, plant->config.ph_noise); }
+float plant_read_ec(struct plant *plant) { return plant->ec + plant_random_gaussian(plant, plant->config.ec_noise); }
+float plant_read_water_temp(struct plant *plant) { return plant->water_temp + plant_random_gaussian(plant, plant->config.water_temp_noise); }
+
+// --------------------------------------------------------------------------------------------------------------------
@@ -0,0 +1,91 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifndef TOOLS_PLANT_SIMULATOR_PLANT_H_
+#define TOOLS_PLANT_SIMULATOR_PLANT_H_
+
+// Dosing pumps, same indexes as pump_calibration.h
+#define PLANT_NUM_PUMPS 8
+#define PLANT_PH_UP_PUMP 6
+#define PLANT_PH_DOWN_PUMP 7
+
+// Specific heat of water in J/(kg*K)
+#define WATER_SPECIFIC_HEAT 4186
+
+struct plant_config {
+	float volume;				// Reservoir volume in litres
+
+	float ph;					// Initial values
+	float ec;
+	float water_temp;
+
+	float ph_up_response;		// pH change per ml of ph up per litre of reservoir (buffering capacity)
+	float ph_down_response;		// pH change per ml of ph down per litre of reservoir
+	float ec_response;			// EC change per ml of nutrient per litre of reservoir
+	float ph_drift;				// pH change per hour caused by plants
+	float ec_drift;				// EC change per hour caused by plants
+	float mixing_time;			// Time constant of dosed solution mixing into reservoir in seconds
+
+	float flow_rates[PLANT_NUM_PUMPS];	// Real flow rate of pumps in ml/s
+
+	float heater_power;			// Watts
+	float cooler_power;			// Watts
+	float ambient_temp;			// Temperature around reservoir
+	float heat_loss;			// Heat exchanged with surroundings in W/K
+	float rf_delay;				// Seconds between outlet command and outlet switching
+
+	float ph_noise;				// Standard deviation of sensor readings
+	float ec_noise;
+	float water_temp_noise;
+
+	uint32_t seed;				// Random seed for sensor noise
+};
+
+struct plant {
+	struct plant_config config;
+
+	// Fully mixed values
+	float ph;
+	float ec;
+	float water_temp;
+
+	// Dosed solution that hasn't mixed into reservoir yet
+	float unmixed_ph;
+	float unmixed_ec;
+
+	// Pumps and outlets
+	bool pumps[PLANT_NUM_PUMPS];
+	float dosed_volumes[PLANT_NUM_PUMPS];
+	bool is_heater_on;
+	bool is_cooler_on;
+	bool heater_request;
+	bool cooler_request;
+	float heater_switch_time;
+	float cooler_switch_time;
+
+	float time;
+	uint64_t random_state;
+};
+
+#endif /* TOOLS_PLANT_SIMULATOR_PLANT_H_ */
+
+// Get default plant config (100 L reservoir)
+void plant_default_config(struct plant_config *config);
+
+// Initialize plant from config
+void init_plant(struct plant *plant, const struct plant_config *config);
+
+// Advance plant by dt seconds
+void plant_step(struct plant *plant, float dt);
+
+// Turn dosing pump on/off
+void plant_set_pump(struct plant *plant, uint8_t pump, bool state);
+
+// Command heater/cooler outlets, they switch after rf delay
+void plant_set_heater(struct plant *plant, bool state);
+void plant_set_cooler(struct plant *plant, bool state);
+
+// Get noisy sensor readings
+float plant_read_ph(struct plant *plant);
+float plant_read_ec(struct plant *plant);
+float plant_read_water_temp(struct plant *plant);
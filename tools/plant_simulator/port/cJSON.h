@@ -0,0 +1,21 @@
+// Host port of cJSON, only the struct layout and functions used by compiled firmware sources
+#pragma once
+
+#include <stddef.h>
+
+typedef struct cJSON {
+	struct cJSON *next;
+	struct cJSON *prev;
+	struct cJSON *child;
+	int type;
+	char *valuestring;
+	int valueint;
+	double valuedouble;
+	char *string;
+} cJSON;
+
+cJSON *cJSON_CreateObject(void);
+cJSON *cJSON_CreateString(const char *string);
+void cJSON_AddItemToObject(cJSON *object, const char *string, cJSON *item);
+
+#define cJSON_ArrayForEach(element, array) for(element = (array != NULL) ? (array)->child : NULL; element != NULL; element = element->next)
@@ -0,0 +1,4 @@
+// Some firmware headers include cJSON in lower case
+#pragma once
+
+#include "cJSON.h"
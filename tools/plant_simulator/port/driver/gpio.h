@@ -0,0 +1,7 @@
+// Host port of the ESP32 gpio driver types
+#pragma once
+
+#include "esp_err.h"
+
+typedef int gpio_num_t;
+typedef enum { GPIO_MODE_INPUT, GPIO_MODE_OUTPUT } gpio_mode_t;
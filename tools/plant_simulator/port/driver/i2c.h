@@ -0,0 +1,21 @@
+// Host port of the ESP32 i2c driver types
+#pragma once
+
+#include "esp_err.h"
+#include "driver/gpio.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+typedef int i2c_port_t;
+
+typedef struct {
+	int mode;
+	int sda_io_num;
+	int scl_io_num;
+	bool sda_pullup_en;
+	bool scl_pullup_en;
+	struct {
+		uint32_t clk_speed;
+	} master;
+} i2c_config_t;
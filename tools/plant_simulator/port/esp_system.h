@@ -0,0 +1,7 @@
+// Host port of esp_system.h
+#pragma once
+
+#include <stdlib.h>
+#include "esp_err.h"
+
+void esp_restart(void);
@@ -0,0 +1,20 @@
+// Host port of FreeRTOS types, the simulator runs the control code on a single thread
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "esp_err.h"
+#include "sdkconfig.h"
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define portMAX_DELAY 0xffffffff
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS 1
+#define configMAX_PRIORITIES 25
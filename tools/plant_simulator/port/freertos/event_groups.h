@@ -0,0 +1,6 @@
+#pragma once
+
+#include "FreeRTOS.h"
+
+typedef void* EventGroupHandle_t;
+typedef uint32_t EventBits_t;
@@ -0,0 +1,5 @@
+#pragma once
+
+#include "queue.h"
+
+typedef void* SemaphoreHandle_t;
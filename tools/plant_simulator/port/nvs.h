@@ -0,0 +1,6 @@
+// Host port of nvs.h, only the handle type is needed since nvs_manager is replaced
+#pragma once
+
+#include "esp_err.h"
+
+typedef uint32_t nvs_handle_t;
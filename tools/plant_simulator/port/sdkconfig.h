@@ -0,0 +1,5 @@
+// Host port of the generated sdkconfig.h, pretends to be an ESP32 on ESP-IDF v4
+#pragma once
+
+#define CONFIG_IDF_TARGET_ESP32 1
+#define ESP_IDF_VERSION_MAJOR 4
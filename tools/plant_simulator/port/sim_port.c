@@ -0,0 +1,163 @@
+#include "sim_port.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <esp_log.h>
+#include <esp_system.h>
+#include <cJSON.h>
+#include <freertos/task.h>
+
+#include "i2cdev.h"
+#include "ds3231.h"
+#include "nvs_manager.h"
+#include "settings_schema.h"
+
+time_t sim_unix_time;
+bool sim_verbose;
+
+// --------------------------------------------------- Logging ---------------------------------------------------------
+
+void sim_log(char level, const char *tag, const char *format, ...) {
+	if(!sim_verbose && level != 'E') return;
+
+	struct tm date_time;
+	gmtime_r(&sim_unix_time, &date_time);
+	fprintf(stderr, "%c (%02d:%02d:%02d) %s: ", level, date_time.tm_hour, date_time.tm_min, date_time.tm_sec, tag);
+
+	va_list args;
+	va_start(args, format);
+	vfprintf(stderr, format, args);
+	va_end(args);
+	fputc('\n', stderr);
+}
+
+// --------------------------------------------------- FreeRTOS --------------------------------------------------------
+
+// Simulator is single threaded, time only moves in main loop
+void vTaskDelay(TickType_t ticks) { (void)ticks; }
+void vTaskSuspend(TaskHandle_t task) { (void)task; }
+void vTaskResume(TaskHandle_t task) { (void)task; }
+void vTaskPrioritySet(TaskHandle_t task, UBaseType_t priority) { (void)task; (void)priority; }
+UBaseType_t uxTaskPriorityGet(TaskHandle_t task) { (void)task; return 0; }
+
+void esp_restart(void) { exit(1); }
+
+// --------------------------------------------------- I2C and virtual DS3231 -----------------------------------------
+
+// External definitions of inline functions from i2cdev.h
+esp_err_t i2c_dev_read_reg(const i2c_dev_t *dev, uint8_t reg, void *in_data, size_t in_size);
+esp_err_t i2c_dev_write_reg(const i2c_dev_t *dev, uint8_t reg, const void *out_data, size_t out_size);
+
+static uint8_t dec2bcd(uint8_t value) { return ((value / 10) << 4) + value % 10; }
+
+esp_err_t i2c_dev_create_mutex(i2c_dev_t *dev) { (void)dev; return ESP_OK; }
+esp_err_t i2c_dev_delete_mutex(i2c_dev_t *dev) { (void)dev; return ESP_OK; }
+esp_err_t i2c_dev_take_mutex(i2c_dev_t *dev) { (void)dev; return ESP_OK; }
+esp_err_t i2c_dev_give_mutex(i2c_dev_t *dev) { (void)dev; return ESP_OK; }
+
+esp_err_t i2c_dev_read(const i2c_dev_t *dev, const void *out_data, size_t out_size, void *in_data, size_t in_size) {
+	(void)dev;
+
+	// Only time registers of RTC exist, they hold simulated time
+	if(out_size != 1 || *(const uint8_t*)out_data != 0 || in_size < 7) return ESP_ERR_NOT_SUPPORTED;
+
+	struct tm date_time;
+	gmtime_r(&sim_unix_time, &date_time);
+
+	uint8_t *data = in_data;
+	data[0] = dec2bcd(date_time.tm_sec);
+	data[1] = dec2bcd(date_time.tm_min);
+	data[2] = dec2bcd(date_time.tm_hour);
+	data[3] = dec2bcd(date_time.tm_wday + 1);
+	data[4] = dec2bcd(date_time.tm_mday);
+	data[5] = dec2bcd(date_time.tm_mon + 1);
+	data[6] = dec2bcd(date_time.tm_year - 100);
+	return ESP_OK;
+}
+
+esp_err_t i2c_dev_write(const i2c_dev_t *dev, const void *out_reg, size_t out_reg_size, const void *out_data, size_t out_size) {
+	(void)dev; (void)out_reg; (void)out_reg_size; (void)out_data; (void)out_size;
+	return ESP_ERR_NOT_SUPPORTED;
+}
+
+// --------------------------------------------------- NVS ------------------------------------------------------------
+
+// Settings are set directly by simulator, only settings blobs are held in memory so they round trip like on device
+#define SIM_NVS_MAX_NAMESPACES 8
+#define SIM_NVS_MAX_SETTINGS 16
+
+struct sim_nvs_settings {
+	nvs_handle_t handle;
+	char key[NVS_NAME_LENGTH];
+	uint16_t version;
+	size_t length;
+	uint8_t data[NVS_SETTINGS_MAX_SIZE];
+};
+
+static char sim_nvs_namespaces[SIM_NVS_MAX_NAMESPACES][NVS_NAME_LENGTH];
+static nvs_handle_t sim_nvs_handles[SIM_NVS_MAX_NAMESPACES];
+static struct sim_nvs_settings sim_nvs_settings[SIM_NVS_MAX_SETTINGS];
+static uint8_t sim_num_nvs_settings;
+
+// Handle of namespace is its index plus one, namespaces are opened on first use
+nvs_handle_t* nvs_get_handle(char *namespace) {
+	uint8_t i;
+	for(i = 0; i < SIM_NVS_MAX_NAMESPACES && sim_nvs_handles[i] != 0; ++i) {
+		if(strcmp(sim_nvs_namespaces[i], namespace) == 0) return &sim_nvs_handles[i];
+	}
+	if(i == SIM_NVS_MAX_NAMESPACES) return NULL;
+	snprintf(sim_nvs_namespaces[i], NVS_NAME_LENGTH, "%s", namespace);
+	sim_nvs_handles[i] = i + 1;
+	return &sim_nvs_handles[i];
+}
+
+static struct sim_nvs_settings* sim_nvs_find_settings(nvs_handle_t handle, const char *key) {
+	for(uint8_t i = 0; i < sim_num_nvs_settings; ++i) {
+		if(sim_nvs_settings[i].handle == handle && strcmp(sim_nvs_settings[i].key, key) == 0) return &sim_nvs_settings[i];
+	}
+	return NULL;
+}
+void nvs_commit_data(nvs_handle_t *handle) { (void)handle; }
+void nvs_remove_key(nvs_handle_t *handle, char *key) { (void)handle; (void)key; }
+
+void nvs_add_uint8(nvs_handle_t *handle, char *key, uint8_t data) { (void)handle; (void)key; (void)data; }
+void nvs_add_uint32(nvs_handle_t *handle, char *key, uint32_t data) { (void)handle; (void)key; (void)data; }
+void nvs_add_float(nvs_handle_t *handle, char *key, float data) { (void)handle; (void)key; (void)data; }
+
+void nvs_add_settings(nvs_handle_t *handle, char *key, uint16_t version, const void *settings, size_t length) {
+	struct sim_nvs_settings *stored = handle != NULL ? sim_nvs_find_settings(*handle, key) : NULL;
+	if(handle == NULL || length > NVS_SETTINGS_MAX_SIZE) return;
+	if(stored == NULL) {
+		if(sim_num_nvs_settings == SIM_NVS_MAX_SETTINGS) return;
+		stored = &sim_nvs_settings[sim_num_nvs_settings++];
+		stored->handle = *handle;
+		snprintf(stored->key, NVS_NAME_LENGTH, "%s", key);
+	}
+	stored->version = version;
+	stored->length = length;
+	memcpy(stored->data, settings, length);
+}
+
+uint16_t nvs_get_settings(char *namespace, char *key, void *settings, size_t length) {
+	nvs_handle_t *handle = nvs_get_handle(namespace);
+	struct sim_nvs_settings *stored = handle != NULL ? sim_nvs_find_settings(*handle, key) : NULL;
+	if(stored == NULL) return 0;
+	memcpy(settings, stored->data, stored->length < length ? stored->length : length);
+	return stored->version;
+}
+
+bool nvs_get_uint8(char *namespace, char *key, uint8_t *data) { (void)namespace; (void)key; (void)data; return false; }
+bool nvs_get_uint32(char *namespace, char *key, uint32_t *data) { (void)namespace; (void)key; (void)data; return false; }
+bool nvs_get_float(char *namespace, char *key, float *data) { (void)namespace; (void)key; (void)data; return false; }
+
+// Settings messages aren't received in simulation
+bool settings_decode(const struct settings_schema *schema, const struct json_document *doc, int object, void *settings, char *error) { (void)schema; (void)doc; (void)object; (void)settings; (void)error; return false; }
+
+// --------------------------------------------------- cJSON ----------------------------------------------------------
+
+// Status objects aren't published in simulation
+cJSON *cJSON_CreateObject(void) { return NULL; }
+cJSON *cJSON_CreateString(const char *string) { (void)string; return NULL; }
+void cJSON_AddItemToObject(cJSON *object, const char *string, cJSON *item) { (void)object; (void)string; (void)item; }
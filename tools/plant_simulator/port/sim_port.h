@@ -0,0 +1,13 @@
+#include <stdbool.h>
+#include <time.h>
+
+#ifndef TOOLS_PLANT_SIMULATOR_SIM_PORT_H_
+#define TOOLS_PLANT_SIMULATOR_SIM_PORT_H_
+
+// Simulated time read by the virtual DS3231
+extern time_t sim_unix_time;
+
+// Print firmware logs
+extern bool sim_verbose;
+
+#endif /* TOOLS_PLANT_SIMULATOR_SIM_PORT_H_ */
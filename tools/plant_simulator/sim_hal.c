@@ -0,0 +1,73 @@
+#include "sim_hal.h"
+
+#include <esp_log.h>
+
+#include "ports.h"
+#include "rf_transmitter.h"
+#include "sensor.h"
+#include "ph_reading.h"
+#include "ec_reading.h"
+#include "water_temp_reading.h"
+#include "reservoir_control.h"
+
+#define SIM_HAL_TAG "SIM_HAL"
+
+struct plant *sim_plant;
+uint32_t sim_pump_starts[PLANT_NUM_PUMPS];
+uint32_t sim_rf_transmissions;
+
+struct sensor* get_ph_sensor(uint8_t reservoir) { return &ph_sensors[reservoir]; }
+struct sensor* get_ec_sensor(uint8_t reservoir) { return &ec_sensors[reservoir]; }
+struct sensor* get_water_temp_sensor() { return &water_temp_sensor; }
+
+// Plant model is a single reservoir
+void sim_read_sensors() {
+	sensor_set_value(get_ph_sensor(0), plant_read_ph(sim_plant));
+	sensor_set_value(get_ec_sensor(0), plant_read_ec(sim_plant));
+	sensor_set_value(&water_temp_sensor, plant_read_water_temp(sim_plant));
+}
+
+// EC nutrient pumps are wired to expander ports in reverse order, pH pumps use same port and pump index
+static uint8_t gpio_to_pump(int gpio) {
+	return gpio <= EC_NUTRIENT_1_PUMP_GPIO ? EC_NUTRIENT_1_PUMP_GPIO - gpio : gpio;
+}
+
+esp_err_t set_gpio_on(int gpio) {
+	uint8_t pump = gpio_to_pump(gpio);
+	if(pump >= PLANT_NUM_PUMPS) return ESP_ERR_INVALID_ARG;
+
+	if(!sim_plant->pumps[pump]) sim_pump_starts[pump]++;
+	plant_set_pump(sim_plant, pump, true);
+	return ESP_OK;
+}
+
+esp_err_t set_gpio_off(int gpio) {
+	uint8_t pump = gpio_to_pump(gpio);
+	if(pump >= PLANT_NUM_PUMPS) return ESP_ERR_INVALID_ARG;
+
+	plant_set_pump(sim_plant, pump, false);
+	return ESP_OK;
+}
+
+esp_err_t control_power_outlet(int power_outlet_id, bool state) {
+	sim_rf_transmissions++;
+
+	switch(power_outlet_id) {
+		case WATER_HEATER:
+			plant_set_heater(sim_plant, state);
+			break;
+		case WATER_COOLER:
+			plant_set_cooler(sim_plant, state);
+			break;
+		default:
+			ESP_LOGE(SIM_HAL_TAG, "Outlet %d isn't simulated", power_outlet_id);
+			return ESP_ERR_NOT_SUPPORTED;
+	}
+	return ESP_OK;
+}
+
+// Reservoir changes aren't simulated
+bool reservoir_is_changing(uint8_t reservoir) { (void)reservoir; return false; }
+
+// Level sensor isn't simulated, configured volume is used
+float reservoir_get_volume(uint8_t reservoir) { (void)reservoir; return reservoir_volume; }
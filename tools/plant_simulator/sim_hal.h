@@ -0,0 +1,20 @@
+#include <stdint.h>
+
+#include "plant.h"
+
+#ifndef TOOLS_PLANT_SIMULATOR_SIM_HAL_H_
+#define TOOLS_PLANT_SIMULATOR_SIM_HAL_H_
+
+// Plant that firmware pumps, outlets and sensors are connected to
+extern struct plant *sim_plant;
+
+// Number of times each pump was turned on
+extern uint32_t sim_pump_starts[PLANT_NUM_PUMPS];
+
+// Number of rf messages sent to outlets
+extern uint32_t sim_rf_transmissions;
+
+#endif /* TOOLS_PLANT_SIMULATOR_SIM_HAL_H_ */
+
+// Copy noisy plant readings into firmware sensors
+void sim_read_sensors();
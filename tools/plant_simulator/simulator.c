@@ -0,0 +1,381 @@
+// Runs firmware control code against a simulated reservoir and prints performance metrics as JSON
+//
+// Usage: plant_simulator [--option=value ...], see --help for options
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "sim_port.h"
+#include "sim_hal.h"
+#include "plant.h"
+
+#include "rtc.h"
+#include "ports.h"
+#include "sensor.h"
+#include "ph_reading.h"
+#include "ec_reading.h"
+#include "water_temp_reading.h"
+#include "sync_sensors.h"
+#include "sensor_control.h"
+#include "control_channels.h"
+#include "ph_control.h"
+#include "ec_control.h"
+#include "water_temp_control.h"
+#include "reservoir_control.h"
+#include "pump_calibration.h"
+
+// Simulation starts on 2021-01-01 00:00:00 UTC and runs in steps of one second
+#define SIM_START_TIME 1609459200
+#define SIM_STEP 1
+
+struct sim_settings {
+	float hours;
+	float verbose;
+	float seed;
+	float flow_calibration_error;	// Relative error of calibrated flow rates
+
+	float ph_enabled;
+	float ph_target;
+	float ph_dose_time;
+	float ph_wait_time;
+	float ph_dose_volume;
+	float ph_dose_response;
+
+	float ec_enabled;
+	float ec_target;
+	float ec_dose_time;
+	float ec_wait_time;
+	float ec_dose_volume;
+	float ec_dose_response;
+	float ec_max_pumps;
+	float ec_proportions[EC_NUM_PUMPS];
+
+	float water_temp_enabled;
+	float water_temp_target;
+};
+
+struct sim_option {
+	const char *name;
+	float *value;
+	const char *description;
+};
+
+struct channel_metrics {
+	const char *name;
+	bool is_enabled;
+	float target;
+	float margin;
+	float initial;
+	float final;
+	float time_to_target;
+	float overshoot;
+	float seconds_in_band;
+	double squared_error;
+};
+
+static struct sim_settings settings;
+static struct plant_config config;
+static struct plant plant;
+
+static struct sim_option options[] = {
+	{"hours", &settings.hours, "Simulated hours"},
+	{"verbose", &settings.verbose, "Print firmware logs to stderr"},
+	{"seed", &settings.seed, "Random seed for sensor noise"},
+	{"volume", &config.volume, "Reservoir volume in litres"},
+	{"ph", &config.ph, "Initial pH"},
+	{"ec", &config.ec, "Initial EC"},
+	{"water_temp", &config.water_temp, "Initial water temperature"},
+	{"ph_up_response", &config.ph_up_response, "pH change per ml/L of pH up"},
+	{"ph_down_response", &config.ph_down_response, "pH change per ml/L of pH down"},
+	{"ec_response", &config.ec_response, "EC change per ml/L of nutrient"},
+	{"ph_drift", &config.ph_drift, "pH change per hour"},
+	{"ec_drift", &config.ec_drift, "EC change per hour"},
+	{"mixing_time", &config.mixing_time, "Mixing time constant in seconds"},
+	{"flow_rate", &config.flow_rates[0], "Flow rate of all pumps in ml/s"},
+	{"flow_calibration_error", &settings.flow_calibration_error, "Relative error of calibrated flow rates, negative disables calibration"},
+	{"heater_power", &config.heater_power, "Heater power in W"},
+	{"cooler_power", &config.cooler_power, "Cooler power in W"},
+	{"ambient_temp", &config.ambient_temp, "Ambient temperature"},
+	{"heat_loss", &config.heat_loss, "Heat exchange with surroundings in W/K"},
+	{"rf_delay", &config.rf_delay, "Outlet switching delay in seconds"},
+	{"ph_noise", &config.ph_noise, "pH sensor noise"},
+	{"ec_noise", &config.ec_noise, "EC sensor noise"},
+	{"water_temp_noise", &config.water_temp_noise, "Water temperature sensor noise"},
+	{"ph_control", &settings.ph_enabled, "Enable pH control"},
+	{"ph_target", &settings.ph_target, "pH target"},
+	{"ph_dose_time", &settings.ph_dose_time, "pH dose time in seconds"},
+	{"ph_wait_time", &settings.ph_wait_time, "pH wait time in seconds"},
+	{"ph_dose_volume", &settings.ph_dose_volume, "pH dose volume limit in ml"},
+	{"ph_dose_response", &settings.ph_dose_response, "pH dose response setting"},
+	{"ec_control", &settings.ec_enabled, "Enable EC control"},
+	{"ec_target", &settings.ec_target, "EC target"},
+	{"ec_dose_time", &settings.ec_dose_time, "EC dose time in seconds"},
+	{"ec_wait_time", &settings.ec_wait_time, "EC wait time in seconds"},
+	{"ec_dose_volume", &settings.ec_dose_volume, "EC dose volume limit in ml"},
+	{"ec_dose_response", &settings.ec_dose_response, "EC dose response setting"},
+	{"ec_max_pumps", &settings.ec_max_pumps, "Nutrient pumps running at once"},
+	{"ec_pump_1", &settings.ec_proportions[0], "Nutrient 1 proportion"},
+	{"ec_pump_2", &settings.ec_proportions[1], "Nutrient 2 proportion"},
+	{"ec_pump_3", &settings.ec_proportions[2], "Nutrient 3 proportion"},
+	{"ec_pump_4", &settings.ec_proportions[3], "Nutrient 4 proportion"},
+	{"ec_pump_5", &settings.ec_proportions[4], "Nutrient 5 proportion"},
+	{"water_temp_control", &settings.water_temp_enabled, "Enable water temperature control"},
+	{"water_temp_target", &settings.water_temp_target, "Water temperature target"},
+};
+
+#define NUM_OPTIONS (sizeof(options) / sizeof(options[0]))
+
+// --------------------------------------------------- Helper functions ----------------------------------------------
+
+static void default_settings() {
+	plant_default_config(&config);
+
+	settings.hours = 24;
+	settings.verbose = 0;
+	settings.seed = config.seed;
+	settings.flow_calibration_error = 0;
+
+	settings.ph_enabled = 1;
+	settings.ph_target = 6;
+	settings.ph_dose_time = 10;
+	settings.ph_wait_time = 600;
+
+	settings.ec_enabled = 1;
+	settings.ec_target = 1.5;
+	settings.ec_dose_time = 20;
+	settings.ec_wait_time = 600;
+	settings.ec_max_pumps = EC_DEFAULT_MAX_ACTIVE_PUMPS;
+	settings.ec_proportions[0] = 0.4;
+	settings.ec_proportions[1] = 0.4;
+	settings.ec_proportions[2] = 0.2;
+
+	settings.water_temp_enabled = 1;
+	settings.water_temp_target = 21;
+}
+
+static void print_usage(const char *program) {
+	printf("Usage: %s [--option=value ...]\n\n", program);
+	for(size_t i = 0; i < NUM_OPTIONS; ++i) printf("  --%-24s %s\n", options[i].name, options[i].description);
+}
+
+static bool parse_args(int argc, char **argv) {
+	for(int i = 1; i < argc; ++i) {
+		char *arg = argv[i];
+		char *value = strchr(arg, '=');
+		if(strncmp(arg, "--", 2) != 0 || value == NULL) {
+			if(strcmp(arg, "--help") != 0) fprintf(stderr, "Invalid argument: %s\n", arg);
+			return false;
+		}
+
+		size_t name_length = value - arg - 2;
+		bool found = false;
+		for(size_t j = 0; j < NUM_OPTIONS && !found; ++j) {
+			if(strlen(options[j].name) != name_length || strncmp(options[j].name, arg + 2, name_length) != 0) continue;
+
+			*options[j].value = strtof(value + 1, NULL);
+			found = true;
+		}
+
+		if(!found) {
+			fprintf(stderr, "Unknown option: %s\n", arg);
+			return false;
+		}
+	}
+
+	config.seed = settings.seed;
+
+	// Single flow rate option applies to all pumps
+	for(int pump = 1; pump < PLANT_NUM_PUMPS; ++pump) config.flow_rates[pump] = config.flow_rates[0];
+	return true;
+}
+
+static void init_doser(struct sensor_control *control, float target, float dose_time, float wait_time, float dose_volume, float dose_response) {
+	control->target_value = target;
+	control->dose_time = dose_time;
+	control->wait_time = wait_time;
+	control->dose_volume = dose_volume;
+	control->dose_response = dose_response;
+}
+
+// Same setup as init_control and init_rtc in firmware, returns false if calibrated flow rates don't survive NVS
+static bool init_firmware() {
+	ec_max_active_pumps[0] = settings.ec_max_pumps > 0 ? settings.ec_max_pumps : 1;
+	for(int pump = 0; pump < EC_NUM_PUMPS; ++pump) ec_nutrient_proportions[0][pump] = settings.ec_proportions[pump];
+
+	init_sensor(get_ph_sensor(0), "ph", true, false);
+	init_sensor(get_ec_sensor(0), "ec", true, false);
+	init_sensor(get_water_temp_sensor(), "water_temp", true, false);
+
+	for(uint8_t i = 0; i < NUM_CONTROL_CHANNELS; ++i) control_channel_init(get_control_channel(i), NULL);
+
+	init_doser(get_ph_control(0), settings.ph_target, settings.ph_dose_time, settings.ph_wait_time, settings.ph_dose_volume, settings.ph_dose_response);
+	get_ph_control(0)->is_up_control = true;
+	get_ph_control(0)->is_down_control = true;
+	settings.ph_enabled ? control_enable(get_ph_control(0)) : control_disable(get_ph_control(0));
+
+	init_doser(get_ec_control(0), settings.ec_target, settings.ec_dose_time, settings.ec_wait_time, settings.ec_dose_volume, settings.ec_dose_response);
+	get_ec_control(0)->is_up_control = true;
+	settings.ec_enabled ? control_enable(get_ec_control(0)) : control_disable(get_ec_control(0));
+
+	get_water_temp_control()->target_value = settings.water_temp_target;
+	get_water_temp_control()->is_up_control = true;
+	get_water_temp_control()->is_down_control = true;
+	settings.water_temp_enabled ? control_enable(get_water_temp_control()) : control_disable(get_water_temp_control());
+
+	reservoir_volume = config.volume;
+	for(int pump = 0; pump < NUM_DOSING_PUMPS; ++pump) {
+		pump_flow_rates[pump] = settings.flow_calibration_error >= 0 ? config.flow_rates[pump] * (1 + settings.flow_calibration_error) : 0;
+	}
+
+	// Rates are reloaded like after reboot, control runs on rates read back
+	float calibrated_rates[NUM_PUMPS];
+	memcpy(calibrated_rates, pump_flow_rates, sizeof(calibrated_rates));
+	pump_store_flow_rates();
+	pump_get_nvs_settings();
+	for(int pump = 0; pump < NUM_PUMPS; ++pump) {
+		if(pump_flow_rates[pump] == calibrated_rates[pump]) continue;
+		fprintf(stderr, "Flow rate of pump %d stored as %g ml/s, read back as %g ml/s\n", pump + 1, calibrated_rates[pump], pump_flow_rates[pump]);
+		return false;
+	}
+
+	for(uint8_t i = 0; i < NUM_CONTROL_CHANNELS; ++i) control_channel_init_timers(get_control_channel(i));
+	init_timer(get_pump_calibration_timer(), &pump_calibration_stop, false, true);
+
+	is_day = true;
+	return true;
+}
+
+static void check_timers() {
+	for(uint8_t i = 0; i < NUM_CONTROL_CHANNELS; ++i) control_channel_check_timers(get_control_channel(i), sim_unix_time);
+	check_timer(&dev, get_pump_calibration_timer(), sim_unix_time);
+}
+
+static void init_metrics(struct channel_metrics *metrics, const char *name, struct sensor_control *control, float initial) {
+	memset(metrics, 0, sizeof(*metrics));
+	metrics->name = name;
+	metrics->is_enabled = control_get_enabled(control);
+	metrics->target = control->target_value;
+	metrics->margin = control->margin_error;
+	metrics->initial = initial;
+	metrics->time_to_target = -1;
+}
+
+static void update_metrics(struct channel_metrics *metrics, float value, float time) {
+	float error = value - metrics->target;
+	bool in_band = fabsf(error) <= metrics->margin;
+
+	if(in_band && metrics->time_to_target < 0) metrics->time_to_target = time;
+	if(in_band) metrics->seconds_in_band += SIM_STEP;
+
+	// Overshoot is how far value went past target, in the direction it had to be moved
+	float direction = metrics->target >= metrics->initial ? 1 : -1;
+	if(direction * error > metrics->overshoot) metrics->overshoot = direction * error;
+
+	metrics->squared_error += (double)error * error * SIM_STEP;
+	metrics->final = value;
+}
+
+static void print_metrics(const struct channel_metrics *metrics, float seconds, const char *extra) {
+	printf("\t\t\"%s\": {\n", metrics->name);
+	printf("\t\t\t\"enabled\": %s,\n", metrics->is_enabled ? "true" : "false");
+	printf("\t\t\t\"target\": %.3f,\n", metrics->target);
+	printf("\t\t\t\"initial\": %.3f,\n", metrics->initial);
+	printf("\t\t\t\"final\": %.3f,\n", metrics->final);
+	printf("\t\t\t\"time_to_target\": %.0f,\n", metrics->time_to_target);
+	printf("\t\t\t\"overshoot\": %.3f,\n", metrics->overshoot);
+	printf("\t\t\t\"time_in_band\": %.4f,\n", metrics->seconds_in_band / seconds);
+	printf("\t\t\t\"rms_error\": %.4f,\n", sqrt(metrics->squared_error / seconds));
+	printf("%s", extra);
+	printf("\t\t}");
+}
+
+static float sum_volumes(uint8_t first_pump, uint8_t last_pump, uint32_t *starts) {
+	float volume = 0;
+	*starts = 0;
+	for(uint8_t pump = first_pump; pump <= last_pump; ++pump) {
+		volume += plant.dosed_volumes[pump];
+		*starts += sim_pump_starts[pump];
+	}
+	return volume;
+}
+
+// --------------------------------------------------------------------------------------------------------------------
+
+int main(int argc, char **argv) {
+	default_settings();
+	if(!parse_args(argc, argv)) {
+		print_usage(argv[0]);
+		return 1;
+	}
+	sim_verbose = settings.verbose != 0;
+
+	// RTC is read back with mktime, keep conversions in UTC
+	setenv("TZ", "UTC", 1);
+	tzset();
+	sim_unix_time = SIM_START_TIME;
+
+	init_plant(&plant, &config);
+	sim_plant = &plant;
+	if(!init_firmware()) return 1;
+
+	struct channel_metrics ph_metrics, ec_metrics, water_temp_metrics;
+	init_metrics(&ph_metrics, "ph", get_ph_control(0), plant.ph);
+	init_metrics(&ec_metrics, "ec", get_ec_control(0), plant.ec);
+	init_metrics(&water_temp_metrics, "water_temp", get_water_temp_control(), plant.water_temp);
+
+	uint32_t duration = settings.hours * 3600;
+	uint32_t measurement_period = SENSOR_MEASUREMENT_PERIOD / 1000;
+	float heater_seconds = 0, cooler_seconds = 0;
+	clock_t start = clock();
+
+	for(uint32_t time = 0; time < duration; time += SIM_STEP) {
+		// Sensor task measures and control task checks values every measurement period
+		if(time % measurement_period == 0) {
+			sim_read_sensors();
+			for(uint8_t i = 0; i < NUM_CONTROL_CHANNELS; ++i) {
+				struct control_channel *channel = get_control_channel(i);
+				channel->check(channel->reservoir);
+			}
+		}
+
+		plant_step(&plant, SIM_STEP);
+		sim_unix_time += SIM_STEP;
+		check_timers();
+
+		if(plant.is_heater_on) heater_seconds += SIM_STEP;
+		if(plant.is_cooler_on) cooler_seconds += SIM_STEP;
+
+		update_metrics(&ph_metrics, plant.ph, time + SIM_STEP);
+		update_metrics(&ec_metrics, plant.ec, time + SIM_STEP);
+		update_metrics(&water_temp_metrics, plant.water_temp, time + SIM_STEP);
+	}
+
+	double wall_seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+	char extra[256];
+	uint32_t starts;
+	float volume;
+
+	printf("{\n");
+	printf("\t\"simulated_seconds\": %u,\n", duration);
+	printf("\t\"speedup\": %.0f,\n", wall_seconds > 0 ? duration / wall_seconds : 0);
+	printf("\t\"channels\": {\n");
+
+	volume = sum_volumes(PLANT_PH_UP_PUMP, PLANT_PH_DOWN_PUMP, &starts);
+	snprintf(extra, sizeof(extra), "\t\t\t\"doses\": %u,\n\t\t\t\"dosed_ml\": %.1f\n", starts, volume);
+	print_metrics(&ph_metrics, duration, extra);
+	printf(",\n");
+
+	volume = sum_volumes(0, EC_NUM_PUMPS - 1, &starts);
+	snprintf(extra, sizeof(extra), "\t\t\t\"doses\": %u,\n\t\t\t\"dosed_ml\": %.1f\n", starts, volume);
+	print_metrics(&ec_metrics, duration, extra);
+	printf(",\n");
+
+	snprintf(extra, sizeof(extra), "\t\t\t\"rf_transmissions\": %u,\n\t\t\t\"heater_seconds\": %.0f,\n\t\t\t\"cooler_seconds\": %.0f\n", sim_rf_transmissions, heater_seconds, cooler_seconds);
+	print_metrics(&water_temp_metrics, duration, extra);
+	printf("\n\t}\n}\n");
+
+	return 0;
+}